@@ -0,0 +1,193 @@
+#ifndef ANALYTICS_HPP
+#define ANALYTICS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+// Space library
+#include "space.hpp"
+
+// Number of spaces aggregated per work unit
+#define ANALYTICS_CHUNK 1024
+
+namespace Analytics {
+    // Report granularity, in UTC days, weeks (from Monday) & months
+    enum Period { DAY, WEEK, MONTH };
+
+    // Booked & open hours and revenue over some time
+    struct Usage {
+        // .. Fractional with slots shorter than an hour
+        double bookedHours = 0;
+        // .. Hours a space could be booked (from its opening)
+        unsigned long long openHours = 0;
+        // .. At the current rates
+        double revenue = 0;
+
+        double GetOccupancy() const { return openHours == 0 ? 0 : (double)bookedHours / openHours; }
+        void Add(const Usage& p_usage) {
+            bookedHours += p_usage.bookedHours;
+            openHours += p_usage.openHours;
+            revenue += p_usage.revenue;
+        }
+    };
+    struct SpaceUsage {
+        unsigned int ID = 0;
+        // .. Pooled, valid for the whole run
+        std::string_view name;
+        Usage usage;
+    };
+
+    // Catalog-wide report over whole periods
+    struct Report {
+        Period period = MONTH;
+        // Start hour (since the epoch) & usage of each period
+        std::vector<long long> periodStarts;
+        std::vector<Usage> periods;
+        std::vector<SpaceUsage> spaces;
+        Usage total;
+    };
+
+    // Utility functions
+    // Period holding an hour since the epoch, and the first hour of a period
+    inline long long PeriodOf(Period p_period, long long p_hour) {
+        long long day = p_hour >= 0 ? p_hour / 24 : (p_hour - 23) / 24;
+        if (p_period == DAY) return day;
+        if (p_period == WEEK) return Space::WeekOfDay(day);
+        return Space::MonthOfDay(day);
+    }
+    inline long long PeriodStartHour(Period p_period, long long p_index) {
+        if (p_period == DAY) return p_index * 24;
+        if (p_period == WEEK) return Space::WeekStartHour(p_index);
+        return Space::MonthStartHour(p_index);
+    }
+    // Booked slots of a space in a period, from its rollups
+    inline unsigned int BookedInPeriod(const Space::Rollups& p_rollups, Period p_period, long long p_index) {
+        if (p_period == DAY) return p_rollups.GetDay(p_index);
+        if (p_period == WEEK) return p_rollups.GetWeek(p_index);
+        return p_rollups.GetMonth(p_index);
+    }
+
+    // Aggregate utilization & revenue of every space over the periods touching [p_startTime, p_endTime)
+    // .. Spaces are split over parallel threads reading a snapshot, booked hours come from the rollups
+    inline Report BuildReport(Space::SpaceManager& p_spaceManager, const time_t& p_startTime,
+        const time_t& p_endTime, Period p_period, unsigned int p_threads = 0) {
+        Report report;
+        report.period = p_period;
+        if (p_endTime <= p_startTime || !p_spaceManager.LoadAllShards())
+            return report;
+        long long firstPeriod = PeriodOf(p_period, (long long)std::floor(p_startTime / 3600.0));
+        long long lastPeriod = PeriodOf(p_period, (long long)std::ceil(p_endTime / 3600.0) - 1);
+        for (long long index = firstPeriod; index <= lastPeriod + 1; index++)
+            report.periodStarts.push_back(PeriodStartHour(p_period, index));
+        unsigned int periodCount = lastPeriod - firstPeriod + 1;
+
+        const Space::SpaceManager::Snapshot snapshot = p_spaceManager.GetSnapshot();
+        unsigned int spaceCount = snapshot.GetSize();
+        unsigned int chunkCount = (spaceCount + ANALYTICS_CHUNK - 1) / ANALYTICS_CHUNK;
+        std::vector<SpaceUsage> spaces(spaceCount);
+        std::vector<char> isUsed(spaceCount, false);
+        std::vector<std::vector<Usage>> chunkPeriods(chunkCount, std::vector<Usage>(periodCount));
+        std::atomic<unsigned int> nextChunk{0};
+        auto worker = [&]() {
+            unsigned int chunk;
+            while ((chunk = nextChunk++) < chunkCount) {
+                Trace::Span span("AggregateChunk", "bulk", chunk);
+                unsigned int last = std::min<unsigned int>((chunk + 1) * ANALYTICS_CHUNK, spaceCount);
+                for (unsigned int ID = chunk * ANALYTICS_CHUNK; ID < last; ID++) {
+                    const Space::Space* space_ptr = snapshot.Get(ID);
+                    if (space_ptr == nullptr) continue;
+                    const Space::Time& timer = space_ptr->timer;
+                    const Space::Rollups& rollups = timer.GetRollups();
+                    long long originHour = (long long)std::floor(timer.GetOriginTime() / 3600.0);
+                    SpaceUsage& row = spaces[ID];
+                    row.ID = ID;
+                    row.name = space_ptr->GetName();
+                    for (unsigned int i = 0; i < periodCount; i++) {
+                        long long startHour = report.periodStarts[i], endHour = report.periodStarts[i + 1];
+                        Usage usage;
+                        usage.openHours = std::max(0LL, endHour - std::max(startHour, originHour));
+                        usage.bookedHours = (double)BookedInPeriod(rollups, p_period, firstPeriod + i) / Space::Time::SLOTS_PER_HOUR;
+                        if (usage.bookedHours != 0)
+                            usage.revenue = timer.GetRevenue(startHour * 3600, endHour * 3600);
+                        row.usage.Add(usage);
+                        chunkPeriods[chunk][i].Add(usage);
+                    }
+                    isUsed[ID] = true;
+                }
+            }
+        };
+        unsigned int threadCount = p_threads;
+        if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::max(1u, std::min(threadCount, chunkCount));
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++)
+            threads.emplace_back([&]() {
+                Trace::SetThreadName("analytics");
+                worker();
+            });
+        worker();
+        for (auto& thread: threads) thread.join();
+
+        // Merge in chunk order so that sums do not depend on the number of threads
+        report.periods.assign(periodCount, Usage());
+        for (const auto& periods: chunkPeriods)
+            for (unsigned int i = 0; i < periodCount; i++)
+                report.periods[i].Add(periods[i]);
+        for (const Usage& usage: report.periods)
+            report.total.Add(usage);
+        for (unsigned int ID = 0; ID < spaceCount; ID++)
+            if (isUsed[ID]) report.spaces.push_back(spaces[ID]);
+        report.periodStarts.pop_back();
+        return report;
+    }
+
+    // Print some details to cmd line
+    // .. Periods, then the p_topSpaces most occupied spaces
+    inline void PrintReport(const Report& p_report, unsigned int p_topSpaces = 10) {
+        if (p_report.periods.empty()) {
+            std::cout << "Nothing to report!\n";
+            return;
+        }
+        auto PrintUsage = [](const Usage& p_usage) {
+            std::cout << std::fixed << std::setprecision(Space::Time::SLOTS_PER_HOUR == 1 ? 0 : 2)
+                      << std::setw(12) << p_usage.bookedHours << std::setw(12) << p_usage.openHours
+                      << std::setw(11) << std::setprecision(1) << p_usage.GetOccupancy() * 100 << "%"
+                      << std::setw(16) << std::setprecision(2) << p_usage.revenue << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            std::cout << std::setprecision(6);
+        };
+        std::cout << std::left << std::setw(20) << "Period" << std::right << std::setw(12) << "Booked (h)"
+                  << std::setw(12) << "Open (h)" << std::setw(12) << "Occupancy" << std::setw(16) << "Revenue (Dhs)\n";
+        for (unsigned int i = 0; i < p_report.periods.size(); i++) {
+            time_t tmp_time = p_report.periodStarts[i] * 3600;
+            tm tmp_tm;
+            gmtime_r(&tmp_time, &tmp_tm);
+            char date[16];
+            strftime(date, sizeof(date), p_report.period == MONTH ? "%Y-%m" : "%Y-%m-%d", &tmp_tm);
+            std::cout << std::left << std::setw(20) << date << std::right;
+            PrintUsage(p_report.periods[i]);
+        }
+        std::cout << std::left << std::setw(20) << "Total" << std::right;
+        PrintUsage(p_report.total);
+
+        std::vector<SpaceUsage> spaces = p_report.spaces;
+        unsigned int count = std::min<unsigned int>(p_topSpaces, spaces.size());
+        std::partial_sort(spaces.begin(), spaces.begin() + count, spaces.end(),
+            [](const SpaceUsage& a, const SpaceUsage& b) { return a.usage.GetOccupancy() > b.usage.GetOccupancy(); });
+        if (count != 0) std::cout << "\nMost occupied spaces:\n";
+        for (unsigned int i = 0; i < count; i++) {
+            std::cout << std::left << std::setw(20) << ("#" + std::to_string(spaces[i].ID) + " " + std::string(spaces[i].name)).substr(0, 19)
+                      << std::right;
+            PrintUsage(spaces[i].usage);
+        }
+    }
+}
+
+#endif
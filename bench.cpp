@@ -0,0 +1,466 @@
+// Microbenchmarks for the core data paths
+// .. Built on Google Benchmark: https://github.com/google/benchmark
+// .. Machine-readable results with --benchmark_format=json or --benchmark_out=<file>
+#include <map>
+#include <memory>
+#include <future>
+#include <cstdlib>
+#include <streambuf>
+#include <filesystem>
+#include <benchmark/benchmark.h>
+
+#include "space.hpp"
+#include "user.hpp"
+#include "generator.hpp"
+#include "analytics.hpp"
+
+namespace {
+    // Fixed origin so that timetables line up between runs
+    const time_t ORIGIN = Generator::Config().originTime;
+    // Non-overlapping reservations made before a timer is reset
+    const unsigned int SLOTS = 1024;
+
+    // Output sink for printing benchmarks
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) { return c; }
+    };
+
+    // Scratch directory for data files, removed on exit
+    std::string scratchDir = "";
+    const std::string& ScratchDir() {
+        if (scratchDir == "") {
+            char tmp_dir[] = "/tmp/evies_bench_XXXXXX";
+            scratchDir = mkdtemp(tmp_dir);
+        }
+        return scratchDir;
+    }
+
+    // Synthetic catalog of n spaces, without users
+    // .. Only the last requested size is kept to bound memory
+    Space::SpaceManager& Catalog(unsigned int n) {
+        static unsigned int size = 0;
+        static std::unique_ptr<Space::SpaceManager> spaceManager;
+        if (spaceManager == nullptr || size != n) {
+            spaceManager.reset();
+            spaceManager.reset(new Space::SpaceManager());
+            User::UserManager userManager(spaceManager.get());
+            Generator::Config config;
+            config.spaces = n;
+            config.eventUsers = 0;
+            config.spaceUsers = 0;
+            config.horizonDays = 30;
+            Generator::Generate(config, *spaceManager, userManager);
+            size = n;
+        }
+        return *spaceManager;
+    }
+
+    // Timer with room for SLOTS reservations of p_span hours
+    Space::Time FreshTimer(unsigned int p_span) {
+        Space::Time timer(100, ORIGIN);
+        timer.SetBulkTimes(std::vector<unsigned long long>(SLOTS * p_span * Space::Time::SLOTS_PER_HOUR / 32 + 1, 0));
+        return timer;
+    }
+}
+
+// Time::AddReservation over spans of range(0) hours
+static void BM_TimeAddReservation(benchmark::State& state) {
+    unsigned int span = state.range(0);
+    Space::Time timer = FreshTimer(span);
+    unsigned int slot = 0;
+    double price;
+    for (auto _ : state) {
+        if (slot == SLOTS) {
+            state.PauseTiming();
+            timer = FreshTimer(span);
+            slot = 0;
+            state.ResumeTiming();
+        }
+        time_t startTime = ORIGIN + (time_t)slot * span * 3600;
+        benchmark::DoNotOptimize(timer.AddReservation(startTime, startTime + span * 3600 - Space::Time::SLOT_SECONDS, price));
+        slot++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimeAddReservation)->Arg(1)->Arg(8)->Arg(32)->Arg(168)->Arg(720);
+
+// Time::RemoveReservation over spans of range(0) hours
+static void BM_TimeRemoveReservation(benchmark::State& state) {
+    unsigned int span = state.range(0);
+    Space::Time booked = FreshTimer(span);
+    double price;
+    for (unsigned int slot = 0; slot < SLOTS; slot++) {
+        time_t startTime = ORIGIN + (time_t)slot * span * 3600;
+        booked.AddReservation(startTime, startTime + span * 3600 - Space::Time::SLOT_SECONDS, price);
+    }
+    Space::Time timer = booked;
+    unsigned int slot = 0;
+    for (auto _ : state) {
+        if (slot == SLOTS) {
+            state.PauseTiming();
+            timer = booked;
+            slot = 0;
+            state.ResumeTiming();
+        }
+        time_t startTime = ORIGIN + (time_t)slot * span * 3600;
+        benchmark::DoNotOptimize(timer.RemoveReservation(startTime, startTime + span * 3600 - Space::Time::SLOT_SECONDS));
+        slot++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimeRemoveReservation)->Arg(1)->Arg(8)->Arg(32)->Arg(168)->Arg(720);
+
+// Time::Quote over spans of range(0) hours, with peak, weekend & seasonal rates
+static void BM_TimeQuote(benchmark::State& state) {
+    unsigned int span = state.range(0);
+    Space::Tariff tariff;
+    tariff.SetPeak(18, 23, 1.5);
+    tariff.SetWeekendRate(1.25);
+    tariff.SetSeasonRate(12, 2);
+    Space::Time timer(100, ORIGIN);
+    timer.SetTariff(tariff);
+    std::mt19937 engine(42);
+    double price;
+    for (auto _ : state) {
+        time_t startTime = ORIGIN + (time_t)(engine() % (24 * 365)) * 3600;
+        benchmark::DoNotOptimize(timer.Quote(startTime, startTime + span * 3600 - Space::Time::SLOT_SECONDS, price));
+        benchmark::DoNotOptimize(price);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimeQuote)->Arg(1)->Arg(168)->Arg(720);
+
+// Weekly 3 hour reservation for range(0) weeks on a free timer
+// .. One recurring rule against range(0) single reservations
+static void BM_TimeAddRecurring(benchmark::State& state) {
+    Space::Recurrence rule(ORIGIN + 18 * 3600, 3 * 3600, 7 * 24 * 3600, state.range(0));
+    double price;
+    for (auto _ : state) {
+        Space::Time timer(100, ORIGIN);
+        benchmark::DoNotOptimize(timer.AddRecurring(rule, price));
+    }
+    state.SetItemsProcessed(state.iterations() * rule.count);
+}
+BENCHMARK(BM_TimeAddRecurring)->Arg(4)->Arg(52)->Arg(520);
+
+static void BM_TimeAddWeekly(benchmark::State& state) {
+    Space::Recurrence rule(ORIGIN + 18 * 3600, 3 * 3600, 7 * 24 * 3600, state.range(0));
+    double price;
+    for (auto _ : state) {
+        Space::Time timer(100, ORIGIN);
+        for (unsigned int i = 0; i < rule.count; i++)
+            benchmark::DoNotOptimize(timer.AddReservation(rule.GetStartTime(i), rule.GetStartTime(i) + rule.duration - Space::Time::SLOT_SECONDS, price));
+    }
+    state.SetItemsProcessed(state.iterations() * rule.count);
+}
+BENCHMARK(BM_TimeAddWeekly)->Arg(4)->Arg(52)->Arg(520);
+
+// SpaceManager::QuoteSpaces of one range on every space of a 1k catalog
+static void BM_QuoteSpaces(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(1000);
+    std::vector<unsigned int> IDs(1000);
+    for (unsigned int i = 0; i < IDs.size(); i++) IDs[i] = i;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(spaceManager.QuoteSpaces(IDs, ORIGIN + 18 * 3600, ORIGIN + 21 * 3600));
+    state.SetItemsProcessed(state.iterations() * IDs.size());
+}
+BENCHMARK(BM_QuoteSpaces);
+
+// SpaceManager::FindFreeSpaces for range(0) hours over the 30 day horizon of 100k spaces
+// .. Uncached: every call scans
+static void BM_FindFreeSpaces(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(100000);
+    spaceManager.SetCacheBudget(0);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(spaceManager.FindFreeSpaces(ORIGIN, ORIGIN + 30 * 86400, state.range(0)));
+    state.SetItemsProcessed(state.iterations() * 100000);
+}
+BENCHMARK(BM_FindFreeSpaces)->Arg(4)->Arg(24)->Arg(72)->Unit(benchmark::kMillisecond);
+
+// SpaceManager::FindFreeSpaces for the first 20 matches of 50 recurring queries on 100k spaces,
+// .. with a booking of a random space every range(0) queries
+// .. Skewed towards the first queries, like the date pickers of busy days
+static void BM_FindFreeSpacesCached(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(100000);
+    spaceManager.SetCacheBudget(CACHE_BUDGET);
+    std::mt19937 engine(42);
+    std::geometric_distribution<unsigned int> pick(0.1);
+    Cache::Stats before = spaceManager.GetCacheStats();
+    unsigned long long i = 0;
+    for (auto _ : state) {
+        unsigned int query = pick(engine) % 50;
+        time_t fromTime = ORIGIN + (query % 10) * 86400;
+        benchmark::DoNotOptimize(spaceManager.FindFreeSpaces(fromTime, fromTime + 86400, 2 + query / 10, 20));
+        if (++i % state.range(0) == 0) {
+            time_t startTime = ORIGIN + (engine() % (30 * 24)) * 3600;
+            double price;
+            spaceManager.GetSpace(engine() % 100000)->timer.AddReservation(startTime, startTime + 3600, price);
+        }
+    }
+    Cache::Stats after = spaceManager.GetCacheStats();
+    state.counters["hit_rate"] = (double)(after.hits - before.hits)
+        / std::max(1ULL, after.hits + after.misses - before.hits - before.misses);
+    spaceManager.SetCacheBudget(0);
+}
+BENCHMARK(BM_FindFreeSpacesCached)->Arg(10)->Arg(100)->Unit(benchmark::kMicrosecond);
+
+// SpaceManager::DeleteSpace + AddSpace churn on a catalog of range(0) spaces
+static void BM_SpaceManagerChurn(benchmark::State& state) {
+    unsigned int n = state.range(0);
+    Space::SpaceManager spaceManager;
+    spaceManager.SetRandomSeed(42);
+    spaceManager.GetRandomizedSpaces(n);
+    Space::Space prototype(*spaceManager.GetSpace(0));
+    std::mt19937 engine(42);
+    for (auto _ : state) {
+        spaceManager.DeleteSpace(engine() % n);
+        benchmark::DoNotOptimize(spaceManager.AddSpace(prototype));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpaceManagerChurn)->Arg(1000)->Arg(100000);
+
+// Insertion of 100k spaces into an empty SpaceManager
+// .. range(0) = 0: copied one by one through AddSpace, 1: moved in bulk through AddSpaces
+static void BM_AddSpaces(benchmark::State& state) {
+    const unsigned int n = 100000;
+    Space::SpaceManager source;
+    source.SetRandomSeed(42);
+    source.GetRandomizedSpaces(1000);
+    std::vector<Space::Space> prototypes;
+    for (unsigned int i = 0; i < n; i++)
+        prototypes.push_back(*source.GetSpace(i % 1000));
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<Space::Space> spaces = prototypes;
+        auto spaceManager = std::make_unique<Space::SpaceManager>();
+        state.ResumeTiming();
+        if (state.range(0) == 1) benchmark::DoNotOptimize(spaceManager->AddSpaces(spaces));
+        else for (const Space::Space& space: spaces)
+            benchmark::DoNotOptimize(spaceManager->AddSpace(space));
+        state.PauseTiming();
+        spaceManager.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_AddSpaces)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Space::Serialize of a generated space with bookings & reviews
+static void BM_SpaceSerialize(benchmark::State& state) {
+    Space::Space* space_ptr = Catalog(1000).GetSpace(0);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(space_ptr->Serialize());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpaceSerialize);
+
+// Space::Deserialize of the same space
+static void BM_SpaceDeserialize(benchmark::State& state) {
+    nljs::json jspace = Catalog(1000).GetSpace(0)->Serialize();
+    Space::Space space;
+    for (auto _ : state) {
+        space.Deserialize(jspace);
+        benchmark::DoNotOptimize(space);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpaceDeserialize);
+
+// SpaceManager::StoreData of range(0) spaces
+static void BM_StoreData(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(state.range(0));
+    std::string fileName = ScratchDir() + "/store.file";
+    for (auto _ : state)
+        if (!spaceManager.StoreData(fileName))
+            state.SkipWithError("StoreData failed");
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StoreData)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// Reservations on a catalog of 100k spaces
+// .. range(0) = 0: alone, 1: while ExportData stores a snapshot in the background
+// .. The first change to each space after the snapshot copies it
+static void BM_BookDuringExport(benchmark::State& state) {
+    const unsigned int bookings = 10000;
+    Space::SpaceManager& spaceManager = Catalog(100000);
+    std::string fileName = ScratchDir() + "/export.file";
+    std::mt19937 engine(42);
+    for (auto _ : state) {
+        std::future<bool> exportTask;
+        if (state.range(0) == 1) exportTask = spaceManager.ExportData(fileName);
+        for (unsigned int i = 0; i < bookings; i++) {
+            Space::Space* space_ptr = spaceManager.GetSpace(engine() % 100000);
+            if (space_ptr == nullptr) continue;
+            time_t startTime = ORIGIN + (engine() % (30 * 24)) * 3600;
+            double price;
+            if (space_ptr->timer.AddReservation(startTime, startTime, price))
+                space_ptr->timer.RemoveReservation(startTime, startTime);
+        }
+        state.PauseTiming();
+        if (exportTask.valid() && !exportTask.get())
+            state.SkipWithError("ExportData failed");
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * bookings);
+}
+BENCHMARK(BM_BookDuringExport)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Bookings on 100k spaces while changes are published every 10 bookings,
+// .. with no follower (0) or one follower applying them between iterations (1)
+static void BM_BookWhilePublishing(benchmark::State& state) {
+    const unsigned int bookings = 10000;
+    Space::SpaceManager& spaceManager = Catalog(100000);
+    User::UserManager userManager(&spaceManager);
+    std::string socketName = ScratchDir() + "/replica.sock";
+    if (!userManager.StartPublisher(socketName)) {
+        state.SkipWithError("StartPublisher failed");
+        return;
+    }
+    Space::SpaceManager replicaSpaces;
+    User::UserManager replica(&replicaSpaces);
+    if (state.range(0) == 1) {
+        replica.GetFollower().Start(socketName);
+        // .. Wait for the image of the catalog
+        while (replica.GetFollower().GetSequence() == 0) {
+            userManager.TickPublisher();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            replica.ApplyReplica();
+        }
+    }
+    std::mt19937 engine(42);
+    for (auto _ : state) {
+        for (unsigned int i = 0; i < bookings; i++) {
+            Space::Space* space_ptr = spaceManager.GetSpace(engine() % 100000);
+            if (space_ptr != nullptr) {
+                time_t startTime = ORIGIN + (engine() % (30 * 24)) * 3600;
+                double price;
+                if (space_ptr->timer.AddReservation(startTime, startTime, price))
+                    space_ptr->timer.RemoveReservation(startTime, startTime);
+            }
+            if (i % 10 == 9) userManager.TickPublisher();
+        }
+        state.PauseTiming();
+        replica.ApplyReplica();
+        state.ResumeTiming();
+    }
+    userManager.StopPublisher();
+    replica.GetFollower().Stop();
+    state.SetItemsProcessed(state.iterations() * bookings);
+}
+BENCHMARK(BM_BookWhilePublishing)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// SpaceManager::LoadData of range(0) spaces
+static void BM_LoadData(benchmark::State& state) {
+    std::string fileName = ScratchDir() + "/load.file";
+    if (!Catalog(state.range(0)).StoreData(fileName)) {
+        state.SkipWithError("StoreData failed");
+        return;
+    }
+    Space::SpaceManager spaceManager;
+    for (auto _ : state)
+        if (!spaceManager.LoadData(fileName))
+            state.SkipWithError("LoadData failed");
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LoadData)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// SpaceManager::StoreShards after one booking, on range(0) spaces
+// .. Only the shard holding the changed space is rewritten
+static void BM_StoreShardsIncremental(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(state.range(0));
+    std::string baseName = ScratchDir() + "/shards.file";
+    if (!spaceManager.StoreShards(baseName)) {
+        state.SkipWithError("StoreShards failed");
+        return;
+    }
+    std::mt19937 engine(42);
+    double price;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Space::Space* space_ptr = spaceManager.GetSpace(engine() % state.range(0));
+        time_t startTime = ORIGIN + (time_t)(engine() % (24 * 365)) * 3600;
+        space_ptr->timer.AddReservation(startTime, startTime, price);
+        state.ResumeTiming();
+        if (!spaceManager.StoreShards(baseName))
+            state.SkipWithError("StoreShards failed");
+    }
+}
+BENCHMARK(BM_StoreShardsIncremental)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// SpaceManager::CaptureShards after one booking, on range(0) spaces
+// .. The session thread's part of a background store, the writes & commit are not timed
+static void BM_CaptureShards(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(state.range(0));
+    std::string baseName = ScratchDir() + "/shards.file";
+    if (!spaceManager.StoreShards(baseName)) {
+        state.SkipWithError("StoreShards failed");
+        return;
+    }
+    std::mt19937 engine(42);
+    double price;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Space::Space* space_ptr = spaceManager.GetSpace(engine() % state.range(0));
+        time_t startTime = ORIGIN + (time_t)(engine() % (24 * 365)) * 3600;
+        space_ptr->timer.AddReservation(startTime, startTime, price);
+        state.ResumeTiming();
+        Storage::Manifest manifest;
+        Storage::ShardWrites writes;
+        if (!spaceManager.CaptureShards(baseName, manifest, writes))
+            state.SkipWithError("CaptureShards failed");
+        state.PauseTiming();
+        if (!writes.Run() || !manifest.Store(baseName))
+            state.SkipWithError("Writing shards failed");
+        spaceManager.FinishShards(baseName, manifest);
+        state.ResumeTiming();
+    }
+}
+// .. Fixed iterations: each one also writes a shard untimed
+BENCHMARK(BM_CaptureShards)->Arg(1000)->Arg(100000)->Arg(1000000)->Iterations(100)->Unit(benchmark::kMillisecond);
+
+// Analytics::BuildReport per week over the generated horizon of range(0) spaces
+static void BM_BuildReport(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Analytics::BuildReport(spaceManager, ORIGIN, ORIGIN + 30 * 86400, Analytics::WEEK));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BuildReport)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// SpaceManager::SearchSpaces for the 10 best matches among 100k spaces
+// .. The index is built before timing
+static void BM_SearchSpaces(benchmark::State& state) {
+    const char* queries[] = {"wedding", "cozy cafe", "Hall with good sound system"};
+    Space::SpaceManager& spaceManager = Catalog(100000);
+    spaceManager.SetCacheBudget(0);
+    spaceManager.SearchSpaces("");
+    for (auto _ : state)
+        benchmark::DoNotOptimize(spaceManager.SearchSpaces(queries[state.range(0)], 10));
+    state.SetLabel(queries[state.range(0)]);
+}
+BENCHMARK(BM_SearchSpaces)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+// SpaceManager::PrintSpaces of range(0) spaces, to a null stream
+static void BM_PrintSpaces(benchmark::State& state) {
+    Space::SpaceManager& spaceManager = Catalog(state.range(0));
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+    for (auto _ : state)
+        spaceManager.PrintSpaces();
+    std::cout.rdbuf(coutBuffer);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PrintSpaces)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    if (scratchDir != "")
+        std::filesystem::remove_all(scratchDir);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+
+// Default memory budget of each query cache in bytes
+#define CACHE_BUDGET (4 << 20)
+// Bookkeeping bytes counted per entry on top of its key & value (list node, lookup entry)
+#define CACHE_ENTRY_OVERHEAD 96
+
+// Query result caches
+// .. Results are kept by normalized query, least recently used first out once over budget
+namespace Cache {
+    // Usage counters of a cache
+    struct Stats {
+        unsigned long long hits = 0, misses = 0, invalidations = 0, evictions = 0;
+        unsigned long long entries = 0, bytes = 0;
+
+        Stats& operator+=(const Stats& p_stats) {
+            hits += p_stats.hits;
+            misses += p_stats.misses;
+            invalidations += p_stats.invalidations;
+            evictions += p_stats.evictions;
+            entries += p_stats.entries;
+            bytes += p_stats.bytes;
+            return *this;
+        }
+        double GetHitRate() const { return hits + misses == 0 ? 0 : (double)hits / (hits + misses); }
+    };
+
+    // Class for an LRU cache of query results over a range of object IDs
+    // .. Each result remembers the IDs [firstID, lastID) it read, so that changed objects
+    // .. only drop the results that could see them
+    // .. T is a vector of results
+    template <typename T>
+    class Lru {
+    private:
+        struct Entry {
+            std::string key;
+            T value;
+            unsigned int firstID, lastID;
+            unsigned long long bytes;
+        };
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, typename std::list<Entry>::iterator> lookup;
+        unsigned long long budget = CACHE_BUDGET;
+        Stats stats;
+
+        void Erase(typename std::list<Entry>::iterator p_entry) {
+            stats.bytes -= p_entry->bytes;
+            lookup.erase(p_entry->key);
+            entries.erase(p_entry);
+        }
+        void Shrink() {
+            while (stats.bytes > budget && !entries.empty()) {
+                Erase(std::prev(entries.end()));
+                stats.evictions++;
+            }
+        }
+    public:
+        // Constructors & destructors
+        Lru(unsigned long long p_budget = CACHE_BUDGET) : budget(p_budget) {}
+        Lru(const Lru&) = delete;
+        Lru& operator=(const Lru&) = delete;
+
+        // Setters
+        // Bytes kept at most, 0 to cache nothing
+        void SetBudget(unsigned long long p_budget) {
+            budget = p_budget;
+            Shrink();
+        }
+        void Clear() {
+            lookup.clear();
+            entries.clear();
+            stats.bytes = 0;
+        }
+
+        // Getters
+        bool IsEmpty() const { return entries.empty(); }
+        unsigned long long GetBudget() const { return budget; }
+        Stats GetStats() const {
+            Stats tmp_stats = stats;
+            tmp_stats.entries = entries.size();
+            return tmp_stats;
+        }
+
+        // Interface
+        // Cached result of p_key, or nullptr (counted as a hit or a miss)
+        // .. Valid until the cache is changed
+        const T* Get(const std::string& p_key) {
+            auto it = lookup.find(p_key);
+            if (it == lookup.end()) {
+                stats.misses++;
+                return nullptr;
+            }
+            stats.hits++;
+            entries.splice(entries.begin(), entries, it->second);
+            return &it->second->value;
+        }
+        // Keep the result of p_key, which read the IDs [p_firstID, p_lastID)
+        void Put(const std::string& p_key, T p_value, unsigned int p_firstID, unsigned int p_lastID) {
+            auto it = lookup.find(p_key);
+            if (it != lookup.end()) Erase(it->second);
+            unsigned long long bytes = p_key.size() + p_value.size() * sizeof(typename T::value_type)
+                + sizeof(Entry) + CACHE_ENTRY_OVERHEAD;
+            if (bytes > budget) return;
+            entries.push_front(Entry{p_key, std::move(p_value), p_firstID, p_lastID, bytes});
+            lookup.emplace(entries.front().key, entries.begin());
+            stats.bytes += bytes;
+            Shrink();
+        }
+        // Drop the results that read any of p_IDs (sorted)
+        void Invalidate(const std::vector<unsigned int>& p_IDs) {
+            if (p_IDs.empty()) return;
+            for (auto it = entries.begin(); it != entries.end(); ) {
+                auto changed = std::lower_bound(p_IDs.begin(), p_IDs.end(), it->firstID);
+                if (changed == p_IDs.end() || *changed >= it->lastID) {
+                    it++;
+                    continue;
+                }
+                auto next = std::next(it);
+                Erase(it);
+                stats.invalidations++;
+                it = next;
+            }
+        }
+        // Drop every result, counted as invalidated
+        void InvalidateAll() {
+            stats.invalidations += entries.size();
+            Clear();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,486 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <charconv>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+// JSON library courtesy of:
+// https://github.com/nlohmann/json
+#include "json.hpp"
+namespace nljs = nlohmann;
+
+// Field descriptors driving the serializers
+// .. Each serializable class lists its fields once, in a constexpr table returned by its static Fields():
+// .. every codec walks the same table, so the names, order & presence rules of a format cannot drift
+// .. Nested classes with their own table (and vectors of them) are handled recursively
+// .. After every field is read, OnDecoded() is called if the class has one, to rebuild derived state
+namespace Codec {
+    // Whether a field may be missing from the input
+    // .. Missing fields keep their value, so decode into freshly constructed objects
+    enum Presence { REQUIRED, OPTIONAL };
+
+    // FNV-1a hash of a key, computed at compile time for the tables
+    constexpr unsigned long long Hash(std::string_view p_key) {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (char c: p_key) hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+        return hash;
+    }
+
+    // Fields written unconditionally
+    struct Always {
+        template <typename C>
+        constexpr bool operator()(const C&) const { return true; }
+    };
+
+    // Descriptor of one field of type T
+    // .. get(object) returns the value to write, set(object, T&&) stores a value read,
+    // .. has(object) tells whether the field is written at all
+    template <typename T, typename Get, typename Set, typename Has>
+    struct Field {
+        using Type = T;
+        const char* key;
+        unsigned long long hash;
+        Get get;
+        Set set;
+        Has has;
+        bool isOptional;
+    };
+    template <typename T, typename Get, typename Set, typename Has>
+    constexpr Field<T, Get, Set, Has> MakeField(const char* p_key, Get p_get, Set p_set, Has p_has, bool p_isOptional) {
+        return Field<T, Get, Set, Has>{p_key, Hash(p_key), p_get, p_set, p_has, p_isOptional};
+    }
+
+    // Field stored as is in a data member
+    template <typename C, typename T>
+    constexpr auto Member(const char* p_key, T C::* p_member, Presence p_presence = REQUIRED) {
+        return MakeField<T>(p_key,
+            [p_member](const C& p_object) -> const T& { return p_object.*p_member; },
+            [p_member](C& p_object, T&& p_value) { p_object.*p_member = std::move(p_value); },
+            Always{}, p_presence == OPTIONAL);
+    }
+    // Field read & written through functions, for values derived from the data members
+    template <typename T, typename Get, typename Set>
+    constexpr auto Property(const char* p_key, Get p_get, Set p_set, Presence p_presence = REQUIRED) {
+        return MakeField<T>(p_key, p_get, p_set, Always{}, p_presence == OPTIONAL);
+    }
+    // Property written only when p_has(object), & optional on load
+    template <typename T, typename Get, typename Set, typename Has>
+    constexpr auto Optional(const char* p_key, Get p_get, Set p_set, Has p_has) {
+        return MakeField<T>(p_key, p_get, p_set, p_has, true);
+    }
+
+    // Type traits
+    template <typename T, typename = void>
+    struct HasFields : std::false_type {};
+    template <typename T>
+    struct HasFields<T, std::void_t<decltype(T::Fields())>> : std::true_type {};
+    template <typename T, typename = void>
+    struct HasOnDecoded : std::false_type {};
+    template <typename T>
+    struct HasOnDecoded<T, std::void_t<decltype(std::declval<T&>().OnDecoded())>> : std::true_type {};
+    // .. Vectors of classes with a table
+    template <typename T>
+    struct IsTableVector : std::false_type {};
+    template <typename T, typename A>
+    struct IsTableVector<std::vector<T, A>> : HasFields<T> {};
+
+    // Table of a class, evaluated once at compile time
+    template <typename C>
+    inline constexpr auto descriptors = C::Fields();
+    // Mask of the required fields of a table
+    template <typename... F>
+    constexpr unsigned long long RequiredMask(const std::tuple<F...>& p_fields) {
+        unsigned long long mask = 0;
+        std::apply([&mask](const auto&... p_field) {
+            unsigned int index = 0;
+            ((mask |= p_field.isOptional ? 0 : 1ULL << index, index++), ...);
+        }, p_fields);
+        return mask;
+    }
+
+    // JSON codec
+    template <typename C>
+    nljs::json ToJson(const C& p_object);
+    template <typename C>
+    void FromJson(const nljs::json& p_jobject, C& p_object);
+
+    template <typename T>
+    nljs::json EncodeValue(const T& p_value) {
+        if constexpr (HasFields<T>::value) return ToJson(p_value);
+        else if constexpr (IsTableVector<T>::value) {
+            nljs::json jarray = nljs::json::array();
+            for (const auto& item: p_value) jarray.push_back(ToJson(item));
+            return jarray;
+        } else return nljs::json(p_value);
+    }
+    template <typename T>
+    void DecodeValue(const nljs::json& p_jvalue, T& p_value) {
+        if constexpr (HasFields<T>::value) FromJson(p_jvalue, p_value);
+        else if constexpr (IsTableVector<T>::value) {
+            p_value.clear();
+            p_value.reserve(p_jvalue.size());
+            for (const auto& jitem: p_jvalue) {
+                typename T::value_type item{};
+                FromJson(jitem, item);
+                p_value.push_back(std::move(item));
+            }
+        } else p_jvalue.get_to(p_value);
+    }
+
+    template <typename F, typename C>
+    void DecodeField(const F& p_field, const nljs::json& p_jvalue, C& p_object) {
+        typename F::Type value{};
+        DecodeValue(p_jvalue, value);
+        p_field.set(p_object, std::move(value));
+    }
+
+    // JSON object holding the fields of p_object
+    template <typename C>
+    nljs::json ToJson(const C& p_object) {
+        nljs::json jobject = nljs::json::object();
+        std::apply([&](const auto&... p_field) {
+            ((p_field.has(p_object) ? (void)(jobject[p_field.key] = EncodeValue(p_field.get(p_object))) : (void)0), ...);
+        }, descriptors<C>);
+        return jobject;
+    }
+    // Read the fields of p_object from a JSON object
+    // .. Keys are matched by their precomputed hashes in one pass over the object; unknown keys are ignored
+    // .. Throws if the input is not an object or misses a required field
+    template <typename C>
+    void FromJson(const nljs::json& p_jobject, C& p_object) {
+        constexpr auto& fields = descriptors<C>;
+        constexpr unsigned long long required = RequiredMask(fields);
+        static_assert(std::tuple_size<std::decay_t<decltype(fields)>>::value <= 64, "Too many fields");
+        if (!p_jobject.is_object())
+            throw std::invalid_argument("Expected an object");
+        unsigned long long seen = 0;
+        for (auto it = p_jobject.begin(); it != p_jobject.end(); it++) {
+            const std::string& key = it.key();
+            unsigned long long hash = Hash(key);
+            std::apply([&](const auto&... p_field) {
+                unsigned int index = 0;
+                // .. Stops at the first match
+                (void)((p_field.hash == hash && key == p_field.key
+                    ? (DecodeField(p_field, it.value(), p_object), seen |= 1ULL << index, true)
+                    : (index++, false)) || ...);
+            }, fields);
+        }
+        if ((seen & required) != required) {
+            std::string missing;
+            std::apply([&](const auto&... p_field) {
+                unsigned int index = 0;
+                ((missing += (required & ~seen) >> index++ & 1 ? std::string(" ") + p_field.key : ""), ...);
+            }, fields);
+            throw std::out_of_range("Missing field(s):" + missing);
+        }
+        if constexpr (HasOnDecoded<C>::value) p_object.OnDecoded();
+    }
+
+    // Value kinds shared by the binary & CSV codecs
+    // .. Text is anything viewed as & built from a string_view (std::string, interned strings)
+    template <typename T>
+    struct IsText : std::bool_constant<std::is_convertible<const T&, std::string_view>::value
+        && std::is_constructible<T, std::string_view>::value> {};
+    template <typename T>
+    struct IsVector : std::false_type {};
+    template <typename T, typename A>
+    struct IsVector<std::vector<T, A>> : std::true_type {};
+    template <typename T>
+    struct IsPair : std::false_type {};
+    template <typename T, typename U>
+    struct IsPair<std::pair<T, U>> : std::true_type {};
+    template <typename T>
+    struct IsUnsupported : std::false_type {};
+
+    // Binary codec
+    // .. Fields follow each other in table order, without keys: optional fields are preceded by a presence byte
+    // .. Numbers are written in little-endian order, text & vectors after their length (LEB128)
+    // .. Nothing is skipped on read, so both ends must build the same tables
+    template <typename C>
+    void EncodeBinary(const C& p_object, std::string& p_bytes);
+    template <typename C>
+    void DecodeBinary(std::string_view& p_bytes, C& p_object);
+
+    inline bool IsLittleEndian() {
+        const unsigned int one = 1;
+        unsigned char first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+    inline void WriteLength(unsigned long long p_length, std::string& p_bytes) {
+        for (; p_length >= 0x80; p_length >>= 7) p_bytes += (char)((p_length & 0x7F) | 0x80);
+        p_bytes += (char)p_length;
+    }
+    // .. Throws if the input ends first
+    inline unsigned long long ReadLength(std::string_view& p_bytes) {
+        unsigned long long length = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            if (p_bytes.empty()) throw std::out_of_range("Truncated input");
+            unsigned char byte = p_bytes.front();
+            p_bytes.remove_prefix(1);
+            length |= (unsigned long long)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return length;
+        }
+        throw std::invalid_argument("Invalid length");
+    }
+    template <typename T>
+    void WriteBinary(const T& p_value, std::string& p_bytes) {
+        if constexpr (HasFields<T>::value) EncodeBinary(p_value, p_bytes);
+        else if constexpr (std::is_arithmetic<T>::value) {
+            unsigned char raw[sizeof(T)];
+            std::memcpy(raw, &p_value, sizeof(T));
+            for (unsigned int i = 0; i < sizeof(T); i++) {
+                // .. Host order to little-endian
+                unsigned int index = IsLittleEndian() ? i : sizeof(T) - 1 - i;
+                p_bytes += (char)raw[index];
+            }
+        } else if constexpr (IsText<T>::value) {
+            std::string_view text = p_value;
+            WriteLength(text.size(), p_bytes);
+            p_bytes.append(text);
+        } else if constexpr (IsVector<T>::value) {
+            WriteLength(p_value.size(), p_bytes);
+            for (const auto& item: p_value) WriteBinary(item, p_bytes);
+        } else if constexpr (IsPair<T>::value) {
+            WriteBinary(p_value.first, p_bytes);
+            WriteBinary(p_value.second, p_bytes);
+        } else static_assert(IsUnsupported<T>::value, "Type not supported by the binary codec");
+    }
+    template <typename T>
+    void ReadBinary(std::string_view& p_bytes, T& p_value) {
+        if constexpr (HasFields<T>::value) DecodeBinary(p_bytes, p_value);
+        else if constexpr (std::is_arithmetic<T>::value) {
+            if (p_bytes.size() < sizeof(T)) throw std::out_of_range("Truncated input");
+            unsigned char raw[sizeof(T)];
+            for (unsigned int i = 0; i < sizeof(T); i++)
+                raw[IsLittleEndian() ? i : sizeof(T) - 1 - i] = p_bytes[i];
+            std::memcpy(&p_value, raw, sizeof(T));
+            p_bytes.remove_prefix(sizeof(T));
+        } else if constexpr (IsText<T>::value) {
+            unsigned long long length = ReadLength(p_bytes);
+            if (length > p_bytes.size()) throw std::out_of_range("Truncated input");
+            p_value = T(p_bytes.substr(0, length));
+            p_bytes.remove_prefix(length);
+        } else if constexpr (IsVector<T>::value) {
+            // .. Every item takes a byte at least, so a damaged count cannot allocate more than the input
+            unsigned long long count = ReadLength(p_bytes);
+            if (count > p_bytes.size()) throw std::out_of_range("Truncated input");
+            p_value.clear();
+            p_value.reserve(count);
+            for (unsigned long long i = 0; i < count; i++) {
+                typename T::value_type item{};
+                ReadBinary(p_bytes, item);
+                p_value.push_back(std::move(item));
+            }
+        } else if constexpr (IsPair<T>::value) {
+            ReadBinary(p_bytes, p_value.first);
+            ReadBinary(p_bytes, p_value.second);
+        } else static_assert(IsUnsupported<T>::value, "Type not supported by the binary codec");
+    }
+
+    // Append the fields of p_object
+    template <typename C>
+    void EncodeBinary(const C& p_object, std::string& p_bytes) {
+        std::apply([&](const auto&... p_field) {
+            ([&](const auto& p_field) {
+                bool isPresent = p_field.has(p_object);
+                if (p_field.isOptional) p_bytes += (char)isPresent;
+                if (isPresent) WriteBinary(p_field.get(p_object), p_bytes);
+            }(p_field), ...);
+        }, descriptors<C>);
+    }
+    // Read the fields of p_object, taking their bytes off the front of p_bytes
+    template <typename C>
+    void DecodeBinary(std::string_view& p_bytes, C& p_object) {
+        std::apply([&](const auto&... p_field) {
+            ([&](const auto& p_field) {
+                if (p_field.isOptional) {
+                    if (p_bytes.empty()) throw std::out_of_range("Truncated input");
+                    bool isPresent = p_bytes.front() != 0;
+                    p_bytes.remove_prefix(1);
+                    if (!isPresent) return;
+                }
+                typename std::decay_t<decltype(p_field)>::Type value{};
+                ReadBinary(p_bytes, value);
+                p_field.set(p_object, std::move(value));
+            }(p_field), ...);
+        }, descriptors<C>);
+        if constexpr (HasOnDecoded<C>::value) p_object.OnDecoded();
+    }
+    // Bytes holding the fields of p_object
+    template <typename C>
+    std::string ToBinary(const C& p_object) {
+        std::string bytes;
+        EncodeBinary(p_object, bytes);
+        return bytes;
+    }
+    // Read p_object from the bytes of ToBinary
+    // .. Throws if the input ends early or goes on after the object
+    template <typename C>
+    void FromBinary(std::string_view p_bytes, C& p_object) {
+        DecodeBinary(p_bytes, p_object);
+        if (!p_bytes.empty()) throw std::invalid_argument("Trailing bytes");
+    }
+
+    // CSV codec
+    // .. One row per object, one column per field, named by its key
+    // .. Fields of nested tables get columns of their own, named parent.child
+    // .. Numbers & booleans are written as they are, text always quoted,
+    // .. & other values (vectors, pairs) as compact JSON in a quoted cell
+    // .. Cells of fields not written are empty & unquoted, so empty text stays apart from a missing field
+    // .. Columns are matched by name on read, in any order; unknown columns are ignored
+    struct Cell {
+        std::string text;
+        bool isQuoted = false;
+    };
+
+    // Columns of a table, with nested tables expanded
+    template <typename C>
+    void CsvColumns(const std::string& p_prefix, std::vector<std::string>& p_columns) {
+        std::apply([&](const auto&... p_field) {
+            ([&](const auto& p_field) {
+                using T = typename std::decay_t<decltype(p_field)>::Type;
+                if constexpr (HasFields<T>::value) CsvColumns<T>(p_prefix + p_field.key + ".", p_columns);
+                else p_columns.push_back(p_prefix + p_field.key);
+            }(p_field), ...);
+        }, descriptors<C>);
+    }
+    template <typename C>
+    unsigned long CsvColumnCount() {
+        std::vector<std::string> columns;
+        CsvColumns<C>("", columns);
+        return columns.size();
+    }
+    inline std::string QuoteCsv(std::string_view p_text) {
+        std::string quoted = "\"";
+        for (char c: p_text) quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        return quoted + '"';
+    }
+    template <typename T>
+    std::string WriteCell(const T& p_value) {
+        if constexpr (std::is_same<T, bool>::value) return p_value ? "true" : "false";
+        else if constexpr (std::is_arithmetic<T>::value) {
+            // .. Shortest text that reads back the same value
+            char buffer[64];
+            return std::string(buffer, std::to_chars(buffer, buffer + sizeof(buffer), p_value).ptr);
+        } else if constexpr (IsText<T>::value) return QuoteCsv(p_value);
+        else return QuoteCsv(EncodeValue(p_value).dump());
+    }
+    template <typename T>
+    void ReadCell(const Cell& p_cell, const char* p_key, T& p_value) {
+        if constexpr (std::is_same<T, bool>::value) {
+            if (p_cell.text != "true" && p_cell.text != "false")
+                throw std::invalid_argument(std::string("Invalid value of field: ") + p_key);
+            p_value = p_cell.text == "true";
+        } else if constexpr (std::is_arithmetic<T>::value) {
+            const char* end = p_cell.text.data() + p_cell.text.size();
+            auto result = std::from_chars(p_cell.text.data(), end, p_value);
+            if (result.ec != std::errc() || result.ptr != end)
+                throw std::invalid_argument(std::string("Invalid value of field: ") + p_key);
+        } else if constexpr (IsText<T>::value) p_value = T(std::string_view(p_cell.text));
+        else DecodeValue(nljs::json::parse(p_cell.text), p_value);
+    }
+
+    // Append the cells of p_object
+    template <typename C>
+    void WriteCsvCells(const C& p_object, std::vector<std::string>& p_cells) {
+        std::apply([&](const auto&... p_field) {
+            ([&](const auto& p_field) {
+                using T = typename std::decay_t<decltype(p_field)>::Type;
+                bool isPresent = p_field.has(p_object);
+                if constexpr (HasFields<T>::value) {
+                    if (isPresent) WriteCsvCells<T>(p_field.get(p_object), p_cells);
+                    else p_cells.resize(p_cells.size() + CsvColumnCount<T>());
+                } else p_cells.push_back(isPresent ? WriteCell<T>(p_field.get(p_object)) : std::string());
+            }(p_field), ...);
+        }, descriptors<C>);
+    }
+    // Read the fields of p_object from the cells of a row, columns found by name
+    // .. False if none of the cells of a nested object is filled: it was not written, & is left as it is
+    // .. Throws if a required field is missing otherwise
+    template <typename C>
+    bool ReadCsvCells(const std::unordered_map<std::string, unsigned long>& p_columns, const std::vector<Cell>& p_cells,
+        const std::string& p_prefix, C& p_object) {
+        std::string missing;
+        bool isAny = false;
+        std::apply([&](const auto&... p_field) {
+            ([&](const auto& p_field) {
+                using T = typename std::decay_t<decltype(p_field)>::Type;
+                T value{};
+                bool isPresent;
+                if constexpr (HasFields<T>::value)
+                    isPresent = ReadCsvCells(p_columns, p_cells, p_prefix + p_field.key + ".", value);
+                else {
+                    auto column = p_columns.find(p_prefix + p_field.key);
+                    isPresent = column != p_columns.end() && column->second < p_cells.size()
+                        && (p_cells[column->second].isQuoted || !p_cells[column->second].text.empty());
+                    if (isPresent) ReadCell(p_cells[column->second], p_field.key, value);
+                }
+                if (isPresent) p_field.set(p_object, std::move(value));
+                else if (!p_field.isOptional) missing += " " + p_prefix + p_field.key;
+                isAny = isAny || isPresent;
+            }(p_field), ...);
+        }, descriptors<C>);
+        if (!isAny && !p_prefix.empty()) return false;
+        if (!missing.empty()) throw std::out_of_range("Missing field(s):" + missing);
+        if constexpr (HasOnDecoded<C>::value) p_object.OnDecoded();
+        return true;
+    }
+    // Split a CSV row into cells, quotes removed
+    // .. Quoted cells may hold commas, doubled quotes & line breaks
+    inline std::vector<Cell> SplitCsv(std::string_view p_row) {
+        std::vector<Cell> cells(1);
+        bool isInQuotes = false;
+        for (unsigned long i = 0; i < p_row.size(); i++) {
+            char c = p_row[i];
+            if (isInQuotes) {
+                if (c != '"') cells.back().text += c;
+                else if (i + 1 < p_row.size() && p_row[i + 1] == '"') cells.back().text += p_row[++i];
+                else isInQuotes = false;
+            } else if (c == '"') isInQuotes = cells.back().isQuoted = true;
+            else if (c == ',') cells.emplace_back();
+            else if (c != '\r' && c != '\n') cells.back().text += c;
+        }
+        if (isInQuotes) throw std::invalid_argument("Unterminated quoted cell");
+        return cells;
+    }
+    inline std::string JoinCsv(const std::vector<std::string>& p_cells) {
+        std::string row;
+        for (unsigned long i = 0; i < p_cells.size(); i++) row += (i == 0 ? "" : ",") + p_cells[i];
+        return row;
+    }
+
+    // Header row of a table
+    template <typename C>
+    std::string CsvHeader() {
+        std::vector<std::string> columns;
+        CsvColumns<C>("", columns);
+        return JoinCsv(columns);
+    }
+    // Row holding the fields of p_object, in the columns of CsvHeader<C>()
+    template <typename C>
+    std::string ToCsv(const C& p_object) {
+        std::vector<std::string> cells;
+        WriteCsvCells(p_object, cells);
+        return JoinCsv(cells);
+    }
+    // Read p_object from a row, under the header row it was written with
+    // .. Throws if a cell cannot be read or a required field is missing
+    template <typename C>
+    void FromCsv(std::string_view p_header, std::string_view p_row, C& p_object) {
+        std::unordered_map<std::string, unsigned long> columns;
+        std::vector<Cell> names = SplitCsv(p_header);
+        for (unsigned long i = 0; i < names.size(); i++) columns.emplace(names[i].text, i);
+        ReadCsvCells(columns, SplitCsv(p_row), "", p_object);
+    }
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <ctime>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+
+// Space & user libraries
+#include "space.hpp"
+#include "user.hpp"
+
+// Number of spaces generated per work unit
+// .. Fixed so the output does not depend on the number of threads
+#define GENERATOR_CHUNK 4096
+
+namespace Generator {
+    // Parameters of a synthetic workload
+    struct Config {
+        // Same seed & config give the same catalog
+        unsigned long long seed = 42;
+        unsigned int spaces = 1000;
+        unsigned int eventUsers = 100;
+        unsigned int spaceUsers = 10;
+        // Average share of bookable hours (8:00 - 24:00) that get booked
+        double occupancy = 0.3;
+        unsigned int horizonDays = 90;
+        unsigned int maxReviews = 5;
+        // Fixed origin for reproducible timetables: 1 Jan 2025 00:00 UTC
+        time_t originTime = 1735689600;
+        // 0 to use all hardware threads
+        unsigned int threads = 0;
+    };
+
+    // Counts of what was generated
+    struct Stats {
+        unsigned long long spaces = 0;
+        unsigned long long users = 0;
+        unsigned long long reservations = 0;
+        unsigned long long bookedHours = 0;
+        unsigned long long reviews = 0;
+    };
+
+    // Reservation made while generating a space
+    // .. Index of the space in the generated batch, times as stored in RSVPs
+    struct Booking {
+        unsigned int index;
+        time_t startTime, endTime;
+        double price;
+    };
+
+    // Utility functions
+    // SplitMix64 to derive independent seeds per work unit
+    inline unsigned long long SplitMix(unsigned long long p_value) {
+        p_value += 0x9E3779B97F4A7C15ull;
+        p_value = (p_value ^ (p_value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        p_value = (p_value ^ (p_value >> 27)) * 0x94D049BB133111EBull;
+        return p_value ^ (p_value >> 31);
+    }
+
+    // Book a space day by day up to its target occupancy
+    // .. Evenings and weekends are busier, bookings last 1 to 6 hours
+    inline void GenerateBookings(const Config& p_config, std::mt19937_64& p_engine, unsigned int p_index,
+        Space::Space& p_space, std::vector<Booking>& p_bookings, unsigned long long& p_bookedHours) {
+        std::normal_distribution<double> occupancyDist(p_config.occupancy, 0.15);
+        double target = std::min(0.95, std::max(0.0, occupancyDist(p_engine)));
+        // Hours between 8:00 and 22:00, weighted towards the evening
+        std::discrete_distribution<int> startDist({1, 1, 2, 2, 2, 2, 2, 2, 3, 3, 4, 5, 5, 4, 2});
+        long long originDay = p_config.originTime / 86400;
+        for (unsigned int day = 0; day < p_config.horizonDays; day++) {
+            // 1 Jan 1970 was a Thursday
+            int weekday = (4 + originDay + day) % 7;
+            double weight = (weekday == 0 || weekday == 6) ? 1.4 : 0.85;
+            double dayTarget = target * weight * 16;
+            double booked = 0;
+            for (int attempt = 0; attempt < 8 && booked < dayTarget; attempt++) {
+                int startHour = 8 + startDist(p_engine);
+                int duration = std::min<int>(1 + p_engine() % 6, 24 - startHour);
+                time_t startTime = p_config.originTime + ((time_t)day * 24 + startHour) * 3600;
+                time_t endTime = startTime + duration * 3600;
+                double price = 0;
+                // Same convention as EventUser: last booked hour starts at end - 1 hour
+                if (p_space.timer.AddReservation(startTime, endTime - Space::Time::SLOT_SECONDS, price)) {
+                    p_bookings.push_back(Booking{p_index, startTime, endTime, price});
+                    booked += duration;
+                    p_bookedHours += duration;
+                }
+            }
+        }
+    }
+
+    // Generate one work unit of spaces, with reviews & bookings
+    inline void GenerateChunk(const Config& p_config, unsigned int p_chunk, std::vector<std::unique_ptr<Space::Space>>& p_spaces,
+        std::vector<Booking>& p_bookings, Stats& p_stats) {
+        const std::string randLocs[] =
+            {"Building", "Park", "Hall", "Hotel", "Stadium", "Cafe", "Center", "Gallery", "Bar", "Arena",
+             "Studio", "Loft", "Rooftop", "Garden", "Theater", "Ballroom"};
+        const std::string randRevs[] = {
+            "Very bad, not good",
+            "Okay ish",
+            "Food is perfect! drinks are okay",
+            "Cozy atmosphere",
+            "Horrible reception n wifi",
+            "perfect for game night !!",
+            "Very fresh & spacious! Worth the price",
+            "Too far from the city",
+            "need more trashbins",
+            "Good sound system & cameras",
+            "Great staff, would book again",
+            "Parking was a nightmare",
+            "Projector too dim for daytime talks",
+            "Lovely natural light in the morning"
+        };
+        const std::string randTags[] =
+            {"wedding", "conference", "concert", "party", "workshop", "exhibition", "meetup", "screening"};
+        std::mt19937_64 engine(SplitMix(p_config.seed + p_chunk));
+        auto Rand = [&engine](unsigned int p_range) { return (unsigned int)(engine() % p_range); };
+        std::normal_distribution<double> qualityDist(3.2, 1.0);
+        std::normal_distribution<double> noiseDist(0, 0.8);
+
+        unsigned int first = p_chunk * GENERATOR_CHUNK;
+        unsigned int last = std::min<unsigned int>(first + GENERATOR_CHUNK, p_config.spaces);
+        for (unsigned int i = first; i < last; i++) {
+            std::string tmpName = "";
+            for (int j = 0; j < 3; j++)
+                tmpName.push_back((char)(Rand(26) + 65));
+            tmpName += " " + randLocs[Rand(16)];
+            unsigned int numberOfPeople = Rand(990) + 10;
+            auto space_ptr = std::make_unique<Space::Space>(
+                0, tmpName,
+                Rand(90) + 10, Rand(45) + 5, Rand(10) + 2,
+                numberOfPeople,
+                std::min(numberOfPeople, Rand(490) + 10), (bool)Rand(2), (bool)Rand(2), (bool)Rand(2),
+                Rand(9900) + 100,
+                (bool)Rand(2), (bool)Rand(2), (bool)Rand(2), (bool)Rand(2),
+                (bool)Rand(2), (bool)Rand(2), (bool)Rand(2)
+            );
+            // Fixed origin instead of the current time
+            space_ptr->timer = Space::Time(space_ptr->timer.GetDirhamsPerHour(), p_config.originTime);
+            unsigned int numOfTags = Rand(3);
+            for (unsigned int j = 0; j < numOfTags; j++)
+                space_ptr->AddTag(randTags[Rand(8)]);
+
+            // Reviews scattered around the space's quality
+            double quality = qualityDist(engine);
+            unsigned int numOfReviews = Rand(p_config.maxReviews + 1);
+            for (unsigned int j = 0; j < numOfReviews; j++) {
+                int score = (int)std::lround(std::min(5.0, std::max(0.0, quality + noiseDist(engine))));
+                space_ptr->review.AddReview(randRevs[Rand(14)], score);
+            }
+            p_stats.reviews += numOfReviews;
+
+            GenerateBookings(p_config, engine, i, *space_ptr, p_bookings, p_stats.bookedHours);
+            p_spaces[i] = std::move(space_ptr);
+        }
+        p_stats.reservations += p_bookings.size();
+    }
+
+    // Generate a synthetic catalog directly into the managers
+    // .. Spaces, reviews & bookings are built on parallel threads,
+    // .. then inserted, and bookings spread over generated event users
+    inline Stats Generate(const Config& p_config, Space::SpaceManager& p_spaceManager, User::UserManager& p_userManager) {
+        Trace::Span span("Generate", "bulk", p_config.spaces);
+        Stats stats;
+        unsigned int chunkCount = (p_config.spaces + GENERATOR_CHUNK - 1) / GENERATOR_CHUNK;
+        std::vector<std::unique_ptr<Space::Space>> spaces(p_config.spaces);
+        std::vector<std::vector<Booking>> bookings(chunkCount);
+        std::vector<Stats> chunkStats(chunkCount);
+
+        // Spaces
+        unsigned int threadCount = p_config.threads;
+        if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::max(1u, std::min(threadCount, chunkCount));
+        std::atomic<unsigned int> nextChunk{0};
+        auto worker = [&]() {
+            unsigned int chunk;
+            while ((chunk = nextChunk++) < chunkCount) {
+                Trace::Span span("GenerateChunk", "bulk", chunk);
+                GenerateChunk(p_config, chunk, spaces, bookings[chunk], chunkStats[chunk]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++)
+            threads.emplace_back([&]() {
+                Trace::SetThreadName("generator");
+                worker();
+            });
+        worker();
+        for (auto& thread: threads) thread.join();
+
+        Trace::Span insertSpan("Insert", "bulk", spaces.size());
+        std::vector<unsigned int> IDs = p_spaceManager.AddSpaces(spaces);
+        stats.spaces = spaces.size();
+        for (const Stats& chunk: chunkStats) {
+            stats.reservations += chunk.reservations;
+            stats.bookedHours += chunk.bookedHours;
+            stats.reviews += chunk.reviews;
+        }
+
+        insertSpan.End();
+
+        // Users
+        const std::string randNames[] =
+            {"Quan", "Maroon 5", "party man", "Aisha", "Omar", "Lina", "Yusuf", "Mei", "Carlos", "Priya",
+             "Events Co", "Gala Crew", "Tech Meetup", "Wedding Planners", "Book Club", "Film Society"};
+        std::mt19937_64 engine(SplitMix(~p_config.seed));
+        std::vector<User::SpaceUser*> spaceUsers;
+        std::vector<User::EventUser*> eventUsers;
+        for (unsigned int i = 0; i < p_config.spaceUsers; i++) {
+            spaceUsers.push_back(new User::SpaceUser(0, randNames[engine() % 16] + " " + std::to_string(i), &p_spaceManager));
+            p_userManager.AddUser(spaceUsers.back());
+        }
+        for (unsigned int i = 0; i < p_config.eventUsers; i++) {
+            eventUsers.push_back(new User::EventUser(0, randNames[engine() % 16] + " " + std::to_string(i), &p_spaceManager));
+            p_userManager.AddUser(eventUsers.back());
+        }
+        stats.users = spaceUsers.size() + eventUsers.size();
+        if (!spaceUsers.empty())
+            for (unsigned int i = 0; i < IDs.size(); i++)
+                spaceUsers[engine() % spaceUsers.size()]->AddSpaceID(IDs[i]);
+        if (!eventUsers.empty())
+            for (const auto& chunk: bookings)
+                for (const Booking& booking: chunk)
+                    eventUsers[engine() % eventUsers.size()]->AddReservationRecord(
+                        IDs[booking.index], booking.startTime, booking.endTime, booking.price);
+        return stats;
+    }
+
+    // Generate a synthetic catalog straight to the storage files
+    // .. Committed as one catalog (see UserManager::StoreCatalog)
+    inline bool GenerateToFiles(const Config& p_config, Stats& p_stats, std::string p_commitFile = COMMIT_FILE) {
+        Space::SpaceManager spaceManager;
+        User::UserManager userManager(&spaceManager);
+        p_stats = Generate(p_config, spaceManager, userManager);
+        return userManager.StoreCatalog(p_commitFile);
+    }
+
+    // Print some details to cmd line
+    inline void PrintStats(const Stats& p_stats) {
+        std::cout << "Spaces: " << p_stats.spaces
+                  << "\nUsers: " << p_stats.users
+                  << "\nReservations: " << p_stats.reservations
+                  << " (" << p_stats.bookedHours << " hours)"
+                  << "\nReviews: " << p_stats.reviews << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef INTERN_HPP
+#define INTERN_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <ostream>
+
+// Independently locked parts of the pool, so parallel loads rarely wait on each other
+#define INTERN_SHARDS 16
+
+// Shared storage for repeated text: names, tags & reviews
+// .. Each distinct string is stored once and never moved or freed,
+// .. so handles stay valid for the whole run and compare by address
+namespace Intern {
+    // Class for the pool of distinct strings
+    class Pool {
+    private:
+        struct Shard {
+            std::mutex mutex;
+            // .. Deque elements keep their address as it grows
+            std::deque<std::string> strings;
+            std::unordered_map<std::string_view, const std::string*> lookup;
+            unsigned long long bytes = 0;
+        };
+        Shard shards[INTERN_SHARDS];
+    public:
+        // Getters
+        // Stored copy of p_text, added on first use
+        const std::string* Get(std::string_view p_text) {
+            static const std::string empty;
+            if (p_text.empty()) return &empty;
+            Shard& shard = shards[std::hash<std::string_view>()(p_text) % INTERN_SHARDS];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.lookup.find(p_text);
+            if (it != shard.lookup.end()) return it->second;
+            const std::string* text_ptr = &shard.strings.emplace_back(p_text);
+            shard.lookup.emplace(*text_ptr, text_ptr);
+            shard.bytes += sizeof(std::string) + (text_ptr->capacity() > 15 ? text_ptr->capacity() + 1 : 0);
+            return text_ptr;
+        }
+        // Number of distinct strings
+        unsigned long long GetCount() {
+            unsigned long long count = 0;
+            for (Shard& shard: shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                count += shard.strings.size();
+            }
+            return count;
+        }
+        // Approximate bytes held by the strings & lookup tables
+        unsigned long long GetBytes() {
+            unsigned long long bytes = 0;
+            for (Shard& shard: shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                bytes += shard.bytes + shard.lookup.size() * (sizeof(std::string_view) + 2 * sizeof(void*))
+                    + shard.lookup.bucket_count() * sizeof(void*);
+            }
+            return bytes;
+        }
+    };
+
+    // Pool shared by every space & user
+    inline Pool& GetPool() {
+        static Pool pool;
+        return pool;
+    }
+
+    // Class for a handle to pooled text
+    // .. As small as a pointer, copies & comparisons never touch the text
+    class String {
+    private:
+        const std::string* text;
+    public:
+        // Constructors & destructors
+        String() : text(GetPool().Get("")) {}
+        String(std::string_view p_text) : text(GetPool().Get(p_text)) {}
+        String(const std::string& p_text) : String(std::string_view(p_text)) {}
+        String(const char* p_text) : String(std::string_view(p_text)) {}
+
+        // Getters
+        std::string_view View() const { return *text; }
+        const std::string& Str() const { return *text; }
+        operator std::string_view() const { return *text; }
+        bool IsEmpty() const { return text->empty(); }
+
+        // Same text is the same handle
+        bool operator==(const String& p_other) const { return text == p_other.text; }
+        bool operator!=(const String& p_other) const { return text != p_other.text; }
+    };
+
+    inline std::ostream& operator<<(std::ostream& p_stream, const String& p_string) {
+        return p_stream << p_string.Str();
+    }
+
+    // JSON conversions, found by the JSON library through argument-dependent lookup
+    template <typename Json>
+    void to_json(Json& p_json, const String& p_string) { p_json = p_string.Str(); }
+    template <typename Json>
+    void from_json(const Json& p_json, String& p_string) {
+        p_string = String(p_json.template get_ref<const typename Json::string_t&>());
+    }
+}
+
+#endif
@@ -0,0 +1,388 @@
+// Trace-replay load test of user sessions
+// .. Replays operation traces (workload.hpp) against the sharded catalog of the current directory,
+// .. through the same calls as the session menus, with background stores running as in the program
+// .. Usage:
+// ..   evies_loadtest synthesize <trace> [sessions] [seed]   synthetic trace over the catalog
+// ..   evies_loadtest replay <trace> [clients] [speed] [report file]
+// .. Traces of real sessions are recorded by the program with EVIES_WORKLOAD_FILE=<trace>
+// .. Replays change the catalog, so run them on a copy of the data files
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <condition_variable>
+
+#include "space.hpp"
+#include "user.hpp"
+#include "generator.hpp"
+
+namespace {
+    // Synthetic sessions
+    // .. Sessions arrive every 200 ms on average and make 3 to 12 operations, 2 seconds apart on average,
+    // .. then end with their store; bookings fall within the horizon of generated catalogs
+    const double SESSION_GAP_MS = 200;
+    const double THINK_TIME_MS = 2000;
+
+    // Operations in one session of a trace, in order
+    struct Session {
+        std::vector<Workload::Event> events;
+    };
+
+    // Latencies & failures per operation, filled by one client
+    struct Results {
+        Metrics::Histogram histograms[Workload::OP_COUNT];
+        unsigned long long failures[Workload::OP_COUNT] = {};
+    };
+
+    // Utility functions
+    // Random event user of the catalog, or false if none is found
+    bool PickEventUser(User::UserManager& p_userManager, std::mt19937_64& p_engine, unsigned int& p_ID) {
+        for (unsigned int attempt = 0; attempt < 100 && p_userManager.GetUserCount() != 0; attempt++) {
+            p_ID = p_engine() % p_userManager.GetUserCount();
+            if (dynamic_cast<User::EventUser*>(p_userManager.GetUser(p_ID)) != nullptr) return true;
+        }
+        return false;
+    }
+    // Write a synthetic trace of p_sessions sessions over the loaded catalog
+    bool Synthesize(const std::string& p_fileName, User::UserManager& p_userManager, Space::SpaceManager& p_spaceManager,
+        unsigned int p_sessions, unsigned long long p_seed) {
+        const std::string words[] = {"hall", "park", "hotel", "studio", "loft", "rooftop", "garden", "theater",
+            "ballroom", "gallery", "cozy", "spacious", "projector", "parking", "staff", "light"};
+        const std::string reviews[] = {"Great staff, would book again", "Okay ish", "Parking was a nightmare",
+            "Lovely natural light in the morning", "Good sound system & cameras"};
+        Generator::Config config;
+        std::mt19937_64 engine(p_seed);
+        std::exponential_distribution<double> sessionGap(1 / SESSION_GAP_MS), thinkTime(1 / THINK_TIME_MS);
+        // .. Browse, find free, reserve, cancel, review, pay
+        std::discrete_distribution<int> opDist({35, 20, 25, 5, 8, 7});
+        if (p_spaceManager.GetSpaceCount() == 0) return false;
+        nljs::json jevents = nljs::json::array();
+        double arrival = 0;
+        for (unsigned int session = 0; session < p_sessions; session++) {
+            unsigned int user;
+            if (!PickEventUser(p_userManager, engine, user)) return false;
+            arrival += sessionGap(engine);
+            double now = arrival;
+            std::vector<Workload::Event> reserved;
+            unsigned int count = 3 + engine() % 10;
+            for (unsigned int i = 0; i <= count; i++) {
+                Workload::Event event;
+                event.time = (unsigned long long)now;
+                event.session = session;
+                event.user = user;
+                event.op = i == count ? Workload::STORE : (Workload::Op)opDist(engine);
+                if (event.op == Workload::CANCEL && reserved.empty()) event.op = Workload::RESERVE;
+                time_t dayTime = config.originTime + (time_t)(engine() % config.horizonDays) * 86400;
+                switch (event.op) {
+                    case Workload::BROWSE:
+                        event.text = words[engine() % 16];
+                        if (engine() % 2) event.text += " " + words[engine() % 16];
+                        break;
+                    case Workload::FIND_FREE:
+                        event.startTime = dayTime + 8 * 3600;
+                        event.endTime = event.startTime + (1 + engine() % 7) * 86400;
+                        event.hours = 1 + engine() % 4;
+                        break;
+                    case Workload::RESERVE:
+                        event.space = engine() % p_spaceManager.GetSpaceCount();
+                        event.startTime = dayTime + (8 + engine() % 12) * 3600;
+                        event.endTime = event.startTime + (1 + engine() % 4) * 3600;
+                        reserved.push_back(event);
+                        break;
+                    case Workload::CANCEL: {
+                        unsigned int index = engine() % reserved.size();
+                        event.space = reserved[index].space;
+                        event.startTime = reserved[index].startTime;
+                        event.endTime = reserved[index].endTime;
+                        reserved.erase(reserved.begin() + index);
+                        break;
+                    }
+                    case Workload::REVIEW:
+                        event.space = engine() % p_spaceManager.GetSpaceCount();
+                        event.text = reviews[engine() % 5];
+                        event.amount = engine() % 6;
+                        break;
+                    case Workload::PAY:
+                        event.amount = 50 + engine() % 500;
+                        break;
+                    default:
+                        break;
+                }
+                jevents.push_back(Codec::ToJson(event));
+                now += thinkTime(engine);
+            }
+        }
+        // .. Sessions overlap: operations in time order, as recorded
+        std::stable_sort(jevents.begin(), jevents.end(), [](const nljs::json& p_a, const nljs::json& p_b) {
+            return p_a["time"].get<unsigned long long>() < p_b["time"].get<unsigned long long>();
+        });
+        return Storage::WriteRecords(p_fileName, jevents);
+    }
+    // Read a trace into sessions, ordered by their first operation
+    bool ReadTrace(const std::string& p_fileName, std::vector<Session>& p_sessions) {
+        std::map<unsigned int, Session> sessions;
+        unsigned int unknown = 0;
+        bool isRead = Storage::ForEachRecord(p_fileName, [&](nljs::json& jevent) {
+            Workload::Event event;
+            try {
+                Codec::FromJson(jevent, event);
+            } catch (std::exception& e) {
+                unknown++;
+                return true;
+            }
+            if (event.op == Workload::OP_COUNT) unknown++;
+            else sessions[event.session].events.push_back(std::move(event));
+            return true;
+        });
+        if (!isRead) return false;
+        if (unknown != 0) std::cout << "Skipped " << unknown << " unknown operation(s)\n";
+        for (auto& session: sessions) p_sessions.push_back(std::move(session.second));
+        std::stable_sort(p_sessions.begin(), p_sessions.end(), [](const Session& p_a, const Session& p_b) {
+            return p_a.events.front().time < p_b.events.front().time;
+        });
+        return true;
+    }
+
+    // Class for the session thread
+    // .. Spaces & users have a single writer, so client requests queue up & run one at a time,
+    // .. with the idle work of the program (finishing & starting background stores) in between
+    class Server {
+    public:
+        struct Request {
+            const Workload::Event* event;
+            bool isDone = false, isOk = false;
+        };
+    private:
+        User::UserManager& userManager;
+        Space::SpaceManager& spaceManager;
+        std::mutex mutex;
+        std::condition_variable wakeUp, done;
+        std::deque<Request*> requests;
+        bool isRunning = true;
+        std::thread thread;
+
+        // Same calls as the session menus, without printing
+        bool Execute(const Workload::Event& p_event) {
+            switch (p_event.op) {
+                case Workload::BROWSE:
+                    spaceManager.SearchSpaces(p_event.text, 10);
+                    return true;
+                case Workload::FIND_FREE:
+                    spaceManager.FindFreeSpaces(p_event.startTime, p_event.endTime, p_event.hours, 10);
+                    return true;
+                case Workload::REVIEW:
+                    return spaceManager.AddReview(p_event.space, p_event.text, p_event.amount);
+                case Workload::STORE:
+                    userManager.EndSession();
+                    return true;
+                default:
+                    break;
+            }
+            User::EventUser* user_ptr = dynamic_cast<User::EventUser*>(userManager.GetUser(p_event.user));
+            if (user_ptr == nullptr) return false;
+            // .. The menu cleans reservations before every choice
+            user_ptr->CleanReservations();
+            double price = 0;
+            int RSVP_ID;
+            switch (p_event.op) {
+                case Workload::RESERVE:
+                    return user_ptr->Reserve(p_event.space, p_event.startTime, p_event.endTime, price);
+                case Workload::CANCEL:
+                    RSVP_ID = user_ptr->FindReservation(p_event.space, p_event.startTime, p_event.endTime);
+                    return RSVP_ID >= 0 && user_ptr->CancelReservation(RSVP_ID);
+                case Workload::PAY:
+                    user_ptr->Pay(p_event.amount);
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        void Run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wakeUp.wait_for(lock, std::chrono::milliseconds(IDLE_INTERVAL),
+                    [this]() { return !requests.empty() || !isRunning; });
+                if (requests.empty() && !isRunning) return;
+                Request* request = nullptr;
+                if (!requests.empty()) {
+                    request = requests.front();
+                    requests.pop_front();
+                }
+                lock.unlock();
+                userManager.TickPersister();
+                bool isOk = request != nullptr && Execute(*request->event);
+                lock.lock();
+                if (request == nullptr) continue;
+                request->isOk = isOk;
+                request->isDone = true;
+                done.notify_all();
+            }
+        }
+    public:
+        // Constructors & destructors
+        Server(User::UserManager& p_userManager, Space::SpaceManager& p_spaceManager)
+            : userManager(p_userManager), spaceManager(p_spaceManager), thread([this]() { Run(); }) {}
+        ~Server() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isRunning = false;
+            }
+            wakeUp.notify_all();
+            thread.join();
+        }
+
+        // Interface
+        // Run an operation & wait for it (returns whether it succeeded)
+        bool Submit(const Workload::Event& p_event) {
+            Request request{&p_event};
+            std::unique_lock<std::mutex> lock(mutex);
+            requests.push_back(&request);
+            wakeUp.notify_all();
+            done.wait(lock, [&request]() { return request.isDone; });
+            return request.isOk;
+        }
+    };
+
+    // Replay sessions with p_clients clients, p_speed times faster than recorded (0 for no pauses)
+    // .. Each client replays one session at a time, operations in order; sessions start in trace order
+    // .. as clients free up. Latencies count from when an operation was due, so time spent waiting
+    // .. for the server or for a client to free up is included
+    double Replay(Server& p_server, const std::vector<Session>& p_sessions, unsigned int p_clients, double p_speed,
+        std::vector<std::unique_ptr<Results>>& p_results) {
+        std::atomic<unsigned int> nextSession{0};
+        unsigned long long firstTime = p_sessions.front().events.front().time;
+        auto startTime = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for (unsigned int client = 0; client < p_clients; client++) {
+            p_results.push_back(std::make_unique<Results>());
+            Results& results = *p_results.back();
+            clients.emplace_back([&, client]() {
+                Trace::SetThreadName("client " + std::to_string(client));
+                unsigned int session;
+                while ((session = nextSession++) < p_sessions.size())
+                    for (const Workload::Event& event: p_sessions[session].events) {
+                        auto dueTime = std::chrono::steady_clock::now();
+                        if (p_speed > 0) {
+                            dueTime = startTime + std::chrono::microseconds(
+                                (long long)((event.time - firstTime) * 1000 / p_speed));
+                            std::this_thread::sleep_until(dueTime);
+                        }
+                        bool isOk = p_server.Submit(event);
+                        results.histograms[event.op].Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - dueTime).count());
+                        if (!isOk) results.failures[event.op]++;
+                    }
+            });
+        }
+        for (std::thread& client: clients) client.join();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
+    // Print & optionally export throughput & latencies per operation
+    bool Report(const std::vector<std::unique_ptr<Results>>& p_results, double p_seconds,
+        unsigned int p_clients, double p_speed, const std::string& p_fileName) {
+        nljs::json joperations;
+        unsigned long long total = 0;
+        std::cout << std::left << std::setw(12) << "Operation" << std::right << std::setw(10) << "Count"
+                  << std::setw(10) << "Failed" << std::setw(10) << "Ops/s" << std::setw(12) << "Mean(ms)"
+                  << std::setw(12) << "p50(ms)" << std::setw(12) << "p99(ms)" << std::setw(12) << "p999(ms)"
+                  << std::setw(12) << "Max(ms)\n";
+        std::cout << std::fixed << std::setprecision(3);
+        for (unsigned int op = 0; op < Workload::OP_COUNT; op++) {
+            std::vector<unsigned long long> buckets(Metrics::Histogram::BUCKETS, 0);
+            unsigned long long count = 0, sum = 0, max = 0, failures = 0;
+            for (const auto& results: p_results) {
+                results->histograms[op].AddTo(buckets, count, sum, max);
+                failures += results->failures[op];
+            }
+            if (count == 0) continue;
+            total += count;
+            Metrics::Summary summary = Metrics::Summarize(buckets, count, sum, max);
+            std::cout << std::left << std::setw(12) << Workload::OpName(op) << std::right << std::setw(10) << count
+                      << std::setw(10) << failures << std::setw(10) << std::setprecision(1) << count / p_seconds
+                      << std::setprecision(3) << std::setw(12) << summary.mean / 1e6 << std::setw(12) << summary.p50 / 1e6
+                      << std::setw(12) << summary.p99 / 1e6 << std::setw(12) << summary.p999 / 1e6
+                      << std::setw(12) << summary.max / 1e6 << std::endl;
+            joperations[Workload::OpName(op)] = {
+                {"count", count},
+                {"failures", failures},
+                {"throughput", count / p_seconds},
+                {"mean_ns", summary.mean},
+                {"p50_ns", summary.p50},
+                {"p99_ns", summary.p99},
+                {"p999_ns", summary.p999},
+                {"max_ns", summary.max}
+            };
+        }
+        std::cout << std::setprecision(1) << "\n" << total << " operations in " << p_seconds << " s: "
+                  << total / p_seconds << " ops/s with " << p_clients << " client(s)\n";
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+        if (p_fileName.empty()) return true;
+        nljs::json jreport = {
+            {"time", (unsigned long long)time(NULL)},
+            {"clients", p_clients},
+            {"speed", p_speed},
+            {"seconds", p_seconds},
+            {"throughput", total / p_seconds},
+            {"operations", joperations},
+            {"core", Metrics::Serialize()}
+        };
+        std::ostringstream content;
+        content << std::setw(4) << jreport << std::endl;
+        return Storage::AtomicWriteFile(p_fileName, content.str());
+    }
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3 || (std::string(argv[1]) != "synthesize" && std::string(argv[1]) != "replay")) {
+		std::cout << "Usage: evies_loadtest synthesize <trace> [sessions] [seed]\n"
+		          << "       evies_loadtest replay <trace> [clients] [speed] [report file]\n"
+		          << "Both use the sharded catalog of the current directory (evies --generate <spaces> makes one)\n";
+		return 1;
+	}
+	Trace::SetThreadName("session");
+	Space::SpaceManager spaceMgr;
+	User::UserManager userMgr(&spaceMgr);
+	if (!userMgr.LoadCatalog()) {
+		std::cout << "Could not load the sharded catalog\n";
+		return 1;
+	}
+	if (std::string(argv[1]) == "synthesize") {
+		unsigned int sessions = argc >= 4? std::stoul(argv[3]): 1000;
+		unsigned long long seed = argc >= 5? std::stoull(argv[4]): 42;
+		if (!Synthesize(argv[2], userMgr, spaceMgr, sessions, seed)) {
+			std::cout << "Synthesis failed!\n";
+			return 1;
+		}
+		std::cout << sessions << " session(s) written to " << argv[2] << std::endl;
+		return 0;
+	}
+	std::vector<Session> sessions;
+	if (!ReadTrace(argv[2], sessions) || sessions.empty()) {
+		std::cout << "Could not read any operation from " << argv[2] << std::endl;
+		return 1;
+	}
+	unsigned int clients = argc >= 4? std::max(1, atoi(argv[3])): 8;
+	double speed = argc >= 5? std::max(0.0, atof(argv[4])): 1;
+	std::string reportFile = argc >= 6? argv[5]: "";
+	userMgr.StartPersister();
+	userMgr.GetPersister().Enable();
+	std::vector<std::unique_ptr<Results>> results;
+	double seconds;
+	{
+		Server server(userMgr, spaceMgr);
+		seconds = Replay(server, sessions, clients, speed, results);
+	}
+	userMgr.StopPersister();
+	if (!Report(results, seconds, clients, speed, reportFile)) {
+		std::cout << "Could not write " << reportFile << std::endl;
+		return 1;
+	}
+	if (Metrics::IsEnabled()) {
+		std::cout << "\nInside the core:\n";
+		Metrics::PrintMetrics();
+	}
+	return 0;
+}
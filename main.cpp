@@ -1,8 +1,62 @@
 #include "space.hpp"
 #include "user.hpp"
+#include "generator.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
+	// Record a Chrome trace of the whole run if requested
+	// .. EVIES_TRACE_FILE=<file>, written on exit
+	Trace::SetThreadName("main");
+	if (getenv("EVIES_TRACE_FILE") != nullptr)
+		Trace::Tracer::Get().Start(getenv("EVIES_TRACE_FILE"));
+	struct TraceGuard { ~TraceGuard() { Trace::Tracer::Get().Stop(); } } traceGuard;
+	// Export metrics periodically if requested
+	// .. EVIES_METRICS_FILE=<file> [EVIES_METRICS_INTERVAL=<seconds>]
+	Metrics::Exporter metricsExporter;
+	if (getenv("EVIES_METRICS_FILE") != nullptr) {
+		const char* interval = getenv("EVIES_METRICS_INTERVAL");
+		metricsExporter.Start(getenv("EVIES_METRICS_FILE"), interval != nullptr? std::max(1, atoi(interval)): 10);
+	}
+	// Generate a synthetic catalog straight to the data files
+	// .. Usage: evies --generate <number of spaces> [seed]
+	if (argc >= 3 && std::string(argv[1]) == "--generate") {
+		Generator::Config config;
+		config.spaces = std::stoul(argv[2]);
+		config.eventUsers = config.spaces / 10 + 1;
+		config.spaceUsers = config.spaces / 100 + 1;
+		if (argc >= 4) config.seed = std::stoull(argv[3]);
+		Generator::Stats stats;
+		if (!Generator::GenerateToFiles(config, stats)) {
+			std::cout << "Generation failed!\n";
+			return 1;
+		}
+		Generator::PrintStats(stats);
+		return 0;
+	}
 	Space::SpaceManager spaceMgr;
 	User::UserManager userMgr(&spaceMgr);
+	// Record the operations of every session for load tests if requested
+	// .. EVIES_WORKLOAD_FILE=<file>, replayed with evies_loadtest
+	if (getenv("EVIES_WORKLOAD_FILE") != nullptr && !Workload::Recorder::Get().Start(getenv("EVIES_WORKLOAD_FILE")))
+		std::cout << "Could not record operations to " << getenv("EVIES_WORKLOAD_FILE") << std::endl;
+	// Seconds between samples of the memory footprint, 0 turns sampling off
+	// .. EVIES_MEMORY_INTERVAL=<seconds>
+	if (getenv("EVIES_MEMORY_INTERVAL") != nullptr)
+		userMgr.GetMemoryHistory().SetInterval(atoi(getenv("EVIES_MEMORY_INTERVAL")));
+	// Run as a read-only replica of another process on this host
+	// .. Usage: evies --follow [socket]
+	if (argc >= 2 && std::string(argv[1]) == "--follow") {
+		userMgr.FollowerProgram(argc >= 3? argv[2]: REPLICA_SOCKET);
+		return 0;
+	}
+	// Publish every change for replicas if requested
+	// .. EVIES_REPLICA_SOCKET=<socket>
+	if (getenv("EVIES_REPLICA_SOCKET") != nullptr && !userMgr.StartPublisher(getenv("EVIES_REPLICA_SOCKET")))
+		std::cout << "Could not publish changes on " << getenv("EVIES_REPLICA_SOCKET") << std::endl;
+	// Background store policy of the sharded catalog
+	// .. EVIES_PERSIST_INTERVAL=<seconds> EVIES_PERSIST_CHANGES=<number of changes>, 0 turns either off
+	const char* persistInterval = getenv("EVIES_PERSIST_INTERVAL");
+	const char* persistChanges = getenv("EVIES_PERSIST_CHANGES");
+	userMgr.GetPersister().SetPolicy(persistInterval != nullptr? atoi(persistInterval): PERSIST_INTERVAL,
+		persistChanges != nullptr? atoi(persistChanges): PERSIST_THRESHOLD);
 	userMgr.MainProgram();
 }
\ No newline at end of file
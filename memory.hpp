@@ -0,0 +1,220 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <deque>
+#include <unordered_set>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+
+// Atomic file writes
+#include "storage.hpp"
+
+// Default memory report export file
+#define MEMORY_FILE "magical.memory"
+// Seconds between samples of the footprint
+#define MEMORY_INTERVAL 10
+// Samples kept, oldest dropped first (an hour at the default interval)
+#define MEMORY_SAMPLES 360
+
+// Memory accounting
+// .. Managers walk their objects and add the heap bytes they own to a report, per category
+// .. Walks only count objects already in memory: unloaded shards are never loaded for a report
+namespace Memory {
+    // Accounted categories
+    enum Category {
+        SPACES,
+        TIMETABLES,
+        ROLLUPS,
+        TARIFFS,
+        REVIEWS,
+        TAGS,
+        TEXT,
+        SPACE_TABLE,
+        SEARCH_INDEX,
+        QUERY_CACHE,
+        USERS,
+        RESERVATIONS,
+        CATEGORY_COUNT
+    };
+    inline const char* CategoryName(unsigned int p_category) {
+        static const char* names[CATEGORY_COUNT] = {
+            "Spaces", "Timetables", "Rollups", "Tariffs", "Reviews", "Tags", "Text",
+            "SpaceTable", "SearchIndex", "QueryCache", "Users", "Reservations"
+        };
+        return names[p_category];
+    }
+
+    // Heap bytes held by the elements of a vector (capacity, not size)
+    template <typename T>
+    inline unsigned long long VectorBytes(const std::vector<T>& p_vector) { return p_vector.capacity() * sizeof(T); }
+
+    // Resident set of the process now & at its peak (VmRSS & VmHWM), in bytes
+    // .. 0 where /proc is not available
+    struct Process {
+        unsigned long long rss = 0, peakRss = 0;
+    };
+    inline Process ReadProcess() {
+        Process process;
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmRSS:") == 0) process.rss = std::stoull(line.substr(6)) * 1024;
+            else if (line.compare(0, 6, "VmHWM:") == 0) process.peakRss = std::stoull(line.substr(6)) * 1024;
+        }
+        return process;
+    }
+
+    // Bytes & objects of one category
+    struct Usage {
+        unsigned long long bytes = 0, count = 0;
+    };
+
+    // Class for a footprint report
+    class Report {
+    private:
+        std::array<Usage, CATEGORY_COUNT> usages{};
+        // Blocks shared between objects (e.g. tariff tables), counted once
+        std::unordered_set<const void*> shared;
+        Process process;
+        time_t time = 0;
+    public:
+        // Constructors & destructors
+        Report() {}
+
+        // Setters
+        void Add(Category p_category, unsigned long long p_bytes, unsigned long long p_count = 1) {
+            usages[p_category].bytes += p_bytes;
+            usages[p_category].count += p_count;
+        }
+        // Add a block that several objects may point to, once
+        void AddShared(Category p_category, const void* p_block, unsigned long long p_bytes) {
+            if (p_block != nullptr && shared.insert(p_block).second) Add(p_category, p_bytes);
+        }
+        // Stamp the report with the time & the process counters, once every walk is done
+        void Finish() {
+            time = ::time(NULL);
+            process = ReadProcess();
+            shared.clear();
+        }
+
+        // Getters
+        const Usage& Get(Category p_category) const { return usages[p_category]; }
+        unsigned long long GetTotalBytes() const {
+            unsigned long long bytes = 0;
+            for (const Usage& usage: usages) bytes += usage.bytes;
+            return bytes;
+        }
+        const Process& GetProcess() const { return process; }
+        time_t GetTime() const { return time; }
+
+        // Serialize function
+        nljs::json Serialize() const {
+            nljs::json jcategories;
+            for (unsigned int category = 0; category < CATEGORY_COUNT; category++)
+                jcategories[CategoryName(category)] = {
+                    {"bytes", usages[category].bytes},
+                    {"count", usages[category].count}
+                };
+            return {
+                {"time", (unsigned long long)time},
+                {"accountedBytes", GetTotalBytes()},
+                {"rssBytes", process.rss},
+                {"peakRssBytes", process.peakRss},
+                {"categories", jcategories}
+            };
+        }
+        // Print some details to cmd line
+        void PrintReport() const {
+            unsigned long long total = GetTotalBytes();
+            std::cout << std::left << std::setw(20) << "Category" << std::right << std::setw(14) << "Objects"
+                      << std::setw(14) << "KiB" << std::setw(10) << "Share\n";
+            std::cout << std::fixed << std::setprecision(1);
+            for (unsigned int category = 0; category < CATEGORY_COUNT; category++)
+                std::cout << std::left << std::setw(20) << CategoryName(category) << std::right
+                          << std::setw(14) << usages[category].count << std::setw(14) << usages[category].bytes / 1024
+                          << std::setw(8) << (total != 0 ? 100.0 * usages[category].bytes / total : 0) << " %\n";
+            std::cout.unsetf(std::ios::floatfield);
+            std::cout << std::setprecision(6);
+            std::cout << "Accounted: " << total / 1024 << " KiB, resident: " << process.rss / 1024
+                      << " KiB (peak " << process.peakRss / 1024 << " KiB)\n";
+            if (process.rss > total)
+                std::cout << "Not accounted (code, allocator, buffers, stacks): " << (process.rss - total) / 1024 << " KiB\n";
+        }
+    };
+
+    // Class for the footprint over time
+    // .. Keeps the last MEMORY_SAMPLES samples & the highest accounted footprint seen
+    class History {
+    public:
+        struct Sample {
+            time_t time;
+            unsigned long long accountedBytes, rssBytes;
+        };
+    private:
+        std::deque<Sample> samples;
+        Sample peak{0, 0, 0};
+        unsigned int interval = MEMORY_INTERVAL;
+        time_t lastTime = 0;
+    public:
+        // Constructors & destructors
+        History() {}
+
+        // Setters
+        // Seconds between samples, 0 to stop sampling
+        void SetInterval(unsigned int p_seconds) { interval = p_seconds; }
+        void Record(const Report& p_report) {
+            Sample sample{p_report.GetTime(), p_report.GetTotalBytes(), p_report.GetProcess().rss};
+            samples.push_back(sample);
+            if (samples.size() > MEMORY_SAMPLES) samples.pop_front();
+            if (sample.accountedBytes >= peak.accountedBytes) peak = sample;
+            lastTime = sample.time;
+        }
+
+        // Getters
+        // Whether the next sample is due
+        bool IsDue() const { return interval != 0 && ::time(NULL) >= lastTime + (time_t)interval; }
+        const std::deque<Sample>& GetSamples() const { return samples; }
+        const Sample& GetPeak() const { return peak; }
+
+        // Serialize function
+        nljs::json Serialize() const {
+            nljs::json jsamples = nljs::json::array();
+            for (const Sample& sample: samples)
+                jsamples.push_back({(unsigned long long)sample.time, sample.accountedBytes, sample.rssBytes});
+            return {
+                {"interval", interval},
+                {"peak", {
+                    {"time", (unsigned long long)peak.time},
+                    {"accountedBytes", peak.accountedBytes},
+                    {"rssBytes", peak.rssBytes}
+                }},
+                {"samples", jsamples}
+            };
+        }
+        // Print some details to cmd line
+        void PrintHistory() const {
+            if (samples.empty()) return;
+            time_t peakTime = peak.time;
+            std::cout << samples.size() << " sample(s) since " << std::put_time(localtime(&samples.front().time), "%c")
+                      << ", highest accounted " << peak.accountedBytes / 1024 << " KiB at "
+                      << std::put_time(localtime(&peakTime), "%c") << std::endl;
+        }
+    };
+
+    // Write a report & the history to a file, atomically
+    inline bool Export(const std::string& p_fileName, const Report& p_report, const History& p_history) {
+        nljs::json jmemory = p_report.Serialize();
+        jmemory["history"] = p_history.Serialize();
+        std::ostringstream content;
+        content << std::setw(4) << jmemory << std::endl;
+        return Storage::AtomicWriteFile(p_fileName, content.str());
+    }
+}
+
+#endif
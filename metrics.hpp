@@ -0,0 +1,286 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cmath>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <condition_variable>
+
+// Atomic file writes
+#include "storage.hpp"
+
+// Latency instrumentation
+// .. Compiled in only if EVIES_METRICS is defined, otherwise scopes cost nothing
+#ifdef EVIES_METRICS
+#define EVIES_METRIC_SCOPE(op) Metrics::ScopedTimer metricsScopedTimer(op)
+#else
+#define EVIES_METRIC_SCOPE(op)
+#endif
+
+// Default metrics export file
+#define METRICS_FILE "magical.metrics"
+
+// Histogram resolution: 2^4 sub-buckets per power of two (6.25% relative error)
+#define METRICS_SUB_BITS 4
+
+namespace Metrics {
+    // Instrumented operations
+    enum Op {
+        ADD_RESERVATION,
+        REMOVE_RESERVATION,
+        SERIALIZE,
+        LOAD_DATA,
+        STORE_DATA,
+        LOAD_SHARD,
+        STORE_SHARDS,
+        PRINT_SPACES,
+        SEARCH,
+        CAPTURE_CATALOG,
+        CAPTURE_CHANGES,
+        OP_COUNT
+    };
+    inline const char* OpName(unsigned int p_op) {
+        static const char* names[OP_COUNT] = {
+            "AddReservation", "RemoveReservation", "Serialize", "LoadData",
+            "StoreData", "LoadShard", "StoreShards", "PrintSpaces", "Search",
+            "CaptureCatalog", "CaptureChanges"
+        };
+        return names[p_op];
+    }
+
+    // Class for HDR-style latency histograms in nanoseconds
+    // .. Values below 2^SUB_BITS are exact, larger ones fall in log-linear buckets
+    // .. Written by one thread only, read by any: relaxed atomics without read-modify-write
+    class Histogram {
+    public:
+        static const unsigned int SUB = 1 << METRICS_SUB_BITS;
+        static const unsigned int BUCKETS = (64 - METRICS_SUB_BITS + 1) * SUB;
+    private:
+        std::atomic<unsigned long long> buckets[BUCKETS];
+        std::atomic<unsigned long long> count{0}, sum{0}, max{0};
+        static void Bump(std::atomic<unsigned long long>& p_value, unsigned long long p_delta) {
+            p_value.store(p_value.load(std::memory_order_relaxed) + p_delta, std::memory_order_relaxed);
+        }
+    public:
+        // Constructors & destructors
+        Histogram() {
+            for (auto& bucket: buckets) bucket.store(0, std::memory_order_relaxed);
+        }
+
+        // Bucket index of a value, and lowest value of a bucket
+        static unsigned int BucketOf(unsigned long long p_value) {
+            if (p_value < SUB) return p_value;
+            unsigned int shift = 63 - __builtin_clzll(p_value) - METRICS_SUB_BITS;
+            return (shift + 1) * SUB + ((p_value >> shift) & (SUB - 1));
+        }
+        static unsigned long long BucketFloor(unsigned int p_bucket) {
+            if (p_bucket < SUB) return p_bucket;
+            unsigned int shift = p_bucket / SUB - 1;
+            return (unsigned long long)(SUB + p_bucket % SUB) << shift;
+        }
+
+        // Setters
+        void Record(unsigned long long p_value) {
+            Bump(buckets[BucketOf(p_value)], 1);
+            Bump(count, 1);
+            Bump(sum, p_value);
+            if (p_value > max.load(std::memory_order_relaxed))
+                max.store(p_value, std::memory_order_relaxed);
+        }
+        // Add another histogram's counts into plain totals
+        void AddTo(std::vector<unsigned long long>& p_buckets, unsigned long long& p_count,
+            unsigned long long& p_sum, unsigned long long& p_max) const {
+            for (unsigned int i = 0; i < BUCKETS; i++)
+                p_buckets[i] += buckets[i].load(std::memory_order_relaxed);
+            p_count += count.load(std::memory_order_relaxed);
+            p_sum += sum.load(std::memory_order_relaxed);
+            p_max = std::max(p_max, max.load(std::memory_order_relaxed));
+        }
+    };
+
+    // Per-thread counters: one histogram per operation
+    struct ThreadBlock {
+        Histogram histograms[OP_COUNT];
+    };
+
+    // Summary of an operation over all threads
+    struct Summary {
+        unsigned long long count = 0;
+        double mean = 0;
+        unsigned long long p50 = 0, p99 = 0, p999 = 0, max = 0;
+    };
+
+    // Summary of merged histogram counts
+    // .. Percentiles from the bucket floors, capped by the true maximum
+    inline Summary Summarize(const std::vector<unsigned long long>& p_buckets, unsigned long long p_count,
+        unsigned long long p_sum, unsigned long long p_max) {
+        Summary summary;
+        summary.count = p_count;
+        summary.max = p_max;
+        if (p_count == 0) return summary;
+        summary.mean = (double)p_sum / p_count;
+        unsigned long long* targets[] = {&summary.p50, &summary.p99, &summary.p999};
+        const double ranks[] = {0.5, 0.99, 0.999};
+        unsigned long long seen = 0;
+        unsigned int next = 0;
+        for (unsigned int i = 0; i < Histogram::BUCKETS && next < 3; i++) {
+            seen += p_buckets[i];
+            while (next < 3 && seen >= std::ceil(ranks[next] * p_count)) {
+                *targets[next] = std::min(Histogram::BucketFloor(i), p_max);
+                next++;
+            }
+        }
+        return summary;
+    }
+
+    // Class to keep track of all thread blocks
+    // .. Blocks outlive their threads so that no count is lost
+    class Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBlock>> blocks;
+    public:
+        static Registry& Get() {
+            static Registry registry;
+            return registry;
+        }
+        std::shared_ptr<ThreadBlock> NewBlock() {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks.push_back(std::make_shared<ThreadBlock>());
+            return blocks.back();
+        }
+        // Merge all threads and compute percentiles
+        std::vector<Summary> Collect() {
+            std::vector<Summary> summaries(OP_COUNT);
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int op = 0; op < OP_COUNT; op++) {
+                std::vector<unsigned long long> buckets(Histogram::BUCKETS, 0);
+                unsigned long long count = 0, sum = 0, max = 0;
+                for (const auto& block: blocks)
+                    block->histograms[op].AddTo(buckets, count, sum, max);
+                summaries[op] = Summarize(buckets, count, sum, max);
+            }
+            return summaries;
+        }
+    };
+
+    // Utility functions
+    inline ThreadBlock& LocalBlock() {
+        thread_local std::shared_ptr<ThreadBlock> block = Registry::Get().NewBlock();
+        return *block;
+    }
+    inline void Record(Op p_op, unsigned long long p_nanoseconds) {
+        LocalBlock().histograms[p_op].Record(p_nanoseconds);
+    }
+    inline bool IsEnabled() {
+#ifdef EVIES_METRICS
+        return true;
+#else
+        return false;
+#endif
+    }
+    // Serialize all summaries
+    inline nljs::json Serialize() {
+        std::vector<Summary> summaries = Registry::Get().Collect();
+        nljs::json joperations;
+        for (unsigned int op = 0; op < OP_COUNT; op++)
+            joperations[OpName(op)] = {
+                {"count", summaries[op].count},
+                {"mean_ns", summaries[op].mean},
+                {"p50_ns", summaries[op].p50},
+                {"p99_ns", summaries[op].p99},
+                {"p999_ns", summaries[op].p999},
+                {"max_ns", summaries[op].max}
+            };
+        return {
+            {"time", (unsigned long long)time(NULL)},
+            {"enabled", IsEnabled()},
+            {"operations", joperations}
+        };
+    }
+    // Print some details to cmd line
+    inline void PrintMetrics() {
+        if (!IsEnabled()) {
+            std::cout << "Metrics are compiled out of this build (define EVIES_METRICS)\n";
+            return;
+        }
+        std::vector<Summary> summaries = Registry::Get().Collect();
+        std::cout << std::left << std::setw(20) << "Operation" << std::right
+                  << std::setw(12) << "Count" << std::setw(12) << "Mean(us)" << std::setw(12) << "p50(us)"
+                  << std::setw(12) << "p99(us)" << std::setw(12) << "p999(us)" << std::setw(12) << "Max(us)\n";
+        for (unsigned int op = 0; op < OP_COUNT; op++) {
+            const Summary& summary = summaries[op];
+            std::cout << std::left << std::setw(20) << OpName(op) << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(12) << summary.count << std::setw(12) << summary.mean / 1000
+                      << std::setw(12) << summary.p50 / 1000.0 << std::setw(12) << summary.p99 / 1000.0
+                      << std::setw(12) << summary.p999 / 1000.0 << std::setw(12) << summary.max / 1000.0 << std::endl;
+        }
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+
+    // Class to time a scope
+    class ScopedTimer {
+        Op op;
+        std::chrono::steady_clock::time_point startTime;
+    public:
+        ScopedTimer(Op p_op) : op(p_op), startTime(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() {
+            Record(op, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - startTime).count());
+        }
+    };
+
+    // Class to export metrics to a file periodically
+    // .. The file is replaced atomically on every export
+    class Exporter {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool isRunning = false;
+        std::string fileName;
+    public:
+        // Constructors & destructors
+        Exporter() {}
+        ~Exporter() { Stop(); }
+
+        // Interface
+        void Start(const std::string& p_fileName, unsigned int p_seconds) {
+            Stop();
+            fileName = p_fileName;
+            isRunning = true;
+            thread = std::thread([this, p_seconds]() {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!wakeUp.wait_for(lock, std::chrono::seconds(p_seconds), [this]() { return !isRunning; }))
+                    Export();
+                // Last export on stop
+                Export();
+            });
+        }
+        void Stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!isRunning) return;
+                isRunning = false;
+            }
+            wakeUp.notify_all();
+            thread.join();
+        }
+        bool Export() const { return Export(fileName); }
+        bool Export(const std::string& p_fileName) const {
+            std::ostringstream content;
+            content << std::setw(4) << Serialize() << std::endl;
+            return Storage::AtomicWriteFile(p_fileName, content.str());
+        }
+    };
+}
+
+#endif
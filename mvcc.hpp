@@ -0,0 +1,257 @@
+#ifndef MVCC_HPP
+#define MVCC_HPP
+
+#include <vector>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+// Objects per chunk of a table
+// .. A write after a snapshot copies one chunk & the root's chunk list, not the whole table
+#define MVCC_CHUNK 256
+
+// Copy-on-write tables with point-in-time snapshots
+// .. Every object, chunk & root is stamped with the epoch it was made in, and taking a snapshot
+// .. starts a new epoch: older parts are then shared with the snapshot, so the writer copies them
+// .. before their first change instead of changing them in place
+// .. Replaced parts are retired, and freed once no snapshot of their epoch is left (epoch-based reclamation)
+namespace Mvcc {
+    template <typename T>
+    class Table;
+
+    // Class for a consistent view of a table
+    // .. Read-only & lock-free: may be read from any thread while the writer goes on
+    // .. Must not outlive its table
+    template <typename T>
+    class Snapshot {
+        friend class Table<T>;
+    private:
+        const typename Table<T>::Root* root = nullptr;
+        std::atomic<unsigned long long>* pin = nullptr;
+
+        Snapshot(const typename Table<T>::Root* p_root, std::atomic<unsigned long long>* p_pin)
+            : root(p_root), pin(p_pin) {}
+    public:
+        // Constructors & destructors
+        Snapshot() {}
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot(Snapshot&& p_snapshot) : root(p_snapshot.root), pin(p_snapshot.pin) {
+            p_snapshot.root = nullptr;
+            p_snapshot.pin = nullptr;
+        }
+        Snapshot& operator=(Snapshot&& p_snapshot) {
+            if (this != &p_snapshot) {
+                Release();
+                std::swap(root, p_snapshot.root);
+                std::swap(pin, p_snapshot.pin);
+            }
+            return *this;
+        }
+        ~Snapshot() { Release(); }
+
+        // Setters
+        // Let the writer reclaim what only this snapshot still sees
+        void Release() {
+            if (pin != nullptr) pin->store(0, std::memory_order_release);
+            root = nullptr;
+            pin = nullptr;
+        }
+
+        // Getters
+        bool IsValid() const { return root != nullptr; }
+        unsigned int GetSize() const { return root == nullptr ? 0 : root->size; }
+        // Object at p_ID, or nullptr for an empty ID
+        const T* Get(unsigned int p_ID) const {
+            if (p_ID >= GetSize()) return nullptr;
+            return root->chunks[p_ID / MVCC_CHUNK]->items[p_ID % MVCC_CHUNK];
+        }
+    };
+
+    // Class for a table of objects by ID, owned by a single writer thread
+    // .. The writer changes the table & takes snapshots; only snapshots are shared with other threads
+    template <typename T>
+    class Table {
+        friend class Snapshot<T>;
+    private:
+        struct Chunk {
+            unsigned long long epoch;
+            std::array<T*, MVCC_CHUNK> items{};
+            std::array<unsigned long long, MVCC_CHUNK> epochs{};
+
+            explicit Chunk(unsigned long long p_epoch) : epoch(p_epoch) {}
+        };
+        struct Root {
+            unsigned long long epoch;
+            unsigned int size = 0;
+            std::vector<Chunk*> chunks;
+
+            explicit Root(unsigned long long p_epoch) : epoch(p_epoch) {}
+        };
+        // Part replaced while snapshots up to its epoch may still read it
+        struct Retired {
+            unsigned long long epoch;
+            void* part;
+            void (*destroy)(void*);
+        };
+
+        // .. Parts of the current epoch are seen by no snapshot
+        unsigned long long epoch = 1;
+        Root* root;
+        // Epochs of live snapshots, 0 for free slots
+        // .. A deque, so slots stay in place while readers release them
+        std::deque<std::atomic<unsigned long long>> pins;
+        // .. In retiring order, so by epoch as well
+        std::vector<Retired> retired;
+
+        template <typename U>
+        static void Destroy(void* p_part) { delete static_cast<U*>(p_part); }
+        // Free a replaced part, right away if no snapshot can see it
+        template <typename U>
+        void Retire(U* p_part, unsigned long long p_epoch) {
+            if (p_part == nullptr) return;
+            if (p_epoch == epoch) {
+                delete p_part;
+                return;
+            }
+            retired.push_back(Retired{epoch - 1, p_part, &Destroy<U>});
+        }
+        // Copies of the root & chunks that the writer may change in place
+        Root* MutableRoot() {
+            if (root->epoch != epoch) {
+                Root* copy = new Root(*root);
+                copy->epoch = epoch;
+                Retire(root, root->epoch);
+                root = copy;
+            }
+            return root;
+        }
+        Chunk* MutableChunk(unsigned int p_chunk) {
+            Chunk*& chunk = MutableRoot()->chunks[p_chunk];
+            if (chunk->epoch != epoch) {
+                Chunk* copy = new Chunk(*chunk);
+                copy->epoch = epoch;
+                Retire(chunk, chunk->epoch);
+                chunk = copy;
+            }
+            return chunk;
+        }
+        // Retire the whole current table
+        void RetireAll() {
+            for (Chunk* chunk: root->chunks) {
+                for (unsigned int i = 0; i < MVCC_CHUNK; i++)
+                    Retire(chunk->items[i], chunk->epochs[i]);
+                Retire(chunk, chunk->epoch);
+            }
+            Retire(root, root->epoch);
+        }
+    public:
+        // Constructors & destructors
+        Table() : root(new Root(epoch)) {}
+        Table(const Table&) = delete;
+        Table& operator=(const Table&) = delete;
+        // .. No snapshot may be left
+        ~Table() {
+            for (Chunk* chunk: root->chunks) {
+                for (T* item: chunk->items) delete item;
+                delete chunk;
+            }
+            delete root;
+            for (const Retired& part: retired) part.destroy(part.part);
+        }
+
+        // Setters
+        // Replace the object at p_ID (nullptr to empty it)
+        void Set(unsigned int p_ID, std::unique_ptr<T> p_item) {
+            Chunk* chunk = MutableChunk(p_ID / MVCC_CHUNK);
+            unsigned int slot = p_ID % MVCC_CHUNK;
+            Retire(chunk->items[slot], chunk->epochs[slot]);
+            chunk->items[slot] = p_item.release();
+            chunk->epochs[slot] = epoch;
+        }
+        // Grow to p_size IDs, new ones empty
+        void Resize(unsigned int p_size) {
+            if (p_size <= root->size) return;
+            Root* writable = MutableRoot();
+            while (writable->chunks.size() * MVCC_CHUNK < p_size)
+                writable->chunks.push_back(new Chunk(epoch));
+            writable->size = p_size;
+        }
+        // Make the root & the chunks of IDs [p_first, p_last) writable in place
+        // .. Set may then be called for distinct IDs of the range from parallel threads
+        void Unshare(unsigned int p_first, unsigned int p_last) {
+            p_last = std::min(p_last, root->size);
+            for (unsigned int chunk = p_first / MVCC_CHUNK; chunk * MVCC_CHUNK < p_last; chunk++)
+                MutableChunk(chunk);
+        }
+        void Reserve(unsigned int p_size) {
+            MutableRoot()->chunks.reserve((p_size + MVCC_CHUNK - 1) / MVCC_CHUNK);
+        }
+        // Drop every object, leaving p_size empty IDs
+        void Reset(unsigned int p_size = 0) {
+            RetireAll();
+            root = new Root(epoch);
+            Resize(p_size);
+            Collect();
+        }
+        // Free retired parts that no live snapshot can see anymore
+        void Collect() {
+            unsigned long long oldest = epoch;
+            for (const auto& pin: pins) {
+                unsigned long long pinned = pin.load(std::memory_order_acquire);
+                if (pinned != 0) oldest = std::min(oldest, pinned);
+            }
+            unsigned long freed = 0;
+            while (freed < retired.size() && retired[freed].epoch < oldest) {
+                retired[freed].destroy(retired[freed].part);
+                freed++;
+            }
+            retired.erase(retired.begin(), retired.begin() + freed);
+        }
+
+        // Getters
+        unsigned int GetSize() const { return root->size; }
+        const T* Get(unsigned int p_ID) const {
+            if (p_ID >= root->size) return nullptr;
+            return root->chunks[p_ID / MVCC_CHUNK]->items[p_ID % MVCC_CHUNK];
+        }
+        // Object at p_ID for the writer to change, copied first if a snapshot may see it
+        T* GetMutable(unsigned int p_ID) {
+            if (Get(p_ID) == nullptr) return nullptr;
+            Chunk* chunk = MutableChunk(p_ID / MVCC_CHUNK);
+            unsigned int slot = p_ID % MVCC_CHUNK;
+            if (chunk->epochs[slot] != epoch) {
+                T* copy = new T(*chunk->items[slot]);
+                Retire(chunk->items[slot], chunk->epochs[slot]);
+                chunk->items[slot] = copy;
+                chunk->epochs[slot] = epoch;
+            }
+            return chunk->items[slot];
+        }
+        // Current state as a snapshot, then start a new epoch
+        Snapshot<T> GetSnapshot() {
+            Collect();
+            std::atomic<unsigned long long>* pin = nullptr;
+            for (auto& slot: pins)
+                if (slot.load(std::memory_order_acquire) == 0) {
+                    pin = &slot;
+                    break;
+                }
+            if (pin == nullptr) pin = &pins.emplace_back(0);
+            pin->store(epoch, std::memory_order_relaxed);
+            Snapshot<T> snapshot(root, pin);
+            epoch++;
+            return snapshot;
+        }
+        unsigned long GetRetiredCount() const { return retired.size(); }
+        // Bytes held by the current root & chunks, objects & retired parts excluded
+        unsigned long long GetBytes() const {
+            return sizeof(Root) + root->chunks.capacity() * sizeof(Chunk*) + root->chunks.size() * sizeof(Chunk)
+                + retired.capacity() * sizeof(Retired);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef PERSIST_HPP
+#define PERSIST_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+
+// Span tracing
+#include "trace.hpp"
+
+// Seconds after which a changed catalog is stored
+#define PERSIST_INTERVAL 30
+// Changes after which the catalog is stored without waiting for the interval
+#define PERSIST_THRESHOLD 100
+// Longest wait in seconds before automatic stores are tried again after failures
+#define PERSIST_MAX_BACKOFF 600
+
+// Background persistence
+// .. The session thread only captures what changed (cheap), a background thread serializes & writes it
+namespace Persist {
+    // Store captured on the session thread
+    // .. write runs on the background thread, finish back on the session thread with its result
+    struct Job {
+        std::function<bool()> write;
+        std::function<void(bool)> finish;
+    };
+
+    // Class for a background store service
+    // .. Ticked from the session thread, which also captures & finishes every store:
+    // .. the background thread only ever runs the write part of one job at a time
+    class Service {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable written;
+        bool isRunning = false;
+        // Job handed to the thread (guarded by mutex)
+        Job job;
+        bool hasJob = false;
+        bool isWritten = false;
+        bool result = false;
+
+        // Session thread only
+        std::function<Job()> capture;
+        std::function<unsigned long long()> counter;
+        unsigned int interval = PERSIST_INTERVAL;
+        unsigned int threshold = PERSIST_THRESHOLD;
+        bool isEnabled = false;
+        // Change count of the last stored state, & of the job being written
+        unsigned long long storedCount = 0;
+        unsigned long long jobCount = 0;
+        std::chrono::steady_clock::time_point captureTime;
+        unsigned long long stores = 0, failures = 0;
+        bool lastResult = true;
+        // Failures in a row, & when automatic stores are tried again
+        // .. The wait starts at the interval (1 second without one) and doubles with every failure
+        unsigned int failureStreak = 0;
+        std::chrono::steady_clock::time_point retryTime;
+
+        void Fail() {
+            failures++;
+            lastResult = false;
+            unsigned int delay = std::max(interval, 1u);
+            for (unsigned int i = 0; i < failureStreak && delay < PERSIST_MAX_BACKOFF; i++) delay *= 2;
+            failureStreak++;
+            retryTime = std::chrono::steady_clock::now() + std::chrono::seconds(std::min(delay, (unsigned int)PERSIST_MAX_BACKOFF));
+        }
+
+        void Run() {
+            Trace::SetThreadName("persist");
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wakeUp.wait(lock, [this]() { return !isRunning || (hasJob && !isWritten); });
+                if (!(hasJob && !isWritten)) return;
+                std::function<bool()> write = job.write;
+                lock.unlock();
+                bool ok = false;
+                {
+                    Trace::Span span("BackgroundStore", "store");
+                    ok = write();
+                }
+                lock.lock();
+                result = ok;
+                isWritten = true;
+                written.notify_all();
+            }
+        }
+        void Submit() {
+            captureTime = std::chrono::steady_clock::now();
+            Job tmp_job = capture();
+            jobCount = counter();
+            if (!tmp_job.write) {
+                Fail();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job = std::move(tmp_job);
+                hasJob = true;
+                isWritten = false;
+            }
+            wakeUp.notify_all();
+        }
+    public:
+        // Constructors & destructors
+        Service() {}
+        Service(const Service&) = delete;
+        Service& operator=(const Service&) = delete;
+        ~Service() { Stop(); }
+
+        // Setters
+        // p_capture runs on the session thread and returns the store to write
+        // p_counter grows with every change of the stored state
+        void Start(std::function<Job()> p_capture, std::function<unsigned long long()> p_counter) {
+            Stop();
+            capture = std::move(p_capture);
+            counter = std::move(p_counter);
+            isRunning = true;
+            thread = std::thread([this]() { Run(); });
+        }
+        // Finish the store being written, then end the thread
+        void Stop() {
+            if (!isRunning) return;
+            Wait();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isRunning = false;
+            }
+            wakeUp.notify_all();
+            thread.join();
+        }
+        // Store once p_seconds passed since the last store, or after p_changes changes (0 to turn off either)
+        void SetPolicy(unsigned int p_seconds, unsigned int p_changes) {
+            interval = p_seconds;
+            threshold = p_changes;
+        }
+        // Automatic stores only while enabled, e.g. once the catalog has a home on disk
+        // .. Enabling takes the current state as stored
+        void Enable(bool p_isEnabled = true) {
+            if (p_isEnabled && !isEnabled) MarkStored();
+            isEnabled = p_isEnabled;
+        }
+        // Take the current state as stored, e.g. right after loading it
+        void MarkStored() {
+            storedCount = counter ? counter() : 0;
+            captureTime = std::chrono::steady_clock::now();
+        }
+
+        // Getters
+        bool IsEnabled() const { return isEnabled; }
+        // A store is being written
+        bool IsBusy() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return hasJob;
+        }
+        // Changes not stored yet
+        unsigned long long GetPendingChanges() const { return counter ? counter() - storedCount : 0; }
+        unsigned long long GetStoreCount() const { return stores; }
+        unsigned long long GetFailureCount() const { return failures; }
+        // Failures since the last store that succeeded
+        unsigned int GetFailureStreak() const { return failureStreak; }
+
+        // Interface
+        // Finish a written store, then start a new one if due
+        // .. Cheap enough to call before every prompt; after failures, waits for the backoff first
+        void Tick() {
+            Poll();
+            if (!isRunning || !isEnabled || IsBusy()) return;
+            if (failureStreak != 0 && std::chrono::steady_clock::now() < retryTime) return;
+            unsigned long long changes = GetPendingChanges();
+            if (changes == 0) return;
+            bool isDue = (threshold != 0 && changes >= threshold)
+                || (interval != 0 && std::chrono::steady_clock::now() - captureTime >= std::chrono::seconds(interval));
+            if (isDue) Submit();
+        }
+        // Start storing every change so far, without waiting for it (if enabled)
+        void Flush() {
+            if (!isRunning || !isEnabled) return;
+            Wait();
+            if (GetPendingChanges() != 0) Submit();
+        }
+        // Wait for the store being written & finish it (returns whether the last store succeeded)
+        bool Wait() {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                written.wait(lock, [this]() { return !hasJob || isWritten; });
+            }
+            Poll();
+            return lastResult;
+        }
+        // Finish a written store on the session thread
+        void Poll() {
+            std::function<void(bool)> finish;
+            bool ok;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!hasJob || !isWritten) return;
+                finish = std::move(job.finish);
+                ok = result;
+                job = Job();
+                hasJob = false;
+            }
+            if (finish) finish(ok);
+            if (ok) {
+                lastResult = true;
+                stores++;
+                storedCount = jobCount;
+                failureStreak = 0;
+            } else Fail();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+
+// Space library
+#include "space.hpp"
+
+// Spaces in one placement at most
+#define PLACEMENT_MAX_ROOMS 16
+// Start times tried at most (a week of one hour slots); later starts are ignored
+#define PLACEMENT_MAX_STARTS (7 * 24 * Space::Time::SLOTS_PER_HOUR)
+// Search nodes per start time before the best placement found so far is kept
+#define PLACEMENT_MAX_NODES 200000
+
+// Placement of large events over several spaces at once
+// .. Finds the cheapest set of spaces free together for the same hours, with enough room
+// .. for every attendee & the amenities asked for, then reserves all of them or none
+namespace Placement {
+    // Amenities of a space, one bit each
+    enum Amenity {
+        CATERING = 1 << 0,
+        NATURAL_LIGHT = 1 << 1,
+        ARTIFICIAL_LIGHT = 1 << 2,
+        PROJECTOR = 1 << 3,
+        SOUND = 1 << 4,
+        CAMERAS = 1 << 5,
+        OUTDOOR = 1 << 6
+    };
+    inline unsigned int AmenitiesOf(const Space::Space& p_space) {
+        return (p_space.IsCatering() ? CATERING : 0) | (p_space.IsNaturalLight() ? NATURAL_LIGHT : 0)
+            | (p_space.IsArtificialLight() ? ARTIFICIAL_LIGHT : 0) | (p_space.IsProjector() ? PROJECTOR : 0)
+            | (p_space.IsSound() ? SOUND : 0) | (p_space.IsCameras() ? CAMERAS : 0) | (p_space.IsOutdoor() ? OUTDOOR : 0);
+    }
+    // Amenities of letters as entered in the menu, one per amenity in bit order ("cnapsmo"), others ignored
+    inline unsigned int AmenitiesOf(const std::string& p_letters) {
+        unsigned int amenities = 0;
+        for (char letter: p_letters) {
+            size_t position = std::string("cnapsmo").find(letter);
+            if (position != std::string::npos) amenities |= 1u << position;
+        }
+        return amenities;
+    }
+
+    // What an event needs
+    struct Request {
+        // Earliest & latest begin times, and length
+        time_t fromTime = 0, toTime = 0;
+        unsigned int hours = 1;
+        unsigned int attendees = 0;
+        // Capacity counted in seats instead of people
+        bool isSeated = false;
+        // Amenities every space must have, and amenities at least one space must have
+        unsigned int everyRoom = 0, anyRoom = 0;
+        unsigned int maxRooms = PLACEMENT_MAX_ROOMS;
+    };
+
+    // Spaces found for an event
+    struct Plan {
+        struct Room {
+            unsigned int ID;
+            unsigned int capacity;
+            double price;
+        };
+        // .. End time exclusive, as in reservations
+        time_t startTime = 0, endTime = 0;
+        std::vector<Room> rooms;
+        double cost = 0;
+        unsigned int capacity = 0;
+        // Whether the search ran to the end, so that no cheaper placement exists
+        bool isOptimal = true;
+        unsigned long long nodes = 0;
+
+        // Print some details to cmd line
+        void PrintPlan() const {
+            time_t tmp_startTime = startTime, tmp_endTime = endTime;
+            std::cout << rooms.size() << " space(s) for " << capacity << " people, " << cost << " Dhs"
+                      << (isOptimal ? "" : " (best found)") << "\n  -- from " << ctime(&tmp_startTime)
+                      << "  -- to " << ctime(&tmp_endTime);
+            for (const Room& room: rooms)
+                std::cout << "  Space #" << room.ID << ": " << room.capacity << " people, " << room.price << " Dhs\n";
+        }
+    };
+
+    // Class for the search over the spaces free at one start time
+    // .. Spaces are sorted by price per person; a placement is built by adding spaces in that order,
+    // .. and a branch is cut once the cheapest way to seat the rest (spaces split as needed) costs more
+    // .. than the best placement so far, or once the spaces left lack an amenity still missing
+    class Search {
+    public:
+        struct Item {
+            unsigned int ID;
+            unsigned int capacity;
+            unsigned int amenities;
+            double price;
+        };
+    private:
+        const Request& request;
+        std::vector<Item> items;
+        // Sums of capacities & prices over the first i items, and amenities of the items from i on
+        std::vector<unsigned long long> capacities;
+        std::vector<double> prices;
+        std::vector<unsigned int> amenities;
+        // Current & best placements, as item indices
+        std::vector<unsigned int> chosen, best;
+        double bestCost;
+        unsigned long long nodes = 0;
+        bool isComplete = true;
+
+        // Lowest price of p_needed more people from the items from p_first on, infinity if they cannot
+        double Bound(unsigned int p_first, unsigned long long p_needed) const {
+            if (p_needed == 0) return 0;
+            if (capacities.back() - capacities[p_first] < p_needed) return std::numeric_limits<double>::infinity();
+            unsigned int last = std::lower_bound(capacities.begin() + p_first + 1, capacities.end(),
+                capacities[p_first] + p_needed) - capacities.begin() - 1;
+            unsigned long long seated = capacities[last] - capacities[p_first];
+            return prices[last] - prices[p_first] + (double)(p_needed - seated) * items[last].price / items[last].capacity;
+        }
+        void Branch(unsigned int p_first, double p_cost, unsigned long long p_capacity, unsigned int p_amenities) {
+            if (chosen.size() == request.maxRooms) return;
+            for (unsigned int i = p_first; i < items.size(); i++) {
+                if (++nodes > PLACEMENT_MAX_NODES) {
+                    isComplete = false;
+                    return;
+                }
+                if (((p_amenities | amenities[i]) & request.anyRoom) != request.anyRoom) return;
+                // .. Later items only seat people at higher prices
+                unsigned long long needed = request.attendees > p_capacity ? request.attendees - p_capacity : 0;
+                if (p_cost + Bound(i, needed) >= bestCost - 1e-9) return;
+                chosen.push_back(i);
+                double cost = p_cost + items[i].price;
+                unsigned long long capacity = p_capacity + items[i].capacity;
+                unsigned int amenitySet = p_amenities | items[i].amenities;
+                if (capacity >= request.attendees && (amenitySet & request.anyRoom) == request.anyRoom) {
+                    if (cost < bestCost - 1e-9) {
+                        bestCost = cost;
+                        best = chosen;
+                    }
+                } else Branch(i + 1, cost, capacity, amenitySet);
+                chosen.pop_back();
+                if (!isComplete) return;
+            }
+        }
+        // First placement: cheapest people first, then the cheapest space for each missing amenity,
+        // .. then spaces that are no longer needed are dropped, dearest first
+        void Greedy() {
+            std::vector<unsigned int> picked;
+            unsigned long long capacity = 0;
+            unsigned int amenitySet = 0;
+            for (unsigned int i = 0; i < items.size() && capacity < request.attendees; i++) {
+                picked.push_back(i);
+                capacity += items[i].capacity;
+                amenitySet |= items[i].amenities;
+            }
+            for (unsigned int bit = 1; bit != 0 && bit <= request.anyRoom; bit <<= 1) {
+                if (!(request.anyRoom & bit) || (amenitySet & bit)) continue;
+                int cheapest = -1;
+                for (unsigned int i = 0; i < items.size(); i++)
+                    if ((items[i].amenities & bit) && (cheapest < 0 || items[i].price < items[cheapest].price)
+                        && std::find(picked.begin(), picked.end(), i) == picked.end())
+                        cheapest = i;
+                if (cheapest < 0) return;
+                picked.push_back(cheapest);
+                capacity += items[cheapest].capacity;
+                amenitySet |= items[cheapest].amenities;
+            }
+            if (capacity < request.attendees) return;
+            std::sort(picked.begin(), picked.end(), [this](unsigned int p_a, unsigned int p_b) {
+                return items[p_a].price > items[p_b].price;
+            });
+            for (unsigned int i = 0; i < picked.size(); ) {
+                unsigned int rest = 0;
+                for (unsigned int j = 0; j < picked.size(); j++)
+                    if (j != i) rest |= items[picked[j]].amenities;
+                if (capacity - items[picked[i]].capacity >= request.attendees && (rest & request.anyRoom) == request.anyRoom) {
+                    capacity -= items[picked[i]].capacity;
+                    picked.erase(picked.begin() + i);
+                } else i++;
+            }
+            if (picked.size() > request.maxRooms) return;
+            double cost = 0;
+            for (unsigned int i: picked) cost += items[i].price;
+            if (cost < bestCost - 1e-9) {
+                bestCost = cost;
+                best = picked;
+            }
+        }
+    public:
+        // Constructors & destructors
+        // .. p_bestCost: cost to beat, e.g. of a placement at another start time
+        Search(const Request& p_request, std::vector<Item> p_items, double p_bestCost)
+            : request(p_request), items(std::move(p_items)), bestCost(p_bestCost) {
+            std::sort(items.begin(), items.end(), [](const Item& p_a, const Item& p_b) {
+                return p_a.price * p_b.capacity < p_b.price * p_a.capacity;
+            });
+            capacities.assign(items.size() + 1, 0);
+            prices.assign(items.size() + 1, 0);
+            amenities.assign(items.size() + 1, 0);
+            for (unsigned int i = 0; i < items.size(); i++) {
+                capacities[i + 1] = capacities[i] + items[i].capacity;
+                prices[i + 1] = prices[i] + items[i].price;
+            }
+            for (unsigned int i = items.size(); i-- > 0; )
+                amenities[i] = amenities[i + 1] | items[i].amenities;
+        }
+
+        // Interface
+        // Search for a placement cheaper than the cost to beat (returns whether one was found)
+        bool Run() {
+            if (items.empty() || capacities.back() < request.attendees
+                || (amenities[0] & request.anyRoom) != request.anyRoom) return false;
+            Greedy();
+            Branch(0, 0, 0, 0);
+            return !best.empty();
+        }
+
+        // Getters
+        bool IsComplete() const { return isComplete; }
+        unsigned long long GetNodeCount() const { return nodes; }
+        double GetCost() const { return bestCost; }
+        std::vector<Item> GetPlacement() const {
+            std::vector<Item> placement;
+            for (unsigned int i: best) placement.push_back(items[i]);
+            return placement;
+        }
+    };
+
+    // Utility functions
+    // Cheapest placement of p_request (returns whether there is one)
+    // .. Each space that could take part is reduced to the bit vector of the start times it is free at;
+    // .. start times where the spaces free together have room for everyone are then searched in order
+    inline bool Place(Space::SpaceManager& p_spaceManager, const Request& p_request, Plan& p_plan) {
+        p_plan = Plan();
+        if (p_request.hours == 0 || p_request.attendees == 0 || p_request.maxRooms == 0 || p_request.toTime < p_request.fromTime)
+            return false;
+        time_t toTime = std::min<time_t>(p_request.toTime,
+            p_request.fromTime + (time_t)(PLACEMENT_MAX_STARTS - 1) * Space::Time::SLOT_SECONDS);
+        struct Candidate {
+            unsigned int ID, capacity, amenities;
+            std::vector<unsigned long long> starts;
+        };
+        std::vector<Candidate> candidates;
+        unsigned long startWords = 0;
+        for (unsigned int ID = 0; ID < p_spaceManager.GetSpaceCount(); ID++) {
+            const Space::Space* space_ptr = p_spaceManager.ReadSpace(ID);
+            if (space_ptr == nullptr) continue;
+            unsigned int amenities = AmenitiesOf(*space_ptr);
+            int capacity = p_request.isSeated ? (int)space_ptr->seats.GetNumberOfSeats() : space_ptr->GetNumberOfPeople();
+            if (capacity <= 0 || (amenities & p_request.everyRoom) != p_request.everyRoom) continue;
+            std::vector<unsigned long long> starts = space_ptr->timer.FreeStarts(p_request.fromTime, toTime, p_request.hours);
+            if (std::all_of(starts.begin(), starts.end(), [](unsigned long long p_word) { return p_word == 0; })) continue;
+            startWords = std::max<unsigned long>(startWords, starts.size());
+            candidates.push_back(Candidate{ID, (unsigned int)capacity, amenities, std::move(starts)});
+        }
+        double bestCost = std::numeric_limits<double>::infinity();
+        for (unsigned long start = 0; start < startWords * 64; start++) {
+            // Spaces free together at this start
+            unsigned long long capacity = 0;
+            unsigned int amenities = 0;
+            std::vector<const Candidate*> free;
+            for (const Candidate& candidate: candidates)
+                if (start / 64 < candidate.starts.size() && (candidate.starts[start / 64] >> (start % 64) & 1)) {
+                    free.push_back(&candidate);
+                    capacity += candidate.capacity;
+                    amenities |= candidate.amenities;
+                }
+            if (capacity < p_request.attendees || (amenities & p_request.anyRoom) != p_request.anyRoom) continue;
+            time_t startTime = p_request.fromTime + (time_t)start * Space::Time::SLOT_SECONDS;
+            time_t endTime = startTime + (time_t)p_request.hours * 3600;
+            std::vector<Search::Item> items;
+            for (const Candidate* candidate_ptr: free) {
+                double price;
+                if (p_spaceManager.ReadSpace(candidate_ptr->ID)->timer.Quote(startTime, endTime - Space::Time::SLOT_SECONDS, price))
+                    items.push_back(Search::Item{candidate_ptr->ID, candidate_ptr->capacity, candidate_ptr->amenities, price});
+            }
+            Search search(p_request, std::move(items), bestCost);
+            bool isFound = search.Run();
+            p_plan.nodes += search.GetNodeCount();
+            if (!search.IsComplete()) p_plan.isOptimal = false;
+            if (!isFound) continue;
+            bestCost = search.GetCost();
+            p_plan.startTime = startTime;
+            p_plan.endTime = endTime;
+            p_plan.rooms.clear();
+            p_plan.capacity = 0;
+            for (const Search::Item& item: search.GetPlacement()) {
+                p_plan.rooms.push_back(Plan::Room{item.ID, item.capacity, item.price});
+                p_plan.capacity += item.capacity;
+            }
+            p_plan.cost = bestCost;
+        }
+        return !p_plan.rooms.empty();
+    }
+    // Reserve every space of a plan, or none
+    // .. If any space cannot be reserved anymore, the ones already reserved are released again
+    // .. Prices & cost are updated to the ones charged
+    inline bool Commit(Space::SpaceManager& p_spaceManager, Plan& p_plan) {
+        unsigned int reserved = 0;
+        for (; reserved < p_plan.rooms.size(); reserved++) {
+            Space::Space* space_ptr = p_spaceManager.GetSpace(p_plan.rooms[reserved].ID);
+            double price;
+            if (space_ptr == nullptr || !space_ptr->timer.AddReservation(p_plan.startTime, p_plan.endTime - Space::Time::SLOT_SECONDS, price))
+                break;
+            p_plan.rooms[reserved].price = price;
+        }
+        if (reserved == p_plan.rooms.size()) {
+            p_plan.cost = 0;
+            for (const Plan::Room& room: p_plan.rooms) p_plan.cost += room.price;
+            return true;
+        }
+        while (reserved-- > 0)
+            p_spaceManager.GetSpace(p_plan.rooms[reserved].ID)->timer.RemoveReservation(
+                p_plan.startTime, p_plan.endTime - Space::Time::SLOT_SECONDS);
+        return false;
+    }
+}
+
+#endif
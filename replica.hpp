@@ -0,0 +1,343 @@
+#ifndef REPLICA_HPP
+#define REPLICA_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstring>
+
+// POSIX sockets
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Checksummed record lines
+#include "storage.hpp"
+
+// Random hidden socket followers connect to by default
+#define REPLICA_SOCKET "magical.replica"
+// Seconds a follower may block a send before it is dropped (it then reconnects & starts over)
+#define REPLICA_SEND_TIMEOUT 5
+// Seconds between attempts of a follower to (re)connect
+#define REPLICA_RETRY 1
+// Milliseconds the background threads sleep at most before checking for new followers or a stop
+#define REPLICA_POLL 100
+
+// Change log shipping to read-only replicas on the same host
+// .. The writing process publishes batches of changed objects on a local (Unix domain) socket,
+// .. followers apply them to their own managers
+// .. Wire format: checksummed record lines (Storage::EncodeRecord), each batch ended by a commit
+// .. record carrying its sequence number: followers apply whole batches only
+namespace Replica {
+    // Changes captured on the session thread
+    // .. encode runs on the publishing thread: it appends record lines of the batch to its argument
+    // .. and returns true while more follow, so that images go out in pieces
+    struct Batch {
+        std::function<bool(std::string&)> encode;
+        // Full state: followers drop what they hold first
+        bool isImage = false;
+    };
+
+    // Send a whole buffer, false if the follower is gone or stuck
+    inline bool SendAll(int p_fd, const std::string& p_data) {
+        size_t sent = 0;
+        while (sent < p_data.size()) {
+            ssize_t count = send(p_fd, p_data.data() + sent, p_data.size() - sent, MSG_NOSIGNAL);
+            if (count <= 0) return false;
+            sent += count;
+        }
+        return true;
+    }
+    inline bool SetAddress(const std::string& p_path, sockaddr_un& p_address) {
+        if (p_path.empty() || p_path.size() >= sizeof(p_address.sun_path)) return false;
+        memset(&p_address, 0, sizeof(p_address));
+        p_address.sun_family = AF_UNIX;
+        strcpy(p_address.sun_path, p_path.c_str());
+        return true;
+    }
+
+    // Class for the publishing side, owned by the session thread of the writing process
+    // .. Ticked from the session thread, which captures every batch: encoding & sending run on a
+    // .. background thread, so slow followers never hold up the writer
+    // .. Joining followers start with an image of the whole state, then get every later batch
+    class Publisher {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool isRunning = false;
+        std::string path;
+        int listenFd = -1;
+        // Batches to send (guarded by mutex)
+        std::deque<Batch> queue;
+        // Followers accepted so far, & the ones connected now (written by the publishing thread)
+        std::atomic<unsigned long long> joins{0};
+        std::atomic<unsigned int> followerCount{0};
+
+        // Publishing thread only
+        // .. Followers wait for the next image before they get any change
+        std::vector<int> followers, waiting;
+        unsigned long long sequence = 0;
+
+        // Session thread only
+        std::function<Batch()> captureImage;
+        std::function<Batch(bool)> captureChanges;
+        unsigned long long imageJoins = 0;
+        bool isResyncDue = false;
+        unsigned long long batches = 0;
+
+        void Accept() {
+            while (true) {
+                int fd = accept(listenFd, nullptr, nullptr);
+                if (fd < 0) return;
+                timeval timeout{REPLICA_SEND_TIMEOUT, 0};
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                waiting.push_back(fd);
+                joins++;
+            }
+        }
+        // Send to every follower in p_fds, dropping the ones that fail
+        static void Send(std::vector<int>& p_fds, const std::string& p_data) {
+            for (auto i = p_fds.begin(); i != p_fds.end(); ) {
+                if (SendAll(*i, p_data)) {
+                    i++;
+                    continue;
+                }
+                close(*i);
+                i = p_fds.erase(i);
+            }
+        }
+        void Run() {
+            Trace::SetThreadName("replica");
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wakeUp.wait_for(lock, std::chrono::milliseconds(REPLICA_POLL),
+                    [this]() { return !isRunning || !queue.empty(); });
+                bool isStopping = !isRunning;
+                std::deque<Batch> tmp_queue;
+                tmp_queue.swap(queue);
+                lock.unlock();
+                Accept();
+                for (Batch& batch: tmp_queue) {
+                    Trace::Span span("PublishBatch", "replica");
+                    if (batch.isImage) {
+                        followers.insert(followers.end(), waiting.begin(), waiting.end());
+                        waiting.clear();
+                    }
+                    bool isMore = true;
+                    while (isMore) {
+                        std::string lines;
+                        isMore = batch.encode(lines);
+                        if (!isMore) lines += Storage::EncodeRecord({{"op", "commit"}, {"sequence", ++sequence}});
+                        Send(followers, lines);
+                    }
+                }
+                followerCount = followers.size() + waiting.size();
+                lock.lock();
+                if (isStopping && queue.empty()) return;
+            }
+        }
+    public:
+        // Constructors & destructors
+        Publisher() {}
+        Publisher(const Publisher&) = delete;
+        Publisher& operator=(const Publisher&) = delete;
+        ~Publisher() { Stop(); }
+
+        // Setters
+        // Listen on p_path (a stale socket file is replaced)
+        // .. p_image captures the whole state; p_changes the changes since its last call,
+        // .. and is called every tick so that changes never pile up (p_isWanted is false when nobody follows)
+        bool Start(const std::string& p_path, std::function<Batch()> p_image, std::function<Batch(bool)> p_changes) {
+            Stop();
+            sockaddr_un address;
+            if (!SetAddress(p_path, address)) return false;
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return false;
+            unlink(p_path.c_str());
+            if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 16) != 0
+                || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+                close(fd);
+                return false;
+            }
+            path = p_path;
+            listenFd = fd;
+            captureImage = std::move(p_image);
+            captureChanges = std::move(p_changes);
+            imageJoins = 0;
+            isResyncDue = false;
+            joins = 0;
+            isRunning = true;
+            thread = std::thread([this]() { Run(); });
+            return true;
+        }
+        // Send what is queued, then disconnect every follower
+        void Stop() {
+            if (!isRunning) return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isRunning = false;
+            }
+            wakeUp.notify_all();
+            thread.join();
+            for (int fd: followers) close(fd);
+            for (int fd: waiting) close(fd);
+            followers.clear();
+            waiting.clear();
+            followerCount = 0;
+            close(listenFd);
+            listenFd = -1;
+            unlink(path.c_str());
+        }
+        // Send an image to every follower on the next tick, e.g. after loading another catalog
+        void Resync() { isResyncDue = true; }
+
+        // Getters
+        bool IsRunning() const { return isRunning; }
+        const std::string& GetPath() const { return path; }
+        unsigned int GetFollowerCount() const { return followerCount; }
+        // Batches published so far, images included
+        unsigned long long GetBatchCount() const { return batches; }
+
+        // Interface
+        // Publish the changes since the last tick, or an image if a follower joined
+        // .. Cheap enough to call before every prompt
+        void Tick() {
+            if (!isRunning) return;
+            unsigned long long tmp_joins = joins;
+            bool isImageDue = isResyncDue || tmp_joins != imageJoins;
+            Batch batch = captureChanges(!isImageDue && followerCount != 0);
+            if (isImageDue) {
+                // .. The image holds these changes too
+                batch = captureImage();
+                batch.isImage = true;
+                imageJoins = tmp_joins;
+                isResyncDue = false;
+            }
+            if (!batch.encode) return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(std::move(batch));
+            }
+            batches++;
+            wakeUp.notify_all();
+        }
+    };
+
+    // Class for the following side
+    // .. A background thread keeps connected (retrying every REPLICA_RETRY seconds) & collects
+    // .. committed batches; the session thread takes them and applies them to its own managers
+    class Follower {
+        std::thread thread;
+        std::mutex mutex;
+        std::atomic<bool> isRunning{false};
+        std::atomic<bool> isConnected{false};
+        std::string path;
+        // Records of committed batches not taken yet (guarded by mutex)
+        nljs::json ready = nljs::json::array();
+        unsigned long long readySequence = 0;
+        // Session thread only
+        unsigned long long sequence = 0;
+
+        int Connect() {
+            sockaddr_un address;
+            if (!SetAddress(path, address)) return -1;
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return -1;
+            if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        // Read batches until the publisher is gone, a record is damaged or the follower stops
+        void Receive(int p_fd) {
+            std::string buffer;
+            nljs::json batch = nljs::json::array();
+            char chunk[65536];
+            while (isRunning) {
+                pollfd entry{p_fd, POLLIN, 0};
+                if (poll(&entry, 1, REPLICA_POLL) <= 0) continue;
+                ssize_t count = recv(p_fd, chunk, sizeof(chunk), 0);
+                if (count <= 0) return;
+                buffer.append(chunk, count);
+                size_t begin = 0, end;
+                while ((end = buffer.find('\n', begin)) != std::string::npos) {
+                    nljs::json jrecord;
+                    if (!Storage::DecodeRecord(buffer.substr(begin, end - begin), jrecord)) return;
+                    begin = end + 1;
+                    if (jrecord["op"] != "commit") {
+                        batch.push_back(std::move(jrecord));
+                        continue;
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (auto& jchange: batch) ready.push_back(std::move(jchange));
+                    readySequence = jrecord["sequence"];
+                    batch = nljs::json::array();
+                }
+                buffer.erase(0, begin);
+            }
+        }
+        void Run() {
+            Trace::SetThreadName("follower");
+            while (isRunning) {
+                int fd = Connect();
+                if (fd >= 0) {
+                    isConnected = true;
+                    Receive(fd);
+                    isConnected = false;
+                    close(fd);
+                }
+                // .. Retry in short steps so that stopping stays quick
+                for (unsigned int i = 0; isRunning && i < REPLICA_RETRY * 1000 / REPLICA_POLL; i++)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(REPLICA_POLL));
+            }
+        }
+    public:
+        // Constructors & destructors
+        Follower() {}
+        Follower(const Follower&) = delete;
+        Follower& operator=(const Follower&) = delete;
+        ~Follower() { Stop(); }
+
+        // Setters
+        void Start(const std::string& p_path = REPLICA_SOCKET) {
+            Stop();
+            path = p_path;
+            isRunning = true;
+            thread = std::thread([this]() { Run(); });
+        }
+        void Stop() {
+            if (!isRunning) return;
+            isRunning = false;
+            thread.join();
+        }
+
+        // Getters
+        bool IsConnected() const { return isConnected; }
+        const std::string& GetPath() const { return path; }
+        // Sequence number of the last batch taken
+        unsigned long long GetSequence() const { return sequence; }
+
+        // Interface
+        // Records of every batch committed since the last call, in order
+        // .. Each is {"op": "image", "spaces": <size>, "users": <size>}, {"op": "space", "ID", "space"}
+        // .. (space null once deleted) or {"op": "user", "ID", "user"}
+        nljs::json Take() {
+            nljs::json records = nljs::json::array();
+            std::lock_guard<std::mutex> lock(mutex);
+            records.swap(ready);
+            sequence = readySequence;
+            return records;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,338 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+
+// Weights of the indexed fields: a word in a name counts as 3 in a review
+#define SEARCH_NAME_WEIGHT 3
+#define SEARCH_TAG_WEIGHT 2
+#define SEARCH_REVIEW_WEIGHT 1
+
+// Postings between skip entries of a posting list
+#define SEARCH_SKIP_BLOCK 64
+
+// Full-text search over space names, tags & reviews
+// .. Inverted index of compressed posting lists, ranked with BM25
+namespace Search {
+    // Utility functions
+    // Split text into lowercase words, without stop words & plural endings
+    inline std::vector<std::string> Tokenize(std::string_view p_text) {
+        static const std::unordered_set<std::string> stopWords = {
+            "a", "an", "and", "are", "as", "at", "be", "but", "by", "for", "from", "has", "have",
+            "in", "is", "it", "of", "on", "or", "so", "the", "to", "too", "was", "with", "would"
+        };
+        std::vector<std::string> tokens;
+        std::string token;
+        for (unsigned int i = 0; i <= p_text.size(); i++) {
+            unsigned char c = i < p_text.size() ? p_text[i] : ' ';
+            if (std::isalnum(c)) {
+                token.push_back(std::tolower(c));
+                continue;
+            }
+            if (token.size() > 3 && token.back() == 's' && token[token.size() - 2] != 's'
+                && token[token.size() - 2] != 'u' && token[token.size() - 2] != 'i')
+                token.pop_back();
+            if (token.size() > 1 && stopWords.count(token) == 0)
+                tokens.push_back(token);
+            token.clear();
+        }
+        return tokens;
+    }
+
+    // Search result
+    struct Result {
+        unsigned int ID;
+        double score;
+    };
+
+    // Class for the documents holding one term
+    // .. IDs ascending, stored as variable length (ID delta, weight) pairs
+    // .. Appending a higher ID is the fast path, anything else rewrites the list
+    // .. A skip entry every SEARCH_SKIP_BLOCK postings lets readers jump ahead without decoding
+    class PostingList {
+    private:
+        // Start of a block: its first ID, the ID before it (delta base) & its byte offset
+        struct Skip {
+            unsigned int firstID, baseID, offset;
+        };
+        std::vector<unsigned char> bytes;
+        std::vector<Skip> skips;
+        unsigned int count = 0, lastID = 0, maxWeight = 0;
+
+        static void PutVarint(std::vector<unsigned char>& p_bytes, unsigned int p_value) {
+            while (p_value >= 0x80) {
+                p_bytes.push_back((unsigned char)(p_value | 0x80));
+                p_value >>= 7;
+            }
+            p_bytes.push_back((unsigned char)p_value);
+        }
+        static unsigned int GetVarint(const unsigned char*& p_byte) {
+            unsigned int value = 0;
+            for (unsigned int shift = 0;; shift += 7) {
+                unsigned char byte = *p_byte++;
+                value |= (unsigned int)(byte & 0x7F) << shift;
+                if (byte < 0x80) return value;
+            }
+        }
+        void Append(unsigned int p_ID, unsigned int p_weight) {
+            if (count % SEARCH_SKIP_BLOCK == 0)
+                skips.push_back(Skip{p_ID, count == 0 ? 0 : lastID, (unsigned int)bytes.size()});
+            PutVarint(bytes, count == 0 ? p_ID : p_ID - lastID);
+            PutVarint(bytes, p_weight);
+            lastID = p_ID;
+            maxWeight = std::max(maxWeight, p_weight);
+            count++;
+        }
+        std::vector<std::pair<unsigned int, unsigned int>> Decode() const {
+            std::vector<std::pair<unsigned int, unsigned int>> postings;
+            postings.reserve(count);
+            ForEach([&postings](unsigned int p_ID, unsigned int p_weight) { postings.emplace_back(p_ID, p_weight); });
+            return postings;
+        }
+        void Encode(const std::vector<std::pair<unsigned int, unsigned int>>& p_postings) {
+            bytes.clear();
+            skips.clear();
+            count = 0;
+            lastID = 0;
+            maxWeight = 0;
+            for (const auto& posting: p_postings)
+                if (posting.second != 0) Append(posting.first, posting.second);
+            bytes.shrink_to_fit();
+            skips.shrink_to_fit();
+        }
+    public:
+        // Class to decode postings one at a time, in ID order
+        class Reader {
+        private:
+            const PostingList* list;
+            const unsigned char* byte;
+            // Postings decoded so far
+            unsigned int position = 0;
+            bool isDone = false;
+        public:
+            unsigned int ID = 0, weight = 0;
+            Reader(const PostingList& p_list) : list(&p_list), byte(p_list.bytes.data()) { Next(); }
+            bool IsDone() const { return isDone; }
+            void Next() {
+                if (position == list->count) {
+                    isDone = true;
+                    return;
+                }
+                // .. The first ID is a delta from 0
+                ID += GetVarint(byte);
+                weight = GetVarint(byte);
+                position++;
+            }
+            // Move to the first document with an ID of at least p_ID
+            // .. Whole blocks before it are skipped through the skip entries
+            void SkipTo(unsigned int p_ID) {
+                if (isDone || ID >= p_ID) return;
+                auto it = std::upper_bound(list->skips.begin() + (position - 1) / SEARCH_SKIP_BLOCK + 1,
+                    list->skips.end(), p_ID, [](unsigned int id, const Skip& skip) { return id < skip.firstID; });
+                if (it != list->skips.begin() + (position - 1) / SEARCH_SKIP_BLOCK + 1) {
+                    --it;
+                    ID = it->baseID;
+                    byte = list->bytes.data() + it->offset;
+                    position = (it - list->skips.begin()) * SEARCH_SKIP_BLOCK;
+                    Next();
+                }
+                while (!isDone && ID < p_ID) Next();
+            }
+        };
+
+        // Getters
+        unsigned int GetCount() const { return count; }
+        unsigned int GetMaxWeight() const { return maxWeight; }
+        unsigned long GetBytes() const { return bytes.capacity() + skips.capacity() * sizeof(Skip); }
+        // Call p_visit(ID, weight) for each document, in ID order
+        template <typename F>
+        void ForEach(F p_visit) const {
+            for (Reader reader(*this); !reader.IsDone(); reader.Next())
+                p_visit(reader.ID, reader.weight);
+        }
+
+        // Setters
+        // Add p_weight occurrences of the term to a document
+        void Add(unsigned int p_ID, unsigned int p_weight) {
+            if (count == 0 || p_ID > lastID) {
+                Append(p_ID, p_weight);
+                return;
+            }
+            auto postings = Decode();
+            auto it = std::lower_bound(postings.begin(), postings.end(), std::make_pair(p_ID, 0u));
+            if (it != postings.end() && it->first == p_ID) it->second += p_weight;
+            else postings.insert(it, std::make_pair(p_ID, p_weight));
+            Encode(postings);
+        }
+        // Remove p_weight occurrences, and the document once none is left
+        void Remove(unsigned int p_ID, unsigned int p_weight) {
+            auto postings = Decode();
+            auto it = std::lower_bound(postings.begin(), postings.end(), std::make_pair(p_ID, 0u));
+            if (it == postings.end() || it->first != p_ID) return;
+            it->second -= std::min(it->second, p_weight);
+            Encode(postings);
+        }
+    };
+
+    // Class for the inverted index
+    // .. Documents are space IDs, each made of weighted text fields
+    class Index {
+    private:
+        std::unordered_map<std::string, PostingList> terms;
+        // Weighted length of each document, for BM25 length normalization
+        std::vector<unsigned int> lengths;
+        unsigned int documentCount = 0;
+        unsigned long long totalLength = 0;
+
+        // Weighted term counts of some fields
+        static std::unordered_map<std::string, unsigned int> Count(
+            const std::vector<std::pair<std::string_view, unsigned int>>& p_fields) {
+            std::unordered_map<std::string, unsigned int> counts;
+            for (const auto& field: p_fields)
+                for (const std::string& token: Tokenize(field.first))
+                    counts[token] += field.second;
+            return counts;
+        }
+        void AddCounts(unsigned int p_ID, const std::unordered_map<std::string, unsigned int>& p_counts) {
+            if (lengths.size() <= p_ID) lengths.resize(p_ID + 1, 0);
+            for (const auto& count: p_counts) {
+                terms[count.first].Add(p_ID, count.second);
+                lengths[p_ID] += count.second;
+                totalLength += count.second;
+            }
+        }
+    public:
+        // Setters
+        void Clear() {
+            terms.clear();
+            lengths.clear();
+            documentCount = 0;
+            totalLength = 0;
+        }
+        // Index a document from its (text, weight) fields
+        void AddDocument(unsigned int p_ID, const std::vector<std::pair<std::string_view, unsigned int>>& p_fields) {
+            AddCounts(p_ID, Count(p_fields));
+            documentCount++;
+        }
+        // Unindex a document, given the same fields it holds in the index
+        void RemoveDocument(unsigned int p_ID, const std::vector<std::pair<std::string_view, unsigned int>>& p_fields) {
+            for (const auto& count: Count(p_fields)) {
+                auto it = terms.find(count.first);
+                if (it == terms.end()) continue;
+                it->second.Remove(p_ID, count.second);
+                if (it->second.GetCount() == 0) terms.erase(it);
+            }
+            if (p_ID < lengths.size()) {
+                totalLength -= lengths[p_ID];
+                lengths[p_ID] = 0;
+            }
+            if (documentCount != 0) documentCount--;
+        }
+        // Add text to an indexed document, e.g. a new review
+        void AddText(unsigned int p_ID, std::string_view p_text, unsigned int p_weight) {
+            AddCounts(p_ID, Count({{p_text, p_weight}}));
+        }
+
+        // Getters
+        unsigned int GetDocumentCount() const { return documentCount; }
+        unsigned int GetTermCount() const { return terms.size(); }
+        // Bytes held by posting lists
+        unsigned long GetBytes() const {
+            unsigned long bytes = 0;
+            for (const auto& term: terms) bytes += term.second.GetBytes();
+            return bytes;
+        }
+
+        // Interface
+        // Up to p_maxResults documents ranked by BM25 over the query words
+        // .. Any word may match; documents matching more & rarer words rank first
+        // .. Posting lists of the query are decoded & merged in ID order, so no per-document table is needed
+        // .. MaxScore: once the results are full, words whose best possible scores add up to no more than
+        // .. the worst result cannot bring in new documents, so they are only looked up (SkipTo)
+        // .. for documents found through the other words, and only while they could still make the results
+        std::vector<Result> Query(const std::string& p_query, unsigned int p_maxResults = 10) const {
+            const double k1 = 1.2, b = 0.75;
+            double averageLength = documentCount == 0 ? 1 : std::max(1.0, (double)totalLength / documentCount);
+            struct Cursor {
+                PostingList::Reader reader;
+                double idf;
+                // Highest possible score of the word, then summed over this & all lower cursors
+                double bound;
+            };
+            std::vector<Cursor> cursors;
+            std::vector<std::string> tokens = Tokenize(p_query);
+            std::sort(tokens.begin(), tokens.end());
+            tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+            for (const std::string& token: tokens) {
+                auto it = terms.find(token);
+                if (it == terms.end()) continue;
+                double frequency = it->second.GetCount();
+                double idf = std::log(1 + (documentCount - frequency + 0.5) / (frequency + 0.5));
+                // .. Heaviest posting in the shortest possible document
+                double weight = it->second.GetMaxWeight();
+                cursors.push_back(Cursor{PostingList::Reader(it->second), idf,
+                    idf * weight * (k1 + 1) / (weight + k1 * (1 - b))});
+            }
+            std::sort(cursors.begin(), cursors.end(), [](const Cursor& a, const Cursor& b) { return a.bound < b.bound; });
+            for (unsigned int i = 1; i < cursors.size(); i++)
+                cursors[i].bound += cursors[i - 1].bound;
+            // Keep the best results in a min-heap
+            auto IsBetter = [](const Result& a, const Result& b) {
+                return a.score > b.score || (a.score == b.score && a.ID < b.ID);
+            };
+            std::vector<Result> results;
+            if (p_maxResults == 0) return results;
+            // Cursors below firstEssential are only looked up
+            unsigned int firstEssential = 0;
+            while (true) {
+                unsigned int ID = (unsigned int)-1;
+                for (unsigned int i = firstEssential; i < cursors.size(); i++)
+                    if (!cursors[i].reader.IsDone()) ID = std::min(ID, cursors[i].reader.ID);
+                if (ID == (unsigned int)-1) break;
+                double norm = k1 * (1 - b + b * (ID < lengths.size() ? lengths[ID] : 0) / averageLength);
+                auto Score = [&](const PostingList::Reader& p_reader, double p_idf) {
+                    double frequency = p_reader.weight;
+                    return p_idf * frequency * (k1 + 1) / (frequency + norm);
+                };
+                Result result{ID, 0};
+                for (unsigned int i = firstEssential; i < cursors.size(); i++) {
+                    PostingList::Reader& reader = cursors[i].reader;
+                    if (!reader.IsDone() && reader.ID == ID) {
+                        result.score += Score(reader, cursors[i].idf);
+                        reader.Next();
+                    }
+                }
+                // .. Later IDs lose ties, so a document has to beat the worst result strictly
+                bool isFull = results.size() == p_maxResults;
+                for (unsigned int i = firstEssential; i-- > 0;) {
+                    if (isFull && result.score + cursors[i].bound <= results.front().score) break;
+                    PostingList::Reader& reader = cursors[i].reader;
+                    reader.SkipTo(ID);
+                    if (!reader.IsDone() && reader.ID == ID) result.score += Score(reader, cursors[i].idf);
+                }
+                if (!isFull) {
+                    results.push_back(result);
+                    std::push_heap(results.begin(), results.end(), IsBetter);
+                } else if (IsBetter(result, results.front())) {
+                    std::pop_heap(results.begin(), results.end(), IsBetter);
+                    results.back() = result;
+                    std::push_heap(results.begin(), results.end(), IsBetter);
+                } else continue;
+                if (results.size() == p_maxResults)
+                    while (firstEssential < cursors.size() && cursors[firstEssential].bound <= results.front().score)
+                        firstEssential++;
+            }
+            std::sort_heap(results.begin(), results.end(), IsBetter);
+            return results;
+        }
+    };
+}
+
+#endif
@@ -8,6 +8,19 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <random>
+#include <functional>
+#include <array>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <future>
 
 // JSON library courtesy of:
 // https://github.com/nlohmann/json
@@ -15,6 +28,34 @@
 namespace nljs = nlohmann;
 // Random hidden file
 #define SPACE_FILE "magical.file"
+// Background export file
+#define EXPORT_FILE "magical.export"
+
+// Sharded storage helpers
+#include "storage.hpp"
+// Latency instrumentation
+#include "metrics.hpp"
+// Full-text search
+#include "search.hpp"
+// Pooled text
+#include "intern.hpp"
+// Field descriptors for the serializers
+#include "codec.hpp"
+// Copy-on-write snapshots
+#include "mvcc.hpp"
+// Query result caches
+#include "cache.hpp"
+// Memory accounting
+#include "memory.hpp"
+
+// Months covered by the tariff prefix tables (1970 - 2199)
+// .. Later months are still quoted, one month at a time
+#define TARIFF_MONTHS (230 * 12)
+
+// Length of timetable slots in seconds: 900 (15 minutes), 1800 (30 minutes) or 3600 (1 hour)
+#ifndef EVIES_SLOT_SECONDS
+#define EVIES_SLOT_SECONDS 3600
+#endif
 
 // Bitwise helpers courtesy of:
 // https://stackoverflow.com/questions/62689/bitwise-indexing-in-c
@@ -30,7 +71,10 @@ namespace Space {
     private:
         float length = 0, width = 0, height = 0;
         float area = 0, aspectRatio = 0;
+        // Bumped on every change
+        unsigned long long version = 0;
         void UpdateAAR() {
+            version++;
             area = length * width;
             // Check for zero before division
             if (width * length != 0) {
@@ -63,6 +107,7 @@ namespace Space {
         }
         void SetHeight(float p_height) {
             height = p_height;
+            version++;
         }
         void SetDimensions(float p_length, float p_width, float p_height) {
             length = p_length;
@@ -77,6 +122,17 @@ namespace Space {
         float GetHeight() const { return height; }
         float GetArea() const { return area; }
         float GetAspectRatio() const { return aspectRatio; }
+        unsigned long long GetVersion() const { return version; }
+
+        // Serialization
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("length", &Dimensions::length),
+                Codec::Member("width", &Dimensions::width),
+                Codec::Member("height", &Dimensions::height)
+            );
+        }
+        void OnDecoded() { UpdateAAR(); }
     };
 
     // Class for seatings
@@ -89,6 +145,8 @@ namespace Space {
         bool surround = false;
         // For if the chairs are not cheap plastic
         bool comfy = true;
+        // Bumped on every change
+        unsigned long long version = 0;
     public:
         // Constructors & destructors
         Seating() {}
@@ -99,155 +157,951 @@ namespace Space {
             comfy = p_comfy;
         }
         // Setters
-        void SetNumberOfSeats(unsigned int p_numberOfSeats) { numberOfSeats = p_numberOfSeats; }
+        void SetNumberOfSeats(unsigned int p_numberOfSeats) { numberOfSeats = p_numberOfSeats; version++; }
         // Setters using overload
-        void IsSlanted(bool p_slanted) { slanted = p_slanted; }
-        void IsSurround(bool p_surround) { surround = p_surround; }
-        void IsComfy(bool p_comfy) { comfy = p_comfy; }
+        void IsSlanted(bool p_slanted) { slanted = p_slanted; version++; }
+        void IsSurround(bool p_surround) { surround = p_surround; version++; }
+        void IsComfy(bool p_comfy) { comfy = p_comfy; version++; }
 
         // Getters
         bool IsSlanted() const { return slanted; }
         bool IsSurround() const { return surround; }
         bool IsComfy() const {return comfy; }
         unsigned int GetNumberOfSeats() const { return numberOfSeats; }
+        unsigned long long GetVersion() const { return version; }
+
+        // Serialization
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("numberOfSeats", &Seating::numberOfSeats),
+                Codec::Member("slanted", &Seating::slanted),
+                Codec::Member("surround", &Seating::surround),
+                Codec::Member("comfy", &Seating::comfy)
+            );
+        }
+    };
+
+    // Calendar helpers (UTC, days & hours since the epoch) courtesy of:
+    // https://howardhinnant.github.io/date_algorithms.html
+    inline long long DaysFromCivil(long long y, unsigned int m, unsigned int d) {
+        y -= m <= 2;
+        long long era = (y >= 0 ? y : y - 399) / 400;
+        unsigned int yoe = (unsigned int)(y - era * 400);
+        unsigned int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (long long)doe - 719468;
+    }
+    // Months since Jan 1970 of a day
+    inline long long MonthOfDay(long long p_day) {
+        p_day += 719468;
+        long long era = (p_day >= 0 ? p_day : p_day - 146096) / 146097;
+        unsigned int doe = (unsigned int)(p_day - era * 146097);
+        unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned int mp = (5 * doy + 2) / 153;
+        unsigned int m = mp < 10 ? mp + 3 : mp - 9;
+        long long y = (long long)yoe + era * 400 + (m <= 2);
+        return (y - 1970) * 12 + m - 1;
+    }
+    inline long long MonthStartHour(long long p_month) {
+        long long year = p_month >= 0 ? p_month / 12 : (p_month - 11) / 12;
+        return DaysFromCivil(1970 + year, p_month - year * 12 + 1, 1) * 24;
+    }
+    // Weeks from Monday 29 Dec 1969 of a day (1 Jan 1970 was a Thursday)
+    inline long long WeekOfDay(long long p_day) {
+        return p_day + 3 >= 0 ? (p_day + 3) / 7 : (p_day + 3 - 6) / 7;
+    }
+    inline long long WeekStartHour(long long p_week) { return (p_week * 7 - 3) * 24; }
+
+    // Class for time-varying hourly rates
+    // .. Multipliers on the base price per hour: peak hours of the day, weekends & months (seasons)
+    // .. Hours are UTC, counted from the Unix epoch
+    // .. Prefix sums over the week and over months quote any range in O(1)
+    // .. Tariffs with the same rules share one table, however they were made (see SharedTables)
+    class Tariff {
+    private:
+        // Peak hours of the day [peakStart, peakEnd), wrapping past midnight if peakStart > peakEnd
+        unsigned int peakStart = 0, peakEnd = 0;
+        double peakRate = 1, weekendRate = 1;
+        // Rates per month, January first
+        std::array<double, 12> seasonRates{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+        // Prefix sums of the multipliers
+        struct Tables {
+            // .. weekly[i]: sum over the first i hours of a week, from Monday 00:00
+            std::array<double, 7 * 24 + 1> weekly;
+            // .. monthly[m]: sum from 1 Jan 1970 to the start of month m
+            std::vector<double> monthly;
+        };
+        // .. Immutable & shared between tariffs with the same rules, null for a flat tariff
+        std::shared_ptr<const Tables> tables;
+        // Rules a table is built from: peak hours (if any), peak, weekend & season rates
+        using Rules = std::tuple<unsigned int, unsigned int, double, double, std::array<double, 12>>;
+
+        bool IsPeak(unsigned int p_hour) const {
+            if (peakStart <= peakEnd) return p_hour >= peakStart && p_hour < peakEnd;
+            return p_hour >= peakStart || p_hour < peakEnd;
+        }
+        bool IsFlatRules() const {
+            if (weekendRate != 1 || (peakRate != 1 && peakStart != peakEnd)) return false;
+            for (double rate: seasonRates)
+                if (rate != 1) return false;
+            return true;
+        }
+        // Weekly pattern summed over [0, p_hour)
+        // .. 1 Jan 1970 was a Thursday: 72 hours after Monday 00:00
+        double WeekSum(long long p_hour) const {
+            long long shifted = p_hour + 72;
+            return (shifted / 168) * tables->weekly[168] + tables->weekly[shifted % 168] - tables->weekly[72];
+        }
+        // All multipliers summed over [0, p_hour)
+        double Sum(long long p_hour) const {
+            if (tables == nullptr || p_hour <= 0) return (double)p_hour;
+            long long month = MonthOfDay(p_hour / 24);
+            long long last = tables->monthly.size() - 1;
+            double sum = tables->monthly[std::min(month, last)];
+            for (long long m = last; m < month; m++)
+                sum += seasonRates[m % 12] * (WeekSum(MonthStartHour(m + 1)) - WeekSum(MonthStartHour(m)));
+            return sum + seasonRates[month % 12] * (WeekSum(p_hour) - WeekSum(MonthStartHour(month)));
+        }
+        // Build the prefix sums of the current rules
+        std::shared_ptr<const Tables> BuildTables() {
+            std::shared_ptr<Tables> tmp_tables = std::make_shared<Tables>();
+            tmp_tables->weekly[0] = 0;
+            for (unsigned int i = 0; i < 168; i++) {
+                double rate = (IsPeak(i % 24) ? peakRate : 1) * (i / 24 >= 5 ? weekendRate : 1);
+                tmp_tables->weekly[i + 1] = tmp_tables->weekly[i] + rate;
+            }
+            // .. WeekSum reads the weekly sums through tables
+            tables = tmp_tables;
+            tmp_tables->monthly.resize(TARIFF_MONTHS + 1);
+            tmp_tables->monthly[0] = 0;
+            for (long long m = 0; m < TARIFF_MONTHS; m++)
+                tmp_tables->monthly[m + 1] = tmp_tables->monthly[m] +
+                    seasonRates[m % 12] * (WeekSum(MonthStartHour(m + 1)) - WeekSum(MonthStartHour(m)));
+            return tmp_tables;
+        }
+        // Table of the current rules, built only if no live tariff holds one already
+        // .. Kept by weak pointers: a table is freed with the last tariff using it,
+        // .. and expired entries are swept once the cache has doubled since the last sweep
+        // .. Locked, since shards are loaded on parallel threads
+        std::shared_ptr<const Tables> SharedTables() {
+            static std::mutex mutex;
+            static std::map<Rules, std::weak_ptr<const Tables>> cache;
+            static size_t sweepSize = 16;
+            // .. Peak hours without a peak rate (or the other way round) change nothing
+            bool isPeak = peakRate != 1 && peakStart != peakEnd;
+            Rules rules{isPeak ? peakStart : 0, isPeak ? peakEnd : 0, isPeak ? peakRate : 1, weekendRate, seasonRates};
+            std::lock_guard<std::mutex> lock(mutex);
+            std::weak_ptr<const Tables>& entry = cache[rules];
+            std::shared_ptr<const Tables> shared = entry.lock();
+            if (shared != nullptr) return shared;
+            shared = BuildTables();
+            entry = shared;
+            if (cache.size() >= sweepSize) {
+                for (auto it = cache.begin(); it != cache.end(); )
+                    it = it->second.expired() ? cache.erase(it) : std::next(it);
+                sweepSize = std::max<size_t>(16, 2 * cache.size());
+            }
+            return shared;
+        }
+        // Rebuild prefix sums after a rule change
+        void Rebuild() {
+            tables = IsFlatRules() ? nullptr : SharedTables();
+        }
+    public:
+        // Constructors & destructors
+        Tariff() {}
+
+        // Setters
+        // .. Each setter looks its table up again: set every rule at once with SetRules
+        void SetRules(unsigned int p_peakStart, unsigned int p_peakEnd, double p_peakRate, double p_weekendRate,
+            const std::array<double, 12>& p_seasonRates) {
+            peakStart = p_peakStart % 24;
+            peakEnd = p_peakEnd % 24;
+            peakRate = p_peakRate;
+            weekendRate = p_weekendRate;
+            seasonRates = p_seasonRates;
+            Rebuild();
+        }
+        void SetPeak(unsigned int p_peakStart, unsigned int p_peakEnd, double p_peakRate) {
+            peakStart = p_peakStart % 24;
+            peakEnd = p_peakEnd % 24;
+            peakRate = p_peakRate;
+            Rebuild();
+        }
+        void SetWeekendRate(double p_weekendRate) { weekendRate = p_weekendRate; Rebuild(); }
+        // .. Month from 1 (January) to 12
+        void SetSeasonRate(unsigned int p_month, double p_rate) {
+            seasonRates[(p_month + 11) % 12] = p_rate;
+            Rebuild();
+        }
+
+        // Getters
+        bool IsFlat() const { return tables == nullptr; }
+        unsigned int GetPeakStart() const { return peakStart; }
+        unsigned int GetPeakEnd() const { return peakEnd; }
+        double GetPeakRate() const { return peakRate; }
+        double GetWeekendRate() const { return weekendRate; }
+        double GetSeasonRate(unsigned int p_month) const { return seasonRates[(p_month + 11) % 12]; }
+        // Prefix tables, once however many copies share them
+        void CountMemory(Memory::Report& p_report) const {
+            if (tables != nullptr) p_report.AddShared(Memory::TARIFFS, tables.get(), sizeof(Tables) + Memory::VectorBytes(tables->monthly));
+        }
+        // Sum of multipliers over hours [p_firstHour, p_lastHour), counted from the epoch
+        // .. Equals the number of hours for a flat tariff
+        double GetUnits(long long p_firstHour, long long p_lastHour) const {
+            return Sum(p_lastHour) - Sum(p_firstHour);
+        }
+
+        // Serialization
+        // .. Every rule may be left out, months missing from seasonRates keep a rate of 1
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("peakStart", &Tariff::peakStart, Codec::OPTIONAL),
+                Codec::Member("peakEnd", &Tariff::peakEnd, Codec::OPTIONAL),
+                Codec::Member("peakRate", &Tariff::peakRate, Codec::OPTIONAL),
+                Codec::Member("weekendRate", &Tariff::weekendRate, Codec::OPTIONAL),
+                Codec::Property<std::vector<double>>("seasonRates",
+                    [](const Tariff& p_tariff) { return std::vector<double>(p_tariff.seasonRates.begin(), p_tariff.seasonRates.end()); },
+                    [](Tariff& p_tariff, std::vector<double>&& p_rates) {
+                        for (unsigned int i = 0; i < 12 && i < p_rates.size(); i++) p_tariff.seasonRates[i] = p_rates[i];
+                    }, Codec::OPTIONAL)
+            );
+        }
+        void OnDecoded() {
+            peakStart %= 24;
+            peakEnd %= 24;
+            Rebuild();
+        }
+        nljs::json Serialize() const { return Codec::ToJson(*this); }
+        void Deserialize(const nljs::json& p_jtariff) {
+            *this = Tariff();
+            Codec::FromJson(p_jtariff, *this);
+        }
+        // Print some details to cmd line
+        void PrintTariff() const {
+            if (IsFlat()) return;
+            if (peakRate != 1 && peakStart != peakEnd)
+                std::cout << "Peak hours: " << peakStart << ":00 - " << peakEnd << ":00 (x" << peakRate << ")\n";
+            if (weekendRate != 1)
+                std::cout << "Weekends: x" << weekendRate << std::endl;
+            const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+            for (unsigned int i = 0; i < 12; i++)
+                if (seasonRates[i] != 1)
+                    std::cout << months[i] << ": x" << seasonRates[i] << std::endl;
+        }
+    };
+
+    // Class for booked slots rolled up per UTC day, week (from Monday) & month
+    // .. Days, weeks & months are counted from the epoch, stored from the first one tracked
+    class Rollups {
+    private:
+        long long firstDay = 0, firstWeek = 0, firstMonth = 0;
+        std::vector<unsigned char> days;
+        std::vector<unsigned short> weeks, months;
+
+        template <typename T>
+        static void Update(std::vector<T>& p_counts, long long p_index, int p_delta) {
+            if (p_counts.size() <= (unsigned long long)p_index) p_counts.resize(p_index + 1, 0);
+            p_counts[p_index] += p_delta;
+        }
+        template <typename T>
+        static unsigned int Get(const std::vector<T>& p_counts, long long p_index) {
+            if (p_index < 0 || (unsigned long long)p_index >= p_counts.size()) return 0;
+            return p_counts[p_index];
+        }
+    public:
+        // Constructors & destructors
+        Rollups() {}
+
+        // Setters
+        // Start over from a day
+        void Reset(long long p_firstDay) {
+            firstDay = p_firstDay;
+            firstWeek = WeekOfDay(firstDay);
+            firstMonth = MonthOfDay(firstDay);
+            days.clear();
+            weeks.clear();
+            months.clear();
+        }
+        // Count p_delta booked slots on a day
+        void Add(long long p_day, int p_delta) {
+            if (p_delta == 0 || p_day < firstDay) return;
+            Update(days, p_day - firstDay, p_delta);
+            Update(weeks, WeekOfDay(p_day) - firstWeek, p_delta);
+            Update(months, MonthOfDay(p_day) - firstMonth, p_delta);
+        }
+
+        // Getters
+        unsigned int GetDay(long long p_day) const { return Get(days, p_day - firstDay); }
+        unsigned int GetWeek(long long p_week) const { return Get(weeks, p_week - firstWeek); }
+        unsigned int GetMonth(long long p_month) const { return Get(months, p_month - firstMonth); }
+        unsigned long long GetBytes() const {
+            return Memory::VectorBytes(days) + Memory::VectorBytes(weeks) + Memory::VectorBytes(months);
+        }
+    };
+
+    // Recurring reservation rule
+    // .. count occurrences of duration seconds, one every period seconds from startTime
+    // .. Kept as one rule instead of count single reservations
+    struct Recurrence {
+        time_t startTime = 0;
+        time_t duration = 3600;
+        time_t period = 24 * 3600;
+        unsigned int count = 1;
+
+        Recurrence() {}
+        Recurrence(const time_t& p_startTime, time_t p_duration, time_t p_period, unsigned int p_count)
+            : startTime(p_startTime), duration(p_duration), period(p_period), count(p_count) {}
+
+        // Occurrences never overlap
+        bool IsValid() const { return duration > 0 && count != 0 && duration <= period; }
+        // Begin time of occurrence p_index, end time (exclusive) of the last one
+        time_t GetStartTime(unsigned int p_index) const { return startTime + (time_t)p_index * period; }
+        time_t GetEndTime() const { return GetStartTime(count - 1) + duration; }
+
+        // Print some details to cmd line
+        void PrintRecurrence() const {
+            time_t tmp_time = GetEndTime();
+            if (period == 24 * 3600) std::cout << "Daily";
+            else if (period == 7 * 24 * 3600) std::cout << "Weekly";
+            else if (period % 3600 == 0) std::cout << "Every " << period / 3600 << " hours";
+            else std::cout << "Every " << period / 60 << " minutes";
+            if (duration % 3600 == 0) std::cout << ", " << duration / 3600 << " hour(s) each, ";
+            else std::cout << ", " << duration / 60 << " minute(s) each, ";
+            std::cout << count << " time(s)\n  -- from " << ctime(&startTime) << "  -- to " << ctime(&tmp_time);
+        }
+        // Serialization
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("startTime", &Recurrence::startTime),
+                Codec::Member("duration", &Recurrence::duration),
+                Codec::Member("period", &Recurrence::period),
+                Codec::Member("count", &Recurrence::count)
+            );
+        }
     };
 
     // Class for available times
     // .. Assume accomodative spaces: working all day
-    class Time {
+    // .. Time is split in slots of SlotSeconds: a whole hour, or an hour divided by 2 or 4
+    // .. Slot math is resolved at compile time, with shifts between slots & hours
+    template <unsigned int SlotSeconds>
+    class BasicTime {
+    public:
+        static constexpr unsigned int SLOT_SECONDS = SlotSeconds;
+        static constexpr unsigned int SLOTS_PER_HOUR = 3600 / SlotSeconds;
+        static constexpr unsigned int SLOTS_PER_DAY = 24 * SLOTS_PER_HOUR;
+        // .. log2(SLOTS_PER_HOUR)
+        static constexpr unsigned int HOUR_SHIFT = SLOTS_PER_HOUR == 4 ? 2 : SLOTS_PER_HOUR == 2 ? 1 : 0;
+        static_assert(SlotSeconds == 900 || SlotSeconds == 1800 || SlotSeconds == 3600,
+            "Slots must last 15 minutes, 30 minutes or 1 hour");
+
+        // Slots in p_seconds, rounded down or up
+        static constexpr long long FloorSlots(long long p_seconds) {
+            return p_seconds >= 0 ? p_seconds / SlotSeconds : -(long long)((SlotSeconds - 1 - p_seconds) / SlotSeconds);
+        }
+        static constexpr long long CeilSlots(long long p_seconds) { return -FloorSlots(-p_seconds); }
+        // Whether timetables can be converted from & to slots of p_slotSeconds
+        static constexpr bool IsSlotSeconds(unsigned int p_slotSeconds) {
+            return p_slotSeconds == 900 || p_slotSeconds == 1800 || p_slotSeconds == 3600;
+        }
+
+        // Timetable words at another slot length, one halving or doubling at a time
+        // .. Finer slots copy their coarser slot, coarser slots are booked if any of their finer slots is
+        static std::vector<unsigned long long> ConvertSlots(const std::vector<unsigned long long>& p_times,
+            unsigned int p_fromSeconds, unsigned int p_toSeconds) {
+            if (!IsSlotSeconds(p_fromSeconds) || !IsSlotSeconds(p_toSeconds))
+                throw std::invalid_argument("Unsupported slot length");
+            std::vector<unsigned long long> times = p_times;
+            for (; p_fromSeconds > p_toSeconds; p_fromSeconds /= 2) {
+                // Each half word spreads over a whole word, every bit doubled
+                std::vector<unsigned long long> finer(times.size() * 2);
+                for (unsigned long i = 0; i < finer.size(); i++) {
+                    unsigned long long bits = (times[i / 2] >> (i % 2 * 16)) & 0xFFFFull;
+                    bits = (bits | bits << 8) & 0x00FF00FFull;
+                    bits = (bits | bits << 4) & 0x0F0F0F0Full;
+                    bits = (bits | bits << 2) & 0x33333333ull;
+                    bits = (bits | bits << 1) & 0x55555555ull;
+                    finer[i] = bits | bits << 1;
+                }
+                times.swap(finer);
+            }
+            for (; p_fromSeconds < p_toSeconds; p_fromSeconds *= 2) {
+                // Each pair of bits merges into one, two words into one
+                std::vector<unsigned long long> coarser((times.size() + 1) / 2, 0);
+                for (unsigned long i = 0; i < times.size(); i++) {
+                    unsigned long long bits = (times[i] | times[i] >> 1) & 0x55555555ull;
+                    bits = (bits | bits >> 1) & 0x33333333ull;
+                    bits = (bits | bits >> 2) & 0x0F0F0F0Full;
+                    bits = (bits | bits >> 4) & 0x00FF00FFull;
+                    bits = (bits | bits >> 8) & 0x0000FFFFull;
+                    coarser[i / 2] |= bits << (i % 2 * 16);
+                }
+                times.swap(coarser);
+            }
+            return times;
+        }
     private:
         time_t originTime;
-        // Using a list of unsigned long long integers 
+        // Using a list of unsigned long long integers
         // .. to keep track of allocated time
-        // .. Each bit corresponds to 1 hour
+        // .. Each bit corresponds to 1 slot
         // .. More long longs added based on scheduler
-        // .. 32 bits per each corresponding to 2.67 days
+        // .. 32 bits per each corresponding to 32 slots (2.67 days of 1 hour slots)
         std::vector<unsigned long long> times;
         // Price per hour
         double dirhamsPerHour = 0;
+        // Peak, weekend & seasonal multipliers on the price per hour
+        Tariff tariff;
+        // Slot length of a timetable being read, converted once read (see OnDecoded)
+        // .. Files from before slotSeconds was kept hold whole hours
+        unsigned int storedSlotSeconds = 3600;
+        // Summaries of the timetable, one bit each
+        // .. Level 1 per word: any slot booked / all slots booked
+        // .. Level 2 per group of 64 words (2048 slots), same meaning
+        // .. Checks & searches skip whole words and groups through them
+        std::vector<unsigned long long> bookedWords, fullWords, bookedGroups, fullGroups;
+        // Booked slots per day, week & month
+        // .. Built whenever the timetable is set, then kept up to date by reservations,
+        // .. so shared (snapshot) copies are never written by readers
+        Rollups rollups;
+        // Bumped on every change
+        unsigned long long version = 0;
+
+        // Slots since the epoch of the first timetable slot
+        long long GetOriginSlot() const { return FloorSlots(originTime); }
+        // Slots from origin to a time, rounded down or up
+        long long FloorSlotsAt(const time_t& p_time) const { return FloorSlots((long long)p_time - originTime); }
+        long long CeilSlotsAt(const time_t& p_time) const { return CeilSlots((long long)p_time - originTime); }
+        // Price of slots [p_startSlot, p_endSlot] since origin
+        // .. Slots share the rate of their hour
+        double PriceOf(unsigned long p_startSlot, unsigned long p_endSlot) const {
+            long long first = GetOriginSlot() + p_startSlot, last = GetOriginSlot() + p_endSlot;
+            if constexpr (SLOTS_PER_HOUR == 1)
+                return dirhamsPerHour * tariff.GetUnits(first, last + 1);
+            long long firstHour = first >> HOUR_SHIFT, lastHour = last >> HOUR_SHIFT;
+            double units;
+            if (firstHour == lastHour)
+                units = (last - first + 1) * tariff.GetUnits(firstHour, firstHour + 1);
+            else units = (SLOTS_PER_HOUR - (first & (SLOTS_PER_HOUR - 1))) * tariff.GetUnits(firstHour, firstHour + 1)
+                + SLOTS_PER_HOUR * tariff.GetUnits(firstHour + 1, lastHour)
+                + ((last & (SLOTS_PER_HOUR - 1)) + 1) * tariff.GetUnits(lastHour, lastHour + 1);
+            return dirhamsPerHour * units / SLOTS_PER_HOUR;
+        }
+        // Bits [p_from, p_to] of a 64 bits word
+        static unsigned long long BitMask(unsigned int p_from, unsigned int p_to) {
+            return (p_to == 63 ? ~0ull : (1ull << (p_to + 1)) - 1) & ~((1ull << p_from) - 1);
+        }
+        // Slots [p_from, p_to] of a timetable word (32 slots in its low bits)
+        static unsigned long long Mask(unsigned int p_from, unsigned int p_to) { return BitMask(p_from, p_to); }
+        static bool IsBitSet(const std::vector<unsigned long long>& p_bits, unsigned long p_index) {
+            return p_index / 64 < p_bits.size() && ((p_bits[p_index / 64] >> (p_index % 64)) & 1);
+        }
+        static void AssignBit(std::vector<unsigned long long>& p_bits, unsigned long p_index, bool p_value) {
+            if (p_value) p_bits[p_index / 64] |= 1ull << (p_index % 64);
+            else p_bits[p_index / 64] &= ~(1ull << (p_index % 64));
+        }
+        // Any bit set in [p_first, p_last] of a bit vector
+        static bool AnyBit(const std::vector<unsigned long long>& p_bits, unsigned long p_first, unsigned long p_last) {
+            if (p_first > p_last || p_first / 64 >= p_bits.size()) return false;
+            p_last = std::min<unsigned long>(p_last, p_bits.size() * 64 - 1);
+            if (p_first / 64 == p_last / 64)
+                return (p_bits[p_first / 64] & BitMask(p_first % 64, p_last % 64)) != 0;
+            if (p_bits[p_first / 64] & BitMask(p_first % 64, 63)) return true;
+            for (unsigned long i = p_first / 64 + 1; i < p_last / 64; i++)
+                if (p_bits[i] != 0) return true;
+            return (p_bits[p_last / 64] & BitMask(0, p_last % 64)) != 0;
+        }
+        // Any booked slot in words [p_firstWord, p_lastWord], from the summaries only
+        bool AnyBookedWord(unsigned long p_firstWord, unsigned long p_lastWord) const {
+            if (p_firstWord > p_lastWord) return false;
+            unsigned long firstGroup = p_firstWord / 64, lastGroup = p_lastWord / 64;
+            if (firstGroup == lastGroup) return AnyBit(bookedWords, p_firstWord, p_lastWord);
+            return AnyBit(bookedWords, p_firstWord, firstGroup * 64 + 63) ||
+                   AnyBit(bookedGroups, firstGroup + 1, lastGroup - 1) ||
+                   AnyBit(bookedWords, lastGroup * 64, p_lastWord);
+        }
+        // Any booked slot in [p_startSlot, p_endSlot] since origin
+        bool AnyBooked(unsigned long p_startSlot, unsigned long p_endSlot) const {
+            if (p_startSlot > p_endSlot || p_startSlot / 32 >= times.size()) return false;
+            p_endSlot = std::min<unsigned long>(p_endSlot, times.size() * 32 - 1);
+            unsigned long firstWord = p_startSlot / 32, lastWord = p_endSlot / 32;
+            if (firstWord == lastWord)
+                return (times[firstWord] & Mask(p_startSlot % 32, p_endSlot % 32)) != 0;
+            return (times[firstWord] & Mask(p_startSlot % 32, 31)) != 0 ||
+                   (times[lastWord] & Mask(0, p_endSlot % 32)) != 0 ||
+                   AnyBookedWord(firstWord + 1, lastWord - 1);
+        }
+        // Refresh the summaries of words [p_firstWord, p_lastWord] and of their groups
+        void UpdateSummaries(unsigned long p_firstWord, unsigned long p_lastWord) {
+            unsigned long groupCount = (times.size() + 63) / 64;
+            bookedWords.resize(groupCount, 0);
+            fullWords.resize(groupCount, 0);
+            bookedGroups.resize((groupCount + 63) / 64, 0);
+            fullGroups.resize((groupCount + 63) / 64, 0);
+            p_lastWord = std::min<unsigned long>(p_lastWord, times.size() - 1);
+            for (unsigned long word = p_firstWord; word <= p_lastWord; word++) {
+                unsigned long long slots = times[word] & 0xFFFFFFFFull;
+                AssignBit(bookedWords, word, slots != 0);
+                AssignBit(fullWords, word, slots == 0xFFFFFFFFull);
+            }
+            for (unsigned long group = p_firstWord / 64; group <= p_lastWord / 64; group++) {
+                AssignBit(bookedGroups, group, bookedWords[group] != 0);
+                AssignBit(fullGroups, group, fullWords[group] == ~0ull);
+            }
+        }
+        // Book or free slots [p_startSlot, p_endSlot] since origin, word by word
+        void AssignRange(unsigned long p_startSlot, unsigned long p_endSlot, bool p_booked) {
+            unsigned long firstWord = p_startSlot / 32, lastWord = p_endSlot / 32;
+            for (unsigned long word = firstWord; word <= lastWord; word++) {
+                unsigned long long mask = Mask(word == firstWord ? p_startSlot % 32 : 0,
+                    word == lastWord ? p_endSlot % 32 : 31);
+                if (p_booked) times[word] |= mask;
+                else times[word] &= ~mask;
+            }
+            UpdateSummaries(firstWord, lastWord);
+        }
+        // Count booked slots [p_startSlot, p_endSlot] since origin with popcount
+        // .. Each word holds 32 slots in its low bits
+        unsigned int CountBooked(unsigned long p_startSlot, unsigned long p_endSlot) const {
+            if (p_startSlot > p_endSlot || p_startSlot / 32 >= times.size()) return 0;
+            unsigned long lastWord = std::min<unsigned long>(p_endSlot / 32, times.size() - 1);
+            if (lastWord < p_endSlot / 32) p_endSlot = lastWord * 32 + 31;
+            unsigned long firstWord = p_startSlot / 32;
+            if (firstWord == lastWord)
+                return __builtin_popcountll(times[firstWord] & Mask(p_startSlot % 32, p_endSlot % 32));
+            unsigned int count = __builtin_popcountll(times[firstWord] & Mask(p_startSlot % 32, 31));
+            for (unsigned long i = firstWord + 1; i < lastWord; i++)
+                // Skip free words, count full ones without loading them
+                if (IsBitSet(fullWords, i)) count += 32;
+                else if (IsBitSet(bookedWords, i)) count += __builtin_popcountll(times[i] & 0xFFFFFFFFull);
+            return count + __builtin_popcountll(times[lastWord] & Mask(0, p_endSlot % 32));
+        }
+        // Call p_visit(day, first slot, last slot) for each UTC day of slots [p_startSlot, p_endSlot]
+        template <typename F>
+        void ForEachDay(unsigned long p_startSlot, unsigned long p_endSlot, F p_visit) const {
+            long long originSlot = GetOriginSlot();
+            while (p_startSlot <= p_endSlot) {
+                long long day = (originSlot + (long long)p_startSlot) / SLOTS_PER_DAY;
+                unsigned long dayEnd = std::min<unsigned long>(p_endSlot, (day + 1) * SLOTS_PER_DAY - originSlot - 1);
+                p_visit(day, p_startSlot, dayEnd);
+                p_startSlot = dayEnd + 1;
+            }
+        }
+        // First & last slots since origin of a recurring rule, and the slots between occurrences
+        // .. The period must be a whole number of slots
+        bool RecurrenceSlots(const Recurrence& p_rule, unsigned long& p_startSlot, unsigned long& p_lastSlot,
+            unsigned long& p_periodSlots) const {
+            if (!p_rule.IsValid() || p_rule.period % SlotSeconds != 0) return false;
+            long long startSlot = FloorSlotsAt(p_rule.startTime);
+            long long durationSlots = CeilSlotsAt(p_rule.startTime + p_rule.duration) - startSlot;
+            p_periodSlots = p_rule.period / SlotSeconds;
+            if (startSlot < 0 || durationSlots > (long long)p_periodSlots) return false;
+            p_startSlot = startSlot;
+            p_lastSlot = p_startSlot + (unsigned long)(p_rule.count - 1) * p_periodSlots + durationSlots - 1;
+            return true;
+        }
+        // Word masks of a recurring rule, from the word holding its first slot
+        // .. Occurrences line up with words again every lcm(period, 32) slots,
+        // .. so one cycle of masks serves the whole rule: word i uses masks[i % masks.size()]
+        // .. Masks ignore where the rule begins & ends: edge words are masked by the caller
+        std::vector<unsigned long long> RecurrenceMasks(unsigned long p_startSlot, unsigned long p_lastSlot,
+            unsigned long p_periodSlots, unsigned long p_durationSlots) const {
+            unsigned long firstWord = p_startSlot / 32;
+            unsigned long cycleWords = p_periodSlots / std::gcd(p_periodSlots, 32ul);
+            std::vector<unsigned long long> masks(std::min(cycleWords, p_lastSlot / 32 - firstWord + 1), 0);
+            // Slots into the period at the first bit of the first word
+            unsigned long phase = (p_periodSlots - (p_startSlot - firstWord * 32) % p_periodSlots) % p_periodSlots;
+            for (auto& mask: masks)
+                for (unsigned int bit = 0; bit < 32; bit++) {
+                    if (phase < p_durationSlots) mask |= 1ull << bit;
+                    if (++phase == p_periodSlots) phase = 0;
+                }
+            return masks;
+        }
+        // Mask of word p_word of a recurring rule, within its first & last slots
+        static unsigned long long RecurrenceMask(const std::vector<unsigned long long>& p_masks, unsigned long p_word,
+            unsigned long p_startSlot, unsigned long p_lastSlot) {
+            unsigned long firstWord = p_startSlot / 32, lastWord = p_lastSlot / 32;
+            return p_masks[(p_word - firstWord) % p_masks.size()] &
+                Mask(p_word == firstWord ? p_startSlot % 32 : 0, p_word == lastWord ? p_lastSlot % 32 : 31);
+        }
+        // Count the whole timetable into the rollups
+        void RebuildRollups() {
+            rollups.Reset(GetOriginSlot() / SLOTS_PER_DAY);
+            if (!times.empty())
+                ForEachDay(0, times.size() * 32 - 1, [this](long long p_day, unsigned long p_first, unsigned long p_last) {
+                    rollups.Add(p_day, CountBooked(p_first, p_last));
+                });
+        }
     public:
         // Constructors & destructors
-        Time() {
+        BasicTime() {
             originTime = time(NULL);
             dirhamsPerHour = 0;
+            RebuildRollups();
         }
-        Time(double p_dirhamsPerHour){
+        BasicTime(double p_dirhamsPerHour){
             originTime = time(NULL);
             // Round up to next hour
             originTime += (3600 - originTime % 3600);
             dirhamsPerHour = p_dirhamsPerHour;
+            RebuildRollups();
         }
-        Time(double p_dirhamsPerHour, const time_t& p_originTime) {
+        BasicTime(double p_dirhamsPerHour, const time_t& p_originTime) {
             originTime = p_originTime;
             dirhamsPerHour = p_dirhamsPerHour;
+            RebuildRollups();
+        }
+        // .. Moves hand over the timetable words instead of copying them
+        BasicTime(const BasicTime&) = default;
+        BasicTime(BasicTime&&) = default;
+        BasicTime& operator=(const BasicTime&) = default;
+        BasicTime& operator=(BasicTime&&) = default;
+        // Conversion from another slot length
+        template <unsigned int OtherSlotSeconds>
+        explicit BasicTime(const BasicTime<OtherSlotSeconds>& p_time) {
+            originTime = p_time.GetOriginTime();
+            dirhamsPerHour = p_time.GetDirhamsPerHour();
+            tariff = p_time.GetTariff();
+            SetBulkTimes(ConvertSlots(p_time.GetTimes(), OtherSlotSeconds, SlotSeconds));
         }
         // Setters
-        void SetDirhamsPerHour(double p_dirhamsPerHour) { dirhamsPerHour = p_dirhamsPerHour; }
-        void SetBulkTimes(const std::vector<unsigned long long>& p_times) { times = p_times; }
+        void SetDirhamsPerHour(double p_dirhamsPerHour) { dirhamsPerHour = p_dirhamsPerHour; version++; }
+        void SetBulkTimes(std::vector<unsigned long long> p_times) {
+            times = std::move(p_times);
+            bookedWords.clear();
+            fullWords.clear();
+            bookedGroups.clear();
+            fullGroups.clear();
+            if (!times.empty()) UpdateSummaries(0, times.size() - 1);
+            RebuildRollups();
+            version++;
+        }
+        void SetTariff(const Tariff& p_tariff) { tariff = p_tariff; version++; }
         // Getters
         double GetDirhamsPerHour() const { return dirhamsPerHour; }
         time_t GetOriginTime() const { return originTime; }
         std::vector<unsigned long long> GetTimes() const { return times; }
+        const Tariff& GetTariff() const { return tariff; }
+        unsigned long long GetVersion() const { return version; }
+        const Rollups& GetRollups() const { return rollups; }
+        // Heap bytes of the timetable, its summaries & rollups
+        void CountMemory(Memory::Report& p_report) const {
+            p_report.Add(Memory::TIMETABLES, Memory::VectorBytes(times) + Memory::VectorBytes(bookedWords)
+                + Memory::VectorBytes(fullWords) + Memory::VectorBytes(bookedGroups) + Memory::VectorBytes(fullGroups));
+            p_report.Add(Memory::ROLLUPS, rollups.GetBytes());
+            tariff.CountMemory(p_report);
+        }
+        // Booked slots & their price at the current rates, in [p_startTime, p_endTime)
+        unsigned int GetBookedSlots(const time_t& p_startTime, const time_t& p_endTime) const {
+            long long startSlot = std::max(0LL, FloorSlotsAt(p_startTime));
+            long long endSlot = CeilSlotsAt(p_endTime) - 1;
+            if (endSlot < startSlot) return 0;
+            return CountBooked(startSlot, endSlot);
+        }
+        double GetRevenue(const time_t& p_startTime, const time_t& p_endTime) const {
+            long long startSlot = std::max(0LL, FloorSlotsAt(p_startTime));
+            long long endSlot = CeilSlotsAt(p_endTime) - 1;
+            if (endSlot < startSlot) return 0;
+            unsigned long last = std::min<unsigned long>(endSlot, times.size() * 32);
+            // Price each run of booked slots
+            double revenue = 0;
+            for (unsigned long slot = startSlot; slot <= last && slot / 32 < times.size();) {
+                unsigned long long word = (times[slot / 32] & 0xFFFFFFFFull) >> (slot % 32);
+                if (word == 0) {
+                    slot = (slot / 32 + 1) * 32;
+                    continue;
+                }
+                slot += __builtin_ctzll(word);
+                if (slot > last) break;
+                unsigned long runEnd = slot;
+                while (runEnd + 1 <= last && (runEnd + 1) / 32 < times.size() && GetBit(times[(runEnd + 1) / 32], (runEnd + 1) % 32))
+                    runEnd++;
+                revenue += PriceOf(slot, runEnd);
+                slot = runEnd + 1;
+            }
+            return revenue;
+        }
+
+        // Function to check if slots are free, with the same slots as AddReservation
+        bool IsFree(const time_t& p_startTime, const time_t& p_endTime) const {
+            long long startSlot = FloorSlotsAt(p_startTime), endSlot = FloorSlotsAt(p_endTime);
+            if (endSlot < startSlot || startSlot < 0) return false;
+            return !AnyBooked(startSlot, endSlot);
+        }
+        // Function to find the first p_hours free hours starting between p_fromTime & p_toTime
+        // .. Fully free or fully booked words & groups of words are skipped in one step
+        // .. Slots past the timetable are free
+        bool FindFree(const time_t& p_fromTime, const time_t& p_toTime, unsigned int p_hours, time_t& p_startTime) const {
+            long long fromSlot = std::max(0LL, CeilSlotsAt(p_fromTime));
+            long long toSlot = FloorSlotsAt(p_toTime);
+            if (p_hours == 0 || toSlot < fromSlot) return false;
+            unsigned long slots = (unsigned long)p_hours << HOUR_SHIFT;
+            unsigned long runStart = fromSlot, lastStart = toSlot;
+            unsigned long slot = runStart, endOfTimes = times.size() * 32;
+            while (runStart <= lastStart) {
+                if (slot - runStart >= slots || slot >= endOfTimes) {
+                    p_startTime = originTime + (time_t)runStart * SlotSeconds;
+                    return true;
+                }
+                unsigned long word = slot / 32;
+                if (slot % 32 == 0) {
+                    // Whole groups, then whole words
+                    if (word % 64 == 0 && !IsBitSet(bookedGroups, word / 64)) { slot += 64 * 32; continue; }
+                    if (word % 64 == 0 && IsBitSet(fullGroups, word / 64)) { slot += 64 * 32; runStart = slot; continue; }
+                    if (!IsBitSet(bookedWords, word)) { slot += 32; continue; }
+                    if (IsBitSet(fullWords, word)) { slot += 32; runStart = slot; continue; }
+                }
+                // Jump to the next change of state inside the word
+                unsigned long long bits = (times[word] & 0xFFFFFFFFull) >> (slot % 32);
+                if (bits & 1) {
+                    unsigned long long freeSlots = ~bits & Mask(0, 31 - slot % 32);
+                    slot += freeSlots == 0 ? 32 - slot % 32 : __builtin_ctzll(freeSlots);
+                    runStart = slot;
+                } else slot += bits == 0 ? 32 - slot % 32 : __builtin_ctzll(bits);
+            }
+            return false;
+        }
+        // Every start in [p_fromTime, p_toTime] with p_hours free hours, as a bit vector
+        // .. Bit i is set if p_hours from p_fromTime plus i slots can be reserved, so that vectors of
+        // .. timetables with different origins line up: spaces are free together where their vectors intersect
+        // .. Booked slots of the range are gathered into a bit vector once, then smeared over the run length in log(run) shifts
+        std::vector<unsigned long long> FreeStarts(const time_t& p_fromTime, const time_t& p_toTime, unsigned int p_hours) const {
+            if (p_hours == 0 || p_toTime < p_fromTime) return {};
+            long long firstSlot = FloorSlotsAt(p_fromTime);
+            long long toSlot = firstSlot + (p_toTime - p_fromTime) / SLOT_SECONDS;
+            unsigned long count = toSlot - firstSlot + 1, slots = (unsigned long)p_hours << HOUR_SHIFT;
+            std::vector<unsigned long long> starts((count + 63) / 64, ~0ull);
+            if (count % 64 != 0) starts.back() = BitMask(0, count % 64 - 1);
+            long long fromSlot = std::max(0LL, firstSlot), lastSlot = toSlot + slots - 1;
+            if (lastSlot < fromSlot) return std::vector<unsigned long long>(starts.size(), 0);
+            if (fromSlot == firstSlot && !AnyBooked(fromSlot, lastSlot)) return starts;
+            // Booked slots of [firstSlot, lastSlot], bit i for slot firstSlot + i
+            // .. Slots before the origin cannot be reserved and count as booked
+            unsigned long window = lastSlot - firstSlot + 1;
+            std::vector<unsigned long long> booked((window + 63) / 64 + 1, 0);
+            for (unsigned long position = 0; position < (unsigned long)std::min<long long>(fromSlot - firstSlot, window); position++)
+                booked[position / 64] |= 1ull << (position % 64);
+            for (long long word = fromSlot / 32; word <= lastSlot / 32 && word < (long long)times.size(); word++) {
+                if (!IsBitSet(bookedWords, word)) continue;
+                unsigned long long bits = times[word] & 0xFFFFFFFFull;
+                unsigned long position = 0;
+                if (word * 32 < firstSlot) bits >>= firstSlot - word * 32;
+                else position = word * 32 - firstSlot;
+                booked[position / 64] |= bits << (position % 64);
+                if (position % 64 > 32) booked[position / 64 + 1] |= bits >> (64 - position % 64);
+            }
+            // Any booked slot in [i, i + slots)
+            auto shiftDown = [](const std::vector<unsigned long long>& p_bits, unsigned long p_shift) {
+                std::vector<unsigned long long> shifted(p_bits.size(), 0);
+                unsigned long words = p_shift / 64, bits = p_shift % 64;
+                for (unsigned long i = 0; i + words < p_bits.size(); i++) {
+                    shifted[i] = p_bits[i + words] >> bits;
+                    if (bits != 0 && i + words + 1 < p_bits.size()) shifted[i] |= p_bits[i + words + 1] << (64 - bits);
+                }
+                return shifted;
+            };
+            for (unsigned long covered = 1; covered < slots; ) {
+                unsigned long step = std::min(covered, slots - covered);
+                std::vector<unsigned long long> shifted = shiftDown(booked, step);
+                for (unsigned long i = 0; i < booked.size(); i++) booked[i] |= shifted[i];
+                covered += step;
+            }
+            for (unsigned long i = 0; i < starts.size(); i++) starts[i] &= ~booked[i];
+            return starts;
+        }
+
+        // Function to quote a reservation without making it
+        // .. Same slots as AddReservation, never touches the timetable
+        bool Quote(const time_t& p_startTime, const time_t& p_endTime, double& price) const {
+            price = 0;
+            long long startSlot = FloorSlotsAt(p_startTime), endSlot = FloorSlotsAt(p_endTime);
+            // Invalid reservation
+            if (endSlot < startSlot || startSlot < 0) return false;
+            price = PriceOf(startSlot, endSlot);
+            return true;
+        }
 
         // Function to reserve
         // .. param price to return the price
+        // .. p_endTime is the beginning of the last slot booked
         bool AddReservation(const time_t& p_startTime, const time_t& p_endTime, double& price) {
+            EVIES_METRIC_SCOPE(Metrics::ADD_RESERVATION);
             // Initialize price
             price = 0;
-            // Get hours difference between startTime, endTime and originTime
-            // .. Hour is tracked (both start & end) from beginning o'clock -> floor is used here
-            unsigned long startHours = (unsigned long)std::floor(std::difftime(p_startTime, originTime) / (60 * 60));
-            unsigned long endHours = (unsigned long)std::floor(std::difftime(p_endTime, originTime) / (60 * 60));
+            // Get slots difference between startTime, endTime and originTime
+            // .. Slot is tracked (both start & end) from its beginning -> floor is used here
+            long long startSlot = FloorSlotsAt(p_startTime), endSlot = FloorSlotsAt(p_endTime);
             // Invalid reservation
-            if (endHours < startHours || startHours < 0) return false;
-            if (times.size() <= endHours / 32)
-                while (times.size() <= endHours / 32) times.push_back(0);
-            // Check if any hour in the reservation is booked
-            if (startHours / 32 == endHours / 32) {
-                for (unsigned long i = startHours % 32; i <= endHours % 32; i++) 
-                    if GetBit(times[startHours / 32], i)
-                        // Time is occupied
-                        return false;
-            } else {
-                for (unsigned long i = startHours % 32; i < 32; i++) 
-                    if GetBit(times[startHours / 32], i)
-                        // Time is occupied
-                        return false;
-                unsigned long j = startHours / 32;
-                while (j != endHours / 32) {
-                    for (unsigned long i = 0; i < 32; i++) 
-                        if GetBit(times[startHours / 32], i)
-                            // Time is occupied
-                            return false;
-                    j++;
-                }
-                for (unsigned long i = 0; i <= endHours % 32; i++) 
-                    if GetBit(times[endHours / 32], i)
-                        // Time is occupied
-                        return false;
-            }
-            // If not, proceed to select the hours
-            if (startHours / 32 == endHours / 32) {
-                for (unsigned long i = startHours % 32; i <= endHours % 32; i++) {
-                    SetBit(times[startHours / 32], i); 
-                }
-            } else {
-                for (unsigned long i = startHours % 32; i < 32; i++) 
-                    SetBit(times[startHours / 32], i);
-                for (unsigned long i = startHours / 32 + 1; i < endHours / 32; i++)
-                    times[i] = ~0;
-                for (unsigned long i = 0; i <= endHours % 32; i++) 
-                    SetBit(times[endHours / 32], i);
-            }
-            price = dirhamsPerHour * (endHours - startHours + 1);
+            if (endSlot < startSlot || startSlot < 0) return false;
+            // Check if any slot in the reservation is booked
+            // .. Edge words are masked, words in between are checked through the summaries
+            if (AnyBooked(startSlot, endSlot))
+                // Time is occupied
+                return false;
+            if (times.size() <= (unsigned long)endSlot / 32)
+                times.resize(endSlot / 32 + 1, 0);
+            // If not, proceed to select the slots
+            AssignRange(startSlot, endSlot, true);
+            price = PriceOf(startSlot, endSlot);
+            ForEachDay(startSlot, endSlot, [this](long long p_day, unsigned long p_first, unsigned long p_last) {
+                rollups.Add(p_day, p_last - p_first + 1);
+            });
+            version++;
             return true;
         }
         // Function to remove reservations
         bool RemoveReservation(const time_t& p_startTime, const time_t& p_endTime) {
-            // Get hours difference between startTime, endTime and originTime
-            // .. Hour is tracked from beginning o'clock -> floor is used here
-            unsigned long startHours = (unsigned long)std::floor(std::difftime(p_startTime, originTime) / (60 * 60));
-            unsigned long endHours = (unsigned long)std::floor(std::difftime(p_endTime, originTime) / (60 * 60));
+            EVIES_METRIC_SCOPE(Metrics::REMOVE_RESERVATION);
+            // Get slots difference between startTime, endTime and originTime
+            // .. Slot is tracked from its beginning -> floor is used here
+            long long startSlot = FloorSlotsAt(p_startTime), endSlot = FloorSlotsAt(p_endTime);
             // Invalid reservation
-            if (endHours < startHours || startHours < 0) return false;
-            if (times.size() < endHours / 32)
-                while (times.size() <= endHours / 32) times.push_back(0);
-            // Directly clear the hours
-            if (startHours / 32 == endHours / 32) {
-                for (unsigned long i = startHours % 32; i <= endHours % 32; i++) 
-                    ClearBit(times[startHours / 32], i);
-            } else {
-                for (unsigned long i = startHours % 32; i < 32; i++) 
-                    ClearBit(times[startHours / 32], i);
-                for (unsigned long i = startHours / 32 + 1; i < endHours / 32; i++)
-                    times[i] = 0;
-                for (unsigned long i = 0; i <= endHours % 32; i++) 
-                    ClearBit(times[endHours / 32], i);
+            if (endSlot < startSlot || startSlot < 0) return false;
+            if (times.size() <= (unsigned long)endSlot / 32)
+                times.resize(endSlot / 32 + 1, 0);
+            // Uncount the slots that were booked
+            ForEachDay(startSlot, endSlot, [this](long long p_day, unsigned long p_first, unsigned long p_last) {
+                rollups.Add(p_day, -(int)CountBooked(p_first, p_last));
+            });
+            // Directly clear the slots
+            AssignRange(startSlot, endSlot, false);
+            version++;
+            return true;
+        }
+
+        // Function to quote a recurring reservation without making it
+        bool Quote(const Recurrence& p_rule, double& price) const {
+            price = 0;
+            unsigned long startSlot, lastSlot, periodSlots;
+            if (!RecurrenceSlots(p_rule, startSlot, lastSlot, periodSlots)) return false;
+            unsigned long durationSlots = lastSlot - startSlot + 1 - (unsigned long)(p_rule.count - 1) * periodSlots;
+            for (unsigned int i = 0; i < p_rule.count; i++) {
+                unsigned long first = startSlot + (unsigned long)i * periodSlots;
+                price += PriceOf(first, first + durationSlots - 1);
             }
             return true;
         }
-    };
+        // Function to reserve every occurrence of a recurring rule, or none
+        // .. Conflict check & booking share one pass over the words, with the rule's precomputed masks
+        // .. On a conflict the words already booked are released again
+        bool AddRecurring(const Recurrence& p_rule, double& price) {
+            EVIES_METRIC_SCOPE(Metrics::ADD_RESERVATION);
+            price = 0;
+            unsigned long startSlot, lastSlot, periodSlots;
+            if (!RecurrenceSlots(p_rule, startSlot, lastSlot, periodSlots)) return false;
+            unsigned long durationSlots = lastSlot - startSlot + 1 - (unsigned long)(p_rule.count - 1) * periodSlots;
+            std::vector<unsigned long long> masks = RecurrenceMasks(startSlot, lastSlot, periodSlots, durationSlots);
+            unsigned long firstWord = startSlot / 32, lastWord = lastSlot / 32;
+            unsigned long oldSize = times.size();
+            if (times.size() <= lastWord) times.resize(lastWord + 1, 0);
+            for (unsigned long word = firstWord; word <= lastWord; word++) {
+                unsigned long long mask = RecurrenceMask(masks, word, startSlot, lastSlot);
+                if (times[word] & mask) {
+                    // Time is occupied
+                    while (word-- > firstWord)
+                        times[word] &= ~RecurrenceMask(masks, word, startSlot, lastSlot);
+                    times.resize(oldSize);
+                    return false;
+                }
+                times[word] |= mask;
+            }
+            UpdateSummaries(firstWord, lastWord);
+            Quote(p_rule, price);
+            for (unsigned int i = 0; i < p_rule.count; i++) {
+                unsigned long first = startSlot + (unsigned long)i * periodSlots;
+                ForEachDay(first, first + durationSlots - 1, [this](long long p_day, unsigned long p_first, unsigned long p_last) {
+                    rollups.Add(p_day, p_last - p_first + 1);
+                });
+            }
+            version++;
+            return true;
+        }
+        // Function to remove every occurrence of a recurring rule
+        bool RemoveRecurring(const Recurrence& p_rule) {
+            EVIES_METRIC_SCOPE(Metrics::REMOVE_RESERVATION);
+            unsigned long startSlot, lastSlot, periodSlots;
+            if (!RecurrenceSlots(p_rule, startSlot, lastSlot, periodSlots)) return false;
+            if (startSlot / 32 >= times.size()) return true;
+            unsigned long durationSlots = lastSlot - startSlot + 1 - (unsigned long)(p_rule.count - 1) * periodSlots;
+            lastSlot = std::min<unsigned long>(lastSlot, times.size() * 32 - 1);
+            // Uncount the slots that were booked
+            for (unsigned int i = 0; i < p_rule.count; i++) {
+                unsigned long first = startSlot + (unsigned long)i * periodSlots;
+                if (first > lastSlot) break;
+                ForEachDay(first, std::min(first + durationSlots - 1, lastSlot),
+                    [this](long long p_day, unsigned long p_first, unsigned long p_last) {
+                        rollups.Add(p_day, -(int)CountBooked(p_first, p_last));
+                    });
+            }
+            std::vector<unsigned long long> masks = RecurrenceMasks(startSlot, lastSlot, periodSlots, durationSlots);
+            unsigned long firstWord = startSlot / 32, lastWord = lastSlot / 32;
+            for (unsigned long word = firstWord; word <= lastWord; word++)
+                times[word] &= ~RecurrenceMask(masks, word, startSlot, lastSlot);
+            UpdateSummaries(firstWord, lastWord);
+            version++;
+            return true;
+        }
 
+        // Serialization
+        // .. The tariff only if rates vary
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("originTime", &BasicTime::originTime),
+                Codec::Member("times", &BasicTime::times),
+                Codec::Property<unsigned int>("slotSeconds",
+                    [](const BasicTime&) { return SlotSeconds; },
+                    [](BasicTime& p_time, unsigned int&& p_slotSeconds) { p_time.storedSlotSeconds = p_slotSeconds; },
+                    Codec::OPTIONAL),
+                Codec::Member("dirhamsPerHour", &BasicTime::dirhamsPerHour),
+                Codec::Optional<Tariff>("tariff",
+                    [](const BasicTime& p_time) -> const Tariff& { return p_time.tariff; },
+                    [](BasicTime& p_time, Tariff&& p_tariff) { p_time.tariff = std::move(p_tariff); },
+                    [](const BasicTime& p_time) { return !p_time.tariff.IsFlat(); })
+            );
+        }
+        // .. Timetables stored with other slots are converted
+        void OnDecoded() {
+            std::vector<unsigned long long> tmp_times;
+            tmp_times.swap(times);
+            if (storedSlotSeconds != SlotSeconds)
+                tmp_times = ConvertSlots(tmp_times, storedSlotSeconds, SlotSeconds);
+            storedSlotSeconds = 3600;
+            SetBulkTimes(std::move(tmp_times));
+        }
+    };
+    // Timetables of the build: slots of EVIES_SLOT_SECONDS
+    using Time = BasicTime<EVIES_SLOT_SECONDS>;
     // Class for reviews
     class Review {
         // .. Constrained to 0 to 5
         bool reviewed = false;
         float score = 0;
         unsigned int numberOfReviews = 0;
-        std::vector<std::string> reviews;
+        std::vector<Intern::String> reviews;
+        // Bumped on every change
+        unsigned long long version = 0;
     public:
         // Constructors & destructors
         Review(float p_score = 0) {
             score = p_score;
         }
+        Review(const Review&) = default;
+        Review(Review&&) = default;
+        Review& operator=(const Review&) = default;
+        Review& operator=(Review&&) = default;
         // Setters
-        void AddReview(const std::string& p_review, float p_score) {
+        void AddReview(const Intern::String& p_review, float p_score) {
             reviewed = true;
+            version++;
             reviews.push_back(p_review);
             score = (score * numberOfReviews + p_score) / (++numberOfReviews);
         }
-        void SetBulkReviews(int p_score, int p_numberOfReviews, const std::vector<std::string>& p_reviews) {
-            reviews = std::vector<std::string>{};
+        void SetBulkReviews(float p_score, unsigned int p_numberOfReviews, std::vector<Intern::String> p_reviews) {
+            reviews = std::vector<Intern::String>{};
+            version++;
             if (p_numberOfReviews == 0) {
                 reviewed = false;
                 score = 0;
@@ -255,22 +1109,39 @@ namespace Space {
             }
             reviewed = true;
             score = p_score;
-            reviews = p_reviews;
+            reviews = std::move(p_reviews);
             numberOfReviews = p_numberOfReviews;
         }
 
         // Getters
         float GetReviewScore() const { return score; }
-        std::vector<std::string> GetReviews() const { return reviews; }
+        const std::vector<Intern::String>& GetReviews() const { return reviews; }
         unsigned int GetNumberOfReviews() const { return numberOfReviews; }
         bool IsReviewed() const { return reviewed; }
+        unsigned long long GetVersion() const { return version; }
+        // .. Texts are pooled, counted with the pool
+        void CountMemory(Memory::Report& p_report) const {
+            p_report.Add(Memory::REVIEWS, Memory::VectorBytes(reviews), reviews.size());
+        }
+
+        // Serialization
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("reviewed", &Review::reviewed),
+                Codec::Member("score", &Review::score),
+                Codec::Member("numberOfReviews", &Review::numberOfReviews),
+                Codec::Member("reviews", &Review::reviews)
+            );
+        }
+        // .. Spaces without reviews keep neither a score nor texts
+        void OnDecoded() { SetBulkReviews(score, numberOfReviews, std::move(reviews)); }
     };
 
     // Class for each discrete space
     class Space {
     private:
         unsigned int ID;
-        std::string name;
+        Intern::String name;
     public:
         Dimensions dims;
     private:
@@ -305,7 +1176,10 @@ namespace Space {
     private:
 
         // Miscellaneous tags
-        std::vector<std::string> tags;
+        std::vector<Intern::String> tags;
+
+        // Bumped on every change of the space's own fields
+        unsigned long long version = 0;
     public:
         // Constructors & destructors
         // Constructors don't copy times & reviews
@@ -358,51 +1232,44 @@ namespace Space {
 
             review = Review();
         }
-        // Copy constructor with optional ID
-        Space(const Space& p_space, unsigned int p_ID = -1) {
-            // Manual work
-            if (p_ID != (unsigned int)(-1))
-                ID = p_ID;
-            else ID = p_space.GetID();
-            name = p_space.GetName();
-            // Use built-in copy constructor
-            dims = Dimensions(p_space.dims.GetLength(), p_space.dims.GetWidth(), p_space.dims.GetHeight());
-            seats = Seating(p_space.seats.GetNumberOfSeats(), p_space.seats.IsSlanted(), p_space.seats.IsSurround(), p_space.seats.IsComfy());
-            numberOfPeople = p_space.GetNumberOfPeople();
-            // Set current time as origin time
-            timer = Time(p_space.timer.GetDirhamsPerHour(), p_space.timer.GetOriginTime());
-            outdoor = p_space.IsOutdoor();
-            catering = p_space.IsCatering();
-            naturalLight = p_space.IsNaturalLight();
-            artificialLight = p_space.IsArtificialLight();
-            projector = p_space.IsProjector();
-            sound = p_space.IsSound();
-            cameras = p_space.IsCameras();
-
-            review = Review();
+        // Copies keep everything, timetable & reviews included
+        Space(const Space&) = default;
+        Space(Space&&) = default;
+        Space& operator=(const Space&) = default;
+        Space& operator=(Space&&) = default;
+        // Copy with another ID
+        Space(const Space& p_space, unsigned int p_ID) : Space(p_space) {
+            ID = p_ID;
         }
         
         // Setters
-        void Rename(const std::string& p_name) {
+        void Rename(const Intern::String& p_name) {
             name = p_name;
+            version++;
         }
         void SetID(unsigned int p_ID) {
             ID = p_ID;
+            version++;
         }
         void SetNumberOfPeople(int p_numberOfPeople) {
             numberOfPeople = p_numberOfPeople;
+            version++;
         }
         // Setters using overload
-        void IsOutdoor(bool p_outdoor) { outdoor = p_outdoor; }
-        void IsCatering(bool p_catering) { catering = p_catering; }
-        void IsNaturalLight(bool p_naturalLight) { naturalLight = p_naturalLight; }
-        void IsArtificialLight(bool p_artificialLight) { artificialLight = p_artificialLight; }
-        void IsProjector(bool p_projector) { projector = p_projector; }
-        void IsSound(bool p_sound) { sound = p_sound; }
-        void IsCameras(bool p_cameras) { cameras = p_cameras; }
+        void IsOutdoor(bool p_outdoor) { outdoor = p_outdoor; version++; }
+        void IsCatering(bool p_catering) { catering = p_catering; version++; }
+        void IsNaturalLight(bool p_naturalLight) { naturalLight = p_naturalLight; version++; }
+        void IsArtificialLight(bool p_artificialLight) { artificialLight = p_artificialLight; version++; }
+        void IsProjector(bool p_projector) { projector = p_projector; version++; }
+        void IsSound(bool p_sound) { sound = p_sound; version++; }
+        void IsCameras(bool p_cameras) { cameras = p_cameras; version++; }
+        void AddTag(const Intern::String& p_tag) {
+            tags.push_back(p_tag);
+            version++;
+        }
 
         // Getters
-        std::string GetName() const { return name; }
+        std::string_view GetName() const { return name; }
         unsigned int GetID() const { return ID; }
         int GetNumberOfPeople() const { return numberOfPeople; }
         bool IsOutdoor() const { return outdoor; }
@@ -412,6 +1279,21 @@ namespace Space {
         bool IsProjector() const { return projector; }
         bool IsSound() const { return sound; }
         bool IsCameras() const { return cameras; }
+        const std::vector<Intern::String>& GetTags() const { return tags; }
+        // Version of the whole space
+        // .. Sum of member versions: grows whenever anything changes
+        unsigned long long GetVersion() const {
+            return version + dims.GetVersion() + seats.GetVersion()
+                + timer.GetVersion() + review.GetVersion();
+        }
+        // Heap bytes of the space & its members
+        // .. Name, tags & reviews point into the text pool, counted with the pool
+        void CountMemory(Memory::Report& p_report) const {
+            p_report.Add(Memory::SPACES, sizeof(Space));
+            p_report.Add(Memory::TAGS, Memory::VectorBytes(tags), tags.size());
+            timer.CountMemory(p_report);
+            review.CountMemory(p_report);
+        }
 
         // Utility
         // Print some details to cmd line
@@ -441,12 +1323,18 @@ namespace Space {
                         std::cout << details[i] << ", ";
                     std::cout << "and also " << details[details.size() - 1] << std::endl;
                 } 
+                if (!tags.empty()) {
+                    std::cout << "Tags:";
+                    for (const Intern::String& tag: tags)
+                        std::cout << " #" << tag;
+                    std::cout << std::endl;
+                }
             }
             if (withReviews) {
                 std::cout << "Reviews:";
                 if (review.GetNumberOfReviews() != 0) {
                     std::cout << std::endl;
-                    for (std::string i: review.GetReviews()) {
+                    for (const Intern::String& i: review.GetReviews()) {
                         std::cout << "   -- " << i << std::endl;
                     }
                     std::cout << "Review score: " << review.GetReviewScore() << std::endl;
@@ -458,13 +1346,16 @@ namespace Space {
                 time_t tmp_time = timer.GetOriginTime();
                 std::cout << "Space opened on: " << ctime(&tmp_time);
                 std::cout << "Price per hour: " << timer.GetDirhamsPerHour() << " Dhs\n";
+                timer.GetTariff().PrintTariff();
                 std::cout << "Timetable:";
                 if (timer.GetTimes().size() != 0) {
                     std::cout << std::endl;
                     tmp_time = timer.GetOriginTime();
                     tm* tmp_tm = localtime(&tmp_time);
                     std::string tmp_string;
-                    int hourCounter = tmp_tm->tm_hour;
+                    // .. One character per slot
+                    int slotCounter = tmp_tm->tm_hour * Time::SLOTS_PER_HOUR + tmp_tm->tm_min * 60 / Time::SLOT_SECONDS;
+                    std::vector<unsigned long long> tmp_times = timer.GetTimes();
                     unsigned int timeCounter = 0;
                     unsigned int bitCounter = 0;
 
@@ -473,14 +1364,14 @@ namespace Space {
                     tmp_string.erase(11, 8);
                     tmp_string.erase(tmp_string.length() - 1);
                     std::cout << std::endl << "  -- " << tmp_string + " ";
-                    for (int i = 0; i < hourCounter; i++)
+                    for (int i = 0; i < slotCounter; i++)
                         std::cout << " ";
 
                     // Loop through the vector of times
-                    while (timeCounter != timer.GetTimes().size()) {
+                    while (timeCounter != tmp_times.size()) {
                         while (bitCounter != 32) {
-                            if (hourCounter == 24) {
-                                hourCounter = 0;
+                            if (slotCounter == (int)Time::SLOTS_PER_DAY) {
+                                slotCounter = 0;
                                 tmp_tm = localtime(&tmp_time);
                                 tmp_tm->tm_mday++;
                                 tmp_time = mktime(tmp_tm);
@@ -490,9 +1381,9 @@ namespace Space {
                                 std::cout << std::endl << "  -- " << tmp_string + " ";
                             }
                             std::cout <<
-                                (GetBit(timer.GetTimes()[timeCounter], bitCounter)? "/": ".");
+                                (GetBit(tmp_times[timeCounter], bitCounter)? "/": ".");
                             bitCounter++;
-                            hourCounter++;
+                            slotCounter++;
                         }
                         bitCounter = 0;
                         timeCounter++;
@@ -501,227 +1392,700 @@ namespace Space {
                 } else std::cout << " Not booked yet\n";
             }
         }
-        // Serialize function
-        nljs::json Serialize() {
-            nljs::json jdims = {
-                {"length", dims.GetLength()},
-                {"width", dims.GetWidth()},
-                {"height", dims.GetHeight()}
-            }, jseats = {
-                {"numberOfSeats", seats.GetNumberOfSeats()},
-                {"slanted", seats.IsSurround()},
-                {"surround", seats.IsSlanted()},
-                {"comfy", seats.IsComfy()}
-            }, jtimer = {
-                {"originTime", (unsigned long long)timer.GetOriginTime()},
-                {"times", timer.GetTimes()},
-                {"dirhamsPerHour", timer.GetDirhamsPerHour()}
-            }, jreview = {
-                {"reviewed", review.IsReviewed()},
-                {"score", review.GetReviewScore()},
-                {"numberOfReviews", review.GetNumberOfReviews()},
-                {"reviews", review.GetReviews()}
-            }, jspace = {
-                {"name", name},
-                {"ID", ID},
-                {"numberOfPeople", numberOfPeople},
-                {"outdoor", outdoor},
-                {"catering", catering},
-                {"naturalLight", naturalLight},
-                {"artificialLight", artificialLight},
-                {"projector", projector},
-                {"sound", sound},
-                {"cameras", cameras},
-                {"dims", jdims},
-                {"seats", jseats},
-                {"timer", jtimer},
-                {"review", jreview}
-            };
-            return jspace;
+        // Serialization
+        // .. Tags may be missing from older files
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("name", &Space::name),
+                Codec::Member("ID", &Space::ID),
+                Codec::Member("numberOfPeople", &Space::numberOfPeople),
+                Codec::Member("outdoor", &Space::outdoor),
+                Codec::Member("catering", &Space::catering),
+                Codec::Member("naturalLight", &Space::naturalLight),
+                Codec::Member("artificialLight", &Space::artificialLight),
+                Codec::Member("projector", &Space::projector),
+                Codec::Member("sound", &Space::sound),
+                Codec::Member("cameras", &Space::cameras),
+                Codec::Member("dims", &Space::dims),
+                Codec::Member("seats", &Space::seats),
+                Codec::Member("timer", &Space::timer),
+                Codec::Member("review", &Space::review),
+                Codec::Member("tags", &Space::tags, Codec::OPTIONAL)
+            );
+        }
+        nljs::json Serialize() const {
+            EVIES_METRIC_SCOPE(Metrics::SERIALIZE);
+            return Codec::ToJson(*this);
         }
-        // Deserialize function
         void Deserialize(const nljs::json& p_jspace) {
-            ID = p_jspace["ID"];
-            name = p_jspace["name"];
-            dims = Dimensions(
-                p_jspace["dims"]["length"].get<nljs::json::number_float_t>(),
-                p_jspace["dims"]["width"].get<nljs::json::number_float_t>(),
-                p_jspace["dims"]["height"].get<nljs::json::number_float_t>()
-            );
-            numberOfPeople = p_jspace["numberOfPeople"];
-            seats = Seating(
-                p_jspace["seats"]["numberOfSeats"], p_jspace["seats"]["slanted"],
-                p_jspace["seats"]["surround"], p_jspace["seats"]["comfy"]
-            );
-            outdoor = p_jspace["outdoor"];
-            catering = p_jspace["catering"];
-            naturalLight = p_jspace["naturalLight"];
-            artificialLight = p_jspace["artificialLight"];
-            projector = p_jspace["projector"];
-            sound = p_jspace["sound"];
-            cameras = p_jspace["cameras"];
-            review = Review();
-            review.SetBulkReviews(
-                p_jspace["review"]["score"].get<nljs::json::number_float_t>(),
-                p_jspace["review"]["numberOfReviews"],
-                p_jspace["review"]["reviews"].get<std::vector<std::string>>()
-            );
-            timer = Time(p_jspace["timer"]["dirhamsPerHour"], p_jspace["timer"]["originTime"]);
-            timer.SetBulkTimes(p_jspace["timer"]["times"].get<std::vector<unsigned long long>>());
+            tags.clear();
+            Codec::FromJson(p_jspace, *this);
         }
     };
 
     // Class to manage spaces
     // (running back of the application)
     class SpaceManager {
-        std::vector<Space*> spaces;
-        unsigned int emptyID = spaces.size();
+    public:
+        // Point-in-time view of every space (see GetSnapshot)
+        using Snapshot = Mvcc::Snapshot<Space>;
+    private:
+        // Copy-on-write table: readers can work on snapshots while spaces keep changing
+        Mvcc::Table<Space> spaces;
+        // Number of changes so far (spaces handed out for change count as one, once found changed)
+        unsigned long long changes = 0;
+        // Empty IDs below the table size, as a min-heap: the lowest is filled first
+        // .. Holes of unloaded shards come from their manifest, stale entries are dropped when taken
+        std::vector<unsigned int> freeIDs;
+
+        // Search index over names, tags & reviews
+        // .. Built on the first search, then kept up to date by AddSpace, DeleteSpace & AddReview
+        Search::Index index;
+        bool isIndexed = false;
+
+        // Spaces changed since they were last taken, for replicas (see TakeChangedIDs)
+        std::vector<unsigned int> changedIDs;
+        bool isTracking = false;
+
+        // Results of repeated queries
+        // .. Free time results are dropped once a space they read changes version,
+        // .. search results once the index changes (scores depend on every document)
+        Cache::Lru<std::vector<std::pair<unsigned int, time_t>>> freeCache;
+        Cache::Lru<std::vector<Search::Result>> searchCache;
+        // Spaces handed out for change since the last settle, with their versions then, one entry per ID
+        // .. Added or replaced spaces have no version to compare (-1), & were counted as changed already
+        std::unordered_map<unsigned int, unsigned long long> handedOut;
+
+        // Sharded storage state
+        Storage::ShardTable shards;
+
+        // Random engine for generated spaces, seeded once
+        std::mt19937 randomEngine{(unsigned int)time(NULL)};
+
+        // Free ID helpers
+        void PushFreeID(unsigned int p_ID) {
+            freeIDs.push_back(p_ID);
+            std::push_heap(freeIDs.begin(), freeIDs.end(), std::greater<unsigned int>());
+        }
+        // Lowest empty ID, taken out of the heap, or the table size when there is none
+        // .. Holes in shards that cannot be loaded are skipped
+        unsigned int TakeFreeID() {
+            while (!freeIDs.empty()) {
+                std::pop_heap(freeIDs.begin(), freeIDs.end(), std::greater<unsigned int>());
+                unsigned int ID = freeIDs.back();
+                freeIDs.pop_back();
+                if (ID < spaces.GetSize() && EnsureShard(shards.GetShardOf(ID)) && spaces.Get(ID) == nullptr)
+                    return ID;
+            }
+            // .. A shard must be loaded before it grows, or stores would keep its old file
+            EnsureShard(shards.GetShardOf(spaces.GetSize()));
+            return spaces.GetSize();
+        }
+        // Rebuild the free IDs of loaded spaces, and holes listed for unloaded shards
+        void ResetFreeIDs() {
+            freeIDs.clear();
+            for (unsigned int ID = 0; ID < spaces.GetSize(); ID++) {
+                unsigned int shard = shards.GetShardOf(ID);
+                if (shards.IsLoaded(shard)) {
+                    if (spaces.Get(ID) == nullptr) freeIDs.push_back(ID);
+                    continue;
+                }
+                // .. Whole unloaded shard at once
+                const Storage::Manifest::Shard& info = shards.GetManifest().shards[shard];
+                freeIDs.insert(freeIDs.end(), info.holes.begin(), info.holes.end());
+                ID = std::max(ID + 1, info.firstID + info.slots) - 1;
+            }
+            // .. Ascending IDs already form a min-heap, but manifests may list holes in any order
+            std::make_heap(freeIDs.begin(), freeIDs.end(), std::greater<unsigned int>());
+        }
+        // Count a change of the space at ID, & mark its shard for the next store
+        void MarkChanged(unsigned int ID) {
+            shards.MarkDirty(ID);
+            changes++;
+            if (isTracking) changedIDs.push_back(ID);
+            if (!freeCache.IsEmpty()) handedOut[ID] = (unsigned long long)-1;
+        }
+        // Remember the version of a space about to be changed in place
+        // .. Counted as a change by SettleChanges only if its version moved, so looking at it changes nothing
+        // .. The first version since the last settle is kept, so the set holds one entry per space at most
+        void MarkHandedOut(unsigned int ID) {
+            handedOut.emplace(ID, spaces.Get(ID)->GetVersion());
+        }
+        // Count the spaces changed since they were handed out, & drop the cached results that read them
+        // .. Done before anything reads changes: queries, change counts, replicas & stores
+        void SettleChanges() {
+            if (handedOut.empty()) return;
+            std::vector<unsigned int> IDs;
+            for (const auto& change: handedOut) {
+                const Space* space_ptr = spaces.Get(change.first);
+                if (change.second == (unsigned long long)-1) {
+                    IDs.push_back(change.first);
+                    continue;
+                }
+                if (space_ptr != nullptr && space_ptr->GetVersion() == change.second) continue;
+                IDs.push_back(change.first);
+                shards.MarkDirty(change.first);
+                changes++;
+                if (isTracking) changedIDs.push_back(change.first);
+            }
+            handedOut = std::unordered_map<unsigned int, unsigned long long>{};
+            std::sort(IDs.begin(), IDs.end());
+            freeCache.Invalidate(IDs);
+        }
+        // Forget every cached result, e.g. when the whole catalog is replaced
+        void ResetCaches() {
+            freeCache.InvalidateAll();
+            searchCache.InvalidateAll();
+            handedOut = std::unordered_map<unsigned int, unsigned long long>{};
+        }
+        // Take ownership of a single space
+        static std::unique_ptr<Space> Own(std::unique_ptr<Space>&& p_space_ptr) { return std::move(p_space_ptr); }
+        static std::unique_ptr<Space> Own(Space&& p_space) { return std::make_unique<Space>(std::move(p_space)); }
+        // Load a single shard file into its ID range
+        bool LoadShard(unsigned int p_shard) {
+            EVIES_METRIC_SCOPE(Metrics::LOAD_SHARD);
+            Trace::Span span("LoadShard", "load", p_shard);
+            const Storage::Manifest::Shard& info = shards.GetManifest().shards[p_shard];
+            Trace::Span deserializeSpan("Deserialize", "load");
+            try {
+                bool isRead = Storage::ForEachRecord(info.fileName, [&](nljs::json& jspace) {
+                    auto space_ptr = std::make_unique<Space>();
+                    space_ptr->Deserialize(jspace);
+                    unsigned int ID = space_ptr->GetID();
+                    // Ignore records outside of the shard range
+                    if (ID >= info.firstID && ID < info.firstID + info.slots)
+                        spaces.Set(ID, std::move(space_ptr));
+                    return true;
+                });
+                if (!isRead) {
+                    std::cout << "Could not load shard " << info.fileName << std::endl;
+                    return false;
+                }
+            } catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            deserializeSpan.End();
+            // .. Changes in place are marked by SettleChanges, so no version sum is kept
+            shards.MarkLoaded(p_shard);
+            return true;
+        }
+        // Write a single shard file from its ID range in a snapshot
+        static bool StoreShard(const Snapshot& p_snapshot, unsigned int p_shard, const Storage::Manifest::Shard& p_info) {
+            Trace::Span span("StoreShard", "store", p_shard);
+            nljs::json jspaces = nljs::json::array();
+            Trace::Span serializeSpan("Serialize", "store");
+            try {
+                for (unsigned int ID = p_info.firstID; ID < p_info.firstID + p_info.slots; ID++)
+                    if (p_snapshot.Get(ID) != nullptr) jspaces.push_back(p_snapshot.Get(ID)->Serialize());
+            } catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            serializeSpan.SetCount(jspaces.size());
+            serializeSpan.End();
+            return Storage::WriteRecords(p_info.fileName, jspaces);
+        }
+        // Weighted text fields of a space for the search index
+        static std::vector<std::pair<std::string_view, unsigned int>> SearchFields(const Space& p_space) {
+            std::vector<std::pair<std::string_view, unsigned int>> fields;
+            fields.emplace_back(p_space.GetName(), SEARCH_NAME_WEIGHT);
+            for (const Intern::String& tag: p_space.GetTags())
+                fields.emplace_back(tag, SEARCH_TAG_WEIGHT);
+            for (const Intern::String& review: p_space.review.GetReviews())
+                fields.emplace_back(review, SEARCH_REVIEW_WEIGHT);
+            return fields;
+        }
+        // Build the search index over every space
+        bool EnsureIndex() {
+            if (isIndexed) return true;
+            if (!EnsureAllShards()) return false;
+            Trace::Span span("BuildIndex", "bulk", spaces.GetSize());
+            index.Clear();
+            for (unsigned int ID = 0; ID < spaces.GetSize(); ID++)
+                if (spaces.Get(ID) != nullptr) index.AddDocument(ID, SearchFields(*spaces.Get(ID)));
+            isIndexed = true;
+            return true;
+        }
+        // Load shards on demand
+        bool EnsureShard(unsigned int p_shard) {
+            if (shards.IsLoaded(p_shard)) return true;
+            return LoadShard(p_shard);
+        }
+        bool EnsureAllShards() {
+            if (shards.IsAllLoaded()) return true;
+            std::vector<std::function<bool()>> jobs;
+            for (unsigned int shard = 0; shard < shards.GetManifest().shards.size(); shard++)
+                if (!shards.IsLoaded(shard)) {
+                    // .. Loaders then only write their own slots, never copy shared parts of the table
+                    const Storage::Manifest::Shard& info = shards.GetManifest().shards[shard];
+                    spaces.Unshare(info.firstID, info.firstID + info.slots);
+                    jobs.push_back([this, shard]() { return LoadShard(shard); });
+                }
+            Trace::Span span("LoadShards", "load", jobs.size());
+            return Storage::RunParallel(jobs);
+        }
     public:
         // Constructors & destructors
         SpaceManager() {}
-        ~SpaceManager() {
-            for (auto i = spaces.begin(); i != spaces.end(); i++)
-                delete *i;
+
+        // Setters
+        void SetRandomSeed(unsigned int p_seed) { randomEngine.seed(p_seed); }
+        // Bytes kept at most by each query cache, 0 to turn caching off
+        void SetCacheBudget(unsigned long long p_bytes) {
+            freeCache.SetBudget(p_bytes);
+            searchCache.SetBudget(p_bytes);
         }
 
         // Getters
-        unsigned int GetEmptyID() const { return emptyID; }
+        unsigned int GetEmptyID() const { return freeIDs.empty() ? spaces.GetSize() : freeIDs.front(); }
+        // Number of IDs in use, including empty ones
+        unsigned int GetSpaceCount() const { return spaces.GetSize(); }
+        // Grows with every change, e.g. to decide when to store
+        unsigned long long GetChangeCount() {
+            SettleChanges();
+            return changes;
+        }
+        // Hits, misses & memory of the query caches
+        Cache::Stats GetCacheStats() const {
+            Cache::Stats stats = freeCache.GetStats();
+            stats += searchCache.GetStats();
+            return stats;
+        }
+        // Heap bytes of the spaces in memory, the table, the index, the caches & the text pool
+        // .. Unloaded shards are not loaded for this
+        void CountMemory(Memory::Report& p_report) const {
+            for (unsigned int ID = 0; ID < spaces.GetSize(); ID++)
+                if (spaces.Get(ID) != nullptr) spaces.Get(ID)->CountMemory(p_report);
+            p_report.Add(Memory::SPACE_TABLE, spaces.GetBytes() + Memory::VectorBytes(freeIDs)
+                + Memory::VectorBytes(changedIDs) + handedOut.bucket_count() * sizeof(void*)
+                + handedOut.size() * (sizeof(std::pair<unsigned int, unsigned long long>) + sizeof(void*)), spaces.GetSize());
+            p_report.Add(Memory::SEARCH_INDEX, index.GetBytes(), index.GetTermCount());
+            Cache::Stats stats = GetCacheStats();
+            p_report.Add(Memory::QUERY_CACHE, stats.bytes, stats.entries);
+            p_report.Add(Memory::TEXT, Intern::GetPool().GetBytes(), Intern::GetPool().GetCount());
+        }
 
         // Interface
-        // Add space via reference (returns ID)
-        unsigned int AddSpace(const Space& p_space) {
-            // Check if full of running spaces
-            bool isFull = false;
-            if (emptyID == spaces.size()) {
-                spaces.push_back(nullptr);
-                isFull = true;
-            }
-            // Create new space at position
-            int ID = emptyID;
-            spaces[emptyID] = new Space(p_space, emptyID);
-
-            // Find next empty space
-            if (isFull) emptyID = spaces.size();
-            else while (emptyID != spaces.size()) {
-                if (spaces[emptyID] == nullptr) break;
-                emptyID++;
+        // Add space, taking ownership (returns ID)
+        // .. The space always takes the ID of its slot
+        unsigned int AddSpace(std::unique_ptr<Space> p_space_ptr) {
+            unsigned int ID = TakeFreeID();
+            if (p_space_ptr->GetID() != ID) p_space_ptr->SetID(ID);
+            if (ID == spaces.GetSize()) spaces.Resize(ID + 1);
+            spaces.Set(ID, std::move(p_space_ptr));
+            MarkChanged(ID);
+            if (isIndexed) {
+                index.AddDocument(ID, SearchFields(*spaces.Get(ID)));
+                searchCache.InvalidateAll();
             }
             return ID;
         }
-        // Add space via pointer (returns ID)
-        unsigned int AddSpace(Space* p_space_ptr) {
-            // Check if full of running spaces
-            bool isFull = false;
-            if (emptyID == spaces.size()) {
-                spaces.push_back(nullptr);
-                isFull = true;
-            }
-            // Create new space at position
-            int ID = emptyID;
-            spaces[emptyID] = p_space_ptr;
-
-            // Find next empty space
-            if (isFull) emptyID = spaces.size();
-            else while (emptyID != spaces.size()) {
-                if (spaces[emptyID] == nullptr) break;
-                emptyID++;
-            }
-            return ID;
+        // Add space via move or copy (returns ID)
+        unsigned int AddSpace(Space&& p_space) { return AddSpace(Own(std::move(p_space))); }
+        unsigned int AddSpace(const Space& p_space) { return AddSpace(std::make_unique<Space>(p_space)); }
+        // Build a space in place from Space constructor arguments (returns ID)
+        template <typename... Args>
+        unsigned int EmplaceSpace(Args&&... p_args) {
+            return AddSpace(std::make_unique<Space>(std::forward<Args>(p_args)...));
+        }
+        // Add many spaces at once, moved out of a range of spaces or unique_ptrs (returns IDs in order)
+        // .. Holes are filled first, then room for the rest is reserved once
+        template <typename Range>
+        std::vector<unsigned int> AddSpaces(Range&& p_spaces) {
+            Trace::Span span("AddSpaces", "bulk");
+            std::vector<unsigned int> IDs;
+            unsigned long count = std::distance(std::begin(p_spaces), std::end(p_spaces));
+            IDs.reserve(count);
+            if (count > freeIDs.size()) spaces.Reserve(spaces.GetSize() + count - freeIDs.size());
+            for (auto& element: p_spaces)
+                IDs.push_back(AddSpace(Own(std::move(element))));
+            span.SetCount(IDs.size());
+            return IDs;
         }
         // Delete space
         bool DeleteSpace(unsigned int ID) {
-            if (ID >= spaces.size()) return false;
-            if (spaces[ID] != nullptr) {
-                delete spaces[ID];
-                spaces[ID] = nullptr;
-                if (emptyID > ID) emptyID = ID;
+            if (ID >= spaces.GetSize()) return false;
+            if (!EnsureShard(shards.GetShardOf(ID))) return false;
+            if (spaces.Get(ID) != nullptr) {
+                if (isIndexed) {
+                    index.RemoveDocument(ID, SearchFields(*spaces.Get(ID)));
+                    searchCache.InvalidateAll();
+                }
+                spaces.Set(ID, nullptr);
+                MarkChanged(ID);
+                PushFreeID(ID);
             } 
             return false;
         }
-        // Get space
+        // Get space to change it
+        // .. Loads the space's shard if needed
+        // .. A space still seen by a snapshot is copied first, the snapshot keeps the old one
+        // .. Changes must be made before the next query, change count or store, which look for them
         Space* GetSpace(unsigned int ID) {
-            if (ID >= spaces.size()) return nullptr;
-            else return spaces[ID];
+            if (ID >= spaces.GetSize()) return nullptr;
+            if (!EnsureShard(shards.GetShardOf(ID))) return nullptr;
+            if (spaces.Get(ID) == nullptr) return nullptr;
+            // .. Its shard is marked once the space is found changed, so stores skip unmarked shards without scanning them
+            MarkHandedOut(ID);
+            return spaces.GetMutable(ID);
+        }
+        // Get space to read it, never copied
+        const Space* ReadSpace(unsigned int ID) {
+            if (ID >= spaces.GetSize()) return nullptr;
+            if (!EnsureShard(shards.GetShardOf(ID))) return nullptr;
+            else return spaces.Get(ID);
+        }
+        // Point-in-time view of every space, after loading all shards
+        // .. Readable from any thread without locks while spaces keep changing here
+        // .. Spaces changed afterwards are copied once, so take snapshots for long or concurrent reads
+        Snapshot GetSnapshot() {
+            EnsureAllShards();
+            return spaces.GetSnapshot();
+        }
+        // Add review to a space
+        bool AddReview(unsigned int ID, const Intern::String& p_review, float p_score) {
+            Space* space_ptr = GetSpace(ID);
+            if (space_ptr == nullptr) return false;
+            space_ptr->review.AddReview(p_review, p_score);
+            if (isIndexed) {
+                index.AddText(ID, p_review, SEARCH_REVIEW_WEIGHT);
+                searchCache.InvalidateAll();
+            }
+            return true;
+        }
+        // Search spaces by name, tags & reviews
+        // .. Up to p_maxResults IDs & scores, best first
+        // .. Repeated queries are answered from the cache, whatever the order, case or plurals of their words
+        std::vector<Search::Result> SearchSpaces(const std::string& p_query, unsigned int p_maxResults = 10) {
+            EVIES_METRIC_SCOPE(Metrics::SEARCH);
+            if (!EnsureIndex()) return std::vector<Search::Result>{};
+            std::vector<std::string> tokens = Search::Tokenize(p_query);
+            std::sort(tokens.begin(), tokens.end());
+            tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+            std::string key = std::to_string(p_maxResults);
+            for (const std::string& token: tokens) key += ' ' + token;
+            if (const auto* cached_ptr = searchCache.Get(key)) return *cached_ptr;
+            std::vector<Search::Result> results = index.Query(p_query, p_maxResults);
+            searchCache.Put(key, results, 0, 0);
+            return results;
+        }
+        // Find spaces with p_hours free hours starting between p_fromTime & p_toTime
+        // .. Up to p_maxResults (0 for all) pairs of ID & earliest start, in ID order
+        // .. Repeated queries are answered from the cache until a space they read changes
+        // .. Changes through GetSpace must be made before the next query
+        std::vector<std::pair<unsigned int, time_t>> FindFreeSpaces(const time_t& p_fromTime, const time_t& p_toTime,
+            unsigned int p_hours, unsigned int p_maxResults = 0) {
+            SettleChanges();
+            std::string key = std::to_string(p_fromTime) + ' ' + std::to_string(p_toTime) + ' '
+                + std::to_string(p_hours) + ' ' + std::to_string(p_maxResults);
+            if (const auto* cached_ptr = freeCache.Get(key)) return *cached_ptr;
+            std::vector<std::pair<unsigned int, time_t>> results;
+            // .. A complete scan also depends on spaces added later
+            unsigned int lastID = (unsigned int)-1;
+            for (unsigned int ID = 0; ID < spaces.GetSize(); ID++) {
+                const Space* space_ptr = ReadSpace(ID);
+                time_t startTime;
+                if (space_ptr != nullptr && space_ptr->timer.FindFree(p_fromTime, p_toTime, p_hours, startTime)) {
+                    results.push_back(std::make_pair(ID, startTime));
+                    if (results.size() == p_maxResults) {
+                        lastID = ID + 1;
+                        break;
+                    }
+                }
+            }
+            freeCache.Put(key, results, 0, lastID);
+            return results;
+        }
+        // Quote the same time range on many spaces without reserving
+        // .. -1 for missing spaces or invalid ranges
+        std::vector<double> QuoteSpaces(const std::vector<unsigned int>& p_IDs,
+            const time_t& p_startTime, const time_t& p_endTime) {
+            std::vector<double> prices(p_IDs.size(), -1);
+            for (unsigned int i = 0; i < p_IDs.size(); i++) {
+                const Space* space_ptr = ReadSpace(p_IDs[i]);
+                double price;
+                if (space_ptr != nullptr && space_ptr->timer.Quote(p_startTime, p_endTime, price))
+                    prices[i] = price;
+            }
+            return prices;
         }
         // Print some details to cmd line
         inline void PrintSpaces(bool withReviews = true, bool withTimes = true,
             bool withDetails = true) {
-            for (auto space_ptr: spaces)
-                if (space_ptr != nullptr) {
+            EVIES_METRIC_SCOPE(Metrics::PRINT_SPACES);
+            Trace::Span span("PrintSpaces", "bulk", spaces.GetSize());
+            EnsureAllShards();
+            Trace::Span printSpan("Print", "bulk");
+            for (unsigned int ID = 0; ID < spaces.GetSize(); ID++)
+                if (spaces.Get(ID) != nullptr) {
                     std::cout << std::endl;
-                    space_ptr->PrintSpace(withReviews, withTimes, withDetails);
+                    spaces.Get(ID)->PrintSpace(withReviews, withTimes, withDetails);
                 }
-            if (spaces.size() == 0) std::cout << "No spaces yet!\n";
+            if (spaces.GetSize() == 0) std::cout << "No spaces yet!\n";
         }
 
         // Data persistence
         // Storing & reading data
+        // .. The file is replaced atomically: a failed store leaves the previous one intact
         bool StoreData(std::string p_fileName = SPACE_FILE) {
-            std::ofstream outFile(p_fileName);
-            if (!outFile.is_open())
+            if (!EnsureAllShards())
                 return false;
-            
+            return StoreSnapshot(GetSnapshot(), p_fileName);
+        }
+        // Store a snapshot, from any thread
+        static bool StoreSnapshot(const Snapshot& p_snapshot, const std::string& p_fileName) {
+            EVIES_METRIC_SCOPE(Metrics::STORE_DATA);
+            Trace::Span span("StoreData", "store", p_snapshot.GetSize());
             // Wrap try-catch block
             try {
-                nljs::json jspaces;
-                for (auto space_ptr: spaces) {
+                Trace::Span serializeSpan("Serialize", "store", p_snapshot.GetSize());
+                nljs::json jspaces = nljs::json::array();
+                for (unsigned int ID = 0; ID < p_snapshot.GetSize(); ID++) {
+                    const Space* space_ptr = p_snapshot.Get(ID);
                     if (space_ptr == nullptr) jspaces.push_back(nullptr);
                     else jspaces.push_back(space_ptr->Serialize());
                 }
+                serializeSpan.End();
                 // Write to file
-                outFile << std::setw(4) << jspaces << std::endl;
+                if (!Storage::WriteRecords(p_fileName, jspaces))
+                    return false;
             } catch (std::exception e) {
-                outFile.close();
                 std::cout << e.what() << std::endl;
                 return false;
             }
             // Save data success
-            outFile.close();
             return true;
         }
+        // Store a snapshot of every space on a background thread
+        // .. Bookings go on meanwhile; the file holds the spaces as they were when called
+        std::future<bool> ExportData(std::string p_fileName = EXPORT_FILE) {
+            return std::async(std::launch::async, [](Snapshot p_snapshot, std::string p_fileName) {
+                Trace::SetThreadName("export");
+                return StoreSnapshot(p_snapshot, p_fileName);
+            }, GetSnapshot(), p_fileName);
+        }
+        // .. Damaged records are skipped, leaving their IDs empty
         bool LoadData(std::string p_fileName = SPACE_FILE) {
-            std::ifstream inFile(p_fileName);
-            if (!inFile.is_open())
+            std::vector<std::unique_ptr<Space>> loaded;
+            if (!ReadData(p_fileName, loaded))
                 return false;
-            
-            // Wrap try-catch block
-            try {
-                nljs::json jspaces;
-                inFile >> jspaces;
-                // Deallocate
-                for (auto i = spaces.begin(); i != spaces.end(); i++)
-                    delete *i;
-                spaces = std::vector<Space*>{};
-                bool isFull = true;
-                for (auto jspace: jspaces) {
-                    if (jspace == nullptr) {
-                        if (isFull) {
-                            isFull = false;
-                            emptyID = spaces.size();
-                        }
-                        spaces.push_back(nullptr);
-                    } else {
-                        spaces.push_back(new Space());
-                        spaces.back()->Deserialize(jspace);
-                    }
+            AdoptData(loaded);
+            // Load data success
+            return true;
+        }
+        // Read the spaces of a file without replacing the current ones (see AdoptData)
+        // .. e.g. to replace them only once other files are read too
+        static bool ReadData(const std::string& p_fileName, std::vector<std::unique_ptr<Space>>& p_loaded) {
+            EVIES_METRIC_SCOPE(Metrics::LOAD_DATA);
+            Trace::Span span("LoadData", "load");
+            // Build spaces as their records are read, placed by their ID
+            // .. Null records only hold a position
+            Trace::Span deserializeSpan("Deserialize", "load");
+            p_loaded.clear();
+            unsigned int position = 0, damaged = 0;
+            bool isRead = Storage::ForEachRecord(p_fileName, [&](nljs::json& jspace) {
+                if (jspace == nullptr) {
+                    position++;
+                    return true;
                 }
-                if (isFull) emptyID = spaces.size();
-            } catch (std::exception e) {
-                inFile.close();
-                std::cout << e.what() << std::endl;
+                // Wrap try-catch block
+                auto space_ptr = std::make_unique<Space>();
+                try {
+                    space_ptr->Deserialize(jspace);
+                } catch (std::exception& e) {
+                    damaged++;
+                    position++;
+                    return true;
+                }
+                // .. IDs out of bounds or read twice are damaged as well
+                unsigned int ID = space_ptr->GetID();
+                if (ID >= MAX_RECORD_ID || (ID < p_loaded.size() && p_loaded[ID] != nullptr)) {
+                    damaged++;
+                    position++;
+                    return true;
+                }
+                position = ID + 1;
+                if (p_loaded.size() < position) p_loaded.resize(position);
+                p_loaded[ID] = std::move(space_ptr);
+                return true;
+            });
+            if (!isRead) {
+                p_loaded.clear();
                 return false;
             }
-            // Load data success
-            inFile.close();
+            if (p_loaded.size() < position) p_loaded.resize(position);
+            deserializeSpan.SetCount(p_loaded.size());
+            span.SetCount(p_loaded.size());
+            if (damaged != 0)
+                std::cout << "Skipped " << damaged << " damaged space(s)" << std::endl;
+            return true;
+        }
+        // Replace every space with spaces read by ReadData
+        void AdoptData(std::vector<std::unique_ptr<Space>>& p_loaded) {
+            // Deallocate
+            Trace::Span allocateSpan("Allocate", "load", spaces.GetSize());
+            spaces.Reset(p_loaded.size());
+            for (unsigned int ID = 0; ID < p_loaded.size(); ID++)
+                if (p_loaded[ID] != nullptr) spaces.Set(ID, std::move(p_loaded[ID]));
+            p_loaded.clear();
+            allocateSpan.End();
+            // Rebuild the shard table & free ID
+            Trace::Span indexSpan("Index", "load");
+            shards.Reset();
+            isIndexed = false;
+            index.Clear();
+            ResetCaches();
+            ResetFreeIDs();
+        }
+
+        // Sharded data persistence
+        // .. Spaces are partitioned by ID range into shard files listed in a manifest
+        // .. Only dirty shards are rewritten, on parallel threads
+        // Describe the next generation in a manifest and queue the writes of its dirty shards
+        // .. The writes read a snapshot: they may run on another thread while spaces keep changing
+        bool CaptureShards(const std::string& p_baseName, Storage::Manifest& p_manifest, Storage::ShardWrites& p_writes) {
+            Trace::Span span("CaptureShards", "store");
+            SettleChanges();
+            // Storing under another name rewrites every shard
+            if (p_baseName != shards.GetBaseName()) {
+                if (!EnsureAllShards())
+                    return false;
+                shards.Reset();
+            }
+            const Storage::Manifest& oldManifest = shards.GetManifest();
+            unsigned int shardSize = shards.GetShardSize();
+            unsigned int shardCount = (spaces.GetSize() + shardSize - 1) / shardSize;
+            p_manifest = Storage::Manifest();
+            p_manifest.generation = shards.GetNextGeneration();
+            p_manifest.shardSize = shardSize;
+            p_manifest.totalSlots = spaces.GetSize();
+            // .. Taken on the first dirty shard only: clean catalogs start no new epoch
+            std::shared_ptr<const Snapshot> snapshot;
+            for (unsigned int shard = 0; shard < shardCount; shard++) {
+                Storage::Manifest::Shard info;
+                if (!shards.IsLoaded(shard) || !shards.IsDirty(shard)) {
+                    // Untouched since load or last store: keep file as is
+                    info = oldManifest.shards[shard];
+                } else {
+                    info.firstID = shard * shardSize;
+                    info.slots = std::min<unsigned int>(shardSize, spaces.GetSize() - info.firstID);
+                    for (unsigned int ID = info.firstID; ID < info.firstID + info.slots; ID++)
+                        if (spaces.Get(ID) == nullptr) info.holes.push_back(ID);
+                    info.mark = shards.GetMark(shard);
+                    info.fileName = Storage::ShardFileName(p_baseName, shard, p_manifest.generation);
+                    if (snapshot == nullptr) snapshot = std::make_shared<const Snapshot>(spaces.GetSnapshot());
+                    p_writes.Add(info.fileName, [snapshot, shard, info]() { return StoreShard(*snapshot, shard, info); });
+                }
+                p_manifest.shards.push_back(info);
+            }
+            return true;
+        }
+        // Write dirty shards under the next generation and describe them in a manifest
+        // .. Nothing is visible to loaders until that manifest is committed
+        bool PrepareShards(const std::string& p_baseName, Storage::Manifest& p_manifest) {
+            EVIES_METRIC_SCOPE(Metrics::STORE_SHARDS);
+            Trace::Span span("PrepareShards", "store");
+            Storage::ShardWrites writes;
+            if (!CaptureShards(p_baseName, p_manifest, writes))
+                return false;
+            return writes.Run();
+        }
+        // Adopt a committed manifest and remove the shard files it replaced
+        // .. Shards changed since they were captured stay dirty
+        void FinishShards(const std::string& p_baseName, const Storage::Manifest& p_manifest) {
+            if (p_baseName == shards.GetBaseName())
+                shards.RemoveStaleFiles(p_manifest);
+            shards.SetManifest(p_baseName, p_manifest);
+            for (unsigned int shard = 0; shard < p_manifest.shards.size(); shard++)
+                if (shards.IsLoaded(shard) && shards.IsDirty(shard))
+                    shards.MarkStored(shard, p_manifest.shards[shard].version, p_manifest.shards[shard].mark);
+        }
+        // Adopt a manifest without loading anything: shards are loaded on first access
+        void AttachShards(const std::string& p_baseName, const Storage::Manifest& p_manifest) {
+            // Deallocate
+            spaces.Reset(p_manifest.totalSlots);
+            shards.Attach(p_baseName, p_manifest);
+            isIndexed = false;
+            index.Clear();
+            ResetCaches();
+            ResetFreeIDs();
+        }
+        bool StoreShards(std::string p_baseName = SPACE_FILE) {
+            Storage::Manifest manifest;
+            if (!PrepareShards(p_baseName, manifest))
+                return false;
+            if (!manifest.Store(p_baseName))
+                return false;
+            FinishShards(p_baseName, manifest);
+            return true;
+        }
+        // Load every shard not loaded yet, e.g. before reading spaces from several threads
+        bool LoadAllShards() { return EnsureAllShards(); }
+        bool LoadShards(std::string p_baseName = SPACE_FILE) {
+            Storage::Manifest manifest;
+            if (!manifest.Load(p_baseName))
+                return false;
+            AttachShards(p_baseName, manifest);
             return true;
         }
 
+        // Replication
+        // .. The writer tracks which spaces change; followers put spaces by ID as they are published
+        // Record changed IDs from now on (or stop & forget them)
+        void TrackChanges(bool p_isTracking) {
+            isTracking = p_isTracking;
+            changedIDs = std::vector<unsigned int>{};
+        }
+        // IDs of spaces added, deleted or changed through GetSpace since the last call, in ID order
+        std::vector<unsigned int> TakeChangedIDs() {
+            SettleChanges();
+            std::vector<unsigned int> IDs;
+            IDs.swap(changedIDs);
+            std::sort(IDs.begin(), IDs.end());
+            IDs.erase(std::unique(IDs.begin(), IDs.end()), IDs.end());
+            return IDs;
+        }
+        // Put a space at ID as it is, or empty ID with nullptr
+        // .. Unlike AddSpace, the ID is not chosen here: IDs in between stay empty
+        void PutSpace(unsigned int ID, std::unique_ptr<Space> p_space_ptr) {
+            if (ID >= spaces.GetSize()) {
+                EnsureShard(shards.GetShardOf(spaces.GetSize()));
+                for (unsigned int freeID = spaces.GetSize(); freeID < ID; freeID++) PushFreeID(freeID);
+                spaces.Resize(ID + 1);
+            } else if (!EnsureShard(shards.GetShardOf(ID))) return;
+            const Space* old_ptr = spaces.Get(ID);
+            if (old_ptr == nullptr && p_space_ptr == nullptr) return;
+            if (old_ptr != nullptr && isIndexed) {
+                index.RemoveDocument(ID, SearchFields(*old_ptr));
+                searchCache.InvalidateAll();
+            }
+            if (old_ptr != nullptr && p_space_ptr == nullptr) PushFreeID(ID);
+            if (p_space_ptr != nullptr && p_space_ptr->GetID() != ID) p_space_ptr->SetID(ID);
+            spaces.Set(ID, std::move(p_space_ptr));
+            if (spaces.Get(ID) != nullptr && isIndexed) {
+                index.AddDocument(ID, SearchFields(*spaces.Get(ID)));
+                searchCache.InvalidateAll();
+            }
+            MarkChanged(ID);
+        }
+        // Drop every space, leaving p_size empty IDs
+        void Clear(unsigned int p_size = 0) {
+            spaces.Reset(p_size);
+            shards.Reset();
+            isIndexed = false;
+            index.Clear();
+            ResetCaches();
+            ResetFreeIDs();
+            changes++;
+        }
+
         // Utility
-        // Generate some random spaces
-        void GetRandomizedSpaces(int n, std::string p_name = "") {
-            // spaces = std::vector<Space*>{};
-            std::srand(time(NULL));
-            unsigned int returnID;
+        // Generate some random spaces (returns the IDs they were given)
+        std::vector<unsigned int> GetRandomizedSpaces(int n, std::string p_name = "") {
+            Trace::Span span("GetRandomizedSpaces", "bulk", n);
+            std::vector<unsigned int> IDs;
+            auto Rand = [this](unsigned int p_range) { return randomEngine() % p_range; };
             for (int i = 0; i < n; i++) {
                 // Check if name is supplied
                 std::string tmpName = "";
@@ -731,43 +2095,49 @@ namespace Space {
                     const std::string randLocs[] =
                         {"Building", "Park", "Hall", "Hotel", "Stadium", "Cafe", "Center", "Gallery", "Bar", "Arena"};
                     for (int j = 0; j < 3; j++)
-                        tmpName.push_back((char)(rand() % 26 + 65));
-                    tmpName += " " + randLocs[rand() % 10];
+                        tmpName.push_back((char)(Rand(26) + 65));
+                    tmpName += " " + randLocs[Rand(10)];
                 }
                 
                 // Create space
-                unsigned int newID = emptyID;
-                AddSpace(
-                    new Space(
-                        newID,                                  // ID
-                        tmpName,                                // name
-
-                                                                // For dimensions
-                        rand() % 90 + 10,                       // length
-                        rand() % 45 + 5,                        // width
-                        rand() % 10 + 2,                        // height
-
-                        rand() % 990 + 10,                      // number of people
-
-                                                                // For seating
-                        rand() % 490 + 10,                      // number of seats
-                        (bool)(rand() % 2),                     // slanted?
-                        (bool)(rand() % 2),                     // surround?
-                        (bool)(rand() % 2),                     // comfy?
-
-                                                                // For timer
-                        rand() % 9900 + 100,                    // price
-
-                        (bool)(rand() % 2),                     // outdoor?
-                        (bool)(rand() % 2),                     // catering?
-                        (bool)(rand() % 2),                     // naturalLight?
-                        (bool)(rand() % 2),                     // artificialLight?
-                        (bool)(rand() % 2),                     // projector?
-                        (bool)(rand() % 2),                     // sound?
-                        (bool)(rand() % 2)                      // camera?
-                    )
+                auto space_ptr = std::make_unique<Space>(
+                    0,                                      // ID (assigned by AddSpace)
+                    tmpName,                                // name
+
+                                                            // For dimensions
+                    Rand(90) + 10,                       // length
+                    Rand(45) + 5,                        // width
+                    Rand(10) + 2,                        // height
+
+                    Rand(990) + 10,                      // number of people
+
+                                                            // For seating
+                    Rand(490) + 10,                      // number of seats
+                    (bool)(Rand(2)),                     // slanted?
+                    (bool)(Rand(2)),                     // surround?
+                    (bool)(Rand(2)),                     // comfy?
+
+                                                            // For timer
+                    Rand(9900) + 100,                    // price
+
+                    (bool)(Rand(2)),                     // outdoor?
+                    (bool)(Rand(2)),                     // catering?
+                    (bool)(Rand(2)),                     // naturalLight?
+                    (bool)(Rand(2)),                     // artificialLight?
+                    (bool)(Rand(2)),                     // projector?
+                    (bool)(Rand(2)),                     // sound?
+                    (bool)(Rand(2))                      // camera?
                 );
 
+                // Add some tags before indexing
+                const std::string randTags[] =
+                    {"wedding", "conference", "concert", "party", "workshop", "exhibition", "meetup", "screening"};
+                int numOfTags = Rand(3);
+                for (int j = 0; j < numOfTags; j++)
+                    space_ptr->AddTag(randTags[Rand(8)]);
+                unsigned int newID = AddSpace(std::move(space_ptr));
+                IDs.push_back(newID);
+
                 // Add bogus reviews
                 const std::string randRevs[] = {
                     "Very bad, not good",
@@ -781,11 +2151,12 @@ namespace Space {
                     "need more trashbins",
                     "Good sound system & cameras"
                 };
-                int numOfReviews = rand() % 3 + 1;
+                int numOfReviews = Rand(3) + 1;
                 for (int j = 0; j < numOfReviews; j++)
-                    spaces[newID]->review.AddReview(randRevs[rand() % 10], rand() % 6);
+                    AddReview(newID, randRevs[Rand(10)], Rand(6));
                 
             }
+            return IDs;
         }
     };
 }
@@ -0,0 +1,587 @@
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <system_error>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+
+// POSIX file API for fsync & rename
+#include <fcntl.h>
+#include <unistd.h>
+
+// JSON library courtesy of:
+// https://github.com/nlohmann/json
+#include "json.hpp"
+namespace nljs = nlohmann;
+
+// Span tracing
+#include "trace.hpp"
+
+// Number of IDs covered by each shard file
+#ifndef SHARD_SIZE
+#define SHARD_SIZE 1024
+#endif
+// Records with an ID from this one up are taken for damaged ones when a single file is read
+// .. Bounds the table a record can make the reader allocate
+#ifndef MAX_RECORD_ID
+#define MAX_RECORD_ID (1u << 24)
+#endif
+// Suffix of the manifest file listing the shards
+#define MANIFEST_SUFFIX ".manifest"
+// Suffix of files being written before they are renamed in place
+#define TEMP_SUFFIX ".tmp"
+// Random hidden file committing space & user shards together
+#define COMMIT_FILE "magical.commit"
+// Suffix of files written to replace their target together with others (see CommitFiles)
+#define NEXT_SUFFIX ".next"
+// Random hidden file listing single files being replaced together
+#define INTENT_FILE "magical.intent"
+
+namespace Storage {
+    // Utility functions
+    // Name of shard file for a given base name and generation
+    // .. e.g. "magical.file" -> "magical.file.3.g7"
+    // .. Each store writes changed shards under a new generation,
+    // .. so files referenced by the last commit are never overwritten
+    inline std::string ShardFileName(const std::string& p_baseName, unsigned int p_shard,
+        unsigned long long p_generation) {
+        return p_baseName + "." + std::to_string(p_shard) + ".g" + std::to_string(p_generation);
+    }
+    // Run jobs on a pool of threads and wait for all of them
+    // .. At most one thread per core: workers take the next job from a shared index until none is left,
+    // .. and the calling thread works too, so jobs still run if no thread can be started
+    // .. Returns true only if every job succeeded
+    inline bool RunParallel(const std::vector<std::function<bool()>>& p_jobs) {
+        if (p_jobs.size() == 1) return p_jobs[0]();
+        std::vector<char> results(p_jobs.size(), false);
+        std::atomic<size_t> next{0};
+        auto Work = [&]() {
+            for (size_t i = next++; i < p_jobs.size(); i = next++)
+                results[i] = p_jobs[i]();
+        };
+        size_t workers = std::min<size_t>(p_jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::thread> threads;
+        try {
+            for (size_t i = 1; i < workers; i++)
+                threads.emplace_back([&]() {
+                    Trace::SetThreadName("storage");
+                    Work();
+                });
+        } catch (std::system_error& e) {
+            // .. Fewer workers then, the ones started are joined below
+        }
+        Work();
+        for (auto& thread: threads) thread.join();
+        for (char result: results)
+            if (!result) return false;
+        return true;
+    }
+    // CRC-32 (IEEE) checksum
+    inline unsigned int Crc32(const char* p_data, size_t p_size) {
+        static const std::vector<unsigned int> table = []() {
+            std::vector<unsigned int> tmp_table(256);
+            for (unsigned int i = 0; i < 256; i++) {
+                unsigned int crc = i;
+                for (int j = 0; j < 8; j++)
+                    crc = (crc & 1) ? (0xEDB88320u ^ (crc >> 1)) : (crc >> 1);
+                tmp_table[i] = crc;
+            }
+            return tmp_table;
+        }();
+        unsigned int crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < p_size; i++)
+            crc = table[(crc ^ (unsigned char)p_data[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+    // Flush the directory entry of a file, e.g. after a rename
+    inline void SyncDirectory(const std::string& p_fileName) {
+        size_t slash = p_fileName.find_last_of('/');
+        std::string dirName = (slash == std::string::npos) ? "." : p_fileName.substr(0, slash + 1);
+        int dirFd = open(dirName.c_str(), O_RDONLY);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+    // Atomically replace a file's content
+    // .. Written to a temporary file, flushed to disk, then renamed in place:
+    // .. a crash leaves either the old or the new file, never a torn one
+    inline bool AtomicWriteFile(const std::string& p_fileName, const std::string& p_content) {
+        std::string tmpName = p_fileName + TEMP_SUFFIX;
+        int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        size_t written = 0;
+        while (written < p_content.size()) {
+            ssize_t count = write(fd, p_content.data() + written, p_content.size() - written);
+            if (count < 0) {
+                close(fd);
+                std::remove(tmpName.c_str());
+                return false;
+            }
+            written += count;
+        }
+        if (fsync(fd) != 0 || close(fd) != 0) {
+            std::remove(tmpName.c_str());
+            return false;
+        }
+        if (std::rename(tmpName.c_str(), p_fileName.c_str()) != 0) {
+            std::remove(tmpName.c_str());
+            return false;
+        }
+        SyncDirectory(p_fileName);
+        return true;
+    }
+    // Checksummed record lines
+    // .. Each record is one line: <crc32 as 8 hex digits> <compact JSON>
+    inline std::string EncodeRecord(const nljs::json& p_jrecord) {
+        std::string body = p_jrecord.dump();
+        std::ostringstream line;
+        line << std::hex << std::setw(8) << std::setfill('0') << Crc32(body.data(), body.size())
+             << ' ' << body << '\n';
+        return line.str();
+    }
+    inline bool DecodeRecord(const std::string& p_line, nljs::json& p_jrecord) {
+        if (p_line.size() < 10 || p_line[8] != ' ')
+            return false;
+        try {
+            unsigned int crc = std::stoul(p_line.substr(0, 8), nullptr, 16);
+            if (crc != Crc32(p_line.data() + 9, p_line.size() - 9))
+                return false;
+            p_jrecord = nljs::json::parse(p_line.begin() + 9, p_line.end());
+        } catch (std::exception& e) {
+            return false;
+        }
+        return true;
+    }
+    // Write / read an array of records to / from a file
+    // .. Files are written atomically as checksummed record lines
+    inline bool WriteRecords(const std::string& p_fileName, const nljs::json& p_jrecords) {
+        Trace::Span encodeSpan("Encode", "store", p_jrecords.size());
+        std::string content;
+        for (const auto& jrecord: p_jrecords)
+            content += EncodeRecord(jrecord);
+        encodeSpan.End();
+        Trace::Span writeSpan("Write", "store", content.size());
+        return AtomicWriteFile(p_fileName, content);
+    }
+    // Class to hand the elements of a top level JSON array over one at a time (SAX handler)
+    // .. Only the element being parsed is held as a DOM, so legacy files of any size
+    // .. load without building the whole array first
+    class ElementReader {
+        const std::function<bool(nljs::json&)>& visit;
+        nljs::json element;
+        // Open objects & arrays of the element, innermost last
+        std::vector<nljs::json*> open;
+        std::string lastKey;
+        bool isStarted = false;
+        unsigned int count = 0;
+        std::string error;
+
+        // Place p_value in the innermost open object or array
+        nljs::json* Insert(nljs::json&& p_value) {
+            nljs::json& parent = *open.back();
+            if (parent.is_array()) {
+                parent.push_back(std::move(p_value));
+                return &parent.back();
+            }
+            nljs::json& slot = parent[lastKey];
+            slot = std::move(p_value);
+            return &slot;
+        }
+        bool Put(nljs::json&& p_value) {
+            if (!isStarted) return false;
+            if (!open.empty()) {
+                Insert(std::move(p_value));
+                return true;
+            }
+            element = std::move(p_value);
+            return Emit();
+        }
+        bool Open(nljs::json&& p_value) {
+            if (!isStarted) return false;
+            if (open.empty()) {
+                element = std::move(p_value);
+                open.push_back(&element);
+            } else open.push_back(Insert(std::move(p_value)));
+            return true;
+        }
+        bool Close() {
+            open.pop_back();
+            return open.empty() ? Emit() : true;
+        }
+        bool Emit() {
+            count++;
+            bool isMore = visit(element);
+            element = nullptr;
+            return isMore;
+        }
+    public:
+        // Constructors & destructors
+        // .. p_visit returns false to stop the parse
+        ElementReader(const std::function<bool(nljs::json&)>& p_visit) : visit(p_visit) {}
+
+        // Getters
+        unsigned int GetCount() const { return count; }
+        const std::string& GetError() const { return error; }
+
+        // SAX interface
+        bool null() { return Put(nullptr); }
+        bool boolean(bool p_value) { return Put(p_value); }
+        bool number_integer(nljs::json::number_integer_t p_value) { return Put(p_value); }
+        bool number_unsigned(nljs::json::number_unsigned_t p_value) { return Put(p_value); }
+        bool number_float(nljs::json::number_float_t p_value, const nljs::json::string_t&) { return Put(p_value); }
+        bool string(nljs::json::string_t& p_value) { return Put(std::move(p_value)); }
+        bool binary(nljs::json::binary_t& p_value) { return Put(nljs::json::binary(std::move(p_value))); }
+        bool start_object(std::size_t) { return Open(nljs::json::object()); }
+        bool key(nljs::json::string_t& p_key) {
+            lastKey = std::move(p_key);
+            return true;
+        }
+        bool end_object() { return Close(); }
+        bool start_array(std::size_t) {
+            // .. The top level array itself is not an element
+            if (!isStarted) {
+                isStarted = true;
+                return true;
+            }
+            return Open(nljs::json::array());
+        }
+        bool end_array() { return open.empty() ? true : Close(); }
+        bool parse_error(std::size_t, const std::string&, const nljs::detail::exception& p_exception) {
+            error = p_exception.what();
+            return false;
+        }
+    };
+    // Visit the records of a file one at a time, in file order
+    // .. Neither the whole file nor all of its records are held in memory: each record is parsed,
+    // .. handed to p_visit & dropped, so callers build their objects as the file is read
+    // .. p_visit returns false to stop reading, which fails the read
+    // .. Damaged records are skipped and counted instead of failing the whole read
+    // .. Legacy files holding a single JSON array are still accepted (streamed through ElementReader)
+    inline bool ForEachRecord(const std::string& p_fileName, const std::function<bool(nljs::json&)>& p_visit,
+        unsigned int& p_damaged) {
+        p_damaged = 0;
+        Trace::Span span("Parse", "load");
+        std::ifstream inFile(p_fileName, std::ios::binary);
+        if (!inFile.is_open())
+            return false;
+        inFile >> std::ws;
+        if (inFile.peek() == '[') {
+            ElementReader reader(p_visit);
+            bool isRead = nljs::json::sax_parse(inFile, &reader);
+            span.SetCount(reader.GetCount());
+            if (!reader.GetError().empty())
+                std::cout << reader.GetError() << std::endl;
+            return isRead;
+        }
+        unsigned int count = 0;
+        std::string line;
+        nljs::json jrecord;
+        while (std::getline(inFile, line)) {
+            if (line.empty()) continue;
+            if (!DecodeRecord(line, jrecord)) {
+                p_damaged++;
+                continue;
+            }
+            count++;
+            if (!p_visit(jrecord)) return false;
+        }
+        span.SetCount(count);
+        return true;
+    }
+    inline bool ForEachRecord(const std::string& p_fileName, const std::function<bool(nljs::json&)>& p_visit) {
+        unsigned int damaged;
+        if (!ForEachRecord(p_fileName, p_visit, damaged))
+            return false;
+        if (damaged != 0)
+            std::cout << "Skipped " << damaged << " damaged record(s) in " << p_fileName << std::endl;
+        return true;
+    }
+
+    // Class for the shard manifest
+    // .. Small file listing every shard of a catalog and its empty IDs,
+    // .. so that shards can be loaded on demand
+    class Manifest {
+    public:
+        // Description of each shard
+        struct Shard {
+            std::string fileName;
+            unsigned int firstID = 0;
+            // Number of IDs covered, including empty ones
+            unsigned int slots = 0;
+            // Empty IDs inside the shard
+            std::vector<unsigned int> holes;
+            // Version sum & structural changes when written (in memory only)
+            unsigned long long version = 0;
+            unsigned long long mark = 0;
+        };
+        unsigned long long generation = 0;
+        unsigned int shardSize = SHARD_SIZE;
+        unsigned int totalSlots = 0;
+        std::vector<Shard> shards;
+
+        // Serialize function
+        nljs::json Serialize() const {
+            nljs::json jshards = nljs::json::array();
+            for (const Shard& shard: shards)
+                jshards.push_back({
+                    {"fileName", shard.fileName},
+                    {"firstID", shard.firstID},
+                    {"slots", shard.slots},
+                    {"holes", shard.holes}
+                });
+            return {
+                {"generation", generation},
+                {"shardSize", shardSize},
+                {"totalSlots", totalSlots},
+                {"shards", jshards}
+            };
+        }
+        // Deserialize function
+        void Deserialize(const nljs::json& p_jmanifest) {
+            generation = p_jmanifest.value("generation", 0ULL);
+            shardSize = p_jmanifest["shardSize"];
+            totalSlots = p_jmanifest["totalSlots"];
+            shards = std::vector<Shard>{};
+            for (const auto& jshard: p_jmanifest["shards"]) {
+                Shard shard;
+                shard.fileName = jshard["fileName"];
+                shard.firstID = jshard["firstID"];
+                shard.slots = jshard["slots"];
+                shard.holes = jshard["holes"].get<std::vector<unsigned int>>();
+                shards.push_back(shard);
+            }
+        }
+        // Storing & reading the manifest file
+        // .. Replacing the manifest is what commits a store
+        bool Store(const std::string& p_baseName) const {
+            std::ostringstream content;
+            content << std::setw(4) << Serialize() << std::endl;
+            return AtomicWriteFile(p_baseName + MANIFEST_SUFFIX, content.str());
+        }
+        bool Load(const std::string& p_baseName) {
+            std::ifstream inFile(p_baseName + MANIFEST_SUFFIX);
+            if (!inFile.is_open())
+                return false;
+            try {
+                nljs::json jmanifest;
+                inFile >> jmanifest;
+                Deserialize(jmanifest);
+            } catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // Class to keep track of shard states for a manager
+    // .. Shard i covers IDs [i * shardSize, (i + 1) * shardSize)
+    // .. A shard is rewritten on store only if it is dirty:
+    // .. .. marked changed (add / delete, or an object found changed in place), or
+    // .. .. for managers that pass version sums (users are changed in place without marks),
+    // .. .. its version sum differs from the one at last store / load
+    class ShardTable {
+        std::string baseName = "";
+        unsigned int shardSize = SHARD_SIZE;
+        Manifest manifest;
+        std::vector<char> loaded;
+        std::vector<char> dirty;
+        std::vector<unsigned long long> versions;
+        // Structural changes per shard, so that a store only cleans what it wrote
+        std::vector<unsigned long long> marks;
+
+        void Grow(unsigned int p_shard) {
+            if (p_shard < loaded.size()) return;
+            // New shards only exist in memory
+            loaded.resize(p_shard + 1, true);
+            dirty.resize(p_shard + 1, true);
+            versions.resize(p_shard + 1, 0);
+            marks.resize(p_shard + 1, 0);
+        }
+    public:
+        // Constructors & destructors
+        ShardTable() {}
+
+        // Setters
+        // Forget about files: everything lives in memory and is dirty
+        void Reset() {
+            baseName = "";
+            shardSize = SHARD_SIZE;
+            manifest = Manifest();
+            loaded = std::vector<char>{};
+            dirty = std::vector<char>{};
+            versions = std::vector<unsigned long long>{};
+            marks = std::vector<unsigned long long>{};
+        }
+        // Adopt a loaded manifest: all shards are clean but not loaded
+        void Attach(const std::string& p_baseName, const Manifest& p_manifest) {
+            baseName = p_baseName;
+            shardSize = p_manifest.shardSize;
+            manifest = p_manifest;
+            loaded = std::vector<char>(p_manifest.shards.size(), false);
+            dirty = std::vector<char>(p_manifest.shards.size(), false);
+            versions = std::vector<unsigned long long>(p_manifest.shards.size(), 0);
+            marks = std::vector<unsigned long long>(p_manifest.shards.size(), 0);
+        }
+        // Mark the shard holding ID as changed
+        void MarkDirty(unsigned int p_ID) {
+            unsigned int shard = p_ID / shardSize;
+            Grow(shard);
+            dirty[shard] = true;
+            marks[shard]++;
+        }
+        void MarkLoaded(unsigned int p_shard, unsigned long long p_version = 0) {
+            Grow(p_shard);
+            loaded[p_shard] = true;
+            versions[p_shard] = p_version;
+        }
+        // .. A shard changed again since it was captured (p_mark) stays dirty
+        void MarkStored(unsigned int p_shard, unsigned long long p_version, unsigned long long p_mark) {
+            Grow(p_shard);
+            if (marks[p_shard] == p_mark) dirty[p_shard] = false;
+            versions[p_shard] = p_version;
+        }
+        void SetManifest(const std::string& p_baseName, const Manifest& p_manifest) {
+            baseName = p_baseName;
+            manifest = p_manifest;
+        }
+        // Generations never go back, even across restarts from a fresh catalog
+        unsigned long long GetNextGeneration() const {
+            unsigned long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            return std::max(manifest.generation + 1, now);
+        }
+
+        // Getters
+        const std::string& GetBaseName() const { return baseName; }
+        const Manifest& GetManifest() const { return manifest; }
+        unsigned int GetShardSize() const { return shardSize; }
+        unsigned int GetShardOf(unsigned int p_ID) const { return p_ID / shardSize; }
+        bool IsLoaded(unsigned int p_shard) const {
+            return p_shard >= loaded.size() || loaded[p_shard];
+        }
+        unsigned long long GetMark(unsigned int p_shard) const {
+            return p_shard < marks.size() ? marks[p_shard] : 0;
+        }
+        // Marked changed since last store / load
+        bool IsDirty(unsigned int p_shard) const {
+            return p_shard >= dirty.size() || dirty[p_shard];
+        }
+        // .. Or with a version sum other than the one at last store / load
+        bool IsDirty(unsigned int p_shard, unsigned long long p_version) const {
+            return p_shard >= dirty.size() || dirty[p_shard] || versions[p_shard] != p_version;
+        }
+        bool IsAllLoaded() const {
+            for (char isLoaded: loaded)
+                if (!isLoaded) return false;
+            return true;
+        }
+
+        // Utility
+        // Remove files of a previous manifest that a new one no longer references
+        void RemoveStaleFiles(const Manifest& p_manifest) const {
+            for (unsigned int shard = 0; shard < manifest.shards.size(); shard++)
+                if (shard >= p_manifest.shards.size()
+                    || p_manifest.shards[shard].fileName != manifest.shards[shard].fileName)
+                    std::remove(manifest.shards[shard].fileName.c_str());
+        }
+    };
+
+    // Shard files of a new generation waiting to be written
+    // .. Collected on the session thread, written on any thread
+    struct ShardWrites {
+        std::vector<std::string> fileNames;
+        std::vector<std::function<bool()>> jobs;
+
+        void Add(const std::string& p_fileName, std::function<bool()> p_job) {
+            fileNames.push_back(p_fileName);
+            jobs.push_back(std::move(p_job));
+        }
+        // Write every file in parallel
+        // .. On failure they are all removed, the previous generation stays intact
+        bool Run() const {
+            if (jobs.empty() || RunParallel(jobs)) return true;
+            for (const std::string& fileName: fileNames)
+                std::remove(fileName.c_str());
+            return false;
+        }
+    };
+
+    // Commit file: space & user manifests replaced together in one atomic rename
+    inline bool StoreCommit(const std::string& p_fileName, const Manifest& p_spaces, const Manifest& p_users) {
+        nljs::json jcommit = {
+            {"spaces", p_spaces.Serialize()},
+            {"users", p_users.Serialize()}
+        };
+        std::ostringstream content;
+        content << std::setw(4) << jcommit << std::endl;
+        return AtomicWriteFile(p_fileName, content.str());
+    }
+    inline bool LoadCommit(const std::string& p_fileName, Manifest& p_spaces, Manifest& p_users) {
+        std::ifstream inFile(p_fileName);
+        if (!inFile.is_open())
+            return false;
+        try {
+            nljs::json jcommit;
+            inFile >> jcommit;
+            p_spaces.Deserialize(jcommit["spaces"]);
+            p_users.Deserialize(jcommit["users"]);
+        } catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Files replaced as one unit
+    // .. Each new file is first written completely next to its target (<target>.next), then the intent file
+    // .. listing the targets is written atomically, and the new files are renamed in place
+    // .. A crash before the intent file leaves every target as it was; after it, RecoverFiles finishes
+    // .. the renames before the next read, so readers see either every file replaced or none
+    inline bool RecoverFiles(const std::string& p_intentFile) {
+        std::vector<std::string> fileNames;
+        {
+            std::ifstream inFile(p_intentFile);
+            // .. Nothing pending
+            if (!inFile.is_open())
+                return true;
+            try {
+                nljs::json jintent;
+                inFile >> jintent;
+                fileNames = jintent.get<std::vector<std::string>>();
+            } catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+        }
+        for (const std::string& fileName: fileNames) {
+            // .. Files renamed before a crash have no new file left
+            std::string nextName = fileName + NEXT_SUFFIX;
+            if (access(nextName.c_str(), F_OK) == 0 && std::rename(nextName.c_str(), fileName.c_str()) != 0)
+                return false;
+        }
+        for (const std::string& fileName: fileNames)
+            SyncDirectory(fileName);
+        return std::remove(p_intentFile.c_str()) == 0;
+    }
+    // Replace p_fileNames with their new files, written beforehand as <target>.next
+    inline bool CommitFiles(const std::string& p_intentFile, const std::vector<std::string>& p_fileNames) {
+        nljs::json jintent = p_fileNames;
+        if (!AtomicWriteFile(p_intentFile, jintent.dump() + "\n"))
+            return false;
+        return RecoverFiles(p_intentFile);
+    }
+}
+
+#endif
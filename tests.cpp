@@ -0,0 +1,1028 @@
+// Unit tests of the core parts
+// .. Usage: evies_tests [suite ...], every suite when none is given
+// .. Registered with CTest one suite per test (EVIES_TEST_SUITES); files are written to the current directory
+// .. Bit-level & pruned code is checked against a naive reference on random inputs
+#include <map>
+#include <set>
+#include <random>
+#include <functional>
+
+#include "storage.hpp"
+#include "mvcc.hpp"
+#include "timerwheel.hpp"
+#include "codec.hpp"
+#include "search.hpp"
+#include "placement.hpp"
+#include "user.hpp"
+
+// Check a condition, counting & reporting failures (assert is compiled out of release builds)
+#define CHECK(p_condition) Check((p_condition), #p_condition, __FILE__, __LINE__)
+
+namespace {
+    unsigned int failures = 0;
+
+    // Utility functions
+    void Check(bool p_isTrue, const char* p_condition, const char* p_file, int p_line) {
+        if (p_isTrue) return;
+        failures++;
+        std::cout << p_file << ":" << p_line << ": check failed: " << p_condition << std::endl;
+    }
+    bool ReadFile(const std::string& p_fileName, std::string& p_content) {
+        std::ifstream inFile(p_fileName, std::ios::binary);
+        if (!inFile.is_open()) return false;
+        std::ostringstream content;
+        content << inFile.rdbuf();
+        p_content = content.str();
+        return true;
+    }
+    bool WriteFile(const std::string& p_fileName, const std::string& p_content) {
+        std::ofstream outFile(p_fileName, std::ios::binary | std::ios::trunc);
+        outFile << p_content;
+        return outFile.good();
+    }
+
+    // Checksummed records: damaged lines are skipped & counted, the others still load
+    void TestStorage() {
+        const std::string fileName = "evies_tests.records";
+        CHECK(Storage::Crc32("123456789", 9) == 0xCBF43926u);
+        nljs::json jrecords = nljs::json::array();
+        for (int i = 0; i < 5; i++) jrecords.push_back({{"ID", i}, {"name", "space " + std::to_string(i)}});
+        CHECK(Storage::WriteRecords(fileName, jrecords));
+        std::vector<int> IDs;
+        unsigned int damaged = 0;
+        auto Collect = [&IDs](nljs::json& p_jrecord) {
+            IDs.push_back(p_jrecord["ID"].get<int>());
+            return true;
+        };
+        CHECK(Storage::ForEachRecord(fileName, Collect, damaged));
+        CHECK(damaged == 0);
+        CHECK((IDs == std::vector<int>{0, 1, 2, 3, 4}));
+
+        // .. Flip a byte in the body of the second record, & tear the last one as a crash would
+        std::string content;
+        CHECK(ReadFile(fileName, content));
+        size_t second = content.find('\n') + 1;
+        size_t bodyByte = content.find("space", second);
+        CHECK(bodyByte != std::string::npos);
+        content[bodyByte] = 'S';
+        size_t last = content.find_last_of('\n', content.size() - 2) + 1;
+        content.resize(last + (content.size() - last) / 2);
+        CHECK(WriteFile(fileName, content));
+        IDs.clear();
+        CHECK(Storage::ForEachRecord(fileName, Collect, damaged));
+        CHECK(damaged == 2);
+        CHECK((IDs == std::vector<int>{0, 2, 3}));
+
+        // .. A damaged checksum field or a missing separator is no record either
+        nljs::json jrecord;
+        std::string line = Storage::EncodeRecord({{"ID", 7}});
+        line.pop_back();
+        CHECK(Storage::DecodeRecord(line, jrecord) && jrecord["ID"] == 7);
+        CHECK(!Storage::DecodeRecord("zzzzzzzz" + line.substr(8), jrecord));
+        CHECK(!Storage::DecodeRecord(line.substr(0, 8) + line.substr(9), jrecord));
+        CHECK(!Storage::ForEachRecord("evies_tests.missing", Collect, damaged));
+        std::remove(fileName.c_str());
+
+        // .. Thousands of jobs run once each, on no more threads than cores
+        std::vector<std::atomic<int>> runs(5000);
+        std::atomic<unsigned int> running{0}, peak{0};
+        std::vector<std::function<bool()>> jobs;
+        for (unsigned int i = 0; i < runs.size(); i++)
+            jobs.push_back([&, i]() {
+                unsigned int now = ++running;
+                for (unsigned int seen = peak; now > seen && !peak.compare_exchange_weak(seen, now); ) {}
+                runs[i]++;
+                running--;
+                return i != 4321;
+            });
+        CHECK(!Storage::RunParallel(jobs));
+        CHECK(std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& p_runs) { return p_runs == 1; }));
+        CHECK(peak <= std::max(1u, std::thread::hardware_concurrency()));
+        jobs.erase(jobs.begin() + 4321);
+        CHECK(Storage::RunParallel(jobs));
+
+        // .. Stores rewrite the shards of spaces changed since, not those only looked at
+        const std::string baseName = "evies_tests.spaces";
+        Space::SpaceManager spaceManager;
+        spaceManager.GetRandomizedSpaces(3 * SHARD_SIZE);
+        CHECK(spaceManager.StoreShards(baseName));
+        Storage::Manifest before, after;
+        CHECK(before.Load(baseName));
+        spaceManager.GetSpace(5);
+        spaceManager.GetSpace(SHARD_SIZE + 5)->IsOutdoor(true);
+        CHECK(spaceManager.StoreShards(baseName));
+        CHECK(after.Load(baseName) && after.shards.size() == 3);
+        CHECK(after.shards[0].fileName == before.shards[0].fileName);
+        CHECK(after.shards[1].fileName != before.shards[1].fileName);
+        CHECK(after.shards[2].fileName == before.shards[2].fileName);
+        Space::SpaceManager loaded;
+        CHECK(loaded.LoadShards(baseName) && loaded.ReadSpace(SHARD_SIZE + 5)->IsOutdoor());
+        for (const Storage::Manifest::Shard& shard: after.shards) std::remove(shard.fileName.c_str());
+        std::remove((baseName + MANIFEST_SUFFIX).c_str());
+
+        // .. Files committed together: a crash after the intent file is finished on recovery
+        const std::string intentFile = "evies_tests.intent";
+        CHECK(WriteFile("evies_tests.a", "old a") && WriteFile("evies_tests.b", "old b"));
+        CHECK(WriteFile("evies_tests.a" NEXT_SUFFIX, "new a") && WriteFile("evies_tests.b" NEXT_SUFFIX, "new b"));
+        CHECK(Storage::AtomicWriteFile(intentFile, "[\"evies_tests.a\", \"evies_tests.b\"]"));
+        CHECK(std::rename("evies_tests.a" NEXT_SUFFIX, "evies_tests.a") == 0);
+        CHECK(ReadFile("evies_tests.b", content) && content == "old b");
+        CHECK(Storage::RecoverFiles(intentFile));
+        CHECK(ReadFile("evies_tests.a", content) && content == "new a");
+        CHECK(ReadFile("evies_tests.b", content) && content == "new b");
+        CHECK(!ReadFile(intentFile, content));
+        // .. Without the intent file, new files written before a crash are not put in place
+        CHECK(WriteFile("evies_tests.a" NEXT_SUFFIX, "newer a"));
+        CHECK(Storage::RecoverFiles(intentFile));
+        CHECK(ReadFile("evies_tests.a", content) && content == "new a");
+        CHECK(WriteFile("evies_tests.b" NEXT_SUFFIX, "newer b"));
+        CHECK(Storage::CommitFiles(intentFile, {"evies_tests.a", "evies_tests.b"}));
+        CHECK(ReadFile("evies_tests.a", content) && content == "newer a");
+        CHECK(ReadFile("evies_tests.b", content) && content == "newer b");
+        std::remove("evies_tests.a");
+        std::remove("evies_tests.b");
+
+        // .. Single data files: spaces & users are replaced only once both files are read
+        {
+            Space::SpaceManager fileSpaces;
+            User::UserManager fileUsers(&fileSpaces);
+            fileSpaces.GetRandomizedSpaces(10);
+            fileUsers.AddUser(new User::EventUser(0, "Stored", &fileSpaces));
+            CHECK(fileUsers.StoreFiles(intentFile));
+            fileSpaces.GetRandomizedSpaces(5);
+            fileUsers.AddUser(new User::EventUser(0, "Added", &fileSpaces));
+            std::rename(USER_FILE, "evies_tests.users");
+            CHECK(!fileUsers.LoadFiles(intentFile));
+            CHECK(fileSpaces.GetSpaceCount() == 15 && fileUsers.GetUserCount() == 2);
+            std::rename("evies_tests.users", USER_FILE);
+            CHECK(fileUsers.LoadFiles(intentFile));
+            CHECK(fileSpaces.GetSpaceCount() == 10 && fileUsers.GetUserCount() == 1);
+            std::remove(SPACE_FILE);
+            std::remove(USER_FILE);
+
+            // .. Records with IDs out of bounds or read twice are skipped as damaged, not allocated for
+            nljs::json jspaces = nljs::json::array(), jusers = nljs::json::array();
+            for (unsigned int ID: {0u, 4294967295u, 2147483648u, MAX_RECORD_ID, 0u, 2u}) {
+                jspaces.push_back(Space::Space(ID, "Space " + std::to_string(jspaces.size()), 10, 10, 3, 20, 20,
+                    false, false, false, 100).Serialize());
+                jusers.push_back(User::EventUser(ID, "User " + std::to_string(jusers.size()), &fileSpaces).Serialize());
+            }
+            CHECK(Storage::WriteRecords("evies_tests.records", jspaces));
+            std::vector<std::unique_ptr<Space::Space>> loadedSpaces;
+            CHECK(Space::SpaceManager::ReadData("evies_tests.records", loadedSpaces));
+            CHECK(loadedSpaces.size() == 3 && loadedSpaces[1] == nullptr);
+            CHECK(loadedSpaces[0]->GetName() == "Space 0" && loadedSpaces[2]->GetName() == "Space 5");
+            CHECK(Storage::WriteRecords("evies_tests.records", jusers));
+            std::vector<User::User*> loadedUsers;
+            CHECK(fileUsers.ReadData("evies_tests.records", loadedUsers));
+            CHECK(loadedUsers.size() == 3 && loadedUsers[1] == nullptr);
+            CHECK(loadedUsers[0]->GetName() == "User 0" && loadedUsers[2]->GetName() == "User 5");
+            for (User::User* user_ptr: loadedUsers) delete user_ptr;
+            std::remove("evies_tests.records");
+        }
+    }
+
+    // Objects counting their live instances, to see when retired versions are freed
+    struct Counted {
+        static int live;
+        int value;
+        Counted(int p_value) : value(p_value) { live++; }
+        Counted(const Counted& p_counted) : value(p_counted.value) { live++; }
+        ~Counted() { live--; }
+    };
+    int Counted::live = 0;
+
+    // Snapshots keep seeing the table as it was; replaced versions are freed once no snapshot sees them
+    void TestMvcc() {
+        {
+            Mvcc::Table<Counted> table;
+            table.Resize(3 * MVCC_CHUNK);
+            for (unsigned int ID = 0; ID < table.GetSize(); ID++) table.Set(ID, std::make_unique<Counted>(ID));
+            CHECK(Counted::live == 3 * MVCC_CHUNK);
+
+            // .. Writes of the current epoch are made in place
+            table.GetMutable(0)->value = -1;
+            CHECK(table.GetRetiredCount() == 0);
+
+            Mvcc::Snapshot<Counted> snapshot = table.GetSnapshot();
+            table.GetMutable(1)->value = 100;
+            table.Set(2, nullptr);
+            table.Set(MVCC_CHUNK, std::make_unique<Counted>(200));
+            table.Resize(4 * MVCC_CHUNK);
+            table.Set(3 * MVCC_CHUNK, std::make_unique<Counted>(300));
+            CHECK(snapshot.GetSize() == 3 * MVCC_CHUNK);
+            CHECK(snapshot.Get(0)->value == -1);
+            CHECK(snapshot.Get(1)->value == 1);
+            CHECK(snapshot.Get(2) != nullptr && snapshot.Get(2)->value == 2);
+            CHECK(snapshot.Get(MVCC_CHUNK)->value == MVCC_CHUNK);
+            CHECK(snapshot.Get(3 * MVCC_CHUNK) == nullptr);
+            CHECK(table.Get(1)->value == 100);
+            CHECK(table.Get(2) == nullptr);
+            CHECK(table.Get(MVCC_CHUNK)->value == 200);
+            CHECK(table.Get(3 * MVCC_CHUNK)->value == 300);
+
+            // .. The old objects 1, 2 & MVCC_CHUNK are kept for the snapshot, along with the chunks & root,
+            // .. next to the copy of 1 & the new objects at MVCC_CHUNK & 3 * MVCC_CHUNK
+            CHECK(Counted::live == 3 * MVCC_CHUNK + 3);
+            CHECK(table.GetRetiredCount() > 0);
+            // .. A second write to the same object copies nothing more
+            unsigned long retired = table.GetRetiredCount();
+            table.GetMutable(1)->value = 101;
+            CHECK(table.GetRetiredCount() == retired);
+            table.Collect();
+            CHECK(table.GetRetiredCount() == retired);
+
+            snapshot.Release();
+            CHECK(!snapshot.IsValid());
+            table.Collect();
+            CHECK(table.GetRetiredCount() == 0);
+            CHECK(Counted::live == 3 * MVCC_CHUNK);
+
+            // .. A snapshot taken later sees the changes, & its pin slot is reused
+            Mvcc::Snapshot<Counted> later = table.GetSnapshot();
+            CHECK(later.Get(1)->value == 101 && later.Get(2) == nullptr);
+            table.GetMutable(1)->value = 102;
+            CHECK(later.Get(1)->value == 101);
+        }
+        CHECK(Counted::live == 0);
+    }
+
+    // Events fire once, at or after their tick & in tick order, after moving down any number of levels
+    void TestTimerWheel() {
+        const time_t origin = 1700000000 / TIMER_TICK_SECONDS * TIMER_TICK_SECONDS;
+        Timer::Wheel<int> wheel(origin);
+        // .. Offsets in ticks on every level & past the top one
+        std::vector<unsigned long long> offsets = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 300000,
+            16777215, 16777216, 20000000};
+        std::mt19937_64 engine(42);
+        for (int i = 0; i < 2000; i++) offsets.push_back(engine() % 30000000);
+        std::vector<time_t> times;
+        for (unsigned int i = 0; i < offsets.size(); i++) {
+            times.push_back(origin + (time_t)offsets[i] * TIMER_TICK_SECONDS + (time_t)(engine() % TIMER_TICK_SECONDS));
+            wheel.Schedule(times[i], i);
+        }
+        CHECK(wheel.GetSize() == offsets.size());
+
+        std::vector<int> fired(offsets.size(), 0);
+        time_t now = origin, last = origin;
+        bool isInOrder = true, isOnTime = true;
+        while (wheel.GetSize() != 0 && now < origin + 40000000LL * TIMER_TICK_SECONDS) {
+            // .. Steps of a few seconds to a few months
+            now += (time_t)(engine() % 200000) * (engine() % 3 == 0 ? TIMER_TICK_SECONDS : 1);
+            time_t previous = origin;
+            for (int value: wheel.Advance(now)) {
+                fired[value]++;
+                time_t tick = times[value] / TIMER_TICK_SECONDS * TIMER_TICK_SECONDS;
+                if (tick > now || tick + TIMER_TICK_SECONDS <= last) isOnTime = false;
+                if (tick < previous) isInOrder = false;
+                previous = tick;
+            }
+            last = now / TIMER_TICK_SECONDS * TIMER_TICK_SECONDS;
+        }
+        CHECK(wheel.GetSize() == 0);
+        CHECK(std::all_of(fired.begin(), fired.end(), [](int p_count) { return p_count == 1; }));
+        CHECK(isOnTime);
+        CHECK(isInOrder);
+
+        // .. Events scheduled in the past fire on the next Advance, even without time passing
+        wheel.Schedule(now - 3600, -1);
+        std::vector<int> due = wheel.Advance(now);
+        CHECK(due.size() == 1 && due[0] == -1);
+        CHECK(wheel.Advance(now + 3600 * 24 * 365).empty());
+    }
+
+    // Records with a nested table, a vector of tables & an optional field
+    struct Part {
+        std::string name;
+        int count = 0;
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("name", &Part::name),
+                Codec::Member("count", &Part::count)
+            );
+        }
+    };
+    struct Record {
+        unsigned int ID = 0;
+        double price = 0;
+        Part main;
+        std::vector<Part> parts;
+        std::vector<std::string> tags;
+        // .. Derived on decoding, never written
+        int total = 0;
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("ID", &Record::ID),
+                Codec::Member("price", &Record::price),
+                Codec::Member("main", &Record::main),
+                Codec::Member("parts", &Record::parts),
+                Codec::Member("tags", &Record::tags, Codec::OPTIONAL)
+            );
+        }
+        void OnDecoded() {
+            total = main.count;
+            for (const Part& part: parts) total += part.count;
+        }
+    };
+
+    // Objects read back from JSON, binary & CSV equal the ones written, & missing fields are named
+    void TestCodec() {
+        Record record;
+        record.ID = 12;
+        record.price = 99.5;
+        record.main = Part{"hall", 3};
+        record.parts = {Part{"stage", 1}, Part{"bar", 2}};
+        record.tags = {"wedding", "concert"};
+        nljs::json jrecord = Codec::ToJson(record);
+        CHECK(jrecord["main"]["name"] == "hall" && jrecord["parts"].size() == 2 && !jrecord.contains("total"));
+
+        Record decoded;
+        Codec::FromJson(nljs::json::parse(jrecord.dump()), decoded);
+        CHECK(decoded.ID == 12 && decoded.price == 99.5);
+        CHECK(decoded.main.name == "hall" && decoded.main.count == 3);
+        CHECK(decoded.parts.size() == 2 && decoded.parts[1].name == "bar" && decoded.parts[1].count == 2);
+        CHECK((decoded.tags == std::vector<std::string>{"wedding", "concert"}));
+        CHECK(decoded.total == 6);
+        CHECK(Codec::ToJson(decoded) == jrecord);
+
+        // .. Optional fields may be missing & keep their value, unknown keys are ignored
+        nljs::json jshort = jrecord;
+        jshort.erase("tags");
+        jshort["unknown"] = true;
+        Record partial;
+        partial.tags = {"kept"};
+        Codec::FromJson(jshort, partial);
+        CHECK(partial.tags.size() == 1 && partial.tags[0] == "kept" && partial.ID == 12);
+
+        // .. Required fields may not, nested ones included
+        auto MissingMessage = [](const nljs::json& p_jrecord) -> std::string {
+            Record failed;
+            try {
+                Codec::FromJson(p_jrecord, failed);
+            } catch (std::out_of_range& e) {
+                return e.what();
+            }
+            return "";
+        };
+        nljs::json jmissing = jrecord;
+        jmissing.erase("ID");
+        jmissing.erase("price");
+        CHECK(MissingMessage(jmissing) == "Missing field(s): ID price");
+        jmissing = jrecord;
+        jmissing["parts"][1].erase("count");
+        CHECK(MissingMessage(jmissing) == "Missing field(s): count");
+        bool isRejected = false;
+        try {
+            Codec::FromJson(nljs::json::array(), partial);
+        } catch (std::invalid_argument& e) {
+            isRejected = true;
+        }
+        CHECK(isRejected);
+
+        // .. Spaces, through their own tables
+        Space::Space space(5, "Grand hall", 20, 10, 6, 150, 120, true, false, true, 250, false, true,
+            true, true, true, false, true);
+        space.AddTag("wedding");
+        space.review.AddReview("Lovely light", 4.5);
+        time_t startTime = (time(NULL) / 3600 + 48) * 3600;
+        double price;
+        CHECK(space.timer.AddReservation(startTime, startTime + 2 * 3600 - Space::Time::SLOT_SECONDS, price));
+        nljs::json jspace = space.Serialize();
+        Space::Space readSpace;
+        readSpace.Deserialize(nljs::json::parse(jspace.dump()));
+        CHECK(readSpace.Serialize() == jspace);
+        CHECK(readSpace.GetID() == 5 && readSpace.GetTags().size() == 1);
+        CHECK(readSpace.dims.GetArea() == space.dims.GetArea());
+        CHECK(!readSpace.timer.AddReservation(startTime, startTime, price));
+        jspace["dims"].erase("width");
+        isRejected = false;
+        try {
+            Space::Space().Deserialize(jspace);
+        } catch (std::out_of_range& e) {
+            isRejected = std::string(e.what()) == "Missing field(s): width";
+        }
+        CHECK(isRejected);
+        // .. The binary & CSV codecs walk the same tables
+        std::string bytes = Codec::ToBinary(record);
+        Record fromBinary;
+        Codec::FromBinary(bytes, fromBinary);
+        CHECK(Codec::ToJson(fromBinary) == jrecord && fromBinary.total == 6);
+        unsigned int rejected = 0;
+        for (unsigned long size = 0; size < bytes.size(); size++) {
+            Record truncated;
+            try {
+                Codec::FromBinary(std::string_view(bytes).substr(0, size), truncated);
+            } catch (std::exception& e) {
+                rejected++;
+            }
+        }
+        CHECK(rejected == bytes.size());
+        isRejected = false;
+        try {
+            Codec::FromBinary(bytes + '\0', fromBinary);
+        } catch (std::invalid_argument& e) {
+            isRejected = true;
+        }
+        CHECK(isRejected);
+
+        std::string header = Codec::CsvHeader<Record>();
+        CHECK(header == "ID,price,main.name,main.count,parts,tags");
+        record.main.name = "hall, \"east\"\nwing";
+        record.tags.push_back("");
+        Record fromCsv;
+        Codec::FromCsv(header, Codec::ToCsv(record), fromCsv);
+        CHECK(Codec::ToJson(fromCsv) == Codec::ToJson(record) && fromCsv.total == 6);
+        // .. Columns in any order, required ones named when missing
+        Record reordered;
+        Codec::FromCsv("tags,parts,main.count,main.name,price,ID,unknown",
+            "\"[]\",\"[]\",4,\"\",1.25,7,x", reordered);
+        CHECK(reordered.ID == 7 && reordered.price == 1.25 && reordered.main.count == 4 && reordered.main.name.empty());
+        auto CsvMissingMessage = [](const std::string& p_header, const std::string& p_row) -> std::string {
+            Record failed;
+            try {
+                Codec::FromCsv(p_header, p_row, failed);
+            } catch (std::out_of_range& e) {
+                return e.what();
+            }
+            return "";
+        };
+        CHECK(CsvMissingMessage("ID,price,main.name,parts", "1,2,\"a\",\"[]\"") == "Missing field(s): main.count");
+        CHECK(CsvMissingMessage("ID,price,main.name,main.count,parts", "1,2,,,\"[]\"") == "Missing field(s): main");
+        CHECK(CsvMissingMessage("ID", "") == "Missing field(s): ID price main parts");
+
+        // .. Spaces & users read back from binary & CSV write the same JSON
+        Space::SpaceManager codecSpaces;
+        codecSpaces.SetRandomSeed(46);
+        codecSpaces.GetRandomizedSpaces(30);
+        Space::Space* tariffed_ptr = codecSpaces.GetSpace(3);
+        Space::Tariff tariff;
+        tariff.SetRules(18, 22, 1.5, 1.25, {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2});
+        tariffed_ptr->timer.SetTariff(tariff);
+        tariffed_ptr->review.AddReview("Loud, but \"fun\"", 3.5);
+        unsigned int mismatches = 0;
+        std::string spaceHeader = Codec::CsvHeader<Space::Space>();
+        for (unsigned int ID = 0; ID < codecSpaces.GetSpaceCount(); ID++) {
+            const Space::Space* space_ptr = codecSpaces.ReadSpace(ID);
+            Space::Space binarySpace, csvSpace;
+            Codec::FromBinary(Codec::ToBinary(*space_ptr), binarySpace);
+            Codec::FromCsv(spaceHeader, Codec::ToCsv(*space_ptr), csvSpace);
+            if (binarySpace.Serialize() != space_ptr->Serialize() || csvSpace.Serialize() != space_ptr->Serialize())
+                mismatches++;
+        }
+        CHECK(mismatches == 0);
+        CHECK(!codecSpaces.ReadSpace(3)->timer.GetTariff().IsFlat());
+        User::EventUser user(4, "Guest, \"first\"", &codecSpaces);
+        CHECK(user.Reserve(5, startTime, startTime + 3600, price));
+        user.AddRecurringRecord(6, Space::Recurrence(startTime, 3600, 7 * 24 * 3600, 4), 400);
+        User::EventUser binaryUser(&codecSpaces), csvUser(&codecSpaces);
+        Codec::FromBinary(Codec::ToBinary(user), binaryUser);
+        Codec::FromCsv(Codec::CsvHeader<User::EventUser>(), Codec::ToCsv(user), csvUser);
+        CHECK(binaryUser.Serialize() == user.Serialize() && csvUser.Serialize() == user.Serialize());
+        CHECK(user.Serialize().contains("recurring"));
+    }
+
+    // Pruned top results equal the top of the exhaustive ranking
+    void TestSearch() {
+        Search::Index index;
+        // .. Small hand-checked ranking: names weigh more than reviews, rare words more than common ones
+        index.AddDocument(0, {{"Rooftop garden", SEARCH_NAME_WEIGHT}, {"Nice view", SEARCH_REVIEW_WEIGHT}});
+        index.AddDocument(1, {{"Basement hall", SEARCH_NAME_WEIGHT}, {"Like a rooftop garden", SEARCH_REVIEW_WEIGHT}});
+        index.AddDocument(2, {{"Garden hall", SEARCH_NAME_WEIGHT}});
+        index.AddDocument(3, {{"Studio", SEARCH_NAME_WEIGHT}});
+        std::vector<Search::Result> results = index.Query("rooftop");
+        CHECK(results.size() == 2 && results[0].ID == 0 && results[1].ID == 1);
+        results = index.Query("rooftop gardens");
+        CHECK(results.size() == 3 && results[0].ID == 0);
+        CHECK(index.Query("cinema").empty());
+        CHECK(index.Query("rooftop", 0).empty());
+
+        // .. Skewed vocabulary, so that common words get pruned & rare ones skipped to
+        index.Clear();
+        std::mt19937_64 engine(7);
+        const unsigned int documents = 5000, words = 300;
+        for (unsigned int ID = 0; ID < documents; ID++) {
+            std::string name, review;
+            for (unsigned int i = 0; i < 3; i++) name += " w" + std::to_string(engine() % (1 + engine() % words));
+            for (unsigned int i = 0; i < 12; i++) review += " w" + std::to_string(engine() % (1 + engine() % words));
+            index.AddDocument(ID, {{name, SEARCH_NAME_WEIGHT}, {review, SEARCH_REVIEW_WEIGHT}});
+        }
+        unsigned int mismatches = 0;
+        for (unsigned int query = 0; query < 200; query++) {
+            std::string text;
+            for (unsigned int i = 0; i < 1 + query % 5; i++) text += " w" + std::to_string(engine() % words);
+            unsigned int maxResults = 1 + engine() % 20;
+            std::vector<Search::Result> pruned = index.Query(text, maxResults);
+            // .. No result is pruned while the results are not full
+            std::vector<Search::Result> all = index.Query(text, documents);
+            if (all.size() > maxResults) all.resize(maxResults);
+            if (pruned.size() != all.size()) {
+                mismatches++;
+                continue;
+            }
+            for (unsigned int i = 0; i < all.size(); i++)
+                if (pruned[i].ID != all[i].ID || std::abs(pruned[i].score - all[i].score) > 1e-9) {
+                    mismatches++;
+                    break;
+                }
+        }
+        CHECK(mismatches == 0);
+
+        // .. Removed documents are no longer found
+        index.Clear();
+        index.AddDocument(0, {{"Rooftop garden", SEARCH_NAME_WEIGHT}});
+        index.AddDocument(1, {{"Rooftop hall", SEARCH_NAME_WEIGHT}});
+        index.RemoveDocument(0, {{"Rooftop garden", SEARCH_NAME_WEIGHT}});
+        results = index.Query("rooftop garden");
+        CHECK(results.size() == 1 && results[0].ID == 1);
+    }
+
+    // Cheapest placement by exhaustive search over every subset of spaces
+    double BruteForce(const Placement::Request& p_request, const std::vector<Placement::Search::Item>& p_items) {
+        double best = std::numeric_limits<double>::infinity();
+        for (unsigned int subset = 1; subset < (1u << p_items.size()); subset++) {
+            unsigned long long capacity = 0;
+            unsigned int amenities = 0, rooms = 0;
+            double cost = 0;
+            for (unsigned int i = 0; i < p_items.size(); i++)
+                if (subset >> i & 1) {
+                    capacity += p_items[i].capacity;
+                    amenities |= p_items[i].amenities;
+                    cost += p_items[i].price;
+                    rooms++;
+                }
+            if (capacity >= p_request.attendees && (amenities & p_request.anyRoom) == p_request.anyRoom
+                && rooms <= p_request.maxRooms)
+                best = std::min(best, cost);
+        }
+        return best;
+    }
+
+    // Branch & bound finds the cheapest placement, & only placements that fit the request
+    void TestPlacement() {
+        std::mt19937_64 engine(1234);
+        unsigned int mismatches = 0, invalid = 0, found = 0;
+        for (unsigned int instance = 0; instance < 500; instance++) {
+            unsigned int count = 1 + engine() % 12;
+            std::vector<Placement::Search::Item> items;
+            for (unsigned int ID = 0; ID < count; ID++)
+                items.push_back(Placement::Search::Item{ID, (unsigned int)(10 + engine() % 190),
+                    (unsigned int)(engine() % 128), (double)(50 + engine() % 950)});
+            Placement::Request request;
+            request.attendees = 1 + engine() % 800;
+            request.anyRoom = engine() % 2 == 0 ? 0 : 1u << (engine() % 7);
+            request.maxRooms = 1 + engine() % 6;
+            double expected = BruteForce(request, items);
+            Placement::Search search(request, items, std::numeric_limits<double>::infinity());
+            bool isFound = search.Run();
+            CHECK(search.IsComplete());
+            if (isFound != (expected != std::numeric_limits<double>::infinity())) {
+                mismatches++;
+                continue;
+            }
+            if (!isFound) continue;
+            found++;
+            if (std::abs(search.GetCost() - expected) > 1e-6) mismatches++;
+            unsigned long long capacity = 0;
+            unsigned int amenities = 0;
+            double cost = 0;
+            std::vector<Placement::Search::Item> placement = search.GetPlacement();
+            for (const Placement::Search::Item& item: placement) {
+                capacity += item.capacity;
+                amenities |= item.amenities;
+                cost += item.price;
+            }
+            if (capacity < request.attendees || (amenities & request.anyRoom) != request.anyRoom
+                || placement.size() > request.maxRooms || std::abs(cost - search.GetCost()) > 1e-6)
+                invalid++;
+        }
+        CHECK(mismatches == 0);
+        CHECK(invalid == 0);
+        CHECK(found > 100);
+
+        // .. A cost to beat that is already the best leaves nothing to find
+        Placement::Request request;
+        request.attendees = 100;
+        std::vector<Placement::Search::Item> items = {{0, 60, 0, 300}, {1, 60, 0, 200}, {2, 100, 0, 600}};
+        Placement::Search first(request, items, std::numeric_limits<double>::infinity());
+        CHECK(first.Run() && first.GetCost() == 500);
+        Placement::Search second(request, items, 500);
+        CHECK(!second.Run());
+    }
+
+    // Multiplier of one hour from the epoch, from the rules alone
+    double NaiveRate(unsigned int p_peakStart, unsigned int p_peakEnd, double p_peakRate, double p_weekendRate,
+        const std::array<double, 12>& p_seasonRates, long long p_hour) {
+        long long day = p_hour / 24;
+        unsigned int hour = p_hour % 24;
+        bool isPeak = p_peakStart <= p_peakEnd ? hour >= p_peakStart && hour < p_peakEnd : hour >= p_peakStart || hour < p_peakEnd;
+        // .. 1 Jan 1970 was a Thursday, day 3 of a week from Monday
+        bool isWeekend = (day + 3) % 7 >= 5;
+        return (isPeak ? p_peakRate : 1) * (isWeekend ? p_weekendRate : 1) * p_seasonRates[Space::MonthOfDay(day) % 12];
+    }
+
+    // Prefix sums quote like adding up every hour, & tariffs with the same rules share one table
+    void TestTariff() {
+        std::mt19937_64 engine(33);
+        unsigned int mismatches = 0;
+        for (unsigned int instance = 0; instance < 200; instance++) {
+            unsigned int peakStart = engine() % 24, peakEnd = engine() % 24;
+            double peakRate = 1 + (engine() % 8) / 4.0, weekendRate = engine() % 3 == 0 ? 1 : 0.5 + (engine() % 6) / 4.0;
+            std::array<double, 12> seasonRates;
+            for (double& rate: seasonRates) rate = engine() % 2 == 0 ? 1 : 0.5 + (engine() % 8) / 4.0;
+            Space::Tariff tariff;
+            tariff.SetRules(peakStart, peakEnd, peakRate, weekendRate, seasonRates);
+            for (unsigned int range = 0; range < 20; range++) {
+                // .. Within & past the prefix tables, across months, years & leap days
+                long long firstHour = engine() % ((long long)(TARIFF_MONTHS + 240) * 31 * 24);
+                long long lastHour = firstHour + engine() % (range % 5 == 0 ? 24 * 800 : 24 * 40);
+                double expected = 0;
+                for (long long hour = firstHour; hour < lastHour; hour++)
+                    expected += NaiveRate(peakStart, peakEnd, peakRate, weekendRate, seasonRates, hour);
+                if (std::abs(tariff.GetUnits(firstHour, lastHour) - expected) > 1e-6 * std::max(1.0, expected))
+                    mismatches++;
+            }
+        }
+        CHECK(mismatches == 0);
+        CHECK(Space::Tariff().IsFlat() && Space::Tariff().GetUnits(100, 250) == 150);
+
+        // .. Rules set in another order, or read from a file, find the same table
+        std::array<double, 12> seasonRates{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2};
+        Space::Tariff first, second, other;
+        first.SetRules(18, 23, 1.5, 1.25, seasonRates);
+        second.SetSeasonRate(12, 2);
+        second.SetWeekendRate(1.25);
+        second.SetPeak(18, 23, 1.5);
+        Space::Tariff read;
+        read.Deserialize(nljs::json::parse(first.Serialize().dump()));
+        other.SetRules(18, 22, 1.5, 1.25, seasonRates);
+        Memory::Report report;
+        first.CountMemory(report);
+        second.CountMemory(report);
+        read.CountMemory(report);
+        CHECK(report.Get(Memory::TARIFFS).count == 1);
+        other.CountMemory(report);
+        CHECK(report.Get(Memory::TARIFFS).count == 2);
+        CHECK(read.GetUnits(1000, 100000) == first.GetUnits(1000, 100000));
+    }
+    // Slots of a timetable one by one, as the summaries & word scans should see them
+    // .. Slots before the origin cannot be reserved, slots past the end are free
+    struct NaiveTimetable {
+        long long slotSeconds;
+        time_t originTime;
+        std::vector<bool> booked;
+
+        long long FloorSlots(const time_t& p_time) const {
+            long long seconds = (long long)p_time - originTime;
+            return seconds >= 0 ? seconds / slotSeconds : -((slotSeconds - 1 - seconds) / slotSeconds);
+        }
+        long long CeilSlots(const time_t& p_time) const { return -FloorSlots(2 * originTime - p_time); }
+        bool IsFreeRun(long long p_slot, unsigned long p_slots) const {
+            if (p_slot < 0) return false;
+            for (long long slot = p_slot; slot < p_slot + (long long)p_slots; slot++)
+                if (slot < (long long)booked.size() && booked[slot]) return false;
+            return true;
+        }
+        bool IsFree(const time_t& p_startTime, const time_t& p_endTime) const {
+            long long startSlot = FloorSlots(p_startTime), endSlot = FloorSlots(p_endTime);
+            return endSlot >= startSlot && IsFreeRun(startSlot, endSlot - startSlot + 1);
+        }
+        bool FindFree(const time_t& p_fromTime, const time_t& p_toTime, unsigned long p_slots, time_t& p_startTime) const {
+            long long fromSlot = std::max(0LL, CeilSlots(p_fromTime)), toSlot = FloorSlots(p_toTime);
+            for (long long slot = fromSlot; p_slots != 0 && slot <= toSlot; slot++)
+                if (IsFreeRun(slot, p_slots)) {
+                    p_startTime = originTime + slot * slotSeconds;
+                    return true;
+                }
+            return false;
+        }
+        std::vector<bool> FreeStarts(const time_t& p_fromTime, const time_t& p_toTime, unsigned long p_slots) const {
+            std::vector<bool> starts;
+            long long firstSlot = FloorSlots(p_fromTime);
+            for (long long i = 0; i <= (p_toTime - p_fromTime) / slotSeconds; i++)
+                starts.push_back(IsFreeRun(firstSlot + i, p_slots));
+            return starts;
+        }
+        unsigned int CountBooked(const time_t& p_startTime, const time_t& p_endTime) const {
+            long long startSlot = std::max(0LL, FloorSlots(p_startTime));
+            long long endSlot = CeilSlots(p_endTime) - 1;
+            unsigned int count = 0;
+            for (long long slot = startSlot; slot <= endSlot && slot < (long long)booked.size(); slot++) count += booked[slot];
+            return count;
+        }
+        void Assign(const time_t& p_startTime, const time_t& p_endTime, bool p_booked) {
+            for (long long slot = FloorSlots(p_startTime); slot <= FloorSlots(p_endTime); slot++) booked[slot] = p_booked;
+        }
+    };
+
+    // Free slot searches & counts through the summary bitmaps agree with a slot by slot scan
+    // .. Timetables mix free & full groups of 64 words, free & full words & scattered slots,
+    // .. then change under random reservations so the summaries are kept up to date, not only built
+    template <unsigned int SlotSeconds>
+    unsigned int CheckTimetable(std::mt19937_64& p_engine) {
+        using Timetable = Space::BasicTime<SlotSeconds>;
+        const time_t originTime = 1700000000 - 1700000000 % 3600;
+        unsigned int mismatches = 0;
+        for (unsigned int instance = 0; instance < 20; instance++) {
+            unsigned long words = 64 * (1 + p_engine() % 4) + p_engine() % 64;
+            std::vector<unsigned long long> times(words, 0);
+            for (unsigned long group = 0; group * 64 < words; group++) {
+                unsigned int groupKind = p_engine() % 5 % 3;
+                for (unsigned long word = group * 64; word < std::min(words, group * 64 + 64); word++) {
+                    unsigned int kind = groupKind < 2 ? groupKind : p_engine() % 4;
+                    if (kind == 1) times[word] = 0xFFFFFFFFull;
+                    else if (kind == 2) times[word] = p_engine() & p_engine() & p_engine() & 0xFFFFFFFFull;
+                    else if (kind == 3) times[word] = (p_engine() | p_engine()) & 0xFFFFFFFFull;
+                }
+            }
+            Timetable timetable(100, originTime);
+            timetable.SetBulkTimes(times);
+            NaiveTimetable naive{SlotSeconds, originTime, std::vector<bool>(words * 32 + 8192, false)};
+            for (unsigned long slot = 0; slot < words * 32; slot++) naive.booked[slot] = (times[slot / 32] >> (slot % 32)) & 1;
+
+            auto RandomTime = [&]() {
+                return originTime - 3 * (time_t)SlotSeconds + (time_t)(p_engine() % ((words * 32 + 200) * SlotSeconds));
+            };
+            for (unsigned int step = 0; step < 200; step++) {
+                time_t startTime = RandomTime();
+                time_t endTime = startTime + (time_t)(p_engine() % (p_engine() % 4 == 0 ? words * 32 : 40) * SlotSeconds)
+                    + (time_t)(p_engine() % SlotSeconds);
+                unsigned int hours = 1 + p_engine() % 6;
+                unsigned long slots = hours * (3600 / SlotSeconds);
+                time_t found = 0, expectedFound = 0;
+                bool isFound = timetable.FindFree(startTime, endTime, hours, found);
+                if (isFound != naive.FindFree(startTime, endTime, slots, expectedFound) || (isFound && found != expectedFound))
+                    mismatches++;
+                std::vector<unsigned long long> starts = timetable.FreeStarts(startTime, endTime, hours);
+                std::vector<bool> expectedStarts = naive.FreeStarts(startTime, endTime, slots);
+                if (starts.size() != (expectedStarts.size() + 63) / 64) mismatches++;
+                else for (unsigned long i = 0; i < expectedStarts.size(); i++)
+                    if ((bool)((starts[i / 64] >> (i % 64)) & 1) != expectedStarts[i]) mismatches++;
+                if (timetable.GetBookedSlots(startTime, endTime) != naive.CountBooked(startTime, endTime)) mismatches++;
+                if (timetable.IsFree(startTime, endTime) != naive.IsFree(startTime, endTime)) mismatches++;
+                // .. Book or free a short range, as AddReservation & RemoveReservation do
+                time_t lastTime = startTime + (time_t)(p_engine() % 80 * SlotSeconds);
+                bool isFree = naive.IsFree(startTime, lastTime);
+                if (timetable.IsFree(startTime, lastTime) != isFree) mismatches++;
+                double price = 0;
+                if (p_engine() % 3 != 0) {
+                    if (timetable.AddReservation(startTime, lastTime, price) != isFree) mismatches++;
+                    if (isFree) naive.Assign(startTime, lastTime, true);
+                } else if (naive.FloorSlots(startTime) >= 0) {
+                    if (!timetable.RemoveReservation(startTime, lastTime)) mismatches++;
+                    naive.Assign(startTime, lastTime, false);
+                }
+            }
+        }
+        return mismatches;
+    }
+    void TestTimetable() {
+        std::mt19937_64 engine(35);
+        CHECK(CheckTimetable<3600>(engine) == 0);
+        CHECK(CheckTimetable<1800>(engine) == 0);
+        CHECK(CheckTimetable<900>(engine) == 0);
+    }
+    // Recurring rules book & free the same slots as their occurrences one by one, or nothing on a conflict
+    // .. Periods that line up with words & periods that do not, rules past the end of the timetable,
+    // .. with prices & day rollups compared as well
+    template <unsigned int SlotSeconds>
+    unsigned int CheckRecurring(std::mt19937_64& p_engine) {
+        using Timetable = Space::BasicTime<SlotSeconds>;
+        const time_t originTime = 1700000000 - 1700000000 % 3600;
+        const unsigned long slotsPerDay = 24 * 3600 / SlotSeconds;
+        unsigned int mismatches = 0;
+        for (unsigned int instance = 0; instance < 20; instance++) {
+            unsigned long words = 1 + p_engine() % 200;
+            std::vector<unsigned long long> times(words, 0);
+            for (auto& word: times) word = p_engine() % 3 == 0 ? p_engine() & p_engine() & p_engine() & 0xFFFFFFFFull : 0;
+            Timetable timetable(100, originTime);
+            Space::Tariff tariff;
+            tariff.SetPeak(p_engine() % 24, p_engine() % 24, 1.5);
+            timetable.SetTariff(tariff);
+            timetable.SetBulkTimes(times);
+            NaiveTimetable naive{SlotSeconds, originTime, std::vector<bool>(words * 32 + 40000, false)};
+            for (unsigned long slot = 0; slot < words * 32; slot++) naive.booked[slot] = (times[slot / 32] >> (slot % 32)) & 1;
+
+            for (unsigned int step = 0; step < 100; step++) {
+                Space::Recurrence rule;
+                unsigned long periodSlots = p_engine() % 2 == 0 ? 32 * (1 + p_engine() % 3) : 1 + p_engine() % 150;
+                rule.period = (time_t)periodSlots * SlotSeconds + (p_engine() % 20 == 0 ? 60 : 0);
+                rule.duration = 1 + p_engine() % (periodSlots * SlotSeconds);
+                rule.count = 1 + p_engine() % 80;
+                rule.startTime = originTime - (time_t)SlotSeconds + (time_t)(p_engine() % ((words * 32 + 64) * SlotSeconds));
+                // .. Occurrences one by one: the slots of the first, one period apart
+                long long startSlot = naive.FloorSlots(rule.startTime);
+                long long durationSlots = naive.CeilSlots(rule.startTime + rule.duration) - startSlot;
+                bool isValid = rule.period % SlotSeconds == 0 && startSlot >= 0 && durationSlots <= (long long)periodSlots;
+                bool isFree = true;
+                double expectedPrice = 0, price = 0;
+                for (unsigned int i = 0; isValid && i < rule.count; i++) {
+                    long long first = startSlot + (long long)i * periodSlots;
+                    isFree = isFree && naive.IsFreeRun(first, durationSlots);
+                    timetable.Quote(originTime + first * SlotSeconds, originTime + (first + durationSlots - 1) * SlotSeconds, price);
+                    expectedPrice += price;
+                }
+                bool isAdd = p_engine() % 3 != 0;
+                if (isAdd) {
+                    bool isAdded = timetable.AddRecurring(rule, price);
+                    if (isAdded != (isValid && isFree) || (isAdded && std::abs(price - expectedPrice) > 1e-6 * expectedPrice))
+                        mismatches++;
+                } else if (timetable.RemoveRecurring(rule) != isValid) mismatches++;
+                for (unsigned int i = 0; isValid && (isFree || !isAdd) && i < rule.count; i++) {
+                    long long first = startSlot + (long long)i * periodSlots;
+                    for (long long slot = first; slot < first + durationSlots; slot++) naive.booked[slot] = isAdd;
+                }
+                // .. The whole timetable, its summaries & rollups after every rule
+                std::vector<unsigned long long> result = timetable.GetTimes();
+                for (unsigned long slot = 0; slot < naive.booked.size(); slot++) {
+                    bool isBooked = slot / 32 < result.size() && (result[slot / 32] >> (slot % 32)) & 1;
+                    if (isBooked != naive.booked[slot]) {
+                        mismatches++;
+                        break;
+                    }
+                }
+                time_t endTime = originTime + (time_t)naive.booked.size() * SlotSeconds;
+                if (timetable.GetBookedSlots(originTime, endTime) != naive.CountBooked(originTime, endTime)) mismatches++;
+                long long originSlot = originTime / SlotSeconds;
+                for (unsigned long day = originSlot / slotsPerDay; day <= (originSlot + naive.booked.size()) / slotsPerDay; day++) {
+                    unsigned int count = 0;
+                    for (unsigned long slot = day * slotsPerDay; slot < (day + 1) * slotsPerDay; slot++)
+                        if (slot >= originSlot && slot - originSlot < naive.booked.size()) count += naive.booked[slot - originSlot];
+                    if (timetable.GetRollups().GetDay(day) != count) mismatches++;
+                }
+            }
+        }
+        return mismatches;
+    }
+    void TestRecurring() {
+        std::mt19937_64 engine(36);
+        CHECK(CheckRecurring<3600>(engine) == 0);
+        CHECK(CheckRecurring<900>(engine) == 0);
+    }
+    // Timetable words at another slot length, slot by slot
+    std::vector<unsigned long long> NaiveConvertSlots(const std::vector<unsigned long long>& p_times,
+        unsigned int p_fromSeconds, unsigned int p_toSeconds) {
+        unsigned long size = p_times.size();
+        for (unsigned int seconds = p_fromSeconds; seconds > p_toSeconds; seconds /= 2) size *= 2;
+        for (unsigned int seconds = p_fromSeconds; seconds < p_toSeconds; seconds *= 2) size = (size + 1) / 2;
+        std::vector<unsigned long long> times(size, 0);
+        for (unsigned long slot = 0; slot < size * 32; slot++) {
+            // .. Finer slots copy their coarser slot, coarser slots are booked if any of their finer slots is
+            unsigned long first = slot * p_toSeconds / p_fromSeconds, last = ((slot + 1) * p_toSeconds - 1) / p_fromSeconds;
+            for (unsigned long from = first; from <= last && from / 32 < p_times.size(); from++)
+                if ((p_times[from / 32] >> (from % 32)) & 1) times[slot / 32] |= 1ull << (slot % 32);
+        }
+        return times;
+    }
+
+    // Conversions between slot lengths agree with a slot by slot copy, & going finer then back is lossless
+    void TestSlots() {
+        std::mt19937_64 engine(37);
+        const unsigned int lengths[] = {900, 1800, 3600};
+        unsigned int mismatches = 0, lossy = 0;
+        for (unsigned int instance = 0; instance < 300; instance++) {
+            std::vector<unsigned long long> times(engine() % 70);
+            for (auto& word: times) word = engine() % 4 == 0 ? 0xFFFFFFFFull : engine() & engine() & 0xFFFFFFFFull;
+            for (unsigned int from: lengths)
+                for (unsigned int to: lengths) {
+                    std::vector<unsigned long long> converted = Space::Time::ConvertSlots(times, from, to);
+                    if (converted != NaiveConvertSlots(times, from, to)) mismatches++;
+                    if (to < from && Space::Time::ConvertSlots(converted, to, from) != times) lossy++;
+                }
+        }
+        CHECK(mismatches == 0);
+        CHECK(lossy == 0);
+        bool isThrown = false;
+        try {
+            Space::Time::ConvertSlots({1}, 3600, 600);
+        } catch (const std::invalid_argument&) {
+            isThrown = true;
+        }
+        CHECK(isThrown);
+
+        // .. Converted timetables keep the booked time: an hour booked in quarters is still booked as an hour
+        const time_t originTime = 1700000000 - 1700000000 % 3600;
+        Space::BasicTime<900> quarters(100, originTime);
+        double price = 0;
+        CHECK(quarters.AddReservation(originTime + 3600 + 900, originTime + 3600 + 900, price));
+        Space::BasicTime<3600> hours(quarters);
+        CHECK(hours.GetBookedSlots(originTime, originTime + 24 * 3600) == 1 && !hours.IsFree(originTime + 3600, originTime + 3600));
+        Space::BasicTime<900> back(hours);
+        CHECK(back.GetBookedSlots(originTime, originTime + 24 * 3600) == 4 && back.IsFree(originTime, originTime + 3599));
+    }
+    // Cached results are dropped exactly when a changed ID is in the range they read
+    // .. Cached free time results match an uncached scan whatever changed in between, & only real changes are counted
+    void TestCache() {
+        std::mt19937_64 engine(44);
+        unsigned int mismatches = 0;
+        for (unsigned int instance = 0; instance < 200; instance++) {
+            Cache::Lru<std::vector<int>> cache(1ull << 30);
+            std::map<std::string, std::pair<unsigned int, unsigned int>> expected;
+            for (unsigned int i = 0; i < 1 + engine() % 40; i++) {
+                unsigned int firstID = engine() % 100, lastID = firstID + engine() % 30;
+                cache.Put(std::to_string(i), std::vector<int>(1 + engine() % 5), firstID, lastID);
+                expected[std::to_string(i)] = {firstID, lastID};
+            }
+            std::vector<unsigned int> IDs;
+            for (unsigned int i = 0; i < engine() % 6; i++) IDs.push_back(engine() % 130);
+            std::sort(IDs.begin(), IDs.end());
+            cache.Invalidate(IDs);
+            for (const auto& entry: expected) {
+                bool isRead = false;
+                for (unsigned int ID: IDs) isRead = isRead || (ID >= entry.second.first && ID < entry.second.second);
+                if ((cache.Get(entry.first) != nullptr) == isRead) mismatches++;
+            }
+        }
+        CHECK(mismatches == 0);
+
+        const time_t originTime = 1700000000 - 1700000000 % 3600;
+        Space::SpaceManager spaceManager;
+        spaceManager.SetRandomSeed(44);
+        spaceManager.GetRandomizedSpaces(60);
+        for (unsigned int ID = 0; ID < spaceManager.GetSpaceCount(); ID++)
+            spaceManager.GetSpace(ID)->timer = Space::Time(100, originTime);
+        spaceManager.TrackChanges(true);
+        spaceManager.TakeChangedIDs();
+        unsigned long long changeCount = spaceManager.GetChangeCount();
+        std::set<unsigned int> changedIDs;
+        unsigned int hits = 0, stale = 0, miscounted = 0;
+        for (unsigned int step = 0; step < 3000; step++) {
+            unsigned int kind = engine() % 30, ID = engine() % (spaceManager.GetSpaceCount() + 2);
+            double price = 0;
+            if (kind < 7) {
+                // .. Changed in place, or only looked at
+                Space::Space* space_ptr = spaceManager.GetSpace(ID);
+                time_t startTime = originTime + (time_t)(engine() % 48) * 3600;
+                time_t endTime = startTime + 3600 * (engine() % 3);
+                if (space_ptr != nullptr && kind < 2 && space_ptr->timer.AddReservation(startTime, endTime, price))
+                    changedIDs.insert(ID);
+            } else if (kind == 7)
+                changedIDs.insert(spaceManager.AddSpace(Space::Space(0, "Added", 10, 10, 3, 20, 20, false, false, false, 100)));
+            else if (kind == 8) {
+                if (spaceManager.ReadSpace(ID) != nullptr) changedIDs.insert(ID);
+                spaceManager.DeleteSpace(ID);
+            } else if (kind < 29) {
+                // .. The same few queries again & again, so most are answered from the cache
+                time_t fromTime = originTime + (time_t)(engine() % 2) * 12 * 3600;
+                unsigned int hours = 1 + engine() % 2, maxResults = engine() % 2 * 5;
+                Cache::Stats before = spaceManager.GetCacheStats();
+                std::vector<std::pair<unsigned int, time_t>> results =
+                    spaceManager.FindFreeSpaces(fromTime, fromTime + 6 * 3600, hours, maxResults);
+                hits += spaceManager.GetCacheStats().hits - before.hits;
+                std::vector<std::pair<unsigned int, time_t>> expected;
+                for (unsigned int i = 0; i < spaceManager.GetSpaceCount() && (maxResults == 0 || expected.size() < maxResults); i++) {
+                    const Space::Space* space_ptr = spaceManager.ReadSpace(i);
+                    time_t startTime;
+                    if (space_ptr != nullptr && space_ptr->timer.FindFree(fromTime, fromTime + 6 * 3600, hours, startTime))
+                        expected.push_back(std::make_pair(i, startTime));
+                }
+                if (results != expected) stale++;
+            } else {
+                // .. A change is counted once it is settled, & only if something changed
+                unsigned long long count = spaceManager.GetChangeCount();
+                std::vector<unsigned int> IDs = spaceManager.TakeChangedIDs();
+                if ((count > changeCount) != !changedIDs.empty() || IDs != std::vector<unsigned int>(changedIDs.begin(), changedIDs.end()))
+                    miscounted++;
+                changeCount = count;
+                changedIDs.clear();
+            }
+        }
+        CHECK(stale == 0);
+        CHECK(miscounted == 0);
+        CHECK(hits > 500);
+    }
+}
+
+int main(int argc, char* argv[]) {
+	const std::map<std::string, std::function<void()>> suites = {
+		{"storage", TestStorage}, {"mvcc", TestMvcc}, {"timerwheel", TestTimerWheel},
+		{"codec", TestCodec}, {"search", TestSearch}, {"placement", TestPlacement},
+		{"tariff", TestTariff}, {"timetable", TestTimetable},
+		{"recurring", TestRecurring}, {"slots", TestSlots},
+		{"cache", TestCache}
+	};
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++) names.push_back(argv[i]);
+	// .. Every suite must be registered with CTest, or its checks would never run in the build
+	if (!names.empty() && names[0] == "--registered") {
+		unsigned int missing = 0;
+		for (const auto& suite: suites)
+			if (std::find(names.begin() + 1, names.end(), suite.first) == names.end()) {
+				std::cout << "Suite not registered with CTest: " << suite.first << std::endl;
+				missing++;
+			}
+		return missing == 0 ? 0 : 1;
+	}
+	if (names.empty())
+		for (const auto& suite: suites) names.push_back(suite.first);
+	for (const std::string& name: names) {
+		auto it = suites.find(name);
+		if (it == suites.end()) {
+			std::cout << "Unknown suite: " << name << std::endl;
+			return 1;
+		}
+		unsigned int before = failures;
+		it->second();
+		std::cout << name << ": " << (failures == before ? "passed" : "FAILED") << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
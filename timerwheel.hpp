@@ -0,0 +1,158 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <vector>
+#include <mutex>
+#include <ctime>
+#include <algorithm>
+
+// Seconds per tick of the wheel
+#define TIMER_TICK_SECONDS 60
+// Levels of 64 buckets each: 64 ticks, 64^2, ... (4 levels of minutes reach 31 years)
+#define TIMER_LEVELS 4
+// Reservation reminders go out this long before the reservation begins
+#define TIMER_REMINDER_SECONDS (24 * 3600)
+
+// Timed events of reservations
+namespace Timer {
+    // Class for a hierarchical timer wheel
+    // .. Level L has 64 buckets of 64^L ticks each; an event is put on the lowest level whose current
+    // .. rotation reaches it, and moved down a level whenever the wheel enters its bucket, so it is
+    // .. moved at most TIMER_LEVELS times. Empty buckets are skipped through one occupancy word per level:
+    // .. scheduling & firing cost O(1) amortized per event, whatever the number of events or idle ticks
+    // .. Events are never removed: owners check that an event still applies when it fires
+    // .. Thread-safe, so that users loaded on parallel threads can schedule their events
+    template <typename T>
+    class Wheel {
+    private:
+        struct Entry {
+            unsigned long long tick;
+            T value;
+        };
+        static constexpr unsigned int BITS = 6;
+        static constexpr unsigned long long SIZE = 1ull << BITS;
+        std::vector<Entry> buckets[TIMER_LEVELS][SIZE];
+        unsigned long long occupied[TIMER_LEVELS] = {};
+        // Events past the reach of the top level
+        std::vector<Entry> overflow;
+        // Last tick fired; events scheduled for it or earlier since go in its bucket, fired by the next Advance
+        unsigned long long current;
+        unsigned long size = 0;
+        mutable std::mutex mutex;
+
+        static unsigned long long TickOf(time_t p_time) { return p_time < 0 ? 0 : (unsigned long long)p_time / TIMER_TICK_SECONDS; }
+        void Place(Entry&& p_entry) {
+            if (p_entry.tick < current) p_entry.tick = current;
+            for (unsigned int level = 0; level < TIMER_LEVELS; level++) {
+                // .. Lowest level where only the digit of this level (or none) differs from the current tick
+                if ((p_entry.tick >> (BITS * (level + 1))) != (current >> (BITS * (level + 1)))) continue;
+                unsigned int bucket = (p_entry.tick >> (BITS * level)) & (SIZE - 1);
+                buckets[level][bucket].push_back(std::move(p_entry));
+                occupied[level] |= 1ull << bucket;
+                return;
+            }
+            overflow.push_back(std::move(p_entry));
+        }
+        // Move the current tick to p_tick, moving down the buckets the wheel enters
+        void MoveTo(unsigned long long p_tick) {
+            current = p_tick;
+            if (current % (1ull << (BITS * TIMER_LEVELS)) == 0 && !overflow.empty()) {
+                std::vector<Entry> entries;
+                entries.swap(overflow);
+                for (Entry& entry: entries) Place(std::move(entry));
+            }
+            for (unsigned int level = TIMER_LEVELS - 1; level > 0; level--) {
+                if (current % (1ull << (BITS * level)) != 0) continue;
+                unsigned int bucket = (current >> (BITS * level)) & (SIZE - 1);
+                if (!(occupied[level] >> bucket & 1)) continue;
+                std::vector<Entry> entries;
+                entries.swap(buckets[level][bucket]);
+                occupied[level] &= ~(1ull << bucket);
+                for (Entry& entry: entries) Place(std::move(entry));
+            }
+        }
+        // First tick from the current one where a bucket fires or moves down, ~0 if none
+        unsigned long long NextTick() const {
+            for (unsigned int level = 0; level < TIMER_LEVELS; level++) {
+                unsigned int digit = (current >> (BITS * level)) & (SIZE - 1);
+                // .. Above level 0, the bucket of the current digit was moved down when the wheel entered it
+                unsigned long long mask = level == 0 ? occupied[0] >> digit << digit
+                    : digit + 1 < SIZE ? occupied[level] >> (digit + 1) << (digit + 1) : 0;
+                if (mask == 0) continue;
+                unsigned long long rotation = current >> (BITS * (level + 1)) << (BITS * (level + 1));
+                return rotation + ((unsigned long long)__builtin_ctzll(mask) << (BITS * level));
+            }
+            if (!overflow.empty())
+                return ((current >> (BITS * TIMER_LEVELS)) + 1) << (BITS * TIMER_LEVELS);
+            return ~0ull;
+        }
+    public:
+        // Constructors & destructors
+        Wheel(time_t p_time = time(NULL)) : current(TickOf(p_time)) {}
+
+        // Getters
+        unsigned long GetSize() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return size;
+        }
+        // Heap bytes held by the buckets
+        unsigned long long GetBytes() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            unsigned long long bytes = overflow.capacity() * sizeof(Entry);
+            for (unsigned int level = 0; level < TIMER_LEVELS; level++)
+                for (unsigned int bucket = 0; bucket < SIZE; bucket++)
+                    bytes += buckets[level][bucket].capacity() * sizeof(Entry);
+            return bytes;
+        }
+
+        // Interface
+        // Schedule p_value at p_time, or at the next Advance if that has passed
+        void Schedule(time_t p_time, T p_value) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Place(Entry{TickOf(p_time), std::move(p_value)});
+            size++;
+        }
+        // Take the events due by p_time, in tick order
+        std::vector<T> Advance(time_t p_time) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<T> due;
+            unsigned long long tick = std::max(TickOf(p_time), current);
+            while (true) {
+                unsigned int bucket = current & (SIZE - 1);
+                if (occupied[0] >> bucket & 1) {
+                    for (Entry& entry: buckets[0][bucket]) due.push_back(std::move(entry.value));
+                    size -= buckets[0][bucket].size();
+                    buckets[0][bucket].clear();
+                    occupied[0] &= ~(1ull << bucket);
+                }
+                if (current == tick) break;
+                // .. Straight to the next bucket to fire or move down, or to p_time if none comes before
+                MoveTo(std::min(NextTick(), tick));
+            }
+            return due;
+        }
+    };
+
+    // Timed events of a reservation
+    enum Kind {
+        // Some time before it begins
+        REMINDER,
+        // When it begins, if the balance is not paid
+        BALANCE_DUE,
+        // When it ends, out of the user's current reservations
+        ARCHIVE
+    };
+    struct Event {
+        Kind kind;
+        // User & wheel registration the event was scheduled for
+        unsigned int userID;
+        unsigned long long owner;
+        // Reservation, by space & times as in the user's records
+        unsigned int spaceID;
+        time_t startTime, endTime;
+        // Occurrence of a recurring reservation, -1 for single ones
+        int occurrence;
+    };
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+// JSON library courtesy of:
+// https://github.com/nlohmann/json
+#include "json.hpp"
+namespace nljs = nlohmann;
+
+// Default trace file
+#define TRACE_FILE "magical.trace"
+
+// Events kept per thread before further spans are dropped
+#define TRACE_MAX_EVENTS (1 << 20)
+
+// Span tracing in the Chrome trace event format
+// .. Enabled at runtime; the file opens in chrome://tracing or https://ui.perfetto.dev
+namespace Trace {
+    // Completed span
+    // .. Names & categories are string literals, times in microseconds since Start
+    struct Event {
+        const char* name;
+        const char* category;
+        double start, duration;
+        long long count;
+    };
+
+    // Spans recorded by one thread
+    struct ThreadBuffer {
+        unsigned int tid = 0;
+        std::string name;
+        std::mutex mutex;
+        std::vector<Event> events;
+        unsigned long long dropped = 0;
+    };
+
+    // Class to collect spans from all threads
+    class Tracer {
+    private:
+        std::atomic<bool> isEnabled{false};
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        std::string fileName;
+        std::chrono::steady_clock::time_point originTime;
+    public:
+        static Tracer& Get() {
+            static Tracer tracer;
+            return tracer;
+        }
+        // Getters
+        bool IsEnabled() const { return isEnabled.load(std::memory_order_relaxed); }
+        double Now() const {
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - originTime).count();
+        }
+
+        // Threads are tagged in order of their first span
+        std::shared_ptr<ThreadBuffer> NewBuffer() {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::make_shared<ThreadBuffer>());
+            buffers.back()->tid = buffers.size();
+            buffers.back()->name = "thread " + std::to_string(buffers.size());
+            return buffers.back();
+        }
+
+        // Interface
+        // Start recording, discarding earlier spans
+        void Start(const std::string& p_fileName) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& buffer: buffers) {
+                std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                buffer->events.clear();
+                buffer->dropped = 0;
+            }
+            fileName = p_fileName;
+            originTime = std::chrono::steady_clock::now();
+            isEnabled.store(true);
+        }
+        // Stop recording and write the trace file
+        bool Stop() {
+            if (!isEnabled.exchange(false))
+                return false;
+            nljs::json jevents = nljs::json::array();
+            long long pid = getpid();
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& buffer: buffers) {
+                std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                jevents.push_back({
+                    {"name", "thread_name"}, {"ph", "M"}, {"pid", pid}, {"tid", buffer->tid},
+                    {"args", {{"name", buffer->name}}}
+                });
+                for (const Event& event: buffer->events) {
+                    nljs::json jevent = {
+                        {"name", event.name}, {"cat", event.category}, {"ph", "X"},
+                        {"ts", event.start}, {"dur", event.duration}, {"pid", pid}, {"tid", buffer->tid}
+                    };
+                    if (event.count >= 0) jevent["args"] = {{"count", event.count}};
+                    jevents.push_back(jevent);
+                }
+                if (buffer->dropped != 0)
+                    std::cout << "Trace dropped " << buffer->dropped << " span(s) on " << buffer->name << std::endl;
+            }
+            std::ofstream outFile(fileName);
+            if (!outFile.is_open())
+                return false;
+            outFile << nljs::json{{"traceEvents", jevents}, {"displayTimeUnit", "ms"}} << std::endl;
+            return outFile.good();
+        }
+    };
+
+    // Utility functions
+    inline ThreadBuffer& LocalBuffer() {
+        thread_local std::shared_ptr<ThreadBuffer> buffer = Tracer::Get().NewBuffer();
+        return *buffer;
+    }
+    // Name shown for the calling thread
+    inline void SetThreadName(const std::string& p_name) {
+        ThreadBuffer& buffer = LocalBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.name = p_name + " " + std::to_string(buffer.tid);
+    }
+
+    // Class for a scoped span
+    // .. Costs one relaxed load while tracing is off
+    // .. End() closes a phase early, so that consecutive phases need no extra scopes
+    class Span {
+    private:
+        const char* name;
+        const char* category;
+        long long count;
+        double startTime = -1;
+    public:
+        // Constructors & destructors
+        Span(const char* p_name, const char* p_category, long long p_count = -1)
+            : name(p_name), category(p_category), count(p_count) {
+            if (Tracer::Get().IsEnabled()) startTime = Tracer::Get().Now();
+        }
+        ~Span() { End(); }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        // Setters
+        void SetCount(long long p_count) { count = p_count; }
+        void End() {
+            if (startTime < 0) return;
+            double duration = Tracer::Get().Now() - startTime;
+            ThreadBuffer& buffer = LocalBuffer();
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            if (buffer.events.size() < TRACE_MAX_EVENTS)
+                buffer.events.push_back(Event{name, category, startTime, duration, count});
+            else buffer.dropped++;
+            startTime = -1;
+        }
+    };
+}
+
+#endif
@@ -9,6 +9,15 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
+#include <future>
+#include <chrono>
+#include <deque>
+#include <atomic>
+
+// POSIX terminal input
+#include <poll.h>
+#include <unistd.h>
 
 // JSON library courtesy of:
 // https://github.com/nlohmann/json
@@ -16,29 +25,70 @@
 namespace nljs = nlohmann;
 // Random hidden file
 #define USER_FILE "file.magical"
+// Milliseconds between rounds of idle work while a terminal waits for the user
+#define IDLE_INTERVAL 100
+// Notices kept per user until shown, oldest dropped first
+#define USER_MAX_NOTICES 20
 
 // Space library
 #include "space.hpp"
+// Utilization reports
+#include "analytics.hpp"
+// Background stores
+#include "persist.hpp"
+// Change log shipping to replicas
+#include "replica.hpp"
+// Operation traces for load tests
+#include "workload.hpp"
+// Events over several spaces
+#include "placement.hpp"
+// Timed events of reservations
+#include "timerwheel.hpp"
 
 namespace User {
     // Utility functions
+    // Work for the session thread while it waits for the user, e.g. finishing background stores
+    inline std::function<void()>& IdleHook() {
+        static std::function<void()> hook;
+        return hook;
+    }
+    // Run idle work once, then again every IDLE_INTERVAL until the user types something
+    // .. Only at a terminal: piped input may already sit in a buffer that poll cannot see
+    inline void WaitForInput() {
+        if (!IdleHook()) return;
+        IdleHook()();
+        if (!isatty(STDIN_FILENO)) return;
+        std::cout << std::flush;
+        pollfd entry{STDIN_FILENO, POLLIN, 0};
+        while (IdleHook() && poll(&entry, 1, IDLE_INTERVAL) == 0)
+            IdleHook()();
+    }
     // Display console message and get user input
     std::string GetInput(const std::string& consoleMessage) {
         std::string userInput;
         std::cout << consoleMessage;
+        WaitForInput();
         getline(std::cin, userInput);
         return userInput;
     }
     // Get user input time rounded by hours (1 min 1 sec later to be safe)    
+    // .. Minutes are asked too when timetables have shorter slots, rounded down to a slot
     time_t GetTime(const std::string message) {
         tm tmp_time{};
         int tmp_month, tmp_year;
         std::cout << std::endl << message;
-        std::cout << "\nFormat: <Day> <Month> <Year> <O'clock>: ";
-        std::cin >> tmp_time.tm_mday >> tmp_month >> tmp_year >> tmp_time.tm_hour;
+        if (Space::Time::SLOT_SECONDS < 3600) {
+            std::cout << "\nFormat: <Day> <Month> <Year> <Hour> <Minutes>: ";
+            WaitForInput();
+            std::cin >> tmp_time.tm_mday >> tmp_month >> tmp_year >> tmp_time.tm_hour >> tmp_time.tm_min;
+            tmp_time.tm_min -= tmp_time.tm_min % (Space::Time::SLOT_SECONDS / 60);
+        } else {
+            std::cout << "\nFormat: <Day> <Month> <Year> <O'clock>: ";
+            WaitForInput();
+            std::cin >> tmp_time.tm_mday >> tmp_month >> tmp_year >> tmp_time.tm_hour;
+        }
         tmp_time.tm_year = tmp_year - 1900;
         tmp_time.tm_mon = tmp_month - 1;
-        tmp_time.tm_min = 0;
         tmp_time.tm_sec = 0;
         std::cin.ignore(100, '\n');
         time_t returnTime = mktime(&tmp_time);
@@ -46,12 +96,32 @@ namespace User {
         return returnTime;
     }
 
+    // Search spaces from user input
+    // .. Returns false to list every space instead
+    bool SearchSpaces(Space::SpaceManager* p_spaceManager) {
+        std::string query = GetInput("\nSearch spaces (leave empty to list all): ");
+        if (query.find_first_not_of(' ') == std::string::npos) return false;
+        Workload::Event event;
+        event.op = Workload::BROWSE;
+        event.text = query;
+        Workload::Recorder::Get().Record(event);
+        auto results = p_spaceManager->SearchSpaces(query, 10);
+        if (results.empty()) std::cout << "No matching space!\n";
+        for (const auto& result: results) {
+            std::cout << std::endl << "Score: " << result.score << std::endl;
+            p_spaceManager->ReadSpace(result.ID)->PrintSpace(true, false, true);
+        }
+        return true;
+    }
+
     // Abstract class for users
     class User {
     protected:
         unsigned int ID;
-        std::string name;
+        Intern::String name;
         Space::SpaceManager* spaceManager;
+        // Bumped on every change
+        unsigned long long version = 0;
     public:
         // Constructors & destructors
         User(Space::SpaceManager* p_spaceManager) {
@@ -65,16 +135,19 @@ namespace User {
             spaceManager = p_spaceManager;
         }
         // Setters
-        void SetName(const std::string& p_name) {
+        void SetName(const Intern::String& p_name) {
             name = p_name;
+            version++;
         }
         void SetID(unsigned int p_ID) {
             ID = p_ID;
+            version++;
         }
 
         // Getters
-        std::string GetName() const { return name; }
+        std::string_view GetName() const { return name; }
         unsigned int GetID() const { return ID; }
+        unsigned long long GetVersion() const { return version; }
 
         // Utility
         // Actions function
@@ -85,12 +158,102 @@ namespace User {
         virtual nljs::json Serialize() = 0;
         // Deserialize function
         virtual void Deserialize(const nljs::json& p_juser) = 0;
+        // Add the heap bytes of the user to a report
+        virtual void CountMemory(Memory::Report& p_report) const = 0;
+        // Schedule the timed events of the user on p_timers
+        virtual void SetTimers(Timer::Wheel<Timer::Event>*) {}
+        // Handle a timed event come due
+        virtual void OnTimer(const Timer::Event&) {}
+    protected:
+        // Record an operation of the session, if a trace is being recorded
+        static void RecordEvent(Workload::Op p_op, unsigned int p_spaceID = 0, time_t p_startTime = 0, time_t p_endTime = 0,
+            unsigned int p_hours = 0, double p_amount = 0, const std::string& p_text = "") {
+            if (!Workload::Recorder::Get().IsRecording()) return;
+            Workload::Event event;
+            event.op = p_op;
+            event.space = p_spaceID;
+            event.startTime = p_startTime;
+            event.endTime = p_endTime;
+            event.hours = p_hours;
+            event.amount = p_amount;
+            event.text = p_text;
+            Workload::Recorder::Get().Record(event);
+        }
     };
 
     // Class for event managers
     class EventUser : public User {
         std::vector<std::pair<unsigned int, std::pair<time_t, time_t>>> RSVPs;
+        // Recurring reservations, one rule each
+        // .. Numbered after the single ones
+        std::vector<std::pair<unsigned int, Space::Recurrence>> recurringRSVPs;
         double outstandingBalance = 0;
+        // Reservations that have ended, moved out of the current ones by their timed events
+        std::vector<std::pair<unsigned int, std::pair<time_t, time_t>>> pastRSVPs;
+        std::vector<std::pair<unsigned int, Space::Recurrence>> pastRecurringRSVPs;
+        // Wheel the timed events are scheduled on, if any, & this user's registration with it
+        Timer::Wheel<Timer::Event>* timers = nullptr;
+        unsigned long long timerOwner = 0;
+        // Reservations ending by this time have been archived
+        time_t archivedTime = 0;
+        // Reminders & balance notices, shown at the next menu
+        std::deque<std::string> notices;
+
+        // Timed events
+        void Schedule(Timer::Kind p_kind, time_t p_time, unsigned int p_spaceID, time_t p_startTime, time_t p_endTime,
+            int p_occurrence = -1) {
+            timers->Schedule(p_time, Timer::Event{p_kind, ID, timerOwner, p_spaceID, p_startTime, p_endTime, p_occurrence});
+        }
+        // Reminder before it begins, balance check when it begins & archive when it ends
+        // .. Events already past are skipped, except the archive
+        void ScheduleReservation(unsigned int p_spaceID, time_t p_startTime, time_t p_endTime) {
+            if (timers == nullptr) return;
+            time_t now = time(NULL);
+            if (p_startTime - TIMER_REMINDER_SECONDS > now)
+                Schedule(Timer::REMINDER, p_startTime - TIMER_REMINDER_SECONDS, p_spaceID, p_startTime, p_endTime);
+            if (p_startTime > now) Schedule(Timer::BALANCE_DUE, p_startTime, p_spaceID, p_startTime, p_endTime);
+            // .. Reservations made for times already archived are archived by their own event
+            archivedTime = std::min(archivedTime, p_endTime - 1);
+            Schedule(Timer::ARCHIVE, p_endTime, p_spaceID, p_startTime, p_endTime);
+        }
+        // The same for a recurring reservation
+        // .. Only the next reminder & balance check are scheduled, each one schedules the following occurrence's
+        void ScheduleRecurring(unsigned int p_spaceID, const Space::Recurrence& p_rule) {
+            if (timers == nullptr) return;
+            time_t now = time(NULL);
+            auto nextAfter = [&p_rule](time_t p_time) -> unsigned int {
+                return p_rule.startTime > p_time ? 0 : (p_time - p_rule.startTime) / p_rule.period + 1;
+            };
+            unsigned int reminder = nextAfter(now + TIMER_REMINDER_SECONDS), next = nextAfter(now);
+            if (reminder < p_rule.count)
+                Schedule(Timer::REMINDER, p_rule.GetStartTime(reminder) - TIMER_REMINDER_SECONDS,
+                    p_spaceID, p_rule.startTime, p_rule.GetEndTime(), reminder);
+            if (next < p_rule.count)
+                Schedule(Timer::BALANCE_DUE, p_rule.GetStartTime(next), p_spaceID, p_rule.startTime, p_rule.GetEndTime(), next);
+            archivedTime = std::min(archivedTime, p_rule.GetEndTime() - 1);
+            Schedule(Timer::ARCHIVE, p_rule.GetEndTime(), p_spaceID, p_rule.startTime, p_rule.GetEndTime(), 0);
+        }
+        // Move every reservation ended by p_time to the past ones, in a single pass
+        void ArchiveEnded(time_t p_time) {
+            unsigned int count = GetNumberOfReservations(), kept = 0;
+            for (unsigned int i = 0; i < RSVPs.size(); i++) {
+                if (RSVPs[i].second.second <= p_time) pastRSVPs.push_back(RSVPs[i]);
+                else RSVPs[kept++] = RSVPs[i];
+            }
+            RSVPs.resize(kept);
+            kept = 0;
+            for (unsigned int i = 0; i < recurringRSVPs.size(); i++) {
+                if (recurringRSVPs[i].second.GetEndTime() <= p_time) pastRecurringRSVPs.push_back(recurringRSVPs[i]);
+                else recurringRSVPs[kept++] = recurringRSVPs[i];
+            }
+            recurringRSVPs.resize(kept);
+            archivedTime = p_time;
+            if (GetNumberOfReservations() != count) version++;
+        }
+        void Notify(const std::string& p_notice) {
+            if (notices.size() == USER_MAX_NOTICES) notices.pop_front();
+            notices.push_back(p_notice);
+        }
     public:
         // Constructors & destructors
         EventUser(Space::SpaceManager* p_spaceManager) : User(p_spaceManager) {}
@@ -99,34 +262,202 @@ namespace User {
             outstandingBalance = p_outstandingBalance;
         }
 
+        // Setters
+        // Record a reservation already made on the space's timer
+        void AddReservationRecord(unsigned int p_spaceID, time_t p_startTime, time_t p_endTime, double p_price) {
+            RSVPs.push_back(std::make_pair(p_spaceID, std::make_pair(p_startTime, p_endTime)));
+            outstandingBalance += p_price;
+            version++;
+            ScheduleReservation(p_spaceID, p_startTime, p_endTime);
+        }
+        void AddRecurringRecord(unsigned int p_spaceID, const Space::Recurrence& p_rule, double p_price) {
+            recurringRSVPs.push_back(std::make_pair(p_spaceID, p_rule));
+            outstandingBalance += p_price;
+            version++;
+            ScheduleRecurring(p_spaceID, p_rule);
+        }
+        // Schedule the timed events of every current reservation on p_timers
+        // .. Events scheduled for an earlier registration are ignored when they come due
+        void SetTimers(Timer::Wheel<Timer::Event>* p_timers) {
+            static std::atomic<unsigned long long> owners(0);
+            timers = p_timers;
+            timerOwner = ++owners;
+            for (const auto& RSVP: RSVPs)
+                ScheduleReservation(RSVP.first, RSVP.second.first, RSVP.second.second);
+            for (const auto& recurring: recurringRSVPs)
+                ScheduleRecurring(recurring.first, recurring.second);
+        }
+
+        // Getters
+        double GetOutstandingBalance() const { return outstandingBalance; }
+        unsigned int GetNumberOfReservations() const { return RSVPs.size() + recurringRSVPs.size(); }
+        unsigned int GetNumberOfPastReservations() const { return pastRSVPs.size() + pastRecurringRSVPs.size(); }
+        void CountMemory(Memory::Report& p_report) const {
+            p_report.Add(Memory::USERS, sizeof(EventUser));
+            p_report.Add(Memory::RESERVATIONS, Memory::VectorBytes(RSVPs) + Memory::VectorBytes(recurringRSVPs)
+                + Memory::VectorBytes(pastRSVPs) + Memory::VectorBytes(pastRecurringRSVPs),
+                GetNumberOfReservations() + GetNumberOfPastReservations());
+        }
+
+        // Reservation # of a single reservation, or of a recurring one by its first & last times
+        // .. -1 if there is none
+        int FindReservation(unsigned int p_spaceID, time_t p_startTime, time_t p_endTime) const {
+            for (unsigned int i = 0; i < RSVPs.size(); i++)
+                if (RSVPs[i].first == p_spaceID && RSVPs[i].second.first == p_startTime && RSVPs[i].second.second == p_endTime)
+                    return i;
+            for (unsigned int i = 0; i < recurringRSVPs.size(); i++)
+                if (recurringRSVPs[i].first == p_spaceID && recurringRSVPs[i].second.startTime == p_startTime
+                    && recurringRSVPs[i].second.GetEndTime() == p_endTime)
+                    return RSVPs.size() + i;
+            return -1;
+        }
+
+        // Interface
+        // .. Operations of the menu, also driven by the load test
+        // Reserve a space for [p_startTime, p_endTime) (returns whether it succeeded, & its price)
+        bool Reserve(unsigned int p_spaceID, time_t p_startTime, time_t p_endTime, double& p_price) {
+            if (spaceManager->ReadSpace(p_spaceID) == nullptr) return false;
+            if (!spaceManager->GetSpace(p_spaceID)->timer.AddReservation(p_startTime, p_endTime - Space::Time::SLOT_SECONDS, p_price))
+                return false;
+            AddReservationRecord(p_spaceID, p_startTime, p_endTime, p_price);
+            return true;
+        }
+        // Reserve every space of a placement, or none (returns whether it succeeded)
+        // .. One reservation per space, priced as charged
+        bool ReservePlan(Placement::Plan& p_plan) {
+            if (!Placement::Commit(*spaceManager, p_plan)) return false;
+            for (const Placement::Plan::Room& room: p_plan.rooms)
+                AddReservationRecord(room.ID, p_plan.startTime, p_plan.endTime, room.price);
+            return true;
+        }
+        // Remove reservation #p_RSVP_ID, every occurrence of a recurring one at once
+        // .. No refund
+        bool CancelReservation(unsigned int p_RSVP_ID) {
+            if (p_RSVP_ID >= GetNumberOfReservations()) return false;
+            if (p_RSVP_ID >= RSVPs.size()) {
+                unsigned int recurringID = p_RSVP_ID - RSVPs.size();
+                Space::Space* space_ptr = spaceManager->GetSpace(recurringRSVPs[recurringID].first);
+                if (space_ptr == nullptr || !space_ptr->timer.RemoveRecurring(recurringRSVPs[recurringID].second))
+                    return false;
+                recurringRSVPs.erase(recurringRSVPs.begin() + recurringID);
+            } else {
+                Space::Space* space_ptr = spaceManager->GetSpace(RSVPs[p_RSVP_ID].first);
+                if (space_ptr == nullptr || !space_ptr->timer.RemoveReservation(RSVPs[p_RSVP_ID].second.first,
+                    RSVPs[p_RSVP_ID].second.second - Space::Time::SLOT_SECONDS))
+                    return false;
+                RSVPs.erase(RSVPs.begin() + p_RSVP_ID);
+            }
+            version++;
+            return true;
+        }
+        // Handle a timed event of one of the reservations
+        // .. Events of reservations cancelled since, or of an earlier registration, are ignored
+        void OnTimer(const Timer::Event& p_event) {
+            if (p_event.owner != timerOwner) return;
+            // .. The first archive event due archives every reservation ended by then: the others come after it
+            // .. & are skipped, so a backlog of ended reservations costs one pass
+            if (p_event.kind == Timer::ARCHIVE) {
+                if (p_event.endTime > archivedTime) ArchiveEnded(std::max(time(NULL), p_event.endTime));
+                return;
+            }
+            int RSVP_ID = FindReservation(p_event.spaceID, p_event.startTime, p_event.endTime);
+            if (RSVP_ID < 0 || (RSVP_ID >= (int)RSVPs.size()) != (p_event.occurrence >= 0)) return;
+            time_t startTime = p_event.startTime;
+            if (p_event.occurrence >= 0)
+                startTime = recurringRSVPs[RSVP_ID - RSVPs.size()].second.GetStartTime(p_event.occurrence);
+            switch (p_event.kind) {
+                case Timer::REMINDER: {
+                    Notify("Reservation #" + std::to_string(RSVP_ID) + " of space #" + std::to_string(p_event.spaceID)
+                        + " begins on " + ctime(&startTime));
+                    if (p_event.occurrence < 0) break;
+                    const Space::Recurrence& rule = recurringRSVPs[RSVP_ID - RSVPs.size()].second;
+                    if ((unsigned int)p_event.occurrence + 1 < rule.count)
+                        Schedule(Timer::REMINDER, rule.GetStartTime(p_event.occurrence + 1) - TIMER_REMINDER_SECONDS,
+                            p_event.spaceID, p_event.startTime, p_event.endTime, p_event.occurrence + 1);
+                    break;
+                }
+                case Timer::BALANCE_DUE: {
+                    if (outstandingBalance >= 0.001) {
+                        std::ostringstream notice;
+                        notice << "Reservation #" << RSVP_ID << " of space #" << p_event.spaceID << " has begun, "
+                               << outstandingBalance << " Dhs are due\n";
+                        Notify(notice.str());
+                    }
+                    if (p_event.occurrence < 0) break;
+                    const Space::Recurrence& rule = recurringRSVPs[RSVP_ID - RSVPs.size()].second;
+                    if ((unsigned int)p_event.occurrence + 1 < rule.count)
+                        Schedule(Timer::BALANCE_DUE, rule.GetStartTime(p_event.occurrence + 1),
+                            p_event.spaceID, p_event.startTime, p_event.endTime, p_event.occurrence + 1);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        // Pay towards the outstanding balance (returns the change given back)
+        double Pay(double p_payment) {
+            if (p_payment <= 0) return 0;
+            version++;
+            double change = std::max(0.0, p_payment - outstandingBalance);
+            outstandingBalance = std::max(0.0, outstandingBalance - p_payment);
+            return change;
+        }
+
         // Utility
         // Clean reservations function: remove reservations with invalid spaces
         inline void CleanReservations() {
             int i = RSVPs.size() - 1;
             while (i >= 0) {
-                if (spaceManager->GetSpace(RSVPs[i].first) == nullptr)
+                if (spaceManager->ReadSpace(RSVPs[i].first) == nullptr) {
                     RSVPs.erase(RSVPs.begin() + i);
+                    version++;
+                }
+                i--;
+            }
+            i = recurringRSVPs.size() - 1;
+            while (i >= 0) {
+                if (spaceManager->ReadSpace(recurringRSVPs[i].first) == nullptr) {
+                    recurringRSVPs.erase(recurringRSVPs.begin() + i);
+                    version++;
+                }
                 i--;
             }
         }
         // Print reservations function
         inline void PrintReservation(unsigned int ID) {
             std::cout << "\nReservation #" << ID << ":\n";
-            spaceManager->GetSpace(RSVPs[ID].first)->PrintSpace(false, false);
+            if (ID >= RSVPs.size()) {
+                const auto& recurring = recurringRSVPs[ID - RSVPs.size()];
+                spaceManager->ReadSpace(recurring.first)->PrintSpace(false, false);
+                std::cout << "Reservation time: ";
+                recurring.second.PrintRecurrence();
+                return;
+            }
+            spaceManager->ReadSpace(RSVPs[ID].first)->PrintSpace(false, false);
             std::cout << "Reservation time:\n  -- from "
                       << ctime(&RSVPs[ID].second.first) << "  -- to "
                       << ctime(&RSVPs[ID].second.second);
         }
         inline void PrintReservations() {
             CleanReservations();
-            if (RSVPs.size() > 0) {
-                for (unsigned int i = 0; i < RSVPs.size(); i++) {
+            if (GetNumberOfReservations() > 0) {
+                for (unsigned int i = 0; i < GetNumberOfReservations(); i++) {
                     std::cout << std::endl;
                     PrintReservation(i);
                 }
             } else {
                 std::cout << " You have no reservations yet\n";
             }
+            if (GetNumberOfPastReservations() > 0)
+                std::cout << "\n(and " << GetNumberOfPastReservations() << " past reservation(s))\n";
+        }
+        // Print & clear the notices
+        inline void PrintNotices() {
+            if (notices.empty()) return;
+            std::cout << "\nNotices:\n";
+            for (const std::string& notice: notices)
+                std::cout << "  -- " << notice;
+            notices.clear();
         }
         // Print function
         inline void PrintUser() {
@@ -143,6 +474,7 @@ namespace User {
             bool isRunning = true;
             while (isRunning) {
                 CleanReservations();
+                PrintNotices();
                 std::cout << "\nWhat would you like to do?\n";
                 std::cout << " 1. Browse spaces\n";
                 std::cout << " 2. Add or remove reservations\n";
@@ -150,17 +482,19 @@ namespace User {
                 std::cout << " 4. Make payment\n";
                 std::cout << " 5. Add review\n";
                 std::cout << " 6. Log out\n";
+                WaitForInput();
                 getline(std::cin, choice);
                 switch (choice[0]) {
                     case '1': {
-                        spaceManager->PrintSpaces(true, false, true);
+                        if (!SearchSpaces(spaceManager))
+                            spaceManager->PrintSpaces(true, false, true);
                         choice = GetInput("View space timetables? (y/n): ");
                         while (choice[0] == 'y') {
                             try {
                                 unsigned int ID  = std::stoi(GetInput("\nSpace ID: "));
-                                if (spaceManager->GetSpace(ID) == nullptr) {
+                                if (spaceManager->ReadSpace(ID) == nullptr) {
                                     std::cout << "Could not find space!\n";
-                                } else spaceManager->GetSpace(ID)->PrintSpace(false, true, false);
+                                } else spaceManager->ReadSpace(ID)->PrintSpace(false, true, false);
                             } catch (std::exception e) {
                                 std::cout << "Invalid input" << std::endl;
                             }
@@ -170,37 +504,111 @@ namespace User {
                     }
                     case '2': {
                         try {
-                            choice = GetInput("\nAdd (1) or remove (2) reservation? (1/2): ");
+                            choice = GetInput("\nAdd (1), remove (2) or quote (3) reservation, find free spaces (4), add recurring reservation (5) or place an event over several spaces (6)? (1/2/3/4/5/6): ");
                             if (choice[0] == '1') {
                                 unsigned int ID  = std::stoi(GetInput("\nSpace ID to make/remove reservation: "));
-                                if (spaceManager->GetSpace(ID) == nullptr) {
+                                if (spaceManager->ReadSpace(ID) == nullptr) {
                                     std::cout << "Could not find space!\n";
                                     break;
                                 }
                                 double price = 0;
                                 time_t tmpStart = GetTime("Input begin time");
                                 time_t tmpEnd = GetTime("Input end time");
-                                if (spaceManager->GetSpace(ID)->timer.AddReservation(tmpStart, tmpEnd - 3600, price)) {
+                                RecordEvent(Workload::RESERVE, ID, tmpStart, tmpEnd);
+                                if (Reserve(ID, tmpStart, tmpEnd, price)) {
                                     std::cout << "Reservation successful!\n";
                                     std::cout << "Price: " << price << " Dhs" << std::endl;
-                                    outstandingBalance += price;
-                                    RSVPs.push_back(std::make_pair(ID, std::make_pair(tmpStart, tmpEnd)));
                                 } else {
                                     std::cout << "Reservation failed!\n";
                                     std::cout << "Possible time conflict or invalid time input\n";
                                 }
                             } else if (choice[0] == '2') {
                                 unsigned int RSVP_ID = std::stoi(GetInput("Enter your reservation #: "));
-                                if (RSVP_ID >= RSVPs.size()) {
+                                if (RSVP_ID >= GetNumberOfReservations()) {
                                     std::cout << "Could not find reservation!\n";
                                     break;
                                 }
-                                if (spaceManager->GetSpace(RSVPs[RSVP_ID].first)->
-                                    timer.RemoveReservation(RSVPs[RSVP_ID].second.first, RSVPs[RSVP_ID].second.second - 3600)) {
-                                    RSVPs.erase(RSVPs.begin() + RSVP_ID);
-                                    std::cout << "Reservation removed!\n";
+                                bool isRecurring = RSVP_ID >= RSVPs.size();
+                                if (isRecurring) {
+                                    const auto& recurring = recurringRSVPs[RSVP_ID - RSVPs.size()];
+                                    RecordEvent(Workload::CANCEL, recurring.first, recurring.second.startTime, recurring.second.GetEndTime());
+                                } else RecordEvent(Workload::CANCEL, RSVPs[RSVP_ID].first, RSVPs[RSVP_ID].second.first, RSVPs[RSVP_ID].second.second);
+                                if (CancelReservation(RSVP_ID)) {
+                                    std::cout << (isRecurring ? "Recurring reservation removed!\n" : "Reservation removed!\n");
                                     std::cout << "No refund :(\n";
                                 }
+                            } else if (choice[0] == '3') {
+                                unsigned int ID  = std::stoi(GetInput("\nSpace ID to quote: "));
+                                if (spaceManager->ReadSpace(ID) == nullptr) {
+                                    std::cout << "Could not find space!\n";
+                                    break;
+                                }
+                                double price = 0;
+                                time_t tmpStart = GetTime("Input begin time");
+                                time_t tmpEnd = GetTime("Input end time");
+                                if (spaceManager->ReadSpace(ID)->timer.Quote(tmpStart, tmpEnd - Space::Time::SLOT_SECONDS, price))
+                                    std::cout << "Price: " << price << " Dhs" << std::endl;
+                                else std::cout << "Invalid time input\n";
+                            } else if (choice[0] == '4') {
+                                time_t tmpStart = GetTime("Input earliest begin time");
+                                time_t tmpEnd = GetTime("Input latest begin time");
+                                unsigned int hours = std::stoi(GetInput("Number of hours: "));
+                                RecordEvent(Workload::FIND_FREE, 0, tmpStart, tmpEnd, hours);
+                                auto results = spaceManager->FindFreeSpaces(tmpStart, tmpEnd, hours, 10);
+                                if (results.empty()) std::cout << "No free space found!\n";
+                                for (const auto& result: results)
+                                    std::cout << "Space #" << result.first << " " << spaceManager->ReadSpace(result.first)->GetName()
+                                              << " from " << ctime(&result.second);
+                            } else if (choice[0] == '5') {
+                                unsigned int ID  = std::stoi(GetInput("\nSpace ID to make reservation: "));
+                                if (spaceManager->ReadSpace(ID) == nullptr) {
+                                    std::cout << "Could not find space!\n";
+                                    break;
+                                }
+                                time_t tmpStart = GetTime("Input begin time of the first reservation");
+                                time_t tmpEnd = GetTime("Input end time of the first reservation");
+                                time_t period = 24 * 3600;
+                                choice = GetInput("Repeat daily (d), weekly (w) or every number of hours (h)? (d/w/h): ");
+                                if (choice[0] == 'w') period = 7 * 24 * 3600;
+                                else if (choice[0] == 'h') period = std::stoi(GetInput("Repeat every (hours): ")) * 3600;
+                                unsigned int count = std::stoi(GetInput("Number of reservations: "));
+                                Space::Recurrence rule(tmpStart, tmpEnd - tmpStart, period, count);
+                                double price = 0;
+                                if (spaceManager->GetSpace(ID)->timer.AddRecurring(rule, price)) {
+                                    std::cout << "Recurring reservation successful!\n";
+                                    std::cout << "Price: " << price << " Dhs" << std::endl;
+                                    AddRecurringRecord(ID, rule, price);
+                                } else {
+                                    std::cout << "Reservation failed!\n";
+                                    std::cout << "Possible time conflict or invalid time input\n";
+                                }
+                            } else if (choice[0] == '6') {
+                                Placement::Request request;
+                                request.attendees = std::stoi(GetInput("\nNumber of attendees: "));
+                                request.isSeated = GetInput("Seated? (y/n): ")[0] == 'y';
+                                request.fromTime = GetTime("Input earliest begin time");
+                                request.toTime = GetTime("Input latest begin time");
+                                request.hours = std::stoi(GetInput("Number of hours: "));
+                                std::cout << "Amenities: catering (c), natural light (n), artificial light (a), projector (p), sound (s), cameras (m), outdoor (o)\n";
+                                request.everyRoom = Placement::AmenitiesOf(GetInput("Needed in every space (e.g. cs, empty for none): "));
+                                request.anyRoom = Placement::AmenitiesOf(GetInput("Needed in at least one space (e.g. p, empty for none): "));
+                                Placement::Plan plan;
+                                if (!Placement::Place(*spaceManager, request, plan)) {
+                                    std::cout << "No set of free spaces found!\n";
+                                    break;
+                                }
+                                plan.PrintPlan();
+                                choice = GetInput("Reserve these spaces? (y/n): ");
+                                if (choice[0] != 'y') break;
+                                if (ReservePlan(plan)) {
+                                    for (const Placement::Plan::Room& room: plan.rooms)
+                                        RecordEvent(Workload::RESERVE, room.ID, plan.startTime, plan.endTime);
+                                    std::cout << "Reservation successful!\n";
+                                    std::cout << "Price: " << plan.cost << " Dhs" << std::endl;
+                                } else {
+                                    std::cout << "Reservation failed!\n";
+                                    std::cout << "A space was booked in the meantime, nothing was reserved\n";
+                                }
                             } else {
                                 std::cout << "Invalid input" << std::endl;
                             }
@@ -221,14 +629,12 @@ namespace User {
                             try {
                                 double payment = stod(GetInput("How much do you want to pay? (Dhs): "));
                                 if (payment > 0) {
+                                    RecordEvent(Workload::PAY, 0, 0, 0, 0, payment);
                                     std::cout << "Payment received!\n";
-                                    if (outstandingBalance < payment) {
-                                        std::cout << "Returning " << payment - outstandingBalance << " Dhs in change\n";
-                                        outstandingBalance = 0;
-                                    } else {
-                                        outstandingBalance -= payment;
-                                        std::cout << "\nYour outstanding balance is " << outstandingBalance << " Dhs" << std::endl;
-                                    }
+                                    double change = Pay(payment);
+                                    if (change > 0)
+                                        std::cout << "Returning " << change << " Dhs in change\n";
+                                    else std::cout << "\nYour outstanding balance is " << outstandingBalance << " Dhs" << std::endl;
                                 }
                             } catch (std::exception e) {
                                 std::cout << "Invalid input" << std::endl;
@@ -239,7 +645,7 @@ namespace User {
                     case '5': {
                         try {
                             unsigned int ID  = std::stoi(GetInput("\nSpace ID to add review: "));
-                            if (spaceManager->GetSpace(ID) == nullptr) {
+                            if (spaceManager->ReadSpace(ID) == nullptr) {
                                 std::cout << "Could not find space!\n";
                                 break;
                             }
@@ -249,7 +655,8 @@ namespace User {
                                 std::cout << "Invalid score!\n";
                                 break;
                             }
-                            spaceManager->GetSpace(ID)->review.AddReview(review, score);
+                            RecordEvent(Workload::REVIEW, ID, 0, 0, 0, score, review);
+                            spaceManager->AddReview(ID, review, score);
                             std::cout << "Review successfully added!\n";
                         } catch (std::exception e) {
                             std::cout << "Invalid input" << std::endl;
@@ -268,24 +675,64 @@ namespace User {
                 if (choice[0] == 'n') isRunning = false;
             }
         }
-        // Serialize function
+        // Serialization
+        // .. Recurring rules only if any, each stored with the ID of its space
+        struct RecurringRecord : Space::Recurrence {
+            unsigned int spaceID = 0;
+            static constexpr auto Fields() {
+                return std::tuple_cat(Space::Recurrence::Fields(),
+                    std::make_tuple(Codec::Member("spaceID", &RecurringRecord::spaceID)));
+            }
+        };
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("ID", &EventUser::ID),
+                Codec::Member("name", &EventUser::name),
+                Codec::Property<std::string>("role",
+                    [](const EventUser&) { return std::string("eventUser"); }, [](EventUser&, std::string&&) {}),
+                Codec::Member("RSVPs", &EventUser::RSVPs),
+                Codec::Member("outstandingBalance", &EventUser::outstandingBalance),
+                Codec::Optional<std::vector<RecurringRecord>>("recurring",
+                    [](const EventUser& p_user) {
+                        std::vector<RecurringRecord> records;
+                        for (const auto& recurring: p_user.recurringRSVPs)
+                            records.push_back(RecurringRecord{recurring.second, recurring.first});
+                        return records;
+                    },
+                    [](EventUser& p_user, std::vector<RecurringRecord>&& p_records) {
+                        for (const auto& record: p_records)
+                            p_user.recurringRSVPs.push_back(std::make_pair(record.spaceID, (const Space::Recurrence&)record));
+                    },
+                    [](const EventUser& p_user) { return !p_user.recurringRSVPs.empty(); }),
+                Codec::Optional<std::vector<std::pair<unsigned int, std::pair<time_t, time_t>>>>("pastRSVPs",
+                    [](const EventUser& p_user) -> const auto& { return p_user.pastRSVPs; },
+                    [](EventUser& p_user, std::vector<std::pair<unsigned int, std::pair<time_t, time_t>>>&& p_RSVPs) {
+                        p_user.pastRSVPs = std::move(p_RSVPs);
+                    },
+                    [](const EventUser& p_user) { return !p_user.pastRSVPs.empty(); }),
+                Codec::Optional<std::vector<RecurringRecord>>("pastRecurring",
+                    [](const EventUser& p_user) {
+                        std::vector<RecurringRecord> records;
+                        for (const auto& recurring: p_user.pastRecurringRSVPs)
+                            records.push_back(RecurringRecord{recurring.second, recurring.first});
+                        return records;
+                    },
+                    [](EventUser& p_user, std::vector<RecurringRecord>&& p_records) {
+                        for (const auto& record: p_records)
+                            p_user.pastRecurringRSVPs.push_back(std::make_pair(record.spaceID, (const Space::Recurrence&)record));
+                    },
+                    [](const EventUser& p_user) { return !p_user.pastRecurringRSVPs.empty(); })
+            );
+        }
         nljs::json Serialize() {
             CleanReservations();
-            nljs::json juser = {
-                {"ID", ID},
-                {"name", name},
-                {"role", "eventUser"},
-                {"RSVPs", nljs::json(RSVPs)},
-                {"outstandingBalance", outstandingBalance}
-            };
-            return juser;
+            return Codec::ToJson(*this);
         }
-        // Deserialize function
         void Deserialize(const nljs::json& p_juser) {
-            ID = p_juser["ID"];
-            name = p_juser["name"];
-            RSVPs = p_juser["RSVPs"].get<std::vector<std::pair<unsigned int, std::pair<time_t, time_t>>>>();
-            outstandingBalance = p_juser["outstandingBalance"];
+            recurringRSVPs.clear();
+            pastRSVPs.clear();
+            pastRecurringRSVPs.clear();
+            Codec::FromJson(p_juser, *this);
         }
     };
 
@@ -298,6 +745,17 @@ namespace User {
         SpaceUser(int p_ID, std::string p_name, Space::SpaceManager* p_spaceManager)
             : User(p_ID, p_name, p_spaceManager) {}
 
+        // Setters
+        void AddSpaceID(unsigned int p_spaceID) {
+            spaceIDs.push_back(p_spaceID);
+            version++;
+        }
+
+        // Getters
+        void CountMemory(Memory::Report& p_report) const {
+            p_report.Add(Memory::USERS, sizeof(SpaceUser) + Memory::VectorBytes(spaceIDs));
+        }
+
         // Utility
         // Print spaces function
         inline void PrintSpaces() {
@@ -305,7 +763,7 @@ namespace User {
                 for (unsigned int i = 0; i < spaceIDs.size(); i++) {
                     std::cout << std::endl;
                     std::cout << "\nSpace #" << i << ":\n";
-                    spaceManager->GetSpace(spaceIDs[i])->PrintSpace();
+                    spaceManager->ReadSpace(spaceIDs[i])->PrintSpace();
                 }
             } else {
                 std::cout << " You have no spaces yet\n";
@@ -332,6 +790,7 @@ namespace User {
                 std::cout << " 2. Add or remove spaces\n";
                 std::cout << " 3. Browse my spaces\n";
                 std::cout << " 4. Log out\n";
+                WaitForInput();
                 getline(std::cin, choice);
                 switch (choice[0]) {
                     case '1': {
@@ -344,7 +803,8 @@ namespace User {
                             if (choice[0] == '1') {
                                 std::string name = GetInput("Enter the name of your space: ");
                                 choice = GetInput("Randomize space or not (manual entry)? ([y]/n): ");
-                                unsigned int ID = spaceManager->GetEmptyID();;
+                                // .. The ID is the one AddSpace assigns, not guessed beforehand
+                                unsigned int ID;
                                 if (choice[0] == 'n') {
                                     float length, width, height;
                                     std::cout << "Enter length, width, height (m): ";
@@ -367,6 +827,18 @@ namespace User {
                                     std::cin >> dirhamsPerHour;
 
                                     std::cin.ignore(100, '\n');
+                                    Space::Tariff tariff;
+                                    if (GetInput("Charge more at peak hours or weekends? (y/[n]) ")[0] == 'y') {
+                                        unsigned int peakStart, peakEnd;
+                                        double peakRate, weekendRate;
+                                        std::cout << "Enter peak start & end hours (0-23, UTC): ";
+                                        std::cin >> peakStart >> peakEnd;
+                                        std::cout << "Enter peak & weekend rate multipliers (1 for none): ";
+                                        std::cin >> peakRate >> weekendRate;
+                                        std::cin.ignore(100, '\n');
+                                        tariff.SetRules(peakStart, peakEnd, peakRate, weekendRate,
+                                            {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1});
+                                    }
                                     bool outdoor = (GetInput("Is the space outdoor? ([y]/n) ")[0] != 'n');
                                     bool catering = (GetInput("Does your space provide catering? ([y]/n) ")[0] != 'n');
                                     bool naturalLight = (GetInput("Is there natural daylight? ([y]/n) ")[0] != 'n');
@@ -374,24 +846,33 @@ namespace User {
                                     bool projector = (GetInput("Are there projectors available? ([y]/n) ")[0] != 'n');
                                     bool sound = (GetInput("Are there any sound systems? ([y]/n) ")[0] != 'n');
                                     bool cameras = (GetInput("Are there cameras available? ([y]/n) ")[0] != 'n');
+                                    std::string tags = GetInput("Enter tags, separated by commas (e.g. wedding, concert): ");
 
-                                    spaceManager->AddSpace(
-                                        new Space::Space(
-                                            ID,
-                                            name, length, width, height, numberOfPeople, numberOfSeats,
-                                            slanted, surround, comfy, dirhamsPerHour, outdoor, catering,
-                                            naturalLight, artificialLight, projector, sound, cameras
-                                        )
+                                    Space::Space space(
+                                        0,
+                                        name, length, width, height, numberOfPeople, numberOfSeats,
+                                        slanted, surround, comfy, dirhamsPerHour, outdoor, catering,
+                                        naturalLight, artificialLight, projector, sound, cameras
                                     );
+                                    space.timer.SetTariff(tariff);
+                                    std::stringstream tagStream(tags);
+                                    std::string tag;
+                                    while (getline(tagStream, tag, ',')) {
+                                        tag.erase(0, tag.find_first_not_of(' '));
+                                        tag.erase(tag.find_last_not_of(' ') + 1);
+                                        if (!tag.empty()) space.AddTag(tag);
+                                    }
+                                    ID = spaceManager->AddSpace(std::move(space));
                                 } else {
-                                    spaceManager->GetRandomizedSpaces(1, name);
+                                    ID = spaceManager->GetRandomizedSpaces(1, name).front();
                                 }
                                 std::cout << "Space " << name << " successfully created with ID: " << ID << "!\n";
                                 spaceIDs.push_back(ID);
+                                version++;
 
                             } else if (choice[0] == '2') {
                                 unsigned int ID  = std::stoi(GetInput("\nSpace ID to remove: "));
-                                if (spaceManager->GetSpace(ID) == nullptr) {
+                                if (spaceManager->ReadSpace(ID) == nullptr) {
                                     std::cout << "Could not find space!\n";
                                     break;
                                 } 
@@ -402,6 +883,7 @@ namespace User {
                                 }
                                 spaceManager->DeleteSpace(ID);
                                 spaceIDs.erase(pos);
+                                version++;
                                 std::cout << "Space successfully deleted!\n";
                             } else {
                                 std::cout << "Invalid input" << std::endl;
@@ -427,33 +909,217 @@ namespace User {
                 if (choice[0] == 'n') isRunning = false;
             }
         }
-        // Serialize function
-        nljs::json Serialize() {
-            nljs::json juser = {
-                {"ID", ID},
-                {"name", name},
-                {"role", "spaceUser"},
-                {"spaceIDs", nljs::json(spaceIDs)}
-            };
-            return juser;
-        }
-        // Deserialize function
-        void Deserialize(const nljs::json& p_juser) {
-            ID = p_juser["ID"];
-            name = p_juser["name"];
-            spaceIDs = p_juser["spaceIDs"].get<std::vector<unsigned int>>();
+        // Serialization
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("ID", &SpaceUser::ID),
+                Codec::Member("name", &SpaceUser::name),
+                Codec::Property<std::string>("role",
+                    [](const SpaceUser&) { return std::string("spaceUser"); }, [](SpaceUser&, std::string&&) {}),
+                Codec::Member("spaceIDs", &SpaceUser::spaceIDs)
+            );
         }
+        nljs::json Serialize() { return Codec::ToJson(*this); }
+        void Deserialize(const nljs::json& p_juser) { Codec::FromJson(p_juser, *this); }
     };
 
     // Class to manage users
     // (running front of the application)
     class UserManager {
         std::vector<User*> users;
-        User* activeUser;
+        // User of the running session, if any
+        User* activeUser = nullptr;
 
         // Check if spaceManager is running
         bool isSpace = false;
         Space::SpaceManager* spaceManager;
+
+        // Sharded storage state
+        Storage::ShardTable shards;
+        // Background export of spaces, if any
+        std::future<bool> exportTask;
+        // Background stores of the sharded catalog
+        Persist::Service persister;
+        // Number of user changes so far (sessions & new users count as one)
+        unsigned long long changes = 0;
+        // Change log for replicas, & the session's user as last published
+        Replica::Publisher publisher;
+        User* publishedUser = nullptr;
+        unsigned long long publishedVersion = 0;
+        // Users changed outside of the session since the last batch, e.g. by timed events
+        std::vector<unsigned int> changedUserIDs;
+        // Change log applied when running as a replica
+        Replica::Follower follower;
+        // Footprint sampled while idle
+        Memory::History memoryHistory;
+        // Timed events of the reservations, once started (see StartTimers)
+        Timer::Wheel<Timer::Event> timers;
+        bool isTimed = false;
+
+        // Sharding helpers
+        // Create user from its serialized form based on role
+        User* NewUser(const nljs::json& p_juser) {
+            User* user_ptr = nullptr;
+            if (p_juser["role"] == "eventUser") user_ptr = new EventUser(spaceManager);
+            else if (p_juser["role"] == "spaceUser") user_ptr = new SpaceUser(spaceManager);
+            if (user_ptr != nullptr) {
+                user_ptr->Deserialize(p_juser);
+                if (isTimed) user_ptr->SetTimers(&timers);
+            }
+            return user_ptr;
+        }
+        // Sum of user versions in a shard
+        unsigned long long ShardVersion(unsigned int p_shard) const {
+            unsigned long long version = 0;
+            unsigned int firstID = p_shard * shards.GetShardSize();
+            for (unsigned int ID = firstID; ID < users.size() && ID < firstID + shards.GetShardSize(); ID++)
+                if (users[ID] != nullptr) version += users[ID]->GetVersion();
+            return version;
+        }
+        // Load a single shard file into its ID range
+        bool LoadShard(unsigned int p_shard) {
+            Trace::Span span("LoadUserShard", "load", p_shard);
+            const Storage::Manifest::Shard& info = shards.GetManifest().shards[p_shard];
+            try {
+                bool isRead = Storage::ForEachRecord(info.fileName, [&](nljs::json& juser) {
+                    User* user_ptr = NewUser(juser);
+                    if (user_ptr == nullptr) return true;
+                    unsigned int ID = user_ptr->GetID();
+                    // Ignore records outside of the shard range
+                    if (ID < info.firstID || ID >= info.firstID + info.slots) {
+                        delete user_ptr;
+                        return true;
+                    }
+                    delete users[ID];
+                    users[ID] = user_ptr;
+                    return true;
+                });
+                if (!isRead) {
+                    std::cout << "Could not load shard " << info.fileName << std::endl;
+                    return false;
+                }
+            } catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            shards.MarkLoaded(p_shard, ShardVersion(p_shard));
+            return true;
+        }
+        // Serialize a single shard from its ID range
+        bool SerializeShard(unsigned int p_shard, nljs::json& p_jusers) {
+            Trace::Span span("SerializeUserShard", "store", p_shard);
+            p_jusers = nljs::json::array();
+            unsigned int firstID = p_shard * shards.GetShardSize();
+            try {
+                for (unsigned int ID = firstID; ID < users.size() && ID < firstID + shards.GetShardSize(); ID++)
+                    if (users[ID] != nullptr) p_jusers.push_back(users[ID]->Serialize());
+            } catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            return true;
+        }
+        // Load shards on demand
+        bool EnsureShard(unsigned int p_shard) {
+            if (shards.IsLoaded(p_shard)) return true;
+            return LoadShard(p_shard);
+        }
+        bool EnsureAllShards() {
+            if (shards.IsAllLoaded()) return true;
+            std::vector<std::function<bool()>> jobs;
+            for (unsigned int shard = 0; shard < shards.GetManifest().shards.size(); shard++)
+                if (!shards.IsLoaded(shard))
+                    jobs.push_back([this, shard]() { return LoadShard(shard); });
+            return Storage::RunParallel(jobs);
+        }
+
+        // Replication helpers
+        // Record line of a space as a snapshot sees it, null once deleted
+        static std::string EncodeSpace(const Space::SpaceManager::Snapshot& p_snapshot, unsigned int ID) {
+            const Space::Space* space_ptr = p_snapshot.Get(ID);
+            return Storage::EncodeRecord({
+                {"op", "space"},
+                {"ID", ID},
+                {"space", space_ptr != nullptr ? space_ptr->Serialize() : nljs::json(nullptr)}
+            });
+        }
+        static std::string EncodeUsers(const nljs::json& p_jusers) {
+            std::string lines;
+            for (const auto& juser: p_jusers)
+                lines += Storage::EncodeRecord({{"op", "user"}, {"ID", juser["ID"]}, {"user", juser}});
+            return lines;
+        }
+        // Put a published user at its ID
+        void PutUser(const nljs::json& p_juser) {
+            User* user_ptr = NewUser(p_juser);
+            if (user_ptr == nullptr) return;
+            unsigned int ID = user_ptr->GetID();
+            if (users.size() <= ID) {
+                EnsureShard(shards.GetShardOf(users.size()));
+                users.resize(ID + 1, nullptr);
+            } else EnsureShard(shards.GetShardOf(ID));
+            delete users[ID];
+            users[ID] = user_ptr;
+            shards.MarkDirty(ID);
+            changes++;
+        }
+        // Drop every user, leaving p_size empty IDs
+        void ClearUsers(unsigned int p_size) {
+            for (auto i = users.begin(); i != users.end(); i++)
+                delete *i;
+            users = std::vector<User*>(p_size, nullptr);
+            shards.Reset();
+            changes++;
+        }
+        // Read-only menus, shared by the main program & replicas
+        void ReportMenu() {
+            std::string choice = GetInput("\nReport per day (d), week (w) or month ([m])? ");
+            Analytics::Period period = Analytics::MONTH;
+            if (choice[0] == 'd') period = Analytics::DAY;
+            else if (choice[0] == 'w') period = Analytics::WEEK;
+            time_t tmpStart = GetTime("Input report begin time");
+            time_t tmpEnd = GetTime("Input report end time");
+            Analytics::PrintReport(Analytics::BuildReport(*spaceManager, tmpStart, tmpEnd, period));
+        }
+        void MetricsMenu() {
+            Metrics::PrintMetrics();
+            if (isSpace) {
+                Cache::Stats stats = spaceManager->GetCacheStats();
+                std::cout << "\nQuery cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+                          << (int)(stats.GetHitRate() * 100) << "%), " << stats.invalidations << " invalidated, "
+                          << stats.evictions << " evicted, " << stats.entries << " entries in "
+                          << stats.bytes / 1024 << " KiB\n";
+            }
+            Memory::Report report = GetMemoryReport();
+            memoryHistory.Record(report);
+            std::cout << "\nMemory:\n";
+            report.PrintReport();
+            memoryHistory.PrintHistory();
+            std::string choice = GetInput("\nExport metrics to " METRICS_FILE "? (y/[n]): ");
+            if (choice[0] == 'y') {
+                if (Metrics::Exporter().Export(METRICS_FILE))
+                    std::cout << "Metrics exported successfully!\n";
+                else std::cout << "Export metrics failed!\n";
+            }
+            choice = GetInput("Export memory report to " MEMORY_FILE "? (y/[n]): ");
+            if (choice[0] == 'y') {
+                if (Memory::Export(MEMORY_FILE, report, memoryHistory))
+                    std::cout << "Memory report exported successfully!\n";
+                else std::cout << "Export memory report failed!\n";
+            }
+            // Toggle span tracing
+            if (Trace::Tracer::Get().IsEnabled()) {
+                choice = GetInput("Stop tracing and write the trace file? (y/[n]): ");
+                if (choice[0] == 'y') {
+                    if (Trace::Tracer::Get().Stop())
+                        std::cout << "Trace written successfully!\n";
+                    else std::cout << "Write trace failed!\n";
+                }
+            } else {
+                choice = GetInput("Start tracing to " TRACE_FILE "? (y/[n]): ");
+                if (choice[0] == 'y') Trace::Tracer::Get().Start(TRACE_FILE);
+            }
+        }
     public:
         // Constructors & destructors
         UserManager(Space::SpaceManager* p_spaceManager = nullptr) {
@@ -461,14 +1127,58 @@ namespace User {
             if (p_spaceManager != nullptr) isSpace = true;
         }
         ~UserManager() {
+            persister.Stop();
+            publisher.Stop();
+            follower.Stop();
             for (auto i = users.begin(); i != users.end(); i++)
                 delete *i;
         }
 
         // Interface
+        // Add user (returns ID)
+        // .. Users take the next ID in order
+        unsigned int AddUser(User* p_user_ptr) {
+            unsigned int ID = users.size();
+            if (p_user_ptr->GetID() != ID) p_user_ptr->SetID(ID);
+            // .. A shard must be loaded before it grows, or stores would keep its old file
+            EnsureShard(shards.GetShardOf(ID));
+            users.push_back(p_user_ptr);
+            shards.MarkDirty(ID);
+            changes++;
+            if (isTimed) p_user_ptr->SetTimers(&timers);
+            return ID;
+        }
+        // Number of users, including ones not loaded yet
+        unsigned int GetUserCount() const { return users.size(); }
+        // Grows with every change of spaces or users
+        unsigned long long GetChangeCount() const {
+            return changes + (isSpace ? spaceManager->GetChangeCount() : 0);
+        }
+        Persist::Service& GetPersister() { return persister; }
+        // Footprint of the users & spaces in memory, per category
+        Memory::Report GetMemoryReport() const {
+            Memory::Report report;
+            for (const User* user_ptr: users)
+                if (user_ptr != nullptr) user_ptr->CountMemory(report);
+            report.Add(Memory::USERS, Memory::VectorBytes(users), 0);
+            report.Add(Memory::RESERVATIONS, timers.GetBytes(), 0);
+            if (isSpace) spaceManager->CountMemory(report);
+            report.Finish();
+            return report;
+        }
+        Memory::History& GetMemoryHistory() { return memoryHistory; }
+        // Get user
+        // .. Loads the user's shard if needed
+        User* GetUser(unsigned int ID) {
+            if (ID >= users.size()) return nullptr;
+            if (!EnsureShard(shards.GetShardOf(ID))) return nullptr;
+            return users[ID];
+        }
         // Print some data to cmd line
         inline void PrintUsers() {
+            EnsureAllShards();
             for (auto user_ptr: users) {
+                if (user_ptr == nullptr) continue;
                 std::cout << std::endl;
                 user_ptr->PrintUser();
             }
@@ -477,66 +1187,440 @@ namespace User {
 
         // Data persistence
         // Storing & reading data
+        // .. The file is replaced atomically: a failed store leaves the previous one intact
         bool StoreData(std::string p_fileName = USER_FILE) {
-            std::ofstream outFile(p_fileName);
-            if (!outFile.is_open())
+            Trace::Span span("StoreUsers", "store", users.size());
+            if (!EnsureAllShards())
                 return false;
 
             // Wrap try-catch block
             try {
-                nljs::json jusers;
+                nljs::json jusers = nljs::json::array();
                 for (auto user_ptr: users)
-                    jusers.push_back(user_ptr->Serialize());
+                    if (user_ptr != nullptr) jusers.push_back(user_ptr->Serialize());
                 // Write to file
-                outFile << std::setw(4) << jusers << std::endl;
+                if (!Storage::WriteRecords(p_fileName, jusers))
+                    return false;
             } catch (std::exception e) {
-                outFile.close();
                 std::cout << e.what() << std::endl;
                 return false;
             }
             // Save data success
-            outFile.close();
             return true;
         }
+        // .. Damaged records are skipped, leaving their IDs empty
         bool LoadData(std::string p_fileName = USER_FILE) {
-            std::ifstream inFile(p_fileName);
-            if (!inFile.is_open())
+            std::vector<User*> loaded;
+            if (!ReadData(p_fileName, loaded))
                 return false;
-            
-            // Wrap try-catch block
-            try {
-                nljs::json jusers;
-                inFile >> jusers;
-                // Deallocate
-                for (auto i = users.begin(); i != users.end(); i++)
-                    delete *i;
-                users = std::vector<User*>{};
-                for (auto juser: jusers) {
-                    if (juser["role"] == "eventUser") {
-                        users.push_back(new EventUser(spaceManager));
-                        users.back()->Deserialize(juser);
-                    } else if (juser["role"] == "spaceUser") {
-                        users.push_back(new SpaceUser(spaceManager));
-                        users.back()->Deserialize(juser);
-                    }
+            AdoptData(loaded);
+            // Load data success
+            return true;
+        }
+        // Read the users of a file without replacing the current ones (see AdoptData)
+        // .. The users read are owned by p_loaded until adopted
+        bool ReadData(const std::string& p_fileName, std::vector<User*>& p_loaded) {
+            Trace::Span span("LoadUsers", "load");
+            // Build users as their records are read, placed by their ID
+            p_loaded.clear();
+            unsigned int damaged = 0;
+            bool isRead = Storage::ForEachRecord(p_fileName, [&](nljs::json& juser) {
+                // Wrap try-catch block
+                User* user_ptr = nullptr;
+                try {
+                    user_ptr = NewUser(juser);
+                } catch (std::exception& e) {
+                    damaged++;
+                    return true;
                 }
-            } catch (std::exception e) {
-                inFile.close();
-                std::cout << e.what() << std::endl;
+                if (user_ptr == nullptr) return true;
+                // .. IDs out of bounds or read twice are damaged as well
+                unsigned int ID = user_ptr->GetID();
+                if (ID >= MAX_RECORD_ID || (ID < p_loaded.size() && p_loaded[ID] != nullptr)) {
+                    delete user_ptr;
+                    damaged++;
+                    return true;
+                }
+                if (p_loaded.size() <= ID) p_loaded.resize(ID + 1, nullptr);
+                p_loaded[ID] = user_ptr;
+                return true;
+            });
+            if (!isRead) {
+                for (User* user_ptr: p_loaded) delete user_ptr;
+                p_loaded.clear();
                 return false;
             }
-            // Load data success
-            inFile.close();
+            if (damaged != 0)
+                std::cout << "Skipped " << damaged << " damaged user(s)" << std::endl;
+            return true;
+        }
+        // Replace every user with users read by ReadData
+        void AdoptData(std::vector<User*>& p_loaded) {
+            // Deallocate
+            for (auto i = users.begin(); i != users.end(); i++)
+                delete *i;
+            users.swap(p_loaded);
+            p_loaded.clear();
+            shards.Reset();
+            publisher.Resync();
+        }
+        // Store the space & user files as one unit
+        // .. Both are written next to the committed ones, then put in place together (see Storage::CommitFiles)
+        bool StoreFiles(std::string p_intentFile = INTENT_FILE) {
+            Trace::Span span("StoreFiles", "store");
+            // .. A store interrupted earlier is finished first, or its files would be replaced one at a time
+            if (!Storage::RecoverFiles(p_intentFile))
+                return false;
+            if (!spaceManager->StoreData(SPACE_FILE NEXT_SUFFIX) || !StoreData(USER_FILE NEXT_SUFFIX)) {
+                std::remove(SPACE_FILE NEXT_SUFFIX);
+                std::remove(USER_FILE NEXT_SUFFIX);
+                return false;
+            }
+            return Storage::CommitFiles(p_intentFile, {SPACE_FILE, USER_FILE});
+        }
+        // Load the space & user files, replacing spaces & users only once both are read
+        bool LoadFiles(std::string p_intentFile = INTENT_FILE) {
+            Trace::Span span("LoadFiles", "load");
+            if (!Storage::RecoverFiles(p_intentFile))
+                return false;
+            std::vector<std::unique_ptr<Space::Space>> loadedSpaces;
+            std::vector<User*> loadedUsers;
+            if (!Space::SpaceManager::ReadData(SPACE_FILE, loadedSpaces) || !ReadData(USER_FILE, loadedUsers))
+                return false;
+            spaceManager->AdoptData(loadedSpaces);
+            AdoptData(loadedUsers);
             return true;
         }
 
+        // Sharded data persistence
+        // .. Users are partitioned by ID range into shard files listed in a manifest
+        // .. Only dirty shards are rewritten, on parallel threads
+        // Describe the next generation in a manifest and queue the writes of its dirty shards
+        // .. Users are small and serialized right away, so the writes may run on another thread
+        bool CaptureShards(const std::string& p_baseName, Storage::Manifest& p_manifest, Storage::ShardWrites& p_writes) {
+            // Storing under another name rewrites every shard
+            if (p_baseName != shards.GetBaseName()) {
+                if (!EnsureAllShards())
+                    return false;
+                shards.Reset();
+            }
+            const Storage::Manifest& oldManifest = shards.GetManifest();
+            unsigned int shardSize = shards.GetShardSize();
+            unsigned int shardCount = (users.size() + shardSize - 1) / shardSize;
+            p_manifest = Storage::Manifest();
+            p_manifest.generation = shards.GetNextGeneration();
+            p_manifest.shardSize = shardSize;
+            p_manifest.totalSlots = users.size();
+            for (unsigned int shard = 0; shard < shardCount; shard++) {
+                Storage::Manifest::Shard info;
+                if (!shards.IsLoaded(shard)) {
+                    // Untouched since load: keep file as is
+                    info = oldManifest.shards[shard];
+                } else {
+                    info.firstID = shard * shardSize;
+                    info.slots = std::min<unsigned int>(shardSize, users.size() - info.firstID);
+                    info.version = ShardVersion(shard);
+                    info.mark = shards.GetMark(shard);
+                    if (shards.IsDirty(shard, info.version)) {
+                        info.fileName = Storage::ShardFileName(p_baseName, shard, p_manifest.generation);
+                        auto jusers = std::make_shared<nljs::json>();
+                        if (!SerializeShard(shard, *jusers))
+                            return false;
+                        std::string fileName = info.fileName;
+                        p_writes.Add(fileName, [jusers, shard, fileName]() {
+                            Trace::Span span("StoreUserShard", "store", shard);
+                            return Storage::WriteRecords(fileName, *jusers);
+                        });
+                    } else info.fileName = oldManifest.shards[shard].fileName;
+                }
+                p_manifest.shards.push_back(info);
+            }
+            return true;
+        }
+        // Write dirty shards under the next generation and describe them in a manifest
+        // .. Nothing is visible to loaders until that manifest is committed
+        bool PrepareShards(const std::string& p_baseName, Storage::Manifest& p_manifest) {
+            Storage::ShardWrites writes;
+            if (!CaptureShards(p_baseName, p_manifest, writes))
+                return false;
+            return writes.Run();
+        }
+        // Adopt a committed manifest and remove the shard files it replaced
+        // .. Shards changed since they were captured stay dirty
+        void FinishShards(const std::string& p_baseName, const Storage::Manifest& p_manifest) {
+            if (p_baseName == shards.GetBaseName())
+                shards.RemoveStaleFiles(p_manifest);
+            shards.SetManifest(p_baseName, p_manifest);
+            for (unsigned int shard = 0; shard < p_manifest.shards.size(); shard++)
+                if (shards.IsLoaded(shard))
+                    shards.MarkStored(shard, p_manifest.shards[shard].version, p_manifest.shards[shard].mark);
+        }
+        // Adopt a manifest without loading anything: shards are loaded on first access
+        void AttachShards(const std::string& p_baseName, const Storage::Manifest& p_manifest) {
+            // Deallocate
+            for (auto i = users.begin(); i != users.end(); i++)
+                delete *i;
+            users = std::vector<User*>(p_manifest.totalSlots, nullptr);
+            shards.Attach(p_baseName, p_manifest);
+        }
+        bool StoreShards(std::string p_baseName = USER_FILE) {
+            Storage::Manifest manifest;
+            if (!PrepareShards(p_baseName, manifest))
+                return false;
+            if (!manifest.Store(p_baseName))
+                return false;
+            FinishShards(p_baseName, manifest);
+            return true;
+        }
+        bool LoadShards(std::string p_baseName = USER_FILE) {
+            Storage::Manifest manifest;
+            if (!manifest.Load(p_baseName))
+                return false;
+            AttachShards(p_baseName, manifest);
+            return true;
+        }
+
+        // Catalog persistence
+        // .. Space & user shards committed as one unit through a single commit file:
+        // .. after a crash, loading sees either the previous or the new catalog
+        // Capture the dirty shards of spaces & users as one store
+        // .. Only the capture runs here: writing & committing may run on another thread,
+        // .. and the managers adopt the new manifests when the store is finished
+        Persist::Job CaptureCatalog(std::string p_commitFile = COMMIT_FILE) {
+            EVIES_METRIC_SCOPE(Metrics::CAPTURE_CATALOG);
+            Trace::Span span("CaptureCatalog", "store");
+            auto spacesManifest = std::make_shared<Storage::Manifest>();
+            auto usersManifest = std::make_shared<Storage::Manifest>();
+            auto writes = std::make_shared<Storage::ShardWrites>();
+            if (!spaceManager->CaptureShards(SPACE_FILE, *spacesManifest, *writes))
+                return Persist::Job();
+            if (!CaptureShards(USER_FILE, *usersManifest, *writes))
+                return Persist::Job();
+            Persist::Job job;
+            job.write = [writes, spacesManifest, usersManifest, p_commitFile]() {
+                EVIES_METRIC_SCOPE(Metrics::STORE_SHARDS);
+                if (!writes->Run())
+                    return false;
+                return Storage::StoreCommit(p_commitFile, *spacesManifest, *usersManifest);
+            };
+            job.finish = [this, spacesManifest, usersManifest](bool p_isStored) {
+                if (!p_isStored) return;
+                spaceManager->FinishShards(SPACE_FILE, *spacesManifest);
+                FinishShards(USER_FILE, *usersManifest);
+            };
+            return job;
+        }
+        bool StoreCatalog(std::string p_commitFile = COMMIT_FILE) {
+            Trace::Span span("StoreCatalog", "store");
+            // Background store first, so that manifests are adopted in order
+            persister.Wait();
+            Persist::Job job = CaptureCatalog(p_commitFile);
+            if (!job.write)
+                return false;
+            bool isStored = job.write();
+            job.finish(isStored);
+            if (isStored) persister.MarkStored();
+            return isStored;
+        }
+        bool LoadCatalog(std::string p_commitFile = COMMIT_FILE) {
+            Trace::Span span("LoadCatalog", "load");
+            persister.Wait();
+            Storage::Manifest spacesManifest, usersManifest;
+            if (!Storage::LoadCommit(p_commitFile, spacesManifest, usersManifest))
+                return false;
+            spaceManager->AttachShards(SPACE_FILE, spacesManifest);
+            AttachShards(USER_FILE, usersManifest);
+            persister.MarkStored();
+            publisher.Resync();
+            return true;
+        }
+
+        // Replication
+        // .. Followers get batches of the spaces & users changed since the last tick, as they are now:
+        // .. spaces are read from a snapshot on the publishing thread, only the changed users are serialized here
+        // Whole catalog, for joining followers
+        Replica::Batch CaptureImage() {
+            Trace::Span span("CaptureImage", "replica");
+            auto snapshot = std::make_shared<Space::SpaceManager::Snapshot>(spaceManager->GetSnapshot());
+            auto jusers = std::make_shared<nljs::json>(nljs::json::array());
+            EnsureAllShards();
+            for (auto user_ptr: users)
+                if (user_ptr != nullptr) jusers->push_back(user_ptr->Serialize());
+            unsigned int userCount = users.size();
+            publishedUser = activeUser;
+            publishedVersion = activeUser != nullptr ? activeUser->GetVersion() : 0;
+            Replica::Batch batch;
+            batch.isImage = true;
+            // .. Spaces go out a shard at a time, users last
+            unsigned int nextID = 0;
+            batch.encode = [snapshot, jusers, userCount, nextID](std::string& p_lines) mutable {
+                if (nextID == 0)
+                    p_lines += Storage::EncodeRecord({{"op", "image"}, {"spaces", snapshot->GetSize()}, {"users", userCount}});
+                unsigned int lastID = std::min(snapshot->GetSize(), nextID + SHARD_SIZE);
+                for (; nextID < lastID; nextID++)
+                    if (snapshot->Get(nextID) != nullptr) p_lines += EncodeSpace(*snapshot, nextID);
+                if (nextID < snapshot->GetSize()) return true;
+                p_lines += EncodeUsers(*jusers);
+                return false;
+            };
+            return batch;
+        }
+        // Spaces & users changed since the last call: the session's user & users changed by timed events
+        // .. Only taken if p_isWanted, e.g. when somebody follows
+        Replica::Batch CaptureChanges(bool p_isWanted = true) {
+            std::vector<unsigned int> IDs = spaceManager->TakeChangedIDs();
+            std::vector<unsigned int> userIDs;
+            userIDs.swap(changedUserIDs);
+            if (activeUser != nullptr && (activeUser != publishedUser || activeUser->GetVersion() != publishedVersion))
+                userIDs.push_back(activeUser->GetID());
+            publishedUser = activeUser;
+            publishedVersion = activeUser != nullptr ? activeUser->GetVersion() : 0;
+            if (!p_isWanted || (IDs.empty() && userIDs.empty()))
+                return Replica::Batch();
+            std::sort(userIDs.begin(), userIDs.end());
+            userIDs.erase(std::unique(userIDs.begin(), userIDs.end()), userIDs.end());
+            EVIES_METRIC_SCOPE(Metrics::CAPTURE_CHANGES);
+            auto snapshot = std::make_shared<Space::SpaceManager::Snapshot>();
+            if (!IDs.empty()) *snapshot = spaceManager->GetSnapshot();
+            auto changedIDs = std::make_shared<std::vector<unsigned int>>(std::move(IDs));
+            auto jusers = std::make_shared<nljs::json>(nljs::json::array());
+            for (unsigned int ID: userIDs)
+                if (ID < users.size() && users[ID] != nullptr) jusers->push_back(users[ID]->Serialize());
+            Replica::Batch batch;
+            batch.encode = [snapshot, changedIDs, jusers](std::string& p_lines) {
+                for (unsigned int ID: *changedIDs)
+                    p_lines += EncodeSpace(*snapshot, ID);
+                p_lines += EncodeUsers(*jusers);
+                return false;
+            };
+            return batch;
+        }
+        // Publish changes on the socket p_path, for followers on the same host (see FollowerProgram)
+        bool StartPublisher(const std::string& p_path = REPLICA_SOCKET) {
+            spaceManager->TrackChanges(true);
+            if (publisher.Start(p_path, [this]() { return CaptureImage(); },
+                [this](bool p_isWanted) { return CaptureChanges(p_isWanted); }))
+                return true;
+            spaceManager->TrackChanges(false);
+            return false;
+        }
+        void TickPublisher() { publisher.Tick(); }
+        // Sample the footprint when due
+        void TickMemory() {
+            if (memoryHistory.IsDue()) memoryHistory.Record(GetMemoryReport());
+        }
+        // Schedule the timed events of the users' reservations from now on, starting with the users loaded
+        // .. Users loaded or added later schedule theirs as they come; not started on replicas
+        void StartTimers() {
+            if (isTimed) return;
+            isTimed = true;
+            for (User* user_ptr: users)
+                if (user_ptr != nullptr) user_ptr->SetTimers(&timers);
+        }
+        // Handle the timed events come due (returns their number)
+        // .. Users of events are not loaded for them: events only come from loaded users
+        unsigned int TickTimers() {
+            std::vector<Timer::Event> due = timers.Advance(time(NULL));
+            for (const Timer::Event& event: due) {
+                if (event.userID >= users.size() || users[event.userID] == nullptr) continue;
+                unsigned long long version = users[event.userID]->GetVersion();
+                users[event.userID]->OnTimer(event);
+                // .. Archived reservations are stored & published like any other change
+                if (users[event.userID]->GetVersion() == version) continue;
+                changes++;
+                if (publisher.IsRunning()) changedUserIDs.push_back(event.userID);
+            }
+            return due.size();
+        }
+        // Publish what is left, then disconnect followers
+        void StopPublisher() {
+            if (!publisher.IsRunning()) return;
+            publisher.Tick();
+            publisher.Stop();
+            spaceManager->TrackChanges(false);
+            changedUserIDs.clear();
+        }
+        Replica::Publisher& GetPublisher() { return publisher; }
+        // Apply the batches received as a follower since the last call (returns the number of records)
+        unsigned int ApplyReplica() {
+            nljs::json records = follower.Take();
+            if (records.empty()) return 0;
+            Trace::Span span("ApplyReplica", "replica", records.size());
+            for (const auto& jrecord: records) {
+                // Wrap try-catch block
+                try {
+                    if (jrecord["op"] == "image") {
+                        spaceManager->Clear(jrecord["spaces"]);
+                        ClearUsers(jrecord["users"]);
+                    } else if (jrecord["op"] == "space") {
+                        std::unique_ptr<Space::Space> space_ptr;
+                        if (!jrecord["space"].is_null()) {
+                            space_ptr = std::make_unique<Space::Space>();
+                            space_ptr->Deserialize(jrecord["space"]);
+                        }
+                        spaceManager->PutSpace(jrecord["ID"], std::move(space_ptr));
+                    } else if (jrecord["op"] == "user") PutUser(jrecord["user"]);
+                } catch (std::exception& e) {
+                    std::cout << e.what() << std::endl;
+                }
+            }
+            return records.size();
+        }
+        Replica::Follower& GetFollower() { return follower; }
+
         // Utility
+        // Report a finished background export, waiting for it if p_wait
+        void CheckExport(bool p_wait = false) {
+            if (!exportTask.valid()) return;
+            if (!p_wait && exportTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+            if (exportTask.get()) std::cout << "\nSpaces exported to " EXPORT_FILE " successfully!\n";
+            else std::cout << "\nExport spaces failed!\n";
+        }
+        // Background store policy: finish written stores & start a new one when due
+        // .. Failures are reported once per streak, retries back off in the persister
+        void TickPersister() {
+            unsigned long long failures = persister.GetFailureCount();
+            persister.Tick();
+            if (persister.GetFailureCount() != failures && persister.GetFailureStreak() == 1)
+                std::cout << "\nBackground store failed!\n";
+        }
+        // Checkpoint at the end of a user session: store & publish its changes right away
+        void EndSession() {
+            Workload::Recorder::Get().EndSession();
+            changes++;
+            persister.Flush();
+            publisher.Tick();
+            activeUser = nullptr;
+        }
+        // Start the background store thread
+        // .. Stores only run once enabled, when the sharded catalog has been stored or loaded
+        void StartPersister() {
+            persister.Start([this]() { return CaptureCatalog(); }, [this]() { return GetChangeCount(); });
+        }
+        // Store what is left, then stop background stores
+        void StopPersister() {
+            IdleHook() = nullptr;
+            persister.Flush();
+            if (!persister.Wait())
+                std::cout << "\nBackground store failed!\n";
+            persister.Stop();
+        }
         // Main program function
+        // .. Once the sharded catalog has been stored or loaded, changes are stored in the background
         void MainProgram() {
             std::string choice;
             bool isRunning = true;
+            StartPersister();
+            StartTimers();
+            IdleHook() = [this]() {
+                TickTimers();
+                TickPersister();
+                TickPublisher();
+                TickMemory();
+            };
             while (isRunning) {
                 try {
+                    CheckExport();
                     std::cout << std::endl;
                     std::cout << "--- +-+ ------------------------------- +-+ ---\n";
                     std::cout << "Welcome to Evies - the event scheduling system!\n";
@@ -549,8 +1633,11 @@ namespace User {
                     std::cout << " 3. Browse users (gray legality)\n";
                     std::cout << " 4. Store/load data\n";
                     std::cout << " 5. Generate random spaces\n";
-                    std::cout << " 6. Exit\n";
+                    std::cout << " 6. Utilization report\n";
+                    std::cout << " 7. Metrics & tracing\n";
+                    std::cout << " 8. Exit\n";
 
+                    WaitForInput();
                     getline(std::cin, choice);
                     switch (choice[0]) {
                         case '1': {
@@ -561,15 +1648,18 @@ namespace User {
                                 while (!isLoggedIn) {
                                     std::string name = GetInput("Enter your name: ");
                                     unsigned int ID = std::stoi(GetInput("Enter your ID: "));
-                                    if (ID >= users.size() || users[ID]->GetName() != name) {
+                                    if (GetUser(ID) == nullptr || users[ID]->GetName() != name) {
                                         std::cout << "Invalid credentials\n";
                                         choice = GetInput("Retry login? ([y]/n): ");
                                         if (choice[0] == 'n') break;
                                     } else {
                                         isLoggedIn = true;
+                                        activeUser = users[ID];
+                                        Workload::Recorder::Get().BeginSession(ID);
                                         std::cout << "\nLogged in successfully as:\n";
                                         users[ID]->PrintUser();
                                         users[ID]->Actions();
+                                        EndSession();
                                     }
                                 }
                             } else if (choice[0] == 'r') {
@@ -582,14 +1672,17 @@ namespace User {
                                     std::cout << "Please remember for next login.\n";
                                     if (choice[0] == '1') activeUser = new EventUser(ID, name, spaceManager);
                                     else activeUser = new SpaceUser(ID, name, spaceManager);
-                                    users.push_back(activeUser);
+                                    AddUser(activeUser);
+                                    Workload::Recorder::Get().BeginSession(ID);
                                     users[ID]->Actions();
+                                    EndSession();
                                 } else std::cout << "Invalid input" << std::endl;
                             } else std::cout << "Invalid input" << std::endl;
                             break;
                         }
                         case '2': {
-                            spaceManager->PrintSpaces();
+                            if (!SearchSpaces(spaceManager))
+                                spaceManager->PrintSpaces();
                             break;
                         }
                         case '3': {
@@ -597,20 +1690,33 @@ namespace User {
                             break;
                         }
                         case '4': {
-                            choice = GetInput("\nWould you like to store (1) or load (2) data? (1/2): ");
+                            choice = GetInput("\nWould you like to store (1) or load (2) data,\n"
+                                "store (3) or load (4) sharded data, or export spaces in the background (5)? (1/2/3/4/5): ");
                             if (choice[0] == '1') {
-                                if (spaceManager->StoreData())
-                                    if (StoreData()) {
-                                        std::cout << "Data stored successfully!\n";
-                                        break;
-                                    }
-                                std::cout << "Store data failed!\nRecommend program restart\n";
+                                if (StoreFiles()) std::cout << "Data stored successfully!\n";
+                                else std::cout << "Store data failed!\nThe previous data files are kept\n";
                             } else if (choice[0] == '2') {
-                                if (spaceManager->LoadData())
-                                    if  (LoadData())
-                                        std::cout << "Data loaded successfully!\n";
-                                        break;
-                                std::cout << "Load data failed!\nRecommend program restart\n";
+                                persister.Wait();
+                                if (LoadFiles()) {
+                                    // Single files are not the sharded catalog: no more background stores over it
+                                    persister.Enable(false);
+                                    std::cout << "Data loaded successfully!\n";
+                                } else std::cout << "Load data failed!\nThe data in memory is unchanged\n";
+                            } else if (choice[0] == '3') {
+                                if (StoreCatalog()) {
+                                    std::cout << "Sharded data stored successfully!\n";
+                                    persister.Enable();
+                                } else std::cout << "Store sharded data failed!\nRecommend program restart\n";
+                            } else if (choice[0] == '4') {
+                                if (LoadCatalog()) {
+                                    std::cout << "Sharded data loaded successfully!\n";
+                                    persister.Enable();
+                                } else std::cout << "Load sharded data failed!\nRecommend program restart\n";
+                            } else if (choice[0] == '5') {
+                                // Bookings may go on, the export sees the spaces as they are now
+                                CheckExport(true);
+                                exportTask = spaceManager->ExportData();
+                                std::cout << "Exporting spaces to " EXPORT_FILE "...\n";
                             } else std::cout << "Invalid input" << std::endl;
                             break;
                         }
@@ -629,6 +1735,17 @@ namespace User {
                             break;
                         }
                         case '6': {
+                            ReportMenu();
+                            break;
+                        }
+                        case '7': {
+                            MetricsMenu();
+                            break;
+                        }
+                        case '8': {
+                            CheckExport(true);
+                            StopPersister();
+                            StopPublisher();
                             isRunning = false;
                             return;
                         }
@@ -643,6 +1760,75 @@ namespace User {
                 choice = GetInput("\nReturn to main menu? ([y]/n): ");
                 isRunning = !(choice[0] == 'n');
             }
+            CheckExport(true);
+            StopPersister();
+            StopPublisher();
+        }
+        // Read-only program of a replica
+        // .. Spaces & users follow the changes published by the writing process on p_path,
+        // .. applied before every prompt; nothing is stored
+        void FollowerProgram(const std::string& p_path = REPLICA_SOCKET) {
+            std::string choice;
+            bool isRunning = true;
+            follower.Start(p_path);
+            IdleHook() = [this]() {
+                ApplyReplica();
+                TickMemory();
+            };
+            while (isRunning) {
+                try {
+                    ApplyReplica();
+                    std::cout << std::endl;
+                    std::cout << "--- +-+ ------------------------------- +-+ ---\n";
+                    std::cout << "Evies replica (read-only) of " << p_path << std::endl;
+                    std::cout << "--- +-+ ------------------------------- +-+ ---\n";
+                    if (follower.IsConnected()) std::cout << "Following, at change " << follower.GetSequence() << std::endl;
+                    else std::cout << "Waiting for the writer, at change " << follower.GetSequence() << std::endl;
+
+                    std::cout << "\nWhat would you like to do?\n";
+                    std::cout << " 1. Browse spaces\n";
+                    std::cout << " 2. Browse users\n";
+                    std::cout << " 3. Utilization report\n";
+                    std::cout << " 4. Metrics & tracing\n";
+                    std::cout << " 5. Exit\n";
+
+                    WaitForInput();
+                    getline(std::cin, choice);
+                    switch (choice[0]) {
+                        case '1': {
+                            if (!SearchSpaces(spaceManager))
+                                spaceManager->PrintSpaces();
+                            break;
+                        }
+                        case '2': {
+                            PrintUsers();
+                            break;
+                        }
+                        case '3': {
+                            ReportMenu();
+                            break;
+                        }
+                        case '4': {
+                            MetricsMenu();
+                            break;
+                        }
+                        case '5': {
+                            isRunning = false;
+                            break;
+                        }
+                        default: {
+                            std::cout << "Invalid input\n";
+                        }
+                    }
+                } catch (std::exception e) {
+                    std::cout << "Invalid input" << std::endl;
+                }
+                if (!isRunning) break;
+                choice = GetInput("\nReturn to main menu? ([y]/n): ");
+                isRunning = !(choice[0] == 'n');
+            }
+            IdleHook() = nullptr;
+            follower.Stop();
         }
     };
 }
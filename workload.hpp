@@ -0,0 +1,147 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <ctime>
+
+// Record lines
+#include "storage.hpp"
+// Field descriptors for the serializers
+#include "codec.hpp"
+
+// Default operation trace file
+#define WORKLOAD_FILE "magical.workload"
+
+// Operation traces of user sessions
+// .. Recorded from the sessions of the main program, replayed by the load test (loadtest.cpp)
+// .. A trace is a file of record lines, one operation each, in the order they were made
+namespace Workload {
+    // Traced operations
+    enum Op {
+        BROWSE,
+        FIND_FREE,
+        RESERVE,
+        CANCEL,
+        REVIEW,
+        PAY,
+        STORE,
+        OP_COUNT
+    };
+    inline const char* OpName(unsigned int p_op) {
+        static const char* names[OP_COUNT] = {
+            "browse", "findFree", "reserve", "cancel", "review", "pay", "store"
+        };
+        return names[p_op];
+    }
+    // Operation of a name, OP_COUNT if unknown
+    inline Op OpOf(const std::string& p_name) {
+        for (unsigned int op = 0; op < OP_COUNT; op++)
+            if (p_name == OpName(op)) return (Op)op;
+        return OP_COUNT;
+    }
+
+    // One operation of a session
+    // .. Only the fields of its operation are meaningful:
+    // .. browse: text (query); findFree: startTime, endTime (latest begin), hours;
+    // .. reserve & cancel: space, startTime, endTime; review: space, text, amount (score); pay: amount
+    struct Event {
+        // Milliseconds since the trace began
+        unsigned long long time = 0;
+        unsigned int session = 0;
+        unsigned int user = 0;
+        Op op = OP_COUNT;
+        unsigned int space = 0;
+        time_t startTime = 0, endTime = 0;
+        unsigned int hours = 0;
+        double amount = 0;
+        std::string text;
+
+        // Serialization
+        // .. Fields left at their defaults are not written
+        template <typename T>
+        static constexpr auto Unless0(const char* p_key, T Event::* p_member) {
+            return Codec::Optional<T>(p_key,
+                [p_member](const Event& p_event) -> const T& { return p_event.*p_member; },
+                [p_member](Event& p_event, T&& p_value) { p_event.*p_member = std::move(p_value); },
+                [p_member](const Event& p_event) { return !(p_event.*p_member == T{}); });
+        }
+        static constexpr auto Fields() {
+            return std::make_tuple(
+                Codec::Member("time", &Event::time),
+                Codec::Member("session", &Event::session),
+                Codec::Member("user", &Event::user),
+                Codec::Property<std::string>("op",
+                    [](const Event& p_event) { return std::string(p_event.op < OP_COUNT ? OpName(p_event.op) : ""); },
+                    [](Event& p_event, std::string&& p_name) { p_event.op = OpOf(p_name); }),
+                Unless0("space", &Event::space),
+                Unless0("startTime", &Event::startTime),
+                Unless0("endTime", &Event::endTime),
+                Unless0("hours", &Event::hours),
+                Unless0("amount", &Event::amount),
+                Unless0("text", &Event::text)
+            );
+        }
+    };
+
+    // Class to record the operations of the sessions to a trace file
+    // .. Used by the session thread only; each operation is written & flushed as it is made
+    class Recorder {
+    private:
+        std::ofstream file;
+        std::chrono::steady_clock::time_point originTime;
+        unsigned int session = 0, user = 0;
+        bool isInSession = false;
+    public:
+        static Recorder& Get() {
+            static Recorder recorder;
+            return recorder;
+        }
+
+        // Getters
+        bool IsRecording() const { return file.is_open(); }
+
+        // Interface
+        // Start a new trace in p_fileName (returns whether it could be opened)
+        bool Start(const std::string& p_fileName) {
+            Stop();
+            file.open(p_fileName, std::ios::out | std::ios::trunc);
+            originTime = std::chrono::steady_clock::now();
+            session = 0;
+            return file.is_open();
+        }
+        void Stop() {
+            if (file.is_open()) file.close();
+        }
+        // Operations that follow are made by user p_userID, in a new session
+        void BeginSession(unsigned int p_userID) {
+            if (!IsRecording()) return;
+            if (isInSession) session++;
+            user = p_userID;
+            isInSession = true;
+        }
+        // Stamp & write an operation of the current session
+        // .. Operations outside of sessions are not recorded
+        void Record(Event p_event) {
+            if (!IsRecording() || !isInSession) return;
+            p_event.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - originTime).count();
+            p_event.session = session;
+            p_event.user = user;
+            file << Storage::EncodeRecord(Codec::ToJson(p_event));
+            file.flush();
+        }
+        // Close the current session, with the store it ends with
+        void EndSession() {
+            if (!IsRecording() || !isInSession) return;
+            Event event;
+            event.op = STORE;
+            Record(event);
+            session++;
+            isInSession = false;
+        }
+    };
+}
+
+#endif